@@ -1,3 +1,7 @@
 glslc.exe test.vert -o test.vert.spv
 glslc.exe test.frag -o test.frag.spv
+glslc.exe cull.comp -o cull.comp.spv
+glslc.exe cull_compact.comp -o cull_compact.comp.spv
+glslc.exe depth_pyramid.comp -o depth_pyramid.comp.spv
+glslc.exe depth_only.vert -o depth_only.vert.spv
 pause
\ No newline at end of file
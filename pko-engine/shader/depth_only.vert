@@ -0,0 +1,30 @@
+#version 450 core
+// the depth pre-pass, positions from their own tightly packed stream. gl_Position is the
+// expression of test.vert, both declare it invariant so the shaded pass passes EQUAL
+layout (location = 0) in vec3 position;
+// instance stream, advances once per instance
+layout (location = 3) in uint transform_index;
+
+layout (set = 0, binding = 0) uniform transforms {
+    mat4 projection;
+    mat4 view;
+} global_ubo;
+
+// rows of the 3x4 model matrix, indexed through the instance stream
+struct object_transform {
+    vec4 rows[3];
+};
+
+layout (std430, set = 0, binding = 1) readonly buffer objects {
+    object_transform transforms[];
+} object_ssbo;
+
+invariant gl_Position;
+
+void main()
+{
+    object_transform object = object_ssbo.transforms[transform_index];
+    mat4 model = transpose(mat4(object.rows[0], object.rows[1], object.rows[2], vec4(0.0, 0.0, 0.0, 1.0)));
+
+    gl_Position = global_ubo.projection * global_ubo.view * model * vec4(position, 1.0);
+}
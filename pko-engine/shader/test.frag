@@ -3,6 +3,7 @@ layout (location = 0) out vec4 frag_color;
 
 layout (location = 0) in VS_IN {
     vec2 uv;
+    vec3 normal;
 } vs_in;
 
 //TODO: move binding to 1, 2 after Material
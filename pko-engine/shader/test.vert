@@ -2,24 +2,41 @@
 layout (location = 0) in vec3 position;
 layout (location = 1) in vec3 normal;
 layout (location = 2) in vec2 uv;
+// instance stream, advances once per instance
+layout (location = 3) in uint transform_index;
 
 layout (location = 0) out VS_OUT {
     vec2 uv;
+    vec3 normal;
 } vs_out;
 
-layout(push_constant) uniform constants {
-    mat4 model;
-    mat3 normal_matrix;
-} object_ubo;
-
 layout (set = 0, binding = 0) uniform transforms {
     mat4 projection;
     mat4 view;
 } global_ubo;
 
+// rows of the 3x4 model matrix, indexed through the instance stream
+struct object_transform {
+    vec4 rows[3];
+};
+
+layout (std430, set = 0, binding = 1) readonly buffer objects {
+    object_transform transforms[];
+} object_ssbo;
+
+// the depth pre-pass computes it in depth_only.vert, the EQUAL test needs the same bits
+invariant gl_Position;
+
 void main()
 {
+    object_transform object = object_ssbo.transforms[transform_index];
+    mat4 model = transpose(mat4(object.rows[0], object.rows[1], object.rows[2], vec4(0.0, 0.0, 0.0, 1.0)));
+
+    // cofactor matrix, the inverse transpose up to a scale the normalize removes
+    mat3 m = mat3(model);
+    mat3 normal_matrix = mat3(cross(m[1], m[2]), cross(m[2], m[0]), cross(m[0], m[1]));
+
     vs_out.uv = uv;
-    gl_Position = global_ubo.projection * global_ubo.view * object_ubo.model * vec4(position, 1.0);
+    vs_out.normal = normalize(normal_matrix * normal);
+    gl_Position = global_ubo.projection * global_ubo.view * model * vec4(position, 1.0);
 }
-
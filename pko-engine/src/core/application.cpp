@@ -4,6 +4,7 @@
 #include "core/renderer/vulkan_renderer/vulkan_renderer.h"
 
 #include "input.h"
+#include "profiler.h"
 
 #include <iostream>
 
@@ -21,6 +22,8 @@ b8 App::init(const char* app_name ,i32 x, i32 y,u32 w, u32 h)
 
 	app_state.input_system = new InputSystem();
 
+	PKO_PROFILE_THREAD("main");
+
 	if (!app_state.platform_state->init(app_name, x, y, w, h))
 		return false;
 
@@ -37,6 +40,8 @@ b8 App::init(const char* app_name ,i32 x, i32 y,u32 w, u32 h)
 
 b8 App::run()
 {
+	PKO_PROFILE_ZONE("App::run");
+
 	if (!app_state.platform_state->platform_message()) {
 
 		reload_desc = { ReloadType::RELOAD_TYPE_ALL };
@@ -0,0 +1,133 @@
+#include "job_system.h"
+
+#include <cassert>
+#include <cstdio>
+
+#include "profiler.h"
+
+JobSystem::JobSystem()
+    : job_fn(nullptr), job_count(0), job_range(0), job_range_count(0), next_range(0),
+      pending_workers(0), generation(0), quit(false)
+{
+}
+
+JobSystem::~JobSystem()
+{
+    shutdown();
+}
+
+b8 JobSystem::init(u32 thread_count)
+{
+    assert(threads.empty());
+
+    if (thread_count == 0)
+        thread_count = std::thread::hardware_concurrency();
+    if (thread_count == 0)
+        thread_count = 1;
+
+    quit = false;
+
+    // worker 0 is the thread calling parallel_for
+    for (u32 i = 1; i < thread_count; ++i)
+        threads.emplace_back(&JobSystem::worker_loop, this, i);
+
+    return true;
+}
+
+void JobSystem::shutdown()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+    }
+    wake.notify_all();
+
+    for (auto& thread : threads)
+        thread.join();
+
+    threads.clear();
+}
+
+void JobSystem::parallel_for(u32 count, u32 min_range, const RangeFn& fn)
+{
+    if (count == 0)
+        return;
+
+    if (min_range == 0)
+        min_range = 1;
+
+    u32 range = (count + worker_count() - 1) / worker_count();
+    if (range < min_range)
+        range = min_range;
+
+    const u32 range_count = (count + range - 1) / range;
+
+    // not worth waking anyone
+    if (range_count == 1 || threads.empty())
+    {
+        fn(0, count, 0);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        job_fn = &fn;
+        job_count = count;
+        job_range = range;
+        job_range_count = range_count;
+        next_range = 0;
+        pending_workers = (u32)threads.size();
+        ++generation;
+    }
+    wake.notify_all();
+
+    run_ranges(0);
+
+    // every worker has to see this job before the next one is written, the ranges may all be
+    // gone by then but the job lives on the caller's stack
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [this] { return pending_workers == 0; });
+    job_fn = nullptr;
+}
+
+void JobSystem::worker_loop(u32 worker_index)
+{
+    u64 seen_generation = 0;
+
+    char name[32];
+    snprintf(name, sizeof(name), "worker %u", worker_index);
+    PKO_PROFILE_THREAD(name);
+
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&] { return quit || generation != seen_generation; });
+
+            if (quit)
+                return;
+
+            seen_generation = generation;
+        }
+
+        run_ranges(worker_index);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            --pending_workers;
+        }
+        done.notify_one();
+    }
+}
+
+void JobSystem::run_ranges(u32 worker_index)
+{
+    u32 range_index;
+    while ((range_index = next_range.fetch_add(1)) < job_range_count)
+    {
+        const u32 first = range_index * job_range;
+        const u32 last = first + job_range < job_count ? first + job_range : job_count;
+
+        (*job_fn)(first, last - first, worker_index);
+    }
+}
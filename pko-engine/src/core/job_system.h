@@ -0,0 +1,58 @@
+#pragma once
+
+/*
+* Fixed pool of worker threads for data parallel work.
+* parallel_for splits [0, count) into contiguous ranges, the calling thread takes ranges too,
+* so worker index 0 is always the caller and worker_count() includes it.
+*/
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "defines.h"
+
+class JobSystem {
+
+public:
+    // first, count, worker index
+    typedef std::function<void(u32, u32, u32)> RangeFn;
+
+    JobSystem();
+    ~JobSystem();
+
+    // thread_count 0 picks hardware concurrency, the caller counts as one of them
+    b8 init(u32 thread_count = 0);
+    void shutdown();
+
+    u32 worker_count() const { return (u32)threads.size() + 1; }
+
+    // blocks until every range has run. ranges are at least min_range long,
+    // so small counts stay on fewer threads
+    void parallel_for(u32 count, u32 min_range, const RangeFn& fn);
+
+private:
+    void worker_loop(u32 worker_index);
+    void run_ranges(u32 worker_index);
+
+    std::vector<std::thread> threads;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+
+    // current job, written under the mutex before the generation bump
+    const RangeFn* job_fn;
+    u32 job_count;
+    u32 job_range;
+    u32 job_range_count;
+    std::atomic<u32> next_range;
+    // workers that have not finished with the current job yet
+    u32 pending_workers;
+
+    u64 generation;
+    b8 quit;
+};
@@ -0,0 +1,146 @@
+#include "profiler.h"
+
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct ProfileEvent {
+    const char* name;
+    u64 begin_ticks;
+    u64 end_ticks;
+};
+
+// single writer, the owning thread. the head is published with release so a reader sees
+// complete events below it
+struct ThreadBuffer {
+    ProfileEvent events[PROFILER_THREAD_CAPACITY];
+    std::atomic<u64> head;
+    u32 thread_id;
+    std::string name;
+};
+
+// buffers outlive their threads, a capture still has the zones of a joined worker
+std::mutex buffers_mutex;
+std::vector<ThreadBuffer*> buffers;
+
+thread_local ThreadBuffer* thread_buffer = nullptr;
+
+// ticks are converted against steady_clock between startup and the capture
+const auto clock_origin = std::chrono::steady_clock::now();
+const u64 tick_origin = Profiler::now_ticks();
+
+ThreadBuffer* get_thread_buffer()
+{
+    if (thread_buffer == nullptr) {
+        ThreadBuffer* buffer = new ThreadBuffer();
+        buffer->head.store(0, std::memory_order_relaxed);
+
+        std::lock_guard<std::mutex> lock(buffers_mutex);
+        buffer->thread_id = (u32)buffers.size();
+        buffers.push_back(buffer);
+        thread_buffer = buffer;
+    }
+
+    return thread_buffer;
+}
+
+void write_escaped(FILE* file, const char* str)
+{
+    for (; *str; ++str) {
+        if (*str == '"' || *str == '\\')
+            fputc('\\', file);
+        fputc(*str, file);
+    }
+}
+
+}  // namespace
+
+std::atomic<b8> Profiler::enabled(false);
+
+void Profiler::set_enabled(b8 enabled_)
+{
+    enabled.store(enabled_, std::memory_order_relaxed);
+}
+
+void Profiler::set_thread_name(const char* name)
+{
+    ThreadBuffer* buffer = get_thread_buffer();
+
+    std::lock_guard<std::mutex> lock(buffers_mutex);
+    buffer->name = name;
+}
+
+void Profiler::record(const char* name, u64 begin_ticks, u64 end_ticks)
+{
+    ThreadBuffer* buffer = get_thread_buffer();
+
+    const u64 head = buffer->head.load(std::memory_order_relaxed);
+    ProfileEvent& event = buffer->events[head % PROFILER_THREAD_CAPACITY];
+    event.name = name;
+    event.begin_ticks = begin_ticks;
+    event.end_ticks = end_ticks;
+
+    buffer->head.store(head + 1, std::memory_order_release);
+}
+
+b8 Profiler::dump_chrome_trace(const char* path)
+{
+    FILE* file = fopen(path, "w");
+    if (file == nullptr) {
+        std::cout << "profiler: failed to open " << path << std::endl;
+        return false;
+    }
+
+    // a writer still inside a zone may land one more event, the head read below bounds it
+    const b8 was_enabled = is_enabled();
+    set_enabled(false);
+
+    std::lock_guard<std::mutex> lock(buffers_mutex);
+
+    const f64 elapsed_ns = (f64)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                               std::chrono::steady_clock::now() - clock_origin).count();
+    const u64 elapsed_ticks = now_ticks() - tick_origin;
+    const f64 us_per_tick = elapsed_ticks > 0 ? elapsed_ns * 1e-3 / elapsed_ticks : 0.0;
+
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+    b8 first = true;
+    for (ThreadBuffer* buffer : buffers) {
+        if (!buffer->name.empty()) {
+            fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+                          "\"args\":{\"name\":\"",
+                    first ? "" : ",\n", buffer->thread_id);
+            write_escaped(file, buffer->name.c_str());
+            fprintf(file, "\"}}");
+            first = false;
+        }
+
+        const u64 head = buffer->head.load(std::memory_order_acquire);
+        const u64 begin = head > PROFILER_THREAD_CAPACITY ? head - PROFILER_THREAD_CAPACITY : 0;
+
+        for (u64 i = begin; i < head; ++i) {
+            const ProfileEvent& event = buffer->events[i % PROFILER_THREAD_CAPACITY];
+
+            fprintf(file, "%s{\"name\":\"", first ? "" : ",\n");
+            write_escaped(file, event.name);
+            // trace event times are microseconds
+            fprintf(file, "\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                    buffer->thread_id, (event.begin_ticks - tick_origin) * us_per_tick,
+                    (event.end_ticks - event.begin_ticks) * us_per_tick);
+            first = false;
+        }
+    }
+
+    fprintf(file, "\n]}\n");
+    fclose(file);
+
+    set_enabled(was_enabled);
+
+    std::cout << "profiler: wrote " << path << std::endl;
+    return true;
+}
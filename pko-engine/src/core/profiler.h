@@ -0,0 +1,89 @@
+#pragma once
+
+/*
+* CPU instrumentation zones.
+* PKO_PROFILE_ZONE("name") records begin and end of the enclosing scope into a ring buffer
+* owned by the calling thread, so recording takes no lock. Names have to outlive the capture,
+* string literals and __FUNCTION__ do.
+* Recording is off until Profiler::set_enabled(true). Build with PKO_PROFILER_ENABLED 0 and
+* the macros expand to nothing.
+*/
+
+#include <atomic>
+#include <chrono>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define PKO_PROFILER_RDTSC 1
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define PKO_PROFILER_RDTSC 1
+#endif
+
+#include "defines.h"
+
+#ifndef PKO_PROFILER_ENABLED
+#define PKO_PROFILER_ENABLED 1
+#endif
+
+// zones kept per thread, older ones are overwritten
+constexpr u32 PROFILER_THREAD_CAPACITY = 1 << 16;
+
+class Profiler {
+
+public:
+    static void set_enabled(b8 enabled);
+    static b8 is_enabled() { return enabled.load(std::memory_order_relaxed); }
+
+    // shows up as the thread name in the trace
+    static void set_thread_name(const char* name);
+
+    // Chrome trace event JSON, opens in chrome://tracing and Perfetto.
+    // recording pauses while the buffers are read
+    static b8 dump_chrome_trace(const char* path);
+
+    // raw timer ticks, converted to time only when a capture is written
+    static u64 now_ticks()
+    {
+#if defined(PKO_PROFILER_RDTSC)
+        return __rdtsc();
+#else
+        return (u64)std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+    }
+    static void record(const char* name, u64 begin_ticks, u64 end_ticks);
+
+private:
+    static std::atomic<b8> enabled;
+};
+
+struct ProfileZone {
+    ProfileZone(const char* name_) : name(name_), begin_ticks(0)
+    {
+        if (Profiler::is_enabled())
+            begin_ticks = Profiler::now_ticks();
+    }
+
+    ~ProfileZone()
+    {
+        // zones that started before the toggle are dropped, not half recorded
+        if (begin_ticks != 0)
+            Profiler::record(name, begin_ticks, Profiler::now_ticks());
+    }
+
+    const char* name;
+    u64 begin_ticks;
+};
+
+#define PKO_PROFILE_CONCAT_INNER(a, b) a##b
+#define PKO_PROFILE_CONCAT(a, b) PKO_PROFILE_CONCAT_INNER(a, b)
+
+#if PKO_PROFILER_ENABLED
+#define PKO_PROFILE_ZONE(name) ProfileZone PKO_PROFILE_CONCAT(profile_zone_, __LINE__)(name)
+#define PKO_PROFILE_FUNCTION() PKO_PROFILE_ZONE(__FUNCTION__)
+#define PKO_PROFILE_THREAD(name) Profiler::set_thread_name(name)
+#else
+#define PKO_PROFILE_ZONE(name)
+#define PKO_PROFILE_FUNCTION()
+#define PKO_PROFILE_THREAD(name)
+#endif
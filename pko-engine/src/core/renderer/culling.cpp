@@ -0,0 +1,400 @@
+#include "culling.h"
+
+#include <algorithm>
+#include <cassert>
+
+#include "core/profiler.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define PKO_CULL_X86 1
+#if defined(_MSC_VER)
+#include <intrin.h>
+// MSVC takes AVX intrinsics without /arch, they only run after the cpuid check
+#define PKO_TARGET_AVX
+#else
+#include <immintrin.h>
+#define PKO_TARGET_AVX __attribute__((target("avx")))
+#endif
+#endif
+
+// zeroed boxes past the end, a whole AVX step from the last box stays inside the arrays
+static const u32 BOUNDS_PADDING = 8;
+
+void frustum_from_matrix(const glm::mat4& m, Frustum* out_frustum)
+{
+    assert(out_frustum);
+
+    // glm is column major, row i of the matrix is m[0][i] .. m[3][i]
+    glm::vec4 rows[4];
+    for (u32 i = 0; i < 4; ++i)
+        rows[i] = glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+
+    glm::vec4* planes = out_frustum->planes;
+    planes[0] = rows[3] + rows[0];
+    planes[1] = rows[3] - rows[0];
+    planes[2] = rows[3] + rows[1];
+    planes[3] = rows[3] - rows[1];
+    // -w <= z holds for either depth range, behind the near plane of a zero to one projection
+    // which only keeps a little more
+    planes[4] = rows[3] + rows[2];
+    planes[5] = rows[3] - rows[2];
+
+    // normalized so distances compare against world sizes
+    for (u32 i = 0; i < 6; ++i)
+        planes[i] /= glm::length(glm::vec3(planes[i]));
+}
+
+void aabb_transform(const glm::mat4& transform, const glm::vec3& min, const glm::vec3& max,
+    glm::vec3* out_min, glm::vec3* out_max)
+{
+    const glm::vec3 center = glm::vec3(transform * glm::vec4((min + max) * 0.5f, 1.0f));
+    const glm::vec3 extent = (max - min) * 0.5f;
+
+    // every axis of the new box gets the absolute projection of the old extents
+    glm::vec3 new_extent;
+    for (u32 row = 0; row < 3; ++row) {
+        new_extent[row] = glm::abs(transform[0][row]) * extent.x +
+            glm::abs(transform[1][row]) * extent.y + glm::abs(transform[2][row]) * extent.z;
+    }
+
+    *out_min = center - new_extent;
+    *out_max = center + new_extent;
+}
+
+glm::vec4 sphere_transform(const glm::mat4& transform, const glm::vec4& sphere)
+{
+    const glm::vec3 center = glm::vec3(transform * glm::vec4(glm::vec3(sphere), 1.0f));
+    const f32 scale = glm::max(glm::length(glm::vec3(transform[0])),
+        glm::max(glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))));
+    return glm::vec4(center, sphere.w * scale);
+}
+
+static CullKernel detect_kernel()
+{
+#if defined(PKO_CULL_X86)
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    // AVX and OSXSAVE, then the OS has to save the ymm registers
+    const b8 avx = (info[2] & (1 << 28)) && (info[2] & (1 << 27)) && (_xgetbv(0) & 6) == 6;
+#else
+    const b8 avx = __builtin_cpu_supports("avx");
+#endif
+    return avx ? CULL_KERNEL_AVX : CULL_KERNEL_SSE;
+#else
+    return CULL_KERNEL_SCALAR;
+#endif
+}
+
+CullKernel cull_kernel_best()
+{
+    static const CullKernel kernel = detect_kernel();
+    return kernel;
+}
+
+const char* cull_kernel_name(CullKernel kernel)
+{
+    switch (kernel) {
+    case CULL_KERNEL_SSE:
+        return "sse";
+    case CULL_KERNEL_AVX:
+        return "avx";
+    default:
+        return "scalar";
+    }
+}
+
+void bounds_soa_build(const glm::vec3* mins, const glm::vec3* maxs, u32 count, BoundsSoA* out_bounds)
+{
+    assert(out_bounds);
+
+    std::vector<f32>* arrays[6] = { &out_bounds->min_x, &out_bounds->min_y, &out_bounds->min_z,
+        &out_bounds->max_x, &out_bounds->max_y, &out_bounds->max_z };
+    for (std::vector<f32>* array : arrays)
+        array->assign(count + BOUNDS_PADDING, 0.0f);
+
+    for (u32 i = 0; i < count; ++i) {
+        out_bounds->min_x[i] = mins[i].x;
+        out_bounds->min_y[i] = mins[i].y;
+        out_bounds->min_z[i] = mins[i].z;
+        out_bounds->max_x[i] = maxs[i].x;
+        out_bounds->max_y[i] = maxs[i].y;
+        out_bounds->max_z[i] = maxs[i].z;
+    }
+
+    out_bounds->count = count;
+}
+
+// the corner furthest along the normal, the same arrays for every box of the plane
+static void positive_corner(const glm::vec4& plane, const BoundsSoA& bounds, const f32** out_x,
+    const f32** out_y, const f32** out_z)
+{
+    *out_x = plane.x >= 0.0f ? bounds.max_x.data() : bounds.min_x.data();
+    *out_y = plane.y >= 0.0f ? bounds.max_y.data() : bounds.min_y.data();
+    *out_z = plane.z >= 0.0f ? bounds.max_z.data() : bounds.min_z.data();
+}
+
+static void cull_scalar(const glm::vec4* planes, u32 plane_count, const BoundsSoA& bounds,
+    u32 first, u32 count, u8* out_visible)
+{
+    for (u32 i = 0; i < count; ++i)
+        out_visible[i] = 1;
+
+    for (u32 p = 0; p < plane_count; ++p) {
+        const glm::vec4& plane = planes[p];
+        const f32 *xs, *ys, *zs;
+        positive_corner(plane, bounds, &xs, &ys, &zs);
+
+        for (u32 i = 0; i < count; ++i) {
+            const u32 box = first + i;
+            const f32 distance = plane.x * xs[box] + plane.y * ys[box] + plane.z * zs[box] + plane.w;
+            if (distance < 0.0f)
+                out_visible[i] = 0;
+        }
+    }
+}
+
+#if defined(PKO_CULL_X86)
+static void cull_sse(const glm::vec4* planes, u32 plane_count, const BoundsSoA& bounds,
+    u32 first, u32 count, u8* out_visible)
+{
+    for (u32 i = 0; i < count; i += 4) {
+        const u32 box = first + i;
+        __m128 outside = _mm_setzero_ps();
+
+        for (u32 p = 0; p < plane_count; ++p) {
+            const glm::vec4& plane = planes[p];
+            const f32 *xs, *ys, *zs;
+            positive_corner(plane, bounds, &xs, &ys, &zs);
+
+            __m128 distance = _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.x), _mm_loadu_ps(xs + box)),
+                    _mm_mul_ps(_mm_set1_ps(plane.y), _mm_loadu_ps(ys + box))),
+                _mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.z), _mm_loadu_ps(zs + box)),
+                    _mm_set1_ps(plane.w)));
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(distance, _mm_setzero_ps()));
+        }
+
+        const u32 mask = (u32)_mm_movemask_ps(outside);
+        const u32 lanes = std::min(4u, count - i);
+        for (u32 lane = 0; lane < lanes; ++lane)
+            out_visible[i + lane] = ((mask >> lane) & 1) == 0;
+    }
+}
+
+PKO_TARGET_AVX static void cull_avx(const glm::vec4* planes, u32 plane_count,
+    const BoundsSoA& bounds, u32 first, u32 count, u8* out_visible)
+{
+    for (u32 i = 0; i < count; i += 8) {
+        const u32 box = first + i;
+        __m256 outside = _mm256_setzero_ps();
+
+        for (u32 p = 0; p < plane_count; ++p) {
+            const glm::vec4& plane = planes[p];
+            const f32 *xs, *ys, *zs;
+            positive_corner(plane, bounds, &xs, &ys, &zs);
+
+            __m256 distance = _mm256_add_ps(
+                _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(plane.x), _mm256_loadu_ps(xs + box)),
+                    _mm256_mul_ps(_mm256_set1_ps(plane.y), _mm256_loadu_ps(ys + box))),
+                _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(plane.z), _mm256_loadu_ps(zs + box)),
+                    _mm256_set1_ps(plane.w)));
+            outside = _mm256_or_ps(outside,
+                _mm256_cmp_ps(distance, _mm256_setzero_ps(), _CMP_LT_OQ));
+        }
+
+        const u32 mask = (u32)_mm256_movemask_ps(outside);
+        const u32 lanes = std::min(8u, count - i);
+        for (u32 lane = 0; lane < lanes; ++lane)
+            out_visible[i + lane] = ((mask >> lane) & 1) == 0;
+    }
+}
+#endif
+
+void frustum_cull_aabbs(const glm::vec4* planes, u32 plane_count, const BoundsSoA& bounds,
+    u32 first, u32 count, u8* out_visible, CullKernel kernel)
+{
+    assert(first + count <= bounds.count);
+
+#if defined(PKO_CULL_X86)
+    if (kernel == CULL_KERNEL_AVX) {
+        cull_avx(planes, plane_count, bounds, first, count, out_visible);
+        return;
+    }
+    if (kernel == CULL_KERNEL_SSE) {
+        cull_sse(planes, plane_count, bounds, first, count, out_visible);
+        return;
+    }
+#endif
+    cull_scalar(planes, plane_count, bounds, first, count, out_visible);
+}
+
+u32 frustum_cull_spheres(const Frustum& frustum, const glm::vec4* spheres, u32 count,
+    u8* out_visible)
+{
+    u32 visible_count = 0;
+    for (u32 i = 0; i < count; ++i) {
+        const glm::vec3 center = glm::vec3(spheres[i]);
+        u8 visible = 1;
+        for (u32 p = 0; p < 6; ++p) {
+            const glm::vec4& plane = frustum.planes[p];
+            if (glm::dot(glm::vec3(plane), center) + plane.w < -spheres[i].w) {
+                visible = 0;
+                break;
+            }
+        }
+        out_visible[i] = visible;
+        visible_count += visible;
+    }
+    return visible_count;
+}
+
+static u32 build_node(const glm::vec3* mins, const glm::vec3* maxs, u32 first, u32 count,
+    Bvh* bvh)
+{
+    const u32 node_index = (u32)bvh->nodes.size();
+    bvh->nodes.push_back(BvhNode{});
+
+    glm::vec3 node_min = mins[bvh->items[first]];
+    glm::vec3 node_max = maxs[bvh->items[first]];
+    glm::vec3 center_min = (node_min + node_max) * 0.5f;
+    glm::vec3 center_max = center_min;
+    for (u32 i = first; i < first + count; ++i) {
+        const u32 item = bvh->items[i];
+        node_min = glm::min(node_min, mins[item]);
+        node_max = glm::max(node_max, maxs[item]);
+        const glm::vec3 center = (mins[item] + maxs[item]) * 0.5f;
+        center_min = glm::min(center_min, center);
+        center_max = glm::max(center_max, center);
+    }
+
+    u32 right = 0;
+    if (count > BVH_LEAF_SIZE) {
+        const glm::vec3 extent = center_max - center_min;
+        const u32 axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+
+        // half the boxes on either side, stacked centers still split
+        const u32 half = count / 2;
+        std::nth_element(bvh->items.begin() + first, bvh->items.begin() + first + half,
+            bvh->items.begin() + first + count, [&](u32 a, u32 b) {
+                return mins[a][axis] + maxs[a][axis] < mins[b][axis] + maxs[b][axis];
+            });
+
+        build_node(mins, maxs, first, half, bvh);
+        right = build_node(mins, maxs, first + half, count - half, bvh);
+    }
+
+    // the vector may have grown, index again
+    BvhNode& node = bvh->nodes[node_index];
+    node.min = node_min;
+    node.max = node_max;
+    node.first = first;
+    node.count = count;
+    node.right = right;
+
+    return node_index;
+}
+
+void bvh_build(const glm::vec3* mins, const glm::vec3* maxs, u32 count, Bvh* out_bvh)
+{
+    PKO_PROFILE_FUNCTION();
+
+    assert(out_bvh);
+
+    out_bvh->nodes.clear();
+    out_bvh->items.resize(count);
+    for (u32 i = 0; i < count; ++i)
+        out_bvh->items[i] = i;
+
+    if (count > 0) {
+        out_bvh->nodes.reserve(2 * ((count + BVH_LEAF_SIZE - 1) / BVH_LEAF_SIZE));
+        build_node(mins, maxs, 0, count, out_bvh);
+    }
+
+    std::vector<glm::vec3> ordered_mins(count);
+    std::vector<glm::vec3> ordered_maxs(count);
+    for (u32 i = 0; i < count; ++i) {
+        ordered_mins[i] = mins[out_bvh->items[i]];
+        ordered_maxs[i] = maxs[out_bvh->items[i]];
+    }
+    bounds_soa_build(ordered_mins.data(), ordered_maxs.data(), count, &out_bvh->bounds);
+}
+
+static u32 set_range(const Bvh& bvh, const BvhNode& node, u8 visible, u8* out_visible)
+{
+    for (u32 i = node.first; i < node.first + node.count; ++i)
+        out_visible[bvh.items[i]] = visible;
+    return visible ? node.count : 0;
+}
+
+u32 bvh_cull(const Bvh& bvh, const Frustum& frustum, u8* out_visible, CullKernel kernel)
+{
+    PKO_PROFILE_FUNCTION();
+
+    assert(out_visible);
+
+    if (bvh.nodes.empty())
+        return 0;
+
+    struct Entry {
+        u32 node;
+        // planes the parent was not fully inside of
+        u32 plane_mask;
+    };
+
+    // depth is logarithmic in the box count, median splits keep it balanced
+    Entry stack[64];
+    u32 stack_size = 0;
+    stack[stack_size++] = { 0, (1u << 6) - 1 };
+
+    u32 visible_count = 0;
+    while (stack_size > 0) {
+        const Entry entry = stack[--stack_size];
+        const BvhNode& node = bvh.nodes[entry.node];
+
+        u32 plane_mask = entry.plane_mask;
+        b8 outside = false;
+        for (u32 p = 0; p < 6 && !outside; ++p) {
+            if ((plane_mask & (1u << p)) == 0)
+                continue;
+
+            const glm::vec4& plane = frustum.planes[p];
+            const glm::vec3 normal(plane);
+            const glm::vec3 positive = glm::mix(node.min, node.max, glm::greaterThanEqual(normal, glm::vec3(0.0f)));
+            const glm::vec3 negative = glm::mix(node.max, node.min, glm::greaterThanEqual(normal, glm::vec3(0.0f)));
+
+            if (glm::dot(normal, positive) + plane.w < 0.0f)
+                outside = true;
+            else if (glm::dot(normal, negative) + plane.w >= 0.0f)
+                plane_mask &= ~(1u << p);
+        }
+
+        if (outside || plane_mask == 0) {
+            visible_count += set_range(bvh, node, !outside, out_visible);
+            continue;
+        }
+
+        if (node.right != 0) {
+            stack[stack_size++] = { node.right, plane_mask };
+            stack[stack_size++] = { entry.node + 1, plane_mask };
+            continue;
+        }
+
+        // a leaf crossing some planes, only those are tested
+        glm::vec4 planes[6];
+        u32 plane_count = 0;
+        for (u32 p = 0; p < 6; ++p) {
+            if (plane_mask & (1u << p))
+                planes[plane_count++] = frustum.planes[p];
+        }
+
+        u8 leaf_visible[BVH_LEAF_SIZE];
+        frustum_cull_aabbs(planes, plane_count, bvh.bounds, node.first, node.count, leaf_visible, kernel);
+        for (u32 i = 0; i < node.count; ++i) {
+            out_visible[bvh.items[node.first + i]] = leaf_visible[i];
+            visible_count += leaf_visible[i];
+        }
+    }
+
+    return visible_count;
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+/*
+* Frustum culling on the CPU.
+* Boxes are kept as structure of arrays so one plane is tested against 8 (AVX), 4 (SSE) or
+* 1 (scalar) boxes per instruction. Per plane only the corner furthest along its normal
+* matters, and with the plane fixed that corner is the same array for every box, so the
+* kernel does no per box selects.
+* The BVH orders the boxes so every node covers a contiguous range of them. Traversal drops
+* planes a node is fully inside of, whole subtrees inside every plane are accepted without a
+* test, and leaves crossing a plane run the kernel on their range.
+* Everything is plain memory, usable from any thread and without a device.
+*/
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "defines.h"
+
+enum CullKernel {
+    CULL_KERNEL_SCALAR,
+    CULL_KERNEL_SSE,
+    CULL_KERNEL_AVX
+};
+
+// boxes the leaves hold at most, one AVX kernel step
+constexpr u32 BVH_LEAF_SIZE = 8;
+
+// planes with normalized xyz pointing inside, a point p is inside when dot(xyz, p) + w >= 0
+struct Frustum {
+    glm::vec4 planes[6];
+};
+
+// padded past count so the wide kernels can load whole steps at any start
+struct BoundsSoA {
+    std::vector<f32> min_x, min_y, min_z;
+    std::vector<f32> max_x, max_y, max_z;
+    u32 count;
+};
+
+struct BvhNode {
+    glm::vec3 min;
+    // first box of the subtree in Bvh order
+    u32 first;
+    glm::vec3 max;
+    // boxes in the subtree
+    u32 count;
+    // second child, the first one follows the node. 0 for leaves, the root is never a child
+    u32 right;
+};
+
+struct Bvh {
+    std::vector<BvhNode> nodes;
+    // item of every box in Bvh order
+    std::vector<u32> items;
+    // boxes in Bvh order
+    BoundsSoA bounds;
+};
+
+// left, right, bottom, top, near, far of a view projection matrix
+void frustum_from_matrix(const glm::mat4& view_projection, Frustum* out_frustum);
+
+// box around the transformed box
+void aabb_transform(const glm::mat4& transform, const glm::vec3& min, const glm::vec3& max,
+    glm::vec3* out_min, glm::vec3* out_max);
+
+// sphere around the transformed sphere, xyz center and w radius. the largest axis scale keeps
+// it around a scaled mesh, as cull.comp does
+glm::vec4 sphere_transform(const glm::mat4& transform, const glm::vec4& sphere);
+
+// the widest the CPU runs, detected once
+CullKernel cull_kernel_best();
+const char* cull_kernel_name(CullKernel kernel);
+
+void bounds_soa_build(const glm::vec3* mins, const glm::vec3* maxs, u32 count, BoundsSoA* out_bounds);
+
+// out_visible[i] for boxes [first, first + count) against plane_count planes, 1 when no plane
+// has the box fully outside
+void frustum_cull_aabbs(const glm::vec4* planes, u32 plane_count, const BoundsSoA& bounds,
+    u32 first, u32 count, u8* out_visible, CullKernel kernel = cull_kernel_best());
+
+// out_visible[i] of every sphere, 1 when no plane has it fully outside. the test cull.comp runs,
+// returns how many are visible
+u32 frustum_cull_spheres(const Frustum& frustum, const glm::vec4* spheres, u32 count,
+    u8* out_visible);
+
+// median split on the widest axis of the box centers, leaves of up to BVH_LEAF_SIZE boxes
+void bvh_build(const glm::vec3* mins, const glm::vec3* maxs, u32 count, Bvh* out_bvh);
+
+// out_visible[item] for every item the bvh was built over, returns how many are visible
+u32 bvh_cull(const Bvh& bvh, const Frustum& frustum, u8* out_visible,
+    CullKernel kernel = cull_kernel_best());
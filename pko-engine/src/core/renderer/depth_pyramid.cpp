@@ -0,0 +1,61 @@
+#include "depth_pyramid.h"
+
+#include <algorithm>
+#include <cassert>
+
+u32 depth_pyramid_level_count(u32 depth_width, u32 depth_height, u32 max_levels)
+{
+    u32 width = (depth_width + 1) / 2;
+    u32 height = (depth_height + 1) / 2;
+    u32 levels = 1;
+    while ((width > 1 || height > 1) && levels < max_levels) {
+        width = (width + 1) / 2;
+        height = (height + 1) / 2;
+        ++levels;
+    }
+    return levels;
+}
+
+void depth_pyramid_level_size(u32 depth_width, u32 depth_height, u32 level, u32* out_width,
+    u32* out_height)
+{
+    const u32 shift = level + 1;
+    *out_width = (depth_width + (1u << shift) - 1) >> shift;
+    *out_height = (depth_height + (1u << shift) - 1) >> shift;
+}
+
+void depth_pyramid_reduce(const f32* depth, u32 depth_width, u32 depth_height, u32 level_count,
+    std::vector<DepthPyramidLevel>* out_levels)
+{
+    assert(depth);
+    assert(depth_width > 0 && depth_height > 0);
+    assert(out_levels);
+
+    out_levels->resize(level_count);
+    for (u32 level = 0; level < level_count; ++level) {
+        DepthPyramidLevel& target = (*out_levels)[level];
+        depth_pyramid_level_size(depth_width, depth_height, level, &target.width,
+            &target.height);
+        target.texels.resize(target.width * target.height);
+
+        const DepthPyramidLevel* source = level > 0 ? &(*out_levels)[level - 1] : NULL;
+        const u32 source_width = source ? source->width : depth_width;
+        const u32 source_height = source ? source->height : depth_height;
+
+        for (u32 y = 0; y < target.height; ++y) {
+            for (u32 x = 0; x < target.width; ++x) {
+                glm::vec2 value(1e30f, -1e30f);
+                for (u32 i = 0; i < 4; ++i) {
+                    const u32 sx = std::min(x * 2 + (i & 1), source_width - 1);
+                    const u32 sy = std::min(y * 2 + (i >> 1), source_height - 1);
+                    const glm::vec2 texel = source
+                        ? source->texels[sy * source_width + sx]
+                        : glm::vec2(depth[sy * source_width + sx]);
+                    value.x = std::min(value.x, texel.x);
+                    value.y = std::max(value.y, texel.y);
+                }
+                target.texels[y * target.width + x] = value;
+            }
+        }
+    }
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+/*
+* Min and max depth pyramid on the CPU, the per level definition depth_pyramid.comp computes in
+* a single dispatch.
+* Level 0 is half the depth extent rounded up, every level halves the one above rounded up.
+* Texel x of a level covers x * 2 and x * 2 + 1 of the level above clamped to its last texel, so
+* odd extents keep their last row and column, and keeps the min and max of what it covers.
+* Every level is reduced from the whole level above, plain memory and no tiles, as a reference
+* for the shader and for readers of the pyramid on the host.
+*/
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "defines.h"
+
+struct DepthPyramidLevel {
+    u32 width;
+    u32 height;
+    // x min and y max, row major
+    std::vector<glm::vec2> texels;
+};
+
+// levels down to 1x1, at most max_levels
+u32 depth_pyramid_level_count(u32 depth_width, u32 depth_height, u32 max_levels);
+
+void depth_pyramid_level_size(u32 depth_width, u32 depth_height, u32 level, u32* out_width,
+    u32* out_height);
+
+// level_count levels of a row major depth image
+void depth_pyramid_reduce(const f32* depth, u32 depth_width, u32 depth_height, u32 level_count,
+    std::vector<DepthPyramidLevel>* out_levels);
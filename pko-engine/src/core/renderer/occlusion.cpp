@@ -0,0 +1,323 @@
+#include "occlusion.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cfloat>
+#include <cmath>
+
+#include "core/job_system.h"
+#include "core/profiler.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+// SSE2 is part of every x64 CPU and the default of 32 bit MSVC, no runtime check needed
+#define PKO_OCCLUSION_SSE 1
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <emmintrin.h>
+#endif
+#endif
+
+// where nothing was rasterized, the far plane
+static const f32 OCCLUSION_CLEAR_DEPTH = 1.0f;
+// triangles set up per job, the setup is a handful of multiplies
+static const u32 MIN_TRIANGLES_PER_JOB = 256;
+static const u32 MIN_BOXES_PER_JOB = 64;
+
+void occlusion_buffer_create(OcclusionBuffer* buffer, u32 width, u32 height)
+{
+    assert(buffer);
+    assert(width > 0 && height > 0);
+
+    buffer->tiles_x = (width + OCCLUSION_TILE_SIZE - 1) / OCCLUSION_TILE_SIZE;
+    buffer->tiles_y = (height + OCCLUSION_TILE_SIZE - 1) / OCCLUSION_TILE_SIZE;
+    buffer->width = buffer->tiles_x * OCCLUSION_TILE_SIZE;
+    buffer->height = buffer->tiles_y * OCCLUSION_TILE_SIZE;
+    buffer->depth.assign(buffer->width * buffer->height, OCCLUSION_CLEAR_DEPTH);
+    buffer->tile_max.assign(buffer->tiles_x * buffer->tiles_y, OCCLUSION_CLEAR_DEPTH);
+    buffer->triangles.clear();
+    buffer->rasterized_triangles = 0;
+}
+
+// screen position and depth, false when the point is behind the near plane. x and y are in
+// pixels with pixel centers on the halves
+static b8 project(const glm::mat4& view_projection, const glm::vec3& p, u32 width, u32 height,
+    glm::vec3* out_screen)
+{
+    const glm::vec4 clip = view_projection * glm::vec4(p, 1.0f);
+    // -w <= z is the near plane of either depth range, with w > 0 the divide is safe
+    if (clip.w <= 0.0f || clip.z < -clip.w)
+        return false;
+
+    const f32 inv_w = 1.0f / clip.w;
+    out_screen->x = (clip.x * inv_w * 0.5f + 0.5f) * width;
+    out_screen->y = (clip.y * inv_w * 0.5f + 0.5f) * height;
+    out_screen->z = clip.z * inv_w;
+    return true;
+}
+
+static void setup_triangle(const glm::mat4& view_projection, const glm::vec3* vertices, u32 width,
+    u32 height, OcclusionTriangle* out_triangle)
+{
+    out_triangle->min_y = 1;
+    out_triangle->max_y = 0;
+
+    glm::vec3 screen[3];
+    for (u32 i = 0; i < 3; ++i) {
+        if (!project(view_projection, vertices[i], width, height, &screen[i]))
+            return;
+    }
+
+    // counter clockwise on screen, the edge functions are positive inside
+    const f32 area = (screen[1].x - screen[0].x) * (screen[2].y - screen[0].y) -
+        (screen[1].y - screen[0].y) * (screen[2].x - screen[0].x);
+    if (area == 0.0f)
+        return;
+    if (area < 0.0f)
+        std::swap(screen[1], screen[2]);
+
+    for (u32 i = 0; i < 3; ++i) {
+        out_triangle->x[i] = screen[i].x;
+        out_triangle->y[i] = screen[i].y;
+        out_triangle->z[i] = screen[i].z;
+    }
+
+    // rows whose centers are inside the y range
+    const f32 min_y = std::min(screen[0].y, std::min(screen[1].y, screen[2].y));
+    const f32 max_y = std::max(screen[0].y, std::max(screen[1].y, screen[2].y));
+    out_triangle->min_y = std::max(0, (i32)std::ceil(min_y - 0.5f));
+    out_triangle->max_y = std::min((i32)height - 1, (i32)std::floor(max_y - 0.5f));
+}
+
+// into rows [first_row, end_row) of the buffer
+static void rasterize_triangle(const OcclusionTriangle& triangle, i32 first_row, i32 end_row,
+    u32 width, f32* depth)
+{
+    const i32 row_begin = std::max(triangle.min_y, first_row);
+    const i32 row_end = std::min(triangle.max_y + 1, end_row);
+    if (row_begin >= row_end)
+        return;
+
+    const f32* x = triangle.x;
+    const f32* y = triangle.y;
+    const f32* z = triangle.z;
+
+    const f32 min_x = std::min(x[0], std::min(x[1], x[2]));
+    const f32 max_x = std::max(x[0], std::max(x[1], x[2]));
+    const i32 column_begin = std::max(0, (i32)std::ceil(min_x - 0.5f));
+    const i32 column_last = std::min((i32)width - 1, (i32)std::floor(max_x - 0.5f));
+    if (column_begin > column_last)
+        return;
+
+    // edge i is opposite vertex i, e(p) = a * (p.x - x[j]) + b * (p.y - y[j])
+    f32 edge_a[3], edge_b[3], edge_x[3], edge_y[3];
+    for (u32 i = 0; i < 3; ++i) {
+        const u32 j = (i + 1) % 3;
+        const u32 k = (i + 2) % 3;
+        edge_a[i] = y[j] - y[k];
+        edge_b[i] = x[k] - x[j];
+        edge_x[i] = x[j];
+        edge_y[i] = y[j];
+    }
+
+    // depth is linear in screen space after the divide
+    const f32 dx1 = x[1] - x[0], dy1 = y[1] - y[0], dz1 = z[1] - z[0];
+    const f32 dx2 = x[2] - x[0], dy2 = y[2] - y[0], dz2 = z[2] - z[0];
+    const f32 inv_area = 1.0f / (dx1 * dy2 - dy1 * dx2);
+    const f32 dzdx = (dz1 * dy2 - dy1 * dz2) * inv_area;
+    const f32 dzdy = (dx1 * dz2 - dz1 * dx2) * inv_area;
+
+    // whole groups of 4 from an aligned column, rows are multiples of the tile size wide
+    const i32 column_start = column_begin & ~3;
+
+    for (i32 row = row_begin; row < row_end; ++row) {
+        const f32 py = row + 0.5f;
+        f32* depth_row = depth + row * width;
+
+#if defined(PKO_OCCLUSION_SSE)
+        __m128 row_edge[3];
+        __m128 column_a[3];
+        for (u32 i = 0; i < 3; ++i) {
+            row_edge[i] = _mm_set1_ps(edge_b[i] * (py - edge_y[i]) - edge_a[i] * edge_x[i]);
+            column_a[i] = _mm_set1_ps(edge_a[i]);
+        }
+        const __m128 row_z = _mm_set1_ps(z[0] + dzdy * (py - y[0]) - dzdx * x[0]);
+        const __m128 column_dz = _mm_set1_ps(dzdx);
+        const __m128 lane_offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+        const __m128 zero = _mm_setzero_ps();
+
+        for (i32 column = column_start; column <= column_last; column += 4) {
+            const __m128 px = _mm_add_ps(_mm_set1_ps((f32)column), lane_offsets);
+
+            __m128 inside = _mm_cmpge_ps(_mm_add_ps(row_edge[0], _mm_mul_ps(column_a[0], px)), zero);
+            inside = _mm_and_ps(inside,
+                _mm_cmpge_ps(_mm_add_ps(row_edge[1], _mm_mul_ps(column_a[1], px)), zero));
+            inside = _mm_and_ps(inside,
+                _mm_cmpge_ps(_mm_add_ps(row_edge[2], _mm_mul_ps(column_a[2], px)), zero));
+            if (_mm_movemask_ps(inside) == 0)
+                continue;
+
+            const __m128 pixel_z = _mm_add_ps(row_z, _mm_mul_ps(column_dz, px));
+            const __m128 old_z = _mm_loadu_ps(depth_row + column);
+            const __m128 new_z = _mm_min_ps(old_z, pixel_z);
+            _mm_storeu_ps(depth_row + column,
+                _mm_or_ps(_mm_and_ps(inside, new_z), _mm_andnot_ps(inside, old_z)));
+        }
+#else
+        for (i32 column = column_start; column <= column_last; ++column) {
+            const f32 px = column + 0.5f;
+
+            b8 inside = true;
+            for (u32 i = 0; i < 3; ++i) {
+                const f32 e = edge_b[i] * (py - edge_y[i]) - edge_a[i] * edge_x[i] + edge_a[i] * px;
+                inside = inside && e >= 0.0f;
+            }
+            if (!inside)
+                continue;
+
+            const f32 pixel_z = z[0] + dzdy * (py - y[0]) - dzdx * x[0] + dzdx * px;
+            depth_row[column] = std::min(depth_row[column], pixel_z);
+        }
+#endif
+    }
+}
+
+static void render_tile_row(OcclusionBuffer* buffer, u32 tile_row)
+{
+    const i32 first_row = tile_row * OCCLUSION_TILE_SIZE;
+    const i32 end_row = first_row + OCCLUSION_TILE_SIZE;
+
+    f32* depth = buffer->depth.data();
+    std::fill(depth + first_row * buffer->width, depth + end_row * buffer->width,
+        OCCLUSION_CLEAR_DEPTH);
+
+    for (const OcclusionTriangle& triangle : buffer->triangles) {
+        if (triangle.max_y < first_row || triangle.min_y >= end_row)
+            continue;
+        rasterize_triangle(triangle, first_row, end_row, buffer->width, depth);
+    }
+
+    for (u32 tile_x = 0; tile_x < buffer->tiles_x; ++tile_x) {
+        f32 farthest = 0.0f;
+        for (i32 row = first_row; row < end_row; ++row) {
+            const f32* pixels = depth + row * buffer->width + tile_x * OCCLUSION_TILE_SIZE;
+            for (u32 i = 0; i < OCCLUSION_TILE_SIZE; ++i)
+                farthest = std::max(farthest, pixels[i]);
+        }
+        buffer->tile_max[tile_row * buffer->tiles_x + tile_x] = farthest;
+    }
+}
+
+void occlusion_buffer_render(OcclusionBuffer* buffer, const glm::mat4& view_projection,
+    const glm::vec3* triangles, u32 triangle_count, JobSystem* jobs)
+{
+    PKO_PROFILE_FUNCTION();
+
+    assert(buffer);
+    assert(buffer->width > 0 && "occlusion buffer was not created");
+
+    buffer->triangles.resize(triangle_count);
+
+    auto setup = [&](u32 first, u32 count, u32) {
+        for (u32 i = first; i < first + count; ++i) {
+            setup_triangle(view_projection, triangles + i * 3, buffer->width, buffer->height,
+                &buffer->triangles[i]);
+        }
+    };
+    auto render = [&](u32 first, u32 count, u32) {
+        for (u32 tile_row = first; tile_row < first + count; ++tile_row)
+            render_tile_row(buffer, tile_row);
+    };
+
+    if (jobs) {
+        jobs->parallel_for(triangle_count, MIN_TRIANGLES_PER_JOB, setup);
+        jobs->parallel_for(buffer->tiles_y, 1, render);
+    } else {
+        setup(0, triangle_count, 0);
+        render(0, buffer->tiles_y, 0);
+    }
+
+    buffer->rasterized_triangles = 0;
+    for (const OcclusionTriangle& triangle : buffer->triangles)
+        buffer->rasterized_triangles += triangle.min_y <= triangle.max_y;
+}
+
+b8 occlusion_test_aabb(const OcclusionBuffer& buffer, const glm::mat4& view_projection,
+    const glm::vec3& min, const glm::vec3& max)
+{
+    glm::vec2 screen_min(FLT_MAX);
+    glm::vec2 screen_max(-FLT_MAX);
+    f32 nearest = FLT_MAX;
+
+    for (u32 i = 0; i < 8; ++i) {
+        const glm::vec3 corner(i & 1 ? max.x : min.x, i & 2 ? max.y : min.y, i & 4 ? max.z : min.z);
+
+        glm::vec3 screen;
+        if (!project(view_projection, corner, buffer.width, buffer.height, &screen))
+            return true;
+
+        screen_min = glm::min(screen_min, glm::vec2(screen));
+        screen_max = glm::max(screen_max, glm::vec2(screen));
+        nearest = std::min(nearest, screen.z);
+    }
+
+    // every pixel the rectangle touches, not only the ones whose centers it covers
+    const i32 x0 = std::max(0, (i32)std::floor(screen_min.x));
+    const i32 y0 = std::max(0, (i32)std::floor(screen_min.y));
+    const i32 x1 = std::min((i32)buffer.width - 1, (i32)std::floor(screen_max.x));
+    const i32 y1 = std::min((i32)buffer.height - 1, (i32)std::floor(screen_max.y));
+    // off screen is for the frustum test to decide
+    if (x0 > x1 || y0 > y1)
+        return true;
+
+    for (i32 tile_y = y0 / OCCLUSION_TILE_SIZE; tile_y <= y1 / (i32)OCCLUSION_TILE_SIZE; ++tile_y) {
+        for (i32 tile_x = x0 / OCCLUSION_TILE_SIZE; tile_x <= x1 / (i32)OCCLUSION_TILE_SIZE; ++tile_x) {
+            if (buffer.tile_max[tile_y * buffer.tiles_x + tile_x] < nearest)
+                continue;
+
+            const i32 row_begin = std::max(y0, tile_y * (i32)OCCLUSION_TILE_SIZE);
+            const i32 row_last = std::min(y1, (tile_y + 1) * (i32)OCCLUSION_TILE_SIZE - 1);
+            const i32 column_begin = std::max(x0, tile_x * (i32)OCCLUSION_TILE_SIZE);
+            const i32 column_last = std::min(x1, (tile_x + 1) * (i32)OCCLUSION_TILE_SIZE - 1);
+            for (i32 row = row_begin; row <= row_last; ++row) {
+                const f32* depth_row = buffer.depth.data() + row * buffer.width;
+                for (i32 column = column_begin; column <= column_last; ++column) {
+                    if (depth_row[column] >= nearest)
+                        return true;
+                }
+            }
+        }
+    }
+
+    return false;
+}
+
+u32 occlusion_cull_aabbs(const OcclusionBuffer& buffer, const glm::mat4& view_projection,
+    const glm::vec3* mins, const glm::vec3* maxs, u32 count, u8* in_out_visible, JobSystem* jobs)
+{
+    PKO_PROFILE_FUNCTION();
+
+    assert(in_out_visible);
+
+    std::atomic<u32> occluded{ 0 };
+    auto cull = [&](u32 first, u32 range_count, u32) {
+        u32 range_occluded = 0;
+        for (u32 i = first; i < first + range_count; ++i) {
+            if (!in_out_visible[i])
+                continue;
+            if (!occlusion_test_aabb(buffer, view_projection, mins[i], maxs[i])) {
+                in_out_visible[i] = 0;
+                ++range_occluded;
+            }
+        }
+        occluded += range_occluded;
+    };
+
+    if (jobs)
+        jobs->parallel_for(count, MIN_BOXES_PER_JOB, cull);
+    else
+        cull(0, count, 0);
+
+    return occluded;
+}
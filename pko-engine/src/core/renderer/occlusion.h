@@ -0,0 +1,68 @@
+#pragma once
+
+/*
+* Occlusion culling on the CPU.
+* A small set of occluder triangles is rasterized into a low resolution depth buffer keeping
+* the nearest depth per pixel, then the farthest depth of every tile is kept on top of it.
+* Boxes are projected to a screen rectangle and their nearest depth, and are occluded when
+* every pixel under the rectangle has an occluder in front of that depth. Tiles answer for
+* their whole area first, only tiles that cannot are looked at per pixel.
+* The buffer is split into rows of tiles and every row is owned by one job, triangles are
+* visited in their given order and the depth is a min, so the result is the same bit for bit
+* whatever the number of threads. Depth is z / w of the projection, the comparisons only need
+* it to grow with distance.
+*/
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "defines.h"
+
+class JobSystem;
+
+// pixels per tile side, rows of tiles are the unit of parallel work
+constexpr u32 OCCLUSION_TILE_SIZE = 8;
+
+// a triangle in screen space, set up once per frame and rasterized by every row it touches
+struct OcclusionTriangle {
+    f32 x[3];
+    f32 y[3];
+    f32 z[3];
+    // pixel rows it covers, inclusive. min_y > max_y when nothing is rasterized
+    i32 min_y;
+    i32 max_y;
+};
+
+struct OcclusionBuffer {
+    // multiples of OCCLUSION_TILE_SIZE
+    u32 width;
+    u32 height;
+    u32 tiles_x;
+    u32 tiles_y;
+    // nearest occluder per pixel, row 0 at clip space y = -1. 1 where there is none
+    std::vector<f32> depth;
+    // farthest depth per tile
+    std::vector<f32> tile_max;
+    std::vector<OcclusionTriangle> triangles;
+    // triangles that were in front of the near plane in the last render
+    u32 rasterized_triangles;
+};
+
+// width and height are rounded up to whole tiles
+void occlusion_buffer_create(OcclusionBuffer* buffer, u32 width, u32 height);
+
+// clears and rasterizes triangle_count triangles of 3 world space vertices each. triangles
+// crossing the near plane are dropped, which only lets more through. jobs may be NULL
+void occlusion_buffer_render(OcclusionBuffer* buffer, const glm::mat4& view_projection,
+    const glm::vec3* triangles, u32 triangle_count, JobSystem* jobs);
+
+// false when the box is hidden behind the occluders of the last render. boxes crossing the
+// near plane are always visible
+b8 occlusion_test_aabb(const OcclusionBuffer& buffer, const glm::mat4& view_projection,
+    const glm::vec3& min, const glm::vec3& max);
+
+// clears in_out_visible[i] of the visible boxes that are occluded, returns how many were.
+// jobs may be NULL
+u32 occlusion_cull_aabbs(const OcclusionBuffer& buffer, const glm::mat4& view_projection,
+    const glm::vec3* mins, const glm::vec3* maxs, u32 count, u8* in_out_visible, JobSystem* jobs);
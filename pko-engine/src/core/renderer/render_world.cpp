@@ -0,0 +1,338 @@
+#include "render_world.h"
+
+#include <atomic>
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+
+#include "core/job_system.h"
+#include "core/profiler.h"
+#include "core/renderer/culling.h"
+
+enum RenderColumn {
+    COLUMN_ENTITY,
+    COLUMN_TRANSFORM,
+    COLUMN_MIN_X,
+    COLUMN_MIN_Y,
+    COLUMN_MIN_Z,
+    COLUMN_MAX_X,
+    COLUMN_MAX_Y,
+    COLUMN_MAX_Z,
+    COLUMN_MESH,
+    COLUMN_MATERIAL,
+    COLUMN_VISIBILITY
+};
+
+static const u32 column_sizes[RENDER_CHUNK_COLUMNS] = {
+    sizeof(Entity),
+    sizeof(glm::mat4),
+    sizeof(f32), sizeof(f32), sizeof(f32),
+    sizeof(f32), sizeof(f32), sizeof(f32),
+    sizeof(MeshRef),
+    sizeof(MaterialRef),
+    sizeof(u8),
+};
+
+// component a column belongs to, entities are in every archetype
+static const u32 column_components[RENDER_CHUNK_COLUMNS] = {
+    RENDER_COMPONENT_COUNT,
+    RENDER_COMPONENT_TRANSFORM,
+    RENDER_COMPONENT_BOUNDS, RENDER_COMPONENT_BOUNDS, RENDER_COMPONENT_BOUNDS,
+    RENDER_COMPONENT_BOUNDS, RENDER_COMPONENT_BOUNDS, RENDER_COMPONENT_BOUNDS,
+    RENDER_COMPONENT_MESH,
+    RENDER_COMPONENT_MATERIAL,
+    RENDER_COMPONENT_VISIBILITY,
+};
+
+// arrays start on a cache line
+static const u32 COLUMN_ALIGNMENT = 64;
+
+static b8 has_column(u32 component_mask, u32 column)
+{
+    const u32 component = column_components[column];
+    return component == RENDER_COMPONENT_COUNT ||
+        (component_mask & RENDER_COMPONENT_BIT(component)) != 0;
+}
+
+static u32 find_archetype(RenderWorld* world, u32 component_mask)
+{
+    for (u32 i = 0; i < world->archetypes.size(); ++i) {
+        if (world->archetypes[i].component_mask == component_mask)
+            return i;
+    }
+
+    RenderArchetype archetype{};
+    archetype.component_mask = component_mask;
+
+    u32 offset = 0;
+    for (u32 c = 0; c < RENDER_CHUNK_COLUMNS; ++c) {
+        if (!has_column(component_mask, c))
+            continue;
+        archetype.column_offsets[c] = offset;
+        offset += column_sizes[c] * RENDER_CHUNK_CAPACITY;
+        offset = (offset + COLUMN_ALIGNMENT - 1) & ~(COLUMN_ALIGNMENT - 1);
+    }
+    archetype.chunk_size = offset;
+
+    world->archetypes.push_back(archetype);
+    return (u32)world->archetypes.size() - 1;
+}
+
+static void* column_row(const RenderArchetype& archetype, const RenderChunk& chunk, u32 column,
+    u32 row)
+{
+    return chunk.data + archetype.column_offsets[column] + column_sizes[column] * row;
+}
+
+static RenderChunkView chunk_view(const RenderArchetype& archetype, const RenderChunk& chunk)
+{
+    auto column = [&](u32 c) -> void* {
+        return has_column(archetype.component_mask, c) ? chunk.data + archetype.column_offsets[c]
+                                                      : NULL;
+    };
+
+    RenderChunkView view{};
+    view.count = chunk.count;
+    view.entities = (const Entity*)column(COLUMN_ENTITY);
+    view.transforms = (glm::mat4*)column(COLUMN_TRANSFORM);
+    view.min_x = (f32*)column(COLUMN_MIN_X);
+    view.min_y = (f32*)column(COLUMN_MIN_Y);
+    view.min_z = (f32*)column(COLUMN_MIN_Z);
+    view.max_x = (f32*)column(COLUMN_MAX_X);
+    view.max_y = (f32*)column(COLUMN_MAX_Y);
+    view.max_z = (f32*)column(COLUMN_MAX_Z);
+    view.meshes = (MeshRef*)column(COLUMN_MESH);
+    view.materials = (MaterialRef*)column(COLUMN_MATERIAL);
+    view.visible = (u8*)column(COLUMN_VISIBILITY);
+    return view;
+}
+
+// a row at the end of the archetype with default components, the entity column is left to
+// the caller
+static void add_row(RenderWorld* world, u32 archetype_index, u32* out_chunk, u32* out_row)
+{
+    RenderArchetype& archetype = world->archetypes[archetype_index];
+
+    if (archetype.chunks.empty() || archetype.chunks.back().count == RENDER_CHUNK_CAPACITY) {
+        RenderChunk chunk{};
+        chunk.data = (u8*)malloc(archetype.chunk_size);
+        archetype.chunks.push_back(chunk);
+    }
+
+    RenderChunk& chunk = archetype.chunks.back();
+    const u32 row = chunk.count++;
+    ++archetype.entity_count;
+
+    RenderChunkView view = chunk_view(archetype, chunk);
+    if (view.transforms)
+        view.transforms[row] = glm::mat4(1.0f);
+    if (view.min_x) {
+        view.min_x[row] = view.min_y[row] = view.min_z[row] = 0.0f;
+        view.max_x[row] = view.max_y[row] = view.max_z[row] = 0.0f;
+    }
+    if (view.meshes)
+        view.meshes[row] = {};
+    if (view.materials)
+        view.materials[row] = {};
+    if (view.visible)
+        view.visible[row] = 1;
+
+    *out_chunk = (u32)archetype.chunks.size() - 1;
+    *out_row = row;
+}
+
+// fills the hole with the last row of the archetype, the moved entity is pointed at it
+static void remove_row(RenderWorld* world, u32 archetype_index, u32 chunk_index, u32 row)
+{
+    RenderArchetype& archetype = world->archetypes[archetype_index];
+    RenderChunk& chunk = archetype.chunks[chunk_index];
+    RenderChunk& last_chunk = archetype.chunks.back();
+    const u32 last_row = last_chunk.count - 1;
+
+    if (&chunk != &last_chunk || row != last_row) {
+        for (u32 c = 0; c < RENDER_CHUNK_COLUMNS; ++c) {
+            if (!has_column(archetype.component_mask, c))
+                continue;
+            memcpy(column_row(archetype, chunk, c, row),
+                column_row(archetype, last_chunk, c, last_row), column_sizes[c]);
+        }
+
+        const Entity moved = *(const Entity*)column_row(archetype, chunk, COLUMN_ENTITY, row);
+        world->records[moved.index].chunk = chunk_index;
+        world->records[moved.index].row = row;
+    }
+
+    --last_chunk.count;
+    --archetype.entity_count;
+    if (last_chunk.count == 0) {
+        free(last_chunk.data);
+        archetype.chunks.pop_back();
+    }
+}
+
+void render_world_clear(RenderWorld* world)
+{
+    assert(world);
+
+    for (RenderArchetype& archetype : world->archetypes) {
+        for (RenderChunk& chunk : archetype.chunks)
+            free(chunk.data);
+    }
+
+    world->archetypes.clear();
+    world->records.clear();
+    world->free_indices.clear();
+    world->entity_count = 0;
+}
+
+Entity render_world_create(RenderWorld* world, u32 component_mask)
+{
+    assert(world);
+    assert(component_mask < RENDER_COMPONENT_BIT(RENDER_COMPONENT_COUNT));
+
+    Entity entity{};
+    if (!world->free_indices.empty()) {
+        entity.index = world->free_indices.back();
+        world->free_indices.pop_back();
+    } else {
+        entity.index = (u32)world->records.size();
+        world->records.push_back({});
+    }
+
+    RenderEntityRecord& record = world->records[entity.index];
+    entity.generation = record.generation;
+    record.archetype = find_archetype(world, component_mask);
+    record.alive = true;
+    add_row(world, record.archetype, &record.chunk, &record.row);
+
+    const RenderArchetype& archetype = world->archetypes[record.archetype];
+    *(Entity*)column_row(archetype, archetype.chunks[record.chunk], COLUMN_ENTITY, record.row) =
+        entity;
+
+    ++world->entity_count;
+    return entity;
+}
+
+void render_world_destroy(RenderWorld* world, Entity entity)
+{
+    assert(render_world_alive(world, entity));
+
+    RenderEntityRecord& record = world->records[entity.index];
+    remove_row(world, record.archetype, record.chunk, record.row);
+
+    record.alive = false;
+    ++record.generation;
+    world->free_indices.push_back(entity.index);
+    --world->entity_count;
+}
+
+b8 render_world_alive(const RenderWorld* world, Entity entity)
+{
+    assert(world);
+
+    return entity.index < world->records.size() && world->records[entity.index].alive &&
+        world->records[entity.index].generation == entity.generation;
+}
+
+void render_world_set_components(RenderWorld* world, Entity entity, u32 component_mask)
+{
+    assert(render_world_alive(world, entity));
+
+    RenderEntityRecord& record = world->records[entity.index];
+    const u32 target = find_archetype(world, component_mask);
+    if (target == record.archetype)
+        return;
+
+    u32 chunk_index, row;
+    add_row(world, target, &chunk_index, &row);
+
+    // the archetype vector did not grow past find_archetype, references stay valid
+    const RenderArchetype& from = world->archetypes[record.archetype];
+    const RenderArchetype& to = world->archetypes[target];
+    for (u32 c = 0; c < RENDER_CHUNK_COLUMNS; ++c) {
+        if (!has_column(from.component_mask, c) || !has_column(to.component_mask, c))
+            continue;
+        memcpy(column_row(to, to.chunks[chunk_index], c, row),
+            column_row(from, from.chunks[record.chunk], c, record.row), column_sizes[c]);
+    }
+
+    remove_row(world, record.archetype, record.chunk, record.row);
+    record.archetype = target;
+    record.chunk = chunk_index;
+    record.row = row;
+}
+
+u32 render_world_components(const RenderWorld* world, Entity entity)
+{
+    assert(render_world_alive(world, entity));
+
+    return world->archetypes[world->records[entity.index].archetype].component_mask;
+}
+
+RenderChunkView render_world_view(RenderWorld* world, Entity entity, u32* out_row)
+{
+    assert(render_world_alive(world, entity));
+    assert(out_row);
+
+    const RenderEntityRecord& record = world->records[entity.index];
+    const RenderArchetype& archetype = world->archetypes[record.archetype];
+    *out_row = record.row;
+    return chunk_view(archetype, archetype.chunks[record.chunk]);
+}
+
+void render_world_for_each_chunk(RenderWorld* world, u32 required_mask, JobSystem* jobs,
+    const std::function<void(const RenderChunkView&, u32)>& fn)
+{
+    assert(world);
+
+    std::vector<RenderChunkView> views;
+    for (const RenderArchetype& archetype : world->archetypes) {
+        if ((archetype.component_mask & required_mask) != required_mask)
+            continue;
+        for (const RenderChunk& chunk : archetype.chunks)
+            views.push_back(chunk_view(archetype, chunk));
+    }
+
+    auto run = [&](u32 first, u32 count, u32 worker) {
+        for (u32 i = first; i < first + count; ++i)
+            fn(views[i], worker);
+    };
+
+    if (jobs)
+        jobs->parallel_for((u32)views.size(), 1, run);
+    else
+        run(0, (u32)views.size(), 0);
+}
+
+u32 render_world_cull(RenderWorld* world, const Frustum& frustum, JobSystem* jobs)
+{
+    PKO_PROFILE_FUNCTION();
+
+    std::atomic<u32> visible_count{0};
+
+    const u32 required = RENDER_COMPONENT_BIT(RENDER_COMPONENT_BOUNDS) |
+        RENDER_COMPONENT_BIT(RENDER_COMPONENT_VISIBILITY);
+    render_world_for_each_chunk(world, required, jobs, [&](const RenderChunkView& view, u32) {
+        for (u32 i = 0; i < view.count; ++i)
+            view.visible[i] = 1;
+
+        // per plane only the corner furthest along its normal matters, the same array for
+        // every row, so the loop over the rows has no selects
+        for (const glm::vec4& plane : frustum.planes) {
+            const f32* x = plane.x >= 0.0f ? view.max_x : view.min_x;
+            const f32* y = plane.y >= 0.0f ? view.max_y : view.min_y;
+            const f32* z = plane.z >= 0.0f ? view.max_z : view.min_z;
+            for (u32 i = 0; i < view.count; ++i) {
+                const f32 distance = plane.x * x[i] + plane.y * y[i] + plane.z * z[i] + plane.w;
+                view.visible[i] &= distance >= 0.0f;
+            }
+        }
+
+        u32 chunk_visible = 0;
+        for (u32 i = 0; i < view.count; ++i)
+            chunk_visible += view.visible[i];
+        visible_count += chunk_visible;
+    });
+
+    return visible_count;
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+/*
+* Entities of the renderer, stored by archetype.
+* An archetype is the set of components its entities have. Its entities live in fixed size
+* chunks, and inside a chunk every component is its own array with one row per entity, the
+* bounds split further into one array per axis, so a system reads only the arrays it needs
+* and walks them front to back.
+* Destroying an entity moves the last entity of its archetype into the hole, rows stay packed
+* and chunks stay full except for the last one. Entities are handles with a generation, a
+* destroyed entity is never mistaken for the one reusing its slot.
+* Systems run over whole chunks, one chunk is never split between threads.
+*/
+
+#include <functional>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "defines.h"
+
+class JobSystem;
+struct Frustum;
+
+enum RenderComponent {
+    // world matrix
+    RENDER_COMPONENT_TRANSFORM,
+    // world space box
+    RENDER_COMPONENT_BOUNDS,
+    RENDER_COMPONENT_MESH,
+    RENDER_COMPONENT_MATERIAL,
+    // 1 when the entity passed the last culling
+    RENDER_COMPONENT_VISIBILITY,
+    RENDER_COMPONENT_COUNT
+};
+
+#define RENDER_COMPONENT_BIT(component) (1u << (component))
+
+// rows of a chunk, 128 rows of every component are around 14 KB
+constexpr u32 RENDER_CHUNK_CAPACITY = 128;
+// arrays of a chunk: entities, transforms, one per bounds axis, meshes, materials, visibility
+constexpr u32 RENDER_CHUNK_COLUMNS = 11;
+
+struct Entity {
+    u32 index;
+    u32 generation;
+};
+
+// mesh of the owner and the mesh instance the entity stands for
+struct MeshRef {
+    u32 mesh;
+    u32 instance;
+};
+
+struct MaterialRef {
+    u32 texture;
+};
+
+// the arrays of one chunk, NULL for components the archetype does not have
+struct RenderChunkView {
+    u32 count;
+    const Entity* entities;
+    glm::mat4* transforms;
+    f32* min_x;
+    f32* min_y;
+    f32* min_z;
+    f32* max_x;
+    f32* max_y;
+    f32* max_z;
+    MeshRef* meshes;
+    MaterialRef* materials;
+    u8* visible;
+};
+
+struct RenderChunk {
+    u32 count;
+    // one allocation, the arrays at the offsets of the archetype
+    u8* data;
+};
+
+struct RenderArchetype {
+    u32 component_mask;
+    // byte offset of every array in a chunk, columns the archetype lacks are unused
+    u32 column_offsets[RENDER_CHUNK_COLUMNS];
+    u32 chunk_size;
+    std::vector<RenderChunk> chunks;
+    u32 entity_count;
+};
+
+// where an entity lives, generation is bumped when it is destroyed
+struct RenderEntityRecord {
+    u32 archetype;
+    u32 chunk;
+    u32 row;
+    u32 generation;
+    b8 alive;
+};
+
+struct RenderWorld {
+    std::vector<RenderArchetype> archetypes;
+    std::vector<RenderEntityRecord> records;
+    std::vector<u32> free_indices;
+    u32 entity_count;
+};
+
+// frees every chunk, handles of the world become invalid
+void render_world_clear(RenderWorld* world);
+
+// components start as identity, an empty box at the origin, zero references and visible
+Entity render_world_create(RenderWorld* world, u32 component_mask);
+void render_world_destroy(RenderWorld* world, Entity entity);
+b8 render_world_alive(const RenderWorld* world, Entity entity);
+
+// moves the entity to the archetype of component_mask, components in both keep their values
+void render_world_set_components(RenderWorld* world, Entity entity, u32 component_mask);
+u32 render_world_components(const RenderWorld* world, Entity entity);
+
+// arrays of the chunk of the entity and its row in them
+RenderChunkView render_world_view(RenderWorld* world, Entity entity, u32* out_row);
+
+// fn for every chunk whose archetype has all of required_mask, chunks are spread over jobs.
+// fn may write the components of its chunk but not create or destroy entities. jobs may be
+// NULL
+void render_world_for_each_chunk(RenderWorld* world, u32 required_mask, JobSystem* jobs,
+    const std::function<void(const RenderChunkView&, u32)>& fn);
+
+// visibility of every entity with bounds from the frustum, returns how many are visible.
+// jobs may be NULL
+u32 render_world_cull(RenderWorld* world, const Frustum& frustum, JobSystem* jobs);
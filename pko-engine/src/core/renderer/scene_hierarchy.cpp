@@ -0,0 +1,257 @@
+#include "scene_hierarchy.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+#include "core/job_system.h"
+#include "core/profiler.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+// SSE2 is part of every x64 CPU and the default of 32 bit MSVC, no runtime check needed
+#define PKO_HIERARCHY_SSE 1
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <emmintrin.h>
+#endif
+#endif
+
+// a node is a matrix multiply, smaller ranges cost more to hand out than to run
+static const u32 MIN_NODES_PER_JOB = 1024;
+
+// parent * local, a column of the product is the parent columns weighted by a local column
+static inline void multiply(const glm::mat4& parent, const glm::mat4& local, glm::mat4* out)
+{
+#if defined(PKO_HIERARCHY_SSE)
+    const f32* a = &parent[0][0];
+    const f32* b = &local[0][0];
+    f32* result = &(*out)[0][0];
+
+    const __m128 a0 = _mm_loadu_ps(a);
+    const __m128 a1 = _mm_loadu_ps(a + 4);
+    const __m128 a2 = _mm_loadu_ps(a + 8);
+    const __m128 a3 = _mm_loadu_ps(a + 12);
+
+    for (u32 c = 0; c < 4; ++c) {
+        const f32* column = b + c * 4;
+        __m128 sum = _mm_mul_ps(a0, _mm_set1_ps(column[0]));
+        sum = _mm_add_ps(sum, _mm_mul_ps(a1, _mm_set1_ps(column[1])));
+        sum = _mm_add_ps(sum, _mm_mul_ps(a2, _mm_set1_ps(column[2])));
+        sum = _mm_add_ps(sum, _mm_mul_ps(a3, _mm_set1_ps(column[3])));
+        _mm_storeu_ps(result + c * 4, sum);
+    }
+#else
+    *out = parent * local;
+#endif
+}
+
+void scene_hierarchy_build(SceneHierarchy* hierarchy, const u32* parents, const glm::mat4* locals,
+    u32 count, std::vector<u32>* out_nodes)
+{
+    PKO_PROFILE_FUNCTION();
+
+    assert(hierarchy);
+    assert(out_nodes);
+
+    std::vector<u32> depths(count);
+    u32 level_count = 0;
+    for (u32 i = 0; i < count; ++i) {
+        assert(parents[i] == SCENE_NODE_NONE || parents[i] < i);
+        depths[i] = parents[i] == SCENE_NODE_NONE ? 0 : depths[parents[i]] + 1;
+        if (depths[i] + 1 > level_count)
+            level_count = depths[i] + 1;
+    }
+
+    // children of every given node in their given order
+    std::vector<u32> child_counts(count + 1, 0);
+    for (u32 i = 0; i < count; ++i) {
+        if (parents[i] != SCENE_NODE_NONE)
+            ++child_counts[parents[i] + 1];
+    }
+    for (u32 i = 0; i < count; ++i)
+        child_counts[i + 1] += child_counts[i];
+    std::vector<u32> children(count);
+    std::vector<u32> next(child_counts.begin(), child_counts.end() - 1);
+    for (u32 i = 0; i < count; ++i) {
+        if (parents[i] != SCENE_NODE_NONE)
+            children[next[parents[i]]++] = i;
+    }
+
+    // breadth first from the roots, siblings keep their order and end up next to each other
+    std::vector<u32> order;
+    order.reserve(count);
+    for (u32 i = 0; i < count; ++i) {
+        if (parents[i] == SCENE_NODE_NONE)
+            order.push_back(i);
+    }
+    const u32 root_count = (u32)order.size();
+    for (u32 n = 0; n < order.size(); ++n) {
+        const u32 i = order[n];
+        order.insert(order.end(), children.begin() + child_counts[i],
+            children.begin() + child_counts[i + 1]);
+    }
+
+    out_nodes->resize(count);
+    for (u32 n = 0; n < count; ++n)
+        (*out_nodes)[order[n]] = n;
+
+    hierarchy->level_offsets.assign(level_count + 1, 0);
+    hierarchy->child_offsets.resize(count + 1);
+    hierarchy->child_offsets[0] = root_count;
+    hierarchy->parents.resize(count);
+    hierarchy->locals.resize(count);
+    hierarchy->worlds.assign(count, glm::mat4(1.0f));
+    for (u32 n = 0; n < count; ++n) {
+        const u32 i = order[n];
+        ++hierarchy->level_offsets[depths[i] + 1];
+        // the children of the nodes before n were queued first
+        hierarchy->child_offsets[n + 1] =
+            hierarchy->child_offsets[n] + child_counts[i + 1] - child_counts[i];
+        // parents were placed first, their new index is known
+        hierarchy->parents[n] =
+            parents[i] == SCENE_NODE_NONE ? SCENE_NODE_NONE : (*out_nodes)[parents[i]];
+        hierarchy->locals[n] = locals[i];
+    }
+    for (u32 l = 0; l < level_count; ++l)
+        hierarchy->level_offsets[l + 1] += hierarchy->level_offsets[l];
+
+    hierarchy->dirty.assign(count, 1);
+    hierarchy->dirty_nodes.resize(count);
+    for (u32 n = 0; n < count; ++n)
+        hierarchy->dirty_nodes[n] = n;
+    hierarchy->updated.assign(count, 0);
+    hierarchy->updated_ranges.clear();
+    hierarchy->updated_count = 0;
+}
+
+void scene_hierarchy_set_local(SceneHierarchy* hierarchy, u32 node, const glm::mat4& local)
+{
+    assert(node < hierarchy->locals.size());
+
+    hierarchy->locals[node] = local;
+    if (hierarchy->dirty[node])
+        return;
+
+    hierarchy->dirty[node] = 1;
+    hierarchy->dirty_nodes.push_back(node);
+}
+
+u32 scene_hierarchy_update(SceneHierarchy* hierarchy, JobSystem* jobs)
+{
+    PKO_PROFILE_FUNCTION();
+
+    assert(hierarchy);
+
+    std::vector<SceneNodeRange>& ranges = hierarchy->updated_ranges;
+    u8* updated = hierarchy->updated.data();
+
+    // flags of the last update describe it until the next one
+    for (const SceneNodeRange& range : ranges)
+        memset(updated + range.first, 0, range.last - range.first);
+    ranges.clear();
+    hierarchy->updated_count = 0;
+
+    std::vector<u32>& dirty_nodes = hierarchy->dirty_nodes;
+    if (dirty_nodes.empty())
+        return 0;
+
+    // levels are contiguous, the dirty nodes of a level are a run of the sorted list
+    std::sort(dirty_nodes.begin(), dirty_nodes.end());
+
+    const u32* parents = hierarchy->parents.data();
+    const u32* child_offsets = hierarchy->child_offsets.data();
+    const glm::mat4* locals = hierarchy->locals.data();
+    glm::mat4* worlds = hierarchy->worlds.data();
+
+    u32 next_dirty = 0;
+    // recomputed on the level before, a run of ranges
+    u32 parents_first = 0;
+    u32 parents_last = 0;
+    // nodes in the ranges of the level before range r, to split the level over the jobs
+    std::vector<u32> range_starts;
+
+    for (u32 l = 0; l + 1 < hierarchy->level_offsets.size(); ++l) {
+        if (parents_first == parents_last && next_dirty == dirty_nodes.size())
+            break;
+
+        const u32 level_last = hierarchy->level_offsets[l + 1];
+        const u32 level_ranges = (u32)ranges.size();
+
+        // ascending and touching ranges coalesce, siblings of updated parents are one range
+        auto append = [&](u32 first, u32 last) {
+            if (first == last)
+                return;
+            if (ranges.size() > level_ranges && ranges.back().last == first)
+                ranges.back().last = last;
+            else
+                ranges.push_back({first, last});
+        };
+
+        // children of the recomputed parents merged with the dirty nodes of the level, both
+        // ascending, so the ranges stay sorted without overlap
+        for (u32 p = parents_first; p < parents_last; ++p) {
+            const u32 first_child = child_offsets[ranges[p].first];
+            const u32 last_child = child_offsets[ranges[p].last];
+            for (; next_dirty < dirty_nodes.size() && dirty_nodes[next_dirty] < first_child;
+                ++next_dirty)
+                append(dirty_nodes[next_dirty], dirty_nodes[next_dirty] + 1);
+            // dirty children are recomputed with their siblings
+            while (next_dirty < dirty_nodes.size() && dirty_nodes[next_dirty] < last_child)
+                ++next_dirty;
+            append(first_child, last_child);
+        }
+        for (; next_dirty < dirty_nodes.size() && dirty_nodes[next_dirty] < level_last;
+            ++next_dirty)
+            append(dirty_nodes[next_dirty], dirty_nodes[next_dirty] + 1);
+
+        const SceneNodeRange* level = ranges.data() + level_ranges;
+        const u32 range_count = (u32)ranges.size() - level_ranges;
+        range_starts.resize(range_count + 1);
+        range_starts[0] = 0;
+        for (u32 r = 0; r < range_count; ++r)
+            range_starts[r + 1] = range_starts[r] + level[r].last - level[r].first;
+        const u32 level_count = range_starts[range_count];
+
+        // parents are in earlier levels, done before this one started
+        auto update = [&](u32 first, u32 node_count, u32) {
+            // the range holding the first node of the job
+            u32 r = (u32)(std::upper_bound(range_starts.begin(), range_starts.end(), first) -
+                range_starts.begin()) - 1;
+            const u32 end = first + node_count;
+            for (u32 at = first; at < end; ++r) {
+                const u32 range_first = level[r].first + at - range_starts[r];
+                const u32 range_last = level[r].first + std::min(end, range_starts[r + 1]) -
+                    range_starts[r];
+                // the roots are exactly the first level
+                if (l == 0) {
+                    memcpy(worlds + range_first, locals + range_first,
+                        (range_last - range_first) * sizeof(glm::mat4));
+                } else {
+                    for (u32 node = range_first; node < range_last; ++node)
+                        multiply(worlds[parents[node]], locals[node], &worlds[node]);
+                }
+                memset(updated + range_first, 1, range_last - range_first);
+                at += range_last - range_first;
+            }
+        };
+
+        parents_first = level_ranges;
+        parents_last = level_ranges + range_count;
+        hierarchy->updated_count += level_count;
+
+        // only leaves were updated on the level before and nothing is dirty on this one
+        if (level_count == 0)
+            continue;
+        if (jobs)
+            jobs->parallel_for(level_count, MIN_NODES_PER_JOB, update);
+        else
+            update(0, level_count, 0);
+    }
+
+    for (u32 node : dirty_nodes)
+        hierarchy->dirty[node] = 0;
+    dirty_nodes.clear();
+
+    return hierarchy->updated_count;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+/*
+* Flattened node hierarchy.
+* Nodes are in breadth first order: a parent always comes before its children, every depth
+* level is one contiguous range and the children of a node are one contiguous range of the
+* next level. Local and world matrices, parents and flags are separate arrays indexed by node.
+* Setting a local matrix only marks the node dirty and appends it to a list. The update walks
+* the levels in order and builds the node ranges to recompute on every level from the child
+* ranges of the nodes recomputed on the level before and the dirty nodes of the level, so it
+* costs what changed instead of what exists, and a full update is one range per level.
+* Every level is split over the job system and only reads worlds of the level before, which
+* is finished.
+* Nodes recomputed by the last update stay flagged until the next one, so their consumers
+* copy only what changed.
+*/
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "defines.h"
+
+class JobSystem;
+
+// parent of the roots
+constexpr u32 SCENE_NODE_NONE = UINT32_MAX;
+
+// nodes [first, last)
+struct SceneNodeRange {
+    u32 first;
+    u32 last;
+};
+
+struct SceneHierarchy {
+    std::vector<u32> parents;
+    std::vector<glm::mat4> locals;
+    std::vector<glm::mat4> worlds;
+    // children of node n are [child_offsets[n], child_offsets[n + 1])
+    std::vector<u32> child_offsets;
+    // local set since the last update
+    std::vector<u8> dirty;
+    std::vector<u32> dirty_nodes;
+    // world recomputed by the last update
+    std::vector<u8> updated;
+    // recomputed by the last update, level after level and ascending within a level
+    std::vector<SceneNodeRange> updated_ranges;
+    // first node of every depth level, one more entry than there are levels
+    std::vector<u32> level_offsets;
+    u32 updated_count;
+};
+
+// count nodes ordered so a parent comes before its children, parents index the same order.
+// out_nodes gets the hierarchy node of every given node, all of them start dirty
+void scene_hierarchy_build(SceneHierarchy* hierarchy, const u32* parents, const glm::mat4* locals,
+    u32 count, std::vector<u32>* out_nodes);
+
+void scene_hierarchy_set_local(SceneHierarchy* hierarchy, u32 node, const glm::mat4& local);
+
+// recomputes the dirty subtrees, returns how many worlds were. jobs may be NULL
+u32 scene_hierarchy_update(SceneHierarchy* hierarchy, JobSystem* jobs);
@@ -79,6 +79,7 @@ VK_DEVICE_LEVEL_FUNCTION(vkDestroyShaderModule)
 VK_DEVICE_LEVEL_FUNCTION(vkCreatePipelineLayout)
 VK_DEVICE_LEVEL_FUNCTION(vkDestroyPipelineLayout)
 VK_DEVICE_LEVEL_FUNCTION(vkCreateGraphicsPipelines)
+VK_DEVICE_LEVEL_FUNCTION(vkCreateComputePipelines)
 VK_DEVICE_LEVEL_FUNCTION(vkDestroyPipeline)
 VK_DEVICE_LEVEL_FUNCTION(vkCreateFramebuffer)
 VK_DEVICE_LEVEL_FUNCTION(vkDestroyFramebuffer)
@@ -87,6 +88,9 @@ VK_DEVICE_LEVEL_FUNCTION(vkCreateDescriptorPool)
 VK_DEVICE_LEVEL_FUNCTION(vkDestroyDescriptorSetLayout)
 VK_DEVICE_LEVEL_FUNCTION(vkDestroyDescriptorPool)
 VK_DEVICE_LEVEL_FUNCTION(vkResetDescriptorPool)
+VK_DEVICE_LEVEL_FUNCTION(vkCreateQueryPool)
+VK_DEVICE_LEVEL_FUNCTION(vkDestroyQueryPool)
+VK_DEVICE_LEVEL_FUNCTION(vkGetQueryPoolResults)
 
 VK_DEVICE_LEVEL_FUNCTION(vkResetCommandBuffer)
 VK_DEVICE_LEVEL_FUNCTION(vkBeginCommandBuffer)
@@ -96,7 +100,11 @@ VK_DEVICE_LEVEL_FUNCTION(vkCmdEndRenderPass)
 VK_DEVICE_LEVEL_FUNCTION(vkCmdBindPipeline)
 VK_DEVICE_LEVEL_FUNCTION(vkCmdDraw)
 VK_DEVICE_LEVEL_FUNCTION(vkCmdDrawIndexed)
+VK_DEVICE_LEVEL_FUNCTION(vkCmdDrawIndexedIndirect)
+VK_DEVICE_LEVEL_FUNCTION(vkCmdDispatch)
+VK_DEVICE_LEVEL_FUNCTION(vkCmdDispatchIndirect)
 VK_DEVICE_LEVEL_FUNCTION(vkCmdCopyBuffer)
+VK_DEVICE_LEVEL_FUNCTION(vkCmdFillBuffer)
 VK_DEVICE_LEVEL_FUNCTION(vkCmdBindVertexBuffers)
 VK_DEVICE_LEVEL_FUNCTION(vkCmdBindIndexBuffer)
 VK_DEVICE_LEVEL_FUNCTION(vkCmdPushConstants)
@@ -105,8 +113,15 @@ VK_DEVICE_LEVEL_FUNCTION(vkCmdSetViewport)
 VK_DEVICE_LEVEL_FUNCTION(vkCmdSetScissor)
 VK_DEVICE_LEVEL_FUNCTION(vkCmdPipelineBarrier)
 VK_DEVICE_LEVEL_FUNCTION(vkCmdCopyBufferToImage)
+VK_DEVICE_LEVEL_FUNCTION(vkCmdCopyImage)
 VK_DEVICE_LEVEL_FUNCTION(vkCmdBeginRenderingKHR);
 VK_DEVICE_LEVEL_FUNCTION(vkCmdEndRenderingKHR);
+VK_DEVICE_LEVEL_FUNCTION(vkCmdPipelineBarrier2KHR)
+VK_DEVICE_LEVEL_FUNCTION(vkCmdExecuteCommands)
+VK_DEVICE_LEVEL_FUNCTION(vkCmdResetQueryPool)
+VK_DEVICE_LEVEL_FUNCTION(vkCmdBeginQuery)
+VK_DEVICE_LEVEL_FUNCTION(vkCmdEndQuery)
+VK_DEVICE_LEVEL_FUNCTION(vkCmdWriteTimestamp)
 
 VK_DEVICE_LEVEL_FUNCTION(vkAcquireNextImageKHR)
 VK_DEVICE_LEVEL_FUNCTION(vkQueueSubmit)
@@ -116,9 +131,13 @@ VK_DEVICE_LEVEL_FUNCTION(vkCreateFence)
 VK_DEVICE_LEVEL_FUNCTION(vkWaitForFences)
 VK_DEVICE_LEVEL_FUNCTION(vkResetFences)
 VK_DEVICE_LEVEL_FUNCTION(vkDestroyFence)
+VK_DEVICE_LEVEL_FUNCTION(vkWaitSemaphores)
+VK_DEVICE_LEVEL_FUNCTION(vkSignalSemaphore)
+VK_DEVICE_LEVEL_FUNCTION(vkGetSemaphoreCounterValue)
 
 VK_DEVICE_LEVEL_FUNCTION(vkCreateImage)
 VK_DEVICE_LEVEL_FUNCTION(vkDestroyImage)
+VK_DEVICE_LEVEL_FUNCTION(vkGetImageMemoryRequirements)
 VK_DEVICE_LEVEL_FUNCTION(vkCreateBuffer)
 VK_DEVICE_LEVEL_FUNCTION(vkDestroyBuffer)
 VK_DEVICE_LEVEL_FUNCTION(vkGetBufferMemoryRequirements)
@@ -127,7 +146,17 @@ VK_DEVICE_LEVEL_FUNCTION(vkFreeMemory)
 VK_DEVICE_LEVEL_FUNCTION(vkMapMemory)
 VK_DEVICE_LEVEL_FUNCTION(vkUnmapMemory)
 VK_DEVICE_LEVEL_FUNCTION(vkBindBufferMemory)
+VK_DEVICE_LEVEL_FUNCTION(vkBindImageMemory)
 VK_DEVICE_LEVEL_FUNCTION(vkAllocateDescriptorSets)
 VK_DEVICE_LEVEL_FUNCTION(vkUpdateDescriptorSets)
 
-#undef VK_DEVICE_LEVEL_FUNCTION
\ No newline at end of file
+#undef VK_DEVICE_LEVEL_FUNCTION
+
+#if !defined(VK_DEVICE_LEVEL_FUNCTION_FROM_EXTENSION)
+#define VK_DEVICE_LEVEL_FUNCTION_FROM_EXTENSION(fun)
+#endif
+
+// NULL unless the extension was enabled, check the DeviceContext flag before calling
+VK_DEVICE_LEVEL_FUNCTION_FROM_EXTENSION(vkCmdDrawIndexedIndirectCountKHR)
+
+#undef VK_DEVICE_LEVEL_FUNCTION_FROM_EXTENSION
\ No newline at end of file
@@ -1,6 +1,8 @@
 #include "vulkan_buffer.h"
 
 #include "vulkan_command_buffer.h"
+#include "vulkan_memory_allocate.h"
+#include "vulkan_metrics.h"
 
 void vulkan_buffer_create(
 	RenderContext* context,
@@ -8,7 +10,8 @@ void vulkan_buffer_create(
 	VkBufferUsageFlags buffer_usage_flag,
 	VmaMemoryUsage memory_usage_flag,
 	VmaAllocationCreateFlags alloc_create_flag,
-	Buffer* buffer
+	Buffer* buffer,
+	MemoryCategory category
 	) 
 {
 	VkBufferCreateInfo buffer_create_info{ VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
@@ -19,15 +22,48 @@ void vulkan_buffer_create(
 	alloc_create_info.usage = memory_usage_flag;
 	alloc_create_info.flags = alloc_create_flag;
 
+	VmaAllocationInfo allocation_info;
 	VK_CHECK(vmaCreateBuffer(
 		context->vma_allocator,
 		&buffer_create_info,
 		&alloc_create_info,
 		&buffer->handle,
 		&buffer->allocation,
-		nullptr
+		&allocation_info
 	));
 
+	// stays mapped for the lifetime of the buffer, uploads skip vmaMapMemory
+	buffer->mapped_data = (alloc_create_flag & VMA_ALLOCATION_CREATE_MAPPED_BIT) ? allocation_info.pMappedData : NULL;
+
+	vulkan_memory_tag(context, buffer->allocation, category);
+}
+
+void vulkan_buffer_create(
+	RenderContext* context,
+	u64 buffer_size,
+	VkBufferUsageFlags buffer_usage_flag,
+	VmaMemoryUsage memory_usage_flag,
+	VmaAllocationCreateFlags alloc_create_flag,
+	BufferHandle* out_buffer,
+	MemoryCategory category
+)
+{
+	Buffer* buffer = NULL;
+	BufferCold* buffer_cold = NULL;
+	out_buffer->id = context->buffer_pool->create(&buffer, &buffer_cold);
+
+	// like images, pooled buffers can always be copied, the defragmenter moves them that way
+	buffer_usage_flag |= VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+
+	buffer_cold->size = buffer_size;
+	buffer_cold->usage = buffer_usage_flag;
+
+	vulkan_buffer_create(context, buffer_size, buffer_usage_flag, memory_usage_flag, alloc_create_flag, buffer, category);
+}
+
+Buffer* vulkan_buffer_get(RenderContext* context, BufferHandle buffer)
+{
+	return context->buffer_pool->get(buffer.id);
 }
 
 void vulkan_buffer_copy(RenderContext* context,
@@ -57,21 +93,48 @@ void vulkan_buffer_copy(RenderContext* context,
 	submit_info.commandBufferCount = 1;
 	submit_info.pCommandBuffers = &one_time_submit.buffer;
 
-	VK_CHECK(vkQueueSubmit(context->device_context.transfer_queue, 1, &submit_info, VK_NULL_HANDLE));
-	vkQueueWaitIdle(context->device_context.transfer_queue);
+	// only wait for this copy, not for everything else queued on the transfer queue
+	VkFence fence;
+	VkFenceCreateInfo fence_create_info{ VK_STRUCTURE_TYPE_FENCE_CREATE_INFO };
+	VK_CHECK(vkCreateFence(context->device_context.handle, &fence_create_info, context->allocator, &fence));
+
+	VK_CHECK(vkQueueSubmit(context->device_context.transfer_queue, 1, &submit_info, fence));
+	VK_CHECK(vkWaitForFences(context->device_context.handle, 1, &fence, true, UINT64_MAX));
+
+	vkDestroyFence(context->device_context.handle, fence, context->allocator);
 	vulkan_command_pool_destroy(context, &one_time_submit);
 }
 
 
 void vulkan_buffer_destroy(RenderContext* context, Buffer* buffer) {
 
+	vulkan_memory_untag(context, buffer->allocation);
 	vmaDestroyBuffer(context->vma_allocator, buffer->handle, buffer->allocation);
 }
 
+void vulkan_buffer_destroy(RenderContext* context, BufferHandle buffer_handle)
+{
+	Buffer* buffer = vulkan_buffer_get(context, buffer_handle);
+	assert(buffer && "stale buffer handle");
+
+	vulkan_memory_untag(context, buffer->allocation);
+	vmaDestroyBuffer(context->vma_allocator, buffer->handle, buffer->allocation);
+	context->buffer_pool->release(buffer_handle.id);
+}
+
 void vulkan_buffer_upload(RenderContext* context, Buffer* buffer, void* data, u32 data_size)
 {
-	void* copied_data;
-	vmaMapMemory(context->vma_allocator, buffer->allocation, &copied_data);
-	memcpy(copied_data, data, data_size);
-	vmaUnmapMemory(context->vma_allocator, buffer->allocation);
+	if (buffer->mapped_data) {
+		memcpy(buffer->mapped_data, data, data_size);
+		// no-op on coherent memory
+		vmaFlushAllocation(context->vma_allocator, buffer->allocation, 0, data_size);
+	}
+	else {
+		void* copied_data;
+		vmaMapMemory(context->vma_allocator, buffer->allocation, &copied_data);
+		memcpy(copied_data, data, data_size);
+		vmaUnmapMemory(context->vma_allocator, buffer->allocation);
+	}
+
+	vulkan_metrics_add(METRIC_BYTES_UPLOADED, data_size);
 }
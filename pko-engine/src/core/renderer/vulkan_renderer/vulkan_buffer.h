@@ -14,12 +14,30 @@ void vulkan_buffer_create(
 	VkBufferUsageFlags buffer_usage_flag,
 	VmaMemoryUsage memory_usage_flag,
 	VmaAllocationCreateFlags alloc_create_flag,
-	Buffer* buffer
+	Buffer* buffer,
+	MemoryCategory category = MEMORY_CATEGORY_OTHER
 );
 
+// pooled buffer, the raw version above is meant for transient buffers like staging
+void vulkan_buffer_create(
+	RenderContext* context,
+	u64 buffer_size,
+	VkBufferUsageFlags buffer_usage_flag,
+	VmaMemoryUsage memory_usage_flag,
+	VmaAllocationCreateFlags alloc_create_flag,
+	BufferHandle* out_buffer,
+	MemoryCategory category = MEMORY_CATEGORY_OTHER
+);
+
+// transient pointer into the buffer pool, NULL for a stale handle
+Buffer* vulkan_buffer_get(RenderContext* context, BufferHandle buffer);
+
+// blocking copy, prefer vulkan_queue_scheduler_upload_buffer at runtime
 void vulkan_buffer_copy(RenderContext* context, Buffer* src_buffer, Buffer* dst_buffer, u64 size,u64 src_offset = 0, u64 dst_offset = 0);
 
+// immediate, buffers frames in flight may still read go through vulkan_deletion_queue_push_buffer
 void vulkan_buffer_destroy(RenderContext* context, Buffer* buffer);
+void vulkan_buffer_destroy(RenderContext* context, BufferHandle buffer);
 
 void vulkan_buffer_upload(RenderContext* context, Buffer* buffer, void* data, u32 data_size);
 
@@ -3,6 +3,8 @@
 #include "vulkan_types.inl"
 #include "vulkan_image.h"
 
+#include <algorithm>
+
 u32 get_queue_family_index(DeviceContext* pDevice, QueueType queueType)
 {
     assert(pDevice);
@@ -12,6 +14,16 @@ u32 get_queue_family_index(DeviceContext* pDevice, QueueType queueType)
     {
         case QUEUE_TYPE_GRAPHICS:
             result = pDevice->graphics_family.index;
+            break;
+        case QUEUE_TYPE_PRESENT:
+            result = pDevice->present_family.index;
+            break;
+        case QUEUE_TYPE_TRANSFER:
+            result = pDevice->transfer_family.index;
+            break;
+        case QUEUE_TYPE_COMPUTE:
+            result = pDevice->compute_family.index;
+            break;
     }
 
     return result;
@@ -34,6 +46,8 @@ VkPipelineStageFlags get_pipeline_stage_flags(VkAccessFlags accessFlags, QueueTy
             {
                 flags |= VK_PIPELINE_STAGE_VERTEX_SHADER_BIT;
                 flags |= VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+                // graphics queue always supports compute
+                flags |= VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
             }
 
             if ((accessFlags &
@@ -70,9 +84,15 @@ VkPipelineStageFlags get_pipeline_stage_flags(VkAccessFlags accessFlags, QueueTy
             break;
     }
 
+    if ((accessFlags & VK_ACCESS_INDIRECT_COMMAND_READ_BIT) != 0)
+        flags |= VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT;
+
     if ((accessFlags & (VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT)) != 0)
         flags |= VK_PIPELINE_STAGE_TRANSFER_BIT;
 
+    if ((accessFlags & VK_ACCESS_HOST_READ_BIT) != 0)
+        flags |= VK_PIPELINE_STAGE_HOST_BIT;
+
     if (flags == 0)
         flags = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
 
@@ -118,10 +138,18 @@ VkAccessFlags resource_state_to_access_flags(ResourceState state)
     {
         flags |= VK_ACCESS_SHADER_READ_BIT;
     }
+    if (state & RESOURCE_STATE_INDIRECT_ARGUMENT)
+    {
+        flags |= VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+    }
     if (state & RESOURCE_STATE_PRESENT)
     {
         flags |= VK_ACCESS_MEMORY_READ_BIT;
     }
+    if (state & RESOURCE_STATE_HOST_READ)
+    {
+        flags |= VK_ACCESS_HOST_READ_BIT;
+    }
 
     return flags;
 }
@@ -135,8 +163,12 @@ void vulkan_command_pool_create(RenderContext* context, Command* command, QueueT
     create_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
     create_info.queueFamilyIndex = get_queue_family_index(&context->device_context, queueType);
     command->type = queueType;
+    command->queue_family_index = create_info.queueFamilyIndex;
     command->is_rendering = false;
 
+    command->barrier_batch = new BarrierBatch();
+    command->barrier_batch->memory_barrier = {VK_STRUCTURE_TYPE_MEMORY_BARRIER_2_KHR};
+
     VK_CHECK(vkCreateCommandPool(context->device_context.handle, &create_info, context->allocator,
                                  &command->pool));
 }
@@ -147,6 +179,9 @@ void vulkan_command_pool_destroy(RenderContext* context, Command* command)
     assert(command);
 
     vkDestroyCommandPool(context->device_context.handle, command->pool, context->allocator);
+
+    delete command->barrier_batch;
+    command->barrier_batch = NULL;
 }
 
 void vulkan_command_buffer_allocate(RenderContext* context, Command* command, b8 is_primary)
@@ -159,6 +194,7 @@ void vulkan_command_buffer_allocate(RenderContext* context, Command* command, b8
     alloc_info.commandBufferCount = 1;
     alloc_info.level =
         is_primary ? VK_COMMAND_BUFFER_LEVEL_PRIMARY : VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+    command->is_secondary = !is_primary;
 
     VK_CHECK(
         vkAllocateCommandBuffers(context->device_context.handle, &alloc_info, &command->buffer));
@@ -175,6 +211,63 @@ void vulkan_command_buffer_begin(Command* command, VkCommandBufferUsageFlags buf
     begin_info.pInheritanceInfo = NULL;
 
     VK_CHECK(vkBeginCommandBuffer(command->buffer, &begin_info));
+
+    // states known from an earlier recording may be stale by the time this one executes
+    if (command->barrier_batch)
+    {
+        command->barrier_batch->image_states.clear();
+        command->barrier_batch->stats = {};
+    }
+}
+
+void vulkan_command_buffer_begin_secondary(Command* command, const RenderDesc* desc,
+                                           VkCommandBufferUsageFlags buffer_usage,
+                                           VkQueryPipelineStatisticFlags pipeline_statistics)
+{
+    assert(command);
+    assert(desc);
+    assert(desc->render_target_count <= MAX_COLOR_ATTACHMENT);
+
+    VkFormat color_formats[MAX_COLOR_ATTACHMENT] = {};
+    VkSampleCountFlagBits sample_count = VK_SAMPLE_COUNT_1_BIT;
+
+    for (u32 i = 0; i < desc->render_target_count; ++i)
+    {
+        color_formats[i] = desc->render_targets[i]->vulkan_format;
+        sample_count = desc->render_targets[i]->sample_count;
+    }
+
+    VkCommandBufferInheritanceRenderingInfoKHR rendering_info{
+        VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO_KHR};
+    rendering_info.colorAttachmentCount = desc->render_target_count;
+    rendering_info.pColorAttachmentFormats = color_formats;
+
+    if (desc->depth_target)
+    {
+        rendering_info.depthAttachmentFormat = desc->depth_target->vulkan_format;
+        sample_count = desc->depth_target->sample_count;
+    }
+    if (desc->stencil_target)
+        rendering_info.stencilAttachmentFormat = desc->stencil_target->vulkan_format;
+
+    rendering_info.rasterizationSamples = sample_count;
+
+    VkCommandBufferInheritanceInfo inheritance_info{
+        VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO};
+    inheritance_info.pNext = &rendering_info;
+    inheritance_info.pipelineStatistics = pipeline_statistics;
+
+    VkCommandBufferBeginInfo begin_info{VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
+    begin_info.flags = buffer_usage | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+    begin_info.pInheritanceInfo = &inheritance_info;
+
+    VK_CHECK(vkBeginCommandBuffer(command->buffer, &begin_info));
+
+    if (command->barrier_batch)
+    {
+        command->barrier_batch->image_states.clear();
+        command->barrier_batch->stats = {};
+    }
 }
 
 void vulkan_command_buffer_end(Command* command)
@@ -188,6 +281,8 @@ void vulkan_command_buffer_end(Command* command)
         command->is_rendering = false;
     }
 
+    vulkan_command_flush_barriers(command);
+
     VK_CHECK(vkEndCommandBuffer(command->buffer));
 }
 
@@ -199,153 +294,307 @@ void vulkan_command_pool_reset(Command* command)
     VK_CHECK(vkResetCommandBuffer(command->buffer, 0));
 }
 
-void vulkan_command_resource_barrier(Command* command, BufferBarrier* bufferBarriers,
-                                     u32 buffBarrierCount, TextureBarrier* textureBarriers,
-                                     u32 textureBarrierCount,
-                                     RenderTargetBarrier* pRenderTargetBarriers,
-                                     u32 renderTargetBarrierCount)
+b8 is_resource_state_write(ResourceState state)
 {
-    assert(command);
-
-    VkAccessFlags srcAccessMask = 0;
-    VkAccessFlags dstAccessMask = 0;
+    return (state & (RESOURCE_STATE_RENDER_TARGET | RESOURCE_STATE_DEPTH_WRITE |
+                     RESOURCE_STATE_UNORDERED_ACCESS | RESOURCE_STATE_COPY_DEST)) != 0;
+}
 
-    u32 imageMemoryBarrierCount = 0;
-    VkImageMemoryBarrier* imageMemoryBarriers = (VkImageMemoryBarrier*)calloc(
-        textureBarrierCount + renderTargetBarrierCount, sizeof(VkImageMemoryBarrier));
+static ResourceState get_tracked_state(BarrierBatch* batch, VkImage image, u32 mip_level,
+                                       ResourceState fallback_state)
+{
+    for (const ImageSubresourceState& subresource : batch->image_states)
+    {
+        if (subresource.image == image && subresource.mip_level == mip_level)
+            return subresource.state;
+    }
 
-    VkMemoryBarrier memoryBarrier = {};
-    memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    return fallback_state;
+}
 
-    for (uint32_t i = 0; i < buffBarrierCount; ++i)
+static void set_tracked_state(BarrierBatch* batch, VkImage image, u32 mip_level,
+                              ResourceState state)
+{
+    for (ImageSubresourceState& subresource : batch->image_states)
     {
-        BufferBarrier* buffBarrier = &bufferBarriers[i];
-
-        if (buffBarrier->current_state == RESOURCE_STATE_UNORDERED_ACCESS &&
-            buffBarrier->new_state == RESOURCE_STATE_UNORDERED_ACCESS)
+        if (subresource.image == image && subresource.mip_level == mip_level)
         {
-            memoryBarrier.srcAccessMask |= VK_ACCESS_SHADER_WRITE_BIT;
-            memoryBarrier.dstAccessMask |= VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_SHADER_READ_BIT;
-        }
-        else
-        {
-            memoryBarrier.srcAccessMask |=
-                resource_state_to_access_flags(buffBarrier->current_state);
-            memoryBarrier.dstAccessMask |= resource_state_to_access_flags(buffBarrier->new_state);
+            subresource.state = state;
+            return;
         }
+    }
+
+    batch->image_states.push_back({image, mip_level, state});
+}
 
-        srcAccessMask |= memoryBarrier.srcAccessMask;
-        dstAccessMask |= memoryBarrier.dstAccessMask;
+static void fill_access_masks(ResourceState current_state, ResourceState new_state,
+                              VkAccessFlags* src_access, VkAccessFlags* dst_access)
+{
+    if (current_state == RESOURCE_STATE_UNORDERED_ACCESS &&
+        new_state == RESOURCE_STATE_UNORDERED_ACCESS)
+    {
+        *src_access = VK_ACCESS_SHADER_WRITE_BIT;
+        *dst_access = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    }
+    else
+    {
+        *src_access = resource_state_to_access_flags(current_state);
+        *dst_access = resource_state_to_access_flags(new_state);
     }
+}
 
-    for (u32 i = 0; i < textureBarrierCount; ++i, ++imageMemoryBarrierCount)
+// a request that continues a pending transition of the same subresources folds into it
+static b8 merge_pending_image_barrier(BarrierBatch* batch, const VkImageMemoryBarrier2KHR* barrier)
+{
+    for (VkImageMemoryBarrier2KHR& pending : batch->image_barriers)
     {
-        TextureBarrier* textureBarrier = &textureBarriers[i];
-        Texture* texture = textureBarrier->texture;
+        if (pending.image != barrier->image ||
+            pending.subresourceRange.baseMipLevel != barrier->subresourceRange.baseMipLevel ||
+            pending.subresourceRange.levelCount != barrier->subresourceRange.levelCount ||
+            pending.newLayout != barrier->oldLayout ||
+            pending.srcQueueFamilyIndex != VK_QUEUE_FAMILY_IGNORED ||
+            barrier->srcQueueFamilyIndex != VK_QUEUE_FAMILY_IGNORED)
+            continue;
+
+        pending.newLayout = barrier->newLayout;
+        pending.dstAccessMask = barrier->dstAccessMask;
+        pending.dstStageMask = barrier->dstStageMask;
+        return true;
+    }
+
+    return false;
+}
+
+static void enqueue_image_barrier(Command* command, VkImage image, VkImageAspectFlags aspect_mask,
+                                  u32 mip_levels, ResourceState current_state,
+                                  ResourceState new_state, ResourceState alias_state,
+                                  u8 subresource_barrier, u8 mip_level, u8 acquire, u8 release,
+                                  u32 queue_family_index)
+{
+    BarrierBatch* batch = command->barrier_batch;
 
-        VkImageMemoryBarrier* imageMemoryBarrier = &imageMemoryBarriers[imageMemoryBarrierCount];
-        if (imageMemoryBarrier)
+    const b8 ownership_transfer =
+        (acquire || release) && queue_family_index != command->queue_family_index;
+    const u32 base_mip = subresource_barrier ? mip_level : 0;
+    const u32 end_mip = subresource_barrier ? mip_level + 1 : std::max(mip_levels, 1u);
+
+    // mips left in different states by earlier requests split into one barrier per run
+    u32 mip = base_mip;
+    while (mip < end_mip)
+    {
+        const ResourceState old_state = get_tracked_state(batch, image, mip, current_state);
+
+        u32 run_end = mip + 1;
+        while (run_end < end_mip &&
+               get_tracked_state(batch, image, run_end, current_state) == old_state)
+            ++run_end;
+
+        for (u32 i = mip; i < run_end; ++i)
+            set_tracked_state(batch, image, i, new_state);
+
+        // read to the same read state orders nothing
+        if (!ownership_transfer && old_state == new_state && !is_resource_state_write(new_state))
         {
-            imageMemoryBarrier->sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            ++batch->stats.elided;
+            mip = run_end;
+            continue;
+        }
 
-            if (textureBarrier->current_state == RESOURCE_STATE_UNORDERED_ACCESS &&
-                textureBarrier->new_state == RESOURCE_STATE_UNORDERED_ACCESS)
+        VkAccessFlags src_access = 0;
+        VkAccessFlags dst_access = 0;
+        fill_access_masks(old_state, new_state, &src_access, &dst_access);
+
+        // contents are discarded but the memory may still be in use by the resource it was
+        // aliased with, wait on its accesses
+        if (old_state == RESOURCE_STATE_UNDEFINED)
+            src_access = resource_state_to_access_flags(alias_state);
+
+        VkImageMemoryBarrier2KHR barrier{VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2_KHR};
+        barrier.srcAccessMask = src_access;
+        barrier.dstAccessMask = dst_access;
+        barrier.oldLayout = resource_state_to_vulkan_image_layout(old_state);
+        barrier.newLayout = resource_state_to_vulkan_image_layout(new_state);
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = image;
+
+        if (ownership_transfer)
+        {
+            if (release)
             {
-                imageMemoryBarrier->srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
-                imageMemoryBarrier->dstAccessMask =
-                    VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+                barrier.dstAccessMask = 0;
+                barrier.srcQueueFamilyIndex = command->queue_family_index;
+                barrier.dstQueueFamilyIndex = queue_family_index;
             }
             else
             {
-                imageMemoryBarrier->srcAccessMask =
-                    resource_state_to_access_flags(textureBarrier->current_state);
-                imageMemoryBarrier->dstAccessMask =
-                    resource_state_to_access_flags(textureBarrier->new_state);
+                barrier.srcAccessMask = 0;
+                barrier.srcQueueFamilyIndex = queue_family_index;
+                barrier.dstQueueFamilyIndex = command->queue_family_index;
             }
+        }
 
-            imageMemoryBarrier->oldLayout =
-                resource_state_to_vulkan_image_layout(textureBarrier->current_state);
-            imageMemoryBarrier->newLayout =
-                resource_state_to_vulkan_image_layout(textureBarrier->new_state);
-            imageMemoryBarrier->srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-            imageMemoryBarrier->dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-            imageMemoryBarrier->image = texture->image;
+        barrier.srcStageMask = get_pipeline_stage_flags(barrier.srcAccessMask, command->type);
+        barrier.dstStageMask = get_pipeline_stage_flags(barrier.dstAccessMask, command->type);
 
-            imageMemoryBarrier->subresourceRange.aspectMask = texture->aspect_mask;
+        // acquire has no source access on this queue, its first scope has to chain with the
+        // semaphore wait of the consuming stages instead
+        if (ownership_transfer && acquire)
+            barrier.srcStageMask |= barrier.dstStageMask;
 
-            imageMemoryBarrier->subresourceRange.baseMipLevel = 0;
-            imageMemoryBarrier->subresourceRange.levelCount = 1;
-            imageMemoryBarrier->subresourceRange.baseArrayLayer = 0;
-            imageMemoryBarrier->subresourceRange.layerCount = 1;
+        barrier.subresourceRange.aspectMask = aspect_mask;
+        barrier.subresourceRange.baseMipLevel = mip;
+        barrier.subresourceRange.levelCount = run_end - mip;
+        barrier.subresourceRange.baseArrayLayer = 0;
+        barrier.subresourceRange.layerCount = 1;
 
-            srcAccessMask |= imageMemoryBarrier->srcAccessMask;
-            dstAccessMask |= imageMemoryBarrier->dstAccessMask;
-        }
+        if (merge_pending_image_barrier(batch, &barrier))
+            ++batch->stats.elided;
+        else
+            batch->image_barriers.push_back(barrier);
+
+        mip = run_end;
     }
+}
 
-    for (u32 i = 0; i < renderTargetBarrierCount; ++i, ++imageMemoryBarrierCount)
-    {
-        RenderTargetBarrier* pRenderTargetBarrier = &pRenderTargetBarriers[i];
-        Texture* texture = pRenderTargetBarrier->render_target->texture;
+static void enqueue_buffer_barrier(Command* command, BufferBarrier* buffBarrier)
+{
+    BarrierBatch* batch = command->barrier_batch;
 
-        VkImageMemoryBarrier* imageMemoryBarrier = &imageMemoryBarriers[imageMemoryBarrierCount];
+    // ownership transfer needs a buffer barrier, families that alias fall through to a
+    // plain memory barrier
+    if ((buffBarrier->acquire || buffBarrier->release) &&
+        buffBarrier->queue_family_index != command->queue_family_index)
+    {
+        VkBufferMemoryBarrier2KHR barrier{VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2_KHR};
+        barrier.buffer = buffBarrier->buffer->handle;
+        barrier.offset = 0;
+        barrier.size = VK_WHOLE_SIZE;
 
-        if (imageMemoryBarrier)
+        if (buffBarrier->release)
         {
-            imageMemoryBarrier->sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            barrier.srcAccessMask = resource_state_to_access_flags(buffBarrier->current_state);
+            barrier.dstAccessMask = 0;
+            barrier.srcQueueFamilyIndex = command->queue_family_index;
+            barrier.dstQueueFamilyIndex = buffBarrier->queue_family_index;
+        }
+        else
+        {
+            barrier.srcAccessMask = 0;
+            barrier.dstAccessMask = resource_state_to_access_flags(buffBarrier->new_state);
+            barrier.srcQueueFamilyIndex = buffBarrier->queue_family_index;
+            barrier.dstQueueFamilyIndex = command->queue_family_index;
+        }
 
-            if (pRenderTargetBarrier->current_state == RESOURCE_STATE_UNORDERED_ACCESS &&
-                pRenderTargetBarrier->new_state == RESOURCE_STATE_UNORDERED_ACCESS)
-            {
-                imageMemoryBarrier->srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
-                imageMemoryBarrier->dstAccessMask =
-                    VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
-            }
-            else
-            {
-                imageMemoryBarrier->srcAccessMask =
-                    resource_state_to_access_flags(pRenderTargetBarrier->current_state);
-                imageMemoryBarrier->dstAccessMask =
-                    resource_state_to_access_flags(pRenderTargetBarrier->new_state);
-            }
+        barrier.srcStageMask = get_pipeline_stage_flags(barrier.srcAccessMask, command->type);
+        barrier.dstStageMask = get_pipeline_stage_flags(barrier.dstAccessMask, command->type);
 
-            imageMemoryBarrier->oldLayout =
-                resource_state_to_vulkan_image_layout(pRenderTargetBarrier->current_state);
-            imageMemoryBarrier->newLayout =
-                resource_state_to_vulkan_image_layout(pRenderTargetBarrier->new_state);
-            imageMemoryBarrier->srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-            imageMemoryBarrier->dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-            imageMemoryBarrier->image = texture->image;
-
-            imageMemoryBarrier->subresourceRange.aspectMask = texture->aspect_mask;
-            imageMemoryBarrier->subresourceRange.baseMipLevel = 0;
-            imageMemoryBarrier->subresourceRange.levelCount = 1;
-            imageMemoryBarrier->subresourceRange.baseArrayLayer = 0;
-            imageMemoryBarrier->subresourceRange.layerCount = 1;
-
-            srcAccessMask |= imageMemoryBarrier->srcAccessMask;
-            dstAccessMask |= imageMemoryBarrier->dstAccessMask;
-        }
+        if (buffBarrier->acquire)
+            barrier.srcStageMask |= barrier.dstStageMask;
+
+        batch->buffer_barriers.push_back(barrier);
+        return;
     }
 
-    assert(imageMemoryBarrierCount == textureBarrierCount + renderTargetBarrierCount);
+    if (buffBarrier->current_state == buffBarrier->new_state &&
+        !is_resource_state_write(buffBarrier->new_state))
+    {
+        ++batch->stats.elided;
+        return;
+    }
 
-    VkPipelineStageFlags srcStageMask = get_pipeline_stage_flags(srcAccessMask, command->type);
-    VkPipelineStageFlags dstStageMask = get_pipeline_stage_flags(dstAccessMask, command->type);
+    VkAccessFlags src_access = 0;
+    VkAccessFlags dst_access = 0;
+    fill_access_masks(buffBarrier->current_state, buffBarrier->new_state, &src_access,
+                      &dst_access);
+
+    // every plain buffer barrier of the batch shares one memory barrier
+    batch->has_memory_barrier = true;
+    batch->memory_barrier.srcAccessMask |= src_access;
+    batch->memory_barrier.dstAccessMask |= dst_access;
+    batch->memory_barrier.srcStageMask |= get_pipeline_stage_flags(src_access, command->type);
+    batch->memory_barrier.dstStageMask |= get_pipeline_stage_flags(dst_access, command->type);
+}
 
-    if (srcAccessMask != 0 || dstAccessMask != 0)
+void vulkan_command_resource_barrier(Command* command, BufferBarrier* bufferBarriers,
+                                     u32 buffBarrierCount, TextureBarrier* textureBarriers,
+                                     u32 textureBarrierCount,
+                                     RenderTargetBarrier* pRenderTargetBarriers,
+                                     u32 renderTargetBarrierCount)
+{
+    assert(command);
+    assert(command->barrier_batch);
+    assert(!command->is_rendering && "barriers can't be recorded inside rendering");
+
+    for (u32 i = 0; i < buffBarrierCount; ++i)
     {
-        vkCmdPipelineBarrier(command->buffer, srcStageMask, dstStageMask, 0, 1, &memoryBarrier, 0,
-                             nullptr, imageMemoryBarrierCount, imageMemoryBarriers);
+        enqueue_buffer_barrier(command, &bufferBarriers[i]);
+    }
+
+    for (u32 i = 0; i < textureBarrierCount; ++i)
+    {
+        TextureBarrier* textureBarrier = &textureBarriers[i];
+        Texture* texture = textureBarrier->texture;
+
+        enqueue_image_barrier(command, texture->image, texture->aspect_mask, texture->mip_levels,
+                              textureBarrier->current_state, textureBarrier->new_state,
+                              RESOURCE_STATE_UNDEFINED, textureBarrier->subresource_barrier,
+                              textureBarrier->mip_level, textureBarrier->acquire,
+                              textureBarrier->release, textureBarrier->queue_family_index);
     }
 
-    if (imageMemoryBarriers != NULL)
+    for (u32 i = 0; i < renderTargetBarrierCount; ++i)
     {
-        free(imageMemoryBarriers);
-        imageMemoryBarriers = NULL;
+        RenderTargetBarrier* pRenderTargetBarrier = &pRenderTargetBarriers[i];
+        RenderTarget* render_target = pRenderTargetBarrier->render_target;
+
+        enqueue_image_barrier(command, render_target->image, render_target->aspect_mask,
+                              render_target->mip_levels, pRenderTargetBarrier->current_state,
+                              pRenderTargetBarrier->new_state, pRenderTargetBarrier->alias_state,
+                              pRenderTargetBarrier->subresource_barrier,
+                              pRenderTargetBarrier->mip_level, false, false,
+                              VK_QUEUE_FAMILY_IGNORED);
     }
 }
 
+void vulkan_command_flush_barriers(Command* command)
+{
+    assert(command);
+
+    BarrierBatch* batch = command->barrier_batch;
+    if (batch == NULL ||
+        (batch->image_barriers.empty() && batch->buffer_barriers.empty() &&
+         !batch->has_memory_barrier))
+        return;
+
+    VkDependencyInfoKHR dependency_info{VK_STRUCTURE_TYPE_DEPENDENCY_INFO_KHR};
+    dependency_info.memoryBarrierCount = batch->has_memory_barrier ? 1 : 0;
+    dependency_info.pMemoryBarriers = &batch->memory_barrier;
+    dependency_info.bufferMemoryBarrierCount = (u32)batch->buffer_barriers.size();
+    dependency_info.pBufferMemoryBarriers = batch->buffer_barriers.data();
+    dependency_info.imageMemoryBarrierCount = (u32)batch->image_barriers.size();
+    dependency_info.pImageMemoryBarriers = batch->image_barriers.data();
+
+    vkCmdPipelineBarrier2KHR(command->buffer, &dependency_info);
+
+    batch->stats.issued += dependency_info.memoryBarrierCount +
+                           dependency_info.bufferMemoryBarrierCount +
+                           dependency_info.imageMemoryBarrierCount;
+    ++batch->stats.batches;
+
+    batch->image_barriers.clear();
+    batch->buffer_barriers.clear();
+    batch->memory_barrier = {VK_STRUCTURE_TYPE_MEMORY_BARRIER_2_KHR};
+    batch->has_memory_barrier = false;
+}
+
+BarrierStats vulkan_command_get_barrier_stats(const Command* command)
+{
+    assert(command && command->barrier_batch);
+
+    return command->barrier_batch->stats;
+}
+
 void vulkan_command_buffer_rendering(Command* command, RenderDesc* desc)
 {
     assert(command);
@@ -364,6 +613,9 @@ void vulkan_command_buffer_rendering(Command* command, RenderDesc* desc)
     assert(desc);
     assert(desc->render_target_count <= MAX_COLOR_ATTACHMENT);
 
+    // the last chance before draws, barriers are not allowed inside rendering
+    vulkan_command_flush_barriers(command);
+
     u32 render_target_idx = 0;
     VkRenderingAttachmentInfoKHR color_attachment_info[MAX_COLOR_ATTACHMENT] = {};
     VkRenderingAttachmentInfoKHR depth_attachment = {};
@@ -398,7 +650,7 @@ void vulkan_command_buffer_rendering(Command* command, RenderDesc* desc)
                                            : VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL;
         depth_attachment.loadOp = render_target_op.load_op;
         depth_attachment.storeOp = render_target_op.store_op;
-        depth_attachment.clearValue = desc->clear_color;
+        depth_attachment.clearValue = desc->clear_depth;
     }
 
     if (stencil_rt != NULL)
@@ -411,11 +663,13 @@ void vulkan_command_buffer_rendering(Command* command, RenderDesc* desc)
         stencil_attachment.imageLayout = VK_IMAGE_LAYOUT_STENCIL_ATTACHMENT_OPTIMAL;
         stencil_attachment.loadOp = render_target_op.load_op;
         stencil_attachment.storeOp = render_target_op.store_op;
-        stencil_attachment.clearValue = desc->clear_color;
+        stencil_attachment.clearValue = desc->clear_stencil;
     }
 
     VkRenderingInfoKHR rendering_info = {};
     rendering_info.sType = VK_STRUCTURE_TYPE_RENDERING_INFO_KHR;
+    rendering_info.flags =
+        desc->secondary_contents ? VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT_KHR : 0;
     rendering_info.renderArea = desc->render_area;
     rendering_info.layerCount = 1;  // TODO
     rendering_info.colorAttachmentCount = desc->render_target_count;
@@ -428,4 +682,39 @@ void vulkan_command_buffer_rendering(Command* command, RenderDesc* desc)
         vkCmdBeginRenderingKHR(command->buffer, &rendering_info);
         command->is_rendering = true;
     }
-}
\ No newline at end of file
+}
+
+void vulkan_command_execute_secondaries(Command* command, u32 count,
+                                        const VkCommandBuffer* buffers)
+{
+    assert(command);
+    assert(command->is_rendering);
+
+    if (count == 0)
+        return;
+
+    vkCmdExecuteCommands(command->buffer, count, buffers);
+}
+
+void vulkan_command_dispatch(Command* command, u32 group_count_x, u32 group_count_y,
+                             u32 group_count_z)
+{
+    assert(command);
+    // dispatch is not allowed inside of a dynamic rendering scope
+    assert(!command->is_rendering);
+
+    vulkan_command_flush_barriers(command);
+    vkCmdDispatch(command->buffer, group_count_x, group_count_y, group_count_z);
+}
+
+void vulkan_command_dispatch_indirect(Command* command, Buffer* buffer, u64 offset)
+{
+    assert(command);
+    assert(buffer);
+    assert(!command->is_rendering);
+
+    // buffer holds a VkDispatchIndirectCommand at offset,
+    // transition it with RESOURCE_STATE_INDIRECT_ARGUMENT first
+    vulkan_command_flush_barriers(command);
+    vkCmdDispatchIndirect(command->buffer, buffer->handle, offset);
+}
@@ -3,11 +3,23 @@
 
 #include "vulkan_types.inl"
 
+u32 get_queue_family_index(DeviceContext* pDevice, QueueType queueType);
+VkPipelineStageFlags get_pipeline_stage_flags(VkAccessFlags accessFlags, QueueType queueType);
+VkAccessFlags resource_state_to_access_flags(ResourceState state);
+b8 is_resource_state_write(ResourceState state);
+
 void vulkan_command_pool_create(RenderContext* context, Command* command, QueueType queueType);
 void vulkan_command_pool_destroy(RenderContext* context, Command* command);
 
 void vulkan_command_buffer_allocate(RenderContext* context, Command* command, b8 is_primary);
 void vulkan_command_buffer_begin(Command* command, VkCommandBufferUsageFlags buffer_usage);
+// secondary that continues the rendering scope desc describes, only the attachment formats
+// are inherited. barriers and rendering calls are not allowed in it.
+// pipeline_statistics may be counted by a query of the primary while it executes, 0 unless
+// pipelineStatisticsQuery and inheritedQueries are enabled
+void vulkan_command_buffer_begin_secondary(Command* command, const RenderDesc* desc,
+                                           VkCommandBufferUsageFlags buffer_usage,
+                                           VkQueryPipelineStatisticFlags pipeline_statistics);
 void vulkan_command_buffer_end(Command* command);
 void vulkan_command_pool_reset(Command* command);
 
@@ -16,7 +28,19 @@ void vulkan_command_resource_barrier(Command* command, BufferBarrier* bufferBarr
                                      u32 textureBarrierCount,
                                      RenderTargetBarrier* pRenderTargetBarriers,
                                      u32 renderTargetBarrierCount);
+// record the pending barriers as one vkCmdPipelineBarrier2KHR. rendering, dispatch and end
+// flush on their own, raw vkCmd work that depends on pending barriers has to flush first
+void vulkan_command_flush_barriers(Command* command);
+// counted since the last begin
+BarrierStats vulkan_command_get_barrier_stats(const Command* command);
 
 void vulkan_command_buffer_rendering(Command* command, RenderDesc* desc);
+// only inside a rendering scope begun with secondary_contents
+void vulkan_command_execute_secondaries(Command* command, u32 count,
+                                        const VkCommandBuffer* buffers);
+
+void vulkan_command_dispatch(Command* command, u32 group_count_x, u32 group_count_y,
+                             u32 group_count_z);
+void vulkan_command_dispatch_indirect(Command* command, Buffer* buffer, u64 offset);
 
 #endif  // !VULKAN_COMMAND_BUFFER_H
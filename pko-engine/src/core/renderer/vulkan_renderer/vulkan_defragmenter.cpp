@@ -0,0 +1,388 @@
+#include "vulkan_defragmenter.h"
+
+#include "core/profiler.h"
+#include "vulkan_buffer.h"
+#include "vulkan_command_buffer.h"
+#include "vulkan_image.h"
+#include "vulkan_queue.h"
+
+#include <algorithm>
+#include <iostream>
+#include <unordered_map>
+
+void vulkan_defragmenter_begin(RenderContext* context, Defragmenter* defragmenter,
+                               u64 max_bytes_per_pass, u32 max_allocations_per_pass)
+{
+    assert(context);
+    assert(defragmenter);
+
+    if (vulkan_defragmenter_is_running(defragmenter))
+        return;
+
+    defragmenter->max_bytes_per_pass = max_bytes_per_pass;
+    defragmenter->max_allocations_per_pass = max_allocations_per_pass;
+    defragmenter->pass_open = false;
+    defragmenter->moves.clear();
+
+    VmaDefragmentationInfo info{};
+    info.flags = VMA_DEFRAGMENTATION_FLAG_ALGORITHM_BALANCED_BIT;
+    info.maxBytesPerPass = max_bytes_per_pass;
+    info.maxAllocationsPerPass = max_allocations_per_pass;
+
+    VK_CHECK(vmaBeginDefragmentation(context->vma_allocator, &info, &defragmenter->vma_context));
+}
+
+static void finish(RenderContext* context, Defragmenter* defragmenter)
+{
+    vmaEndDefragmentation(context->vma_allocator, defragmenter->vma_context,
+                          &defragmenter->stats);
+    defragmenter->vma_context = NULL;
+
+    std::cout << "defragmentation: moved " << defragmenter->stats.allocationsMoved
+              << " allocations, " << defragmenter->stats.bytesMoved << " bytes, freed "
+              << defragmenter->stats.deviceMemoryBlocksFreed << " blocks" << std::endl;
+}
+
+// the copies retired, VMA takes the old memory back. true when the run is done
+static b8 end_pass(RenderContext* context, Defragmenter* defragmenter)
+{
+    const VkDevice device = context->device_context.handle;
+
+    for (const DefragmentationMove& move : defragmenter->moves)
+    {
+        for (u32 i = 0; i < move.old_view_count; ++i)
+            vkDestroyImageView(device, move.old_views[i], context->allocator);
+
+        if (move.is_texture)
+            vkDestroyImage(device, move.old_image, context->allocator);
+        else
+            vkDestroyBuffer(device, move.old_buffer, context->allocator);
+    }
+    defragmenter->moves.clear();
+
+    defragmenter->pass_open = false;
+    return vmaEndDefragmentationPass(context->vma_allocator, defragmenter->vma_context,
+                                     &defragmenter->pass) == VK_SUCCESS;
+}
+
+static b8 is_movable(RenderContext* context, VmaAllocation allocation)
+{
+    VmaAllocationInfo info;
+    vmaGetAllocationInfo(context->vma_allocator, allocation, &info);
+
+    const MemoryCategory category = (MemoryCategory)(uintptr_t)info.pUserData;
+    if (category == MEMORY_CATEGORY_RENDER_TARGET || category == MEMORY_CATEGORY_STAGING ||
+        category == MEMORY_CATEGORY_UNIFORM || category == MEMORY_CATEGORY_INDIRECT)
+        return false;
+
+    // the CPU may hold pointers into it
+    VkMemoryPropertyFlags memory_flags = 0;
+    vmaGetAllocationMemoryProperties(context->vma_allocator, allocation, &memory_flags);
+
+    return (memory_flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) == 0;
+}
+
+static void move_buffer(RenderContext* context, BufferHandle handle,
+                        const VmaDefragmentationMove* vma_move, DefragmentationMove* out_move,
+                        VkBufferCopy* out_region, VkBuffer* out_new_buffer)
+{
+    Buffer* buffer = vulkan_buffer_get(context, handle);
+    const BufferCold* buffer_cold = context->buffer_pool->get_cold(handle.id);
+
+    VkBufferCreateInfo buffer_create_info{VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO};
+    buffer_create_info.size = buffer_cold->size;
+    buffer_create_info.usage = buffer_cold->usage;
+
+    VkBuffer new_buffer;
+    VK_CHECK(vkCreateBuffer(context->device_context.handle, &buffer_create_info,
+                            context->allocator, &new_buffer));
+    VK_CHECK(vkBindBufferMemory(context->device_context.handle, new_buffer, vma_move->dstMemory,
+                                vma_move->dstOffset));
+
+    *out_move = {};
+    out_move->handle = handle.id;
+    out_move->old_buffer = buffer->handle;
+
+    *out_region = {0, 0, buffer_cold->size};
+    *out_new_buffer = new_buffer;
+
+    buffer->handle = new_buffer;
+}
+
+static void move_texture(RenderContext* context, TextureHandle handle,
+                         const VmaDefragmentationMove* vma_move, DefragmentationMove* out_move)
+{
+    Texture* texture = vulkan_texture_get(context, handle);
+    const TextureCold* texture_cold = context->texture_pool->get_cold(handle.id);
+
+    VkImage new_image;
+    VK_CHECK(vkCreateImage(context->device_context.handle, &texture_cold->create_info,
+                           context->allocator, &new_image));
+    VK_CHECK(vkBindImageMemory(context->device_context.handle, new_image, vma_move->dstMemory,
+                               vma_move->dstOffset));
+
+    *out_move = {};
+    out_move->handle = handle.id;
+    out_move->is_texture = true;
+    out_move->old_image = texture->image;
+
+    texture->image = new_image;
+    vulkan_texture_recreate_views(context, handle, out_move->old_views,
+                                  &out_move->old_view_count);
+}
+
+// which state a buffer rests in is not tracked, the copies order against every buffer access
+static const ResourceState BUFFER_ANY_STATE = (ResourceState)(
+    RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER | RESOURCE_STATE_INDEX_BUFFER |
+    RESOURCE_STATE_UNORDERED_ACCESS | RESOURCE_STATE_SHADER_RESOURCE |
+    RESOURCE_STATE_INDIRECT_ARGUMENT | RESOURCE_STATE_COPY_DEST | RESOURCE_STATE_COPY_SOURCE);
+
+static void record_copies(RenderContext* context, Defragmenter* defragmenter, Command* command,
+                          const std::vector<VkBuffer>& new_buffers,
+                          const std::vector<VkBufferCopy>& buffer_regions)
+{
+    // the barriers only read the handles, the moved resources already point at the new ones
+    std::vector<Buffer> buffers;
+    std::vector<Texture> textures;
+    std::vector<const DefragmentationMove*> image_moves;
+
+    u32 buffer_index = 0;
+    for (const DefragmentationMove& move : defragmenter->moves)
+    {
+        if (!move.is_texture)
+        {
+            Buffer old_buffer{};
+            old_buffer.handle = move.old_buffer;
+            Buffer new_buffer{};
+            new_buffer.handle = new_buffers[buffer_index++];
+            buffers.push_back(old_buffer);
+            buffers.push_back(new_buffer);
+            continue;
+        }
+
+        const TextureHandle handle{move.handle};
+        const TextureCold* texture_cold = context->texture_pool->get_cold(handle.id);
+
+        // nothing was ever written, the new image starts undefined as well
+        if (texture_cold->resting_state == RESOURCE_STATE_UNDEFINED)
+            continue;
+
+        Texture old_texture = *vulkan_texture_get(context, handle);
+        old_texture.image = move.old_image;
+        textures.push_back(old_texture);
+        image_moves.push_back(&move);
+    }
+
+    std::vector<BufferBarrier> buffer_barriers;
+    for (u32 i = 0; i < buffers.size(); i += 2)
+    {
+        buffer_barriers.push_back({&buffers[i], BUFFER_ANY_STATE, RESOURCE_STATE_COPY_SOURCE});
+        buffer_barriers.push_back(
+            {&buffers[i + 1], RESOURCE_STATE_UNDEFINED, RESOURCE_STATE_COPY_DEST});
+    }
+
+    std::vector<TextureBarrier> texture_barriers;
+    for (u32 i = 0; i < image_moves.size(); ++i)
+    {
+        const TextureHandle handle{image_moves[i]->handle};
+        const TextureCold* texture_cold = context->texture_pool->get_cold(handle.id);
+
+        TextureBarrier old_barrier{};
+        old_barrier.texture = &textures[i];
+        old_barrier.current_state = texture_cold->resting_state;
+        old_barrier.new_state = RESOURCE_STATE_COPY_SOURCE;
+        texture_barriers.push_back(old_barrier);
+
+        TextureBarrier new_barrier{};
+        new_barrier.texture = vulkan_texture_get(context, handle);
+        new_barrier.current_state = RESOURCE_STATE_UNDEFINED;
+        new_barrier.new_state = RESOURCE_STATE_COPY_DEST;
+        texture_barriers.push_back(new_barrier);
+    }
+
+    vulkan_command_resource_barrier(command, buffer_barriers.data(), (u32)buffer_barriers.size(),
+                                    texture_barriers.data(), (u32)texture_barriers.size(), NULL,
+                                    0);
+    vulkan_command_flush_barriers(command);
+
+    buffer_index = 0;
+    for (const DefragmentationMove& move : defragmenter->moves)
+    {
+        if (move.is_texture)
+            continue;
+
+        vkCmdCopyBuffer(command->buffer, move.old_buffer, new_buffers[buffer_index], 1,
+                        &buffer_regions[buffer_index]);
+        ++buffer_index;
+    }
+
+    texture_barriers.clear();
+    for (const DefragmentationMove* move : image_moves)
+    {
+        const TextureHandle handle{move->handle};
+        Texture* texture = vulkan_texture_get(context, handle);
+        const TextureCold* texture_cold = context->texture_pool->get_cold(handle.id);
+
+        VkImageCopy regions[MAX_MIP_LEVELS];
+        for (u32 mip = 0; mip < texture->mip_levels; ++mip)
+        {
+            VkImageCopy& region = regions[mip];
+            region = {};
+            region.srcSubresource = {texture->aspect_mask, mip, 0, 1};
+            region.dstSubresource = region.srcSubresource;
+            region.extent.width = std::max(texture_cold->create_info.extent.width >> mip, 1u);
+            region.extent.height = std::max(texture_cold->create_info.extent.height >> mip, 1u);
+            region.extent.depth = 1;
+        }
+
+        vkCmdCopyImage(command->buffer, move->old_image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                       texture->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, texture->mip_levels,
+                       regions);
+
+        TextureBarrier barrier{};
+        barrier.texture = texture;
+        barrier.current_state = RESOURCE_STATE_COPY_DEST;
+        barrier.new_state = texture_cold->resting_state;
+        texture_barriers.push_back(barrier);
+    }
+
+    buffer_barriers.clear();
+    for (u32 i = 1; i < buffers.size(); i += 2)
+        buffer_barriers.push_back({&buffers[i], RESOURCE_STATE_COPY_DEST, BUFFER_ANY_STATE});
+
+    vulkan_command_resource_barrier(command, buffer_barriers.data(), (u32)buffer_barriers.size(),
+                                    texture_barriers.data(), (u32)texture_barriers.size(), NULL,
+                                    0);
+    vulkan_command_flush_barriers(command);
+}
+
+// the allocations VMA picked are matched to their pool records, anything else stays put
+static void begin_pass(RenderContext* context, Defragmenter* defragmenter, Command* command)
+{
+    std::unordered_map<VmaAllocation, u32> buffers;
+    std::unordered_map<VmaAllocation, u32> textures;
+
+    BufferPool* buffer_pool = context->buffer_pool;
+    for (u32 i = 0; i < buffer_pool->size(); ++i)
+        buffers[buffer_pool->hot_data()[i].allocation] = buffer_pool->handle_at(i);
+
+    TexturePool* texture_pool = context->texture_pool;
+    for (u32 i = 0; i < texture_pool->size(); ++i)
+    {
+        // swapchain images and images placed in render graph memory have no allocation
+        const VmaAllocation allocation = texture_pool->cold_data()[i].allocation;
+        if (texture_pool->hot_data()[i].owns_image && allocation != VK_NULL_HANDLE)
+            textures[allocation] = texture_pool->handle_at(i);
+    }
+
+    std::vector<VkBuffer> new_buffers;
+    std::vector<VkBufferCopy> buffer_regions;
+
+    for (u32 i = 0; i < defragmenter->pass.moveCount; ++i)
+    {
+        VmaDefragmentationMove& vma_move = defragmenter->pass.pMoves[i];
+
+        if (!is_movable(context, vma_move.srcAllocation))
+        {
+            vma_move.operation = VMA_DEFRAGMENTATION_MOVE_OPERATION_IGNORE;
+            continue;
+        }
+
+        DefragmentationMove move;
+
+        auto buffer = buffers.find(vma_move.srcAllocation);
+        if (buffer != buffers.end())
+        {
+            VkBufferCopy region;
+            VkBuffer new_buffer;
+            move_buffer(context, BufferHandle{buffer->second}, &vma_move, &move, &region,
+                        &new_buffer);
+            new_buffers.push_back(new_buffer);
+            buffer_regions.push_back(region);
+            defragmenter->moves.push_back(move);
+            continue;
+        }
+
+        auto texture = textures.find(vma_move.srcAllocation);
+        if (texture != textures.end())
+        {
+            move_texture(context, TextureHandle{texture->second}, &vma_move, &move);
+            defragmenter->moves.push_back(move);
+            continue;
+        }
+
+        vma_move.operation = VMA_DEFRAGMENTATION_MOVE_OPERATION_IGNORE;
+    }
+
+    if (!defragmenter->moves.empty())
+        record_copies(context, defragmenter, command, new_buffers, buffer_regions);
+}
+
+b8 vulkan_defragmenter_update(RenderContext* context, Defragmenter* defragmenter,
+                              Command* command)
+{
+    PKO_PROFILE_FUNCTION();
+
+    assert(context);
+    assert(defragmenter);
+    assert(command && command->type == QUEUE_TYPE_GRAPHICS);
+
+    if (!vulkan_defragmenter_is_running(defragmenter))
+        return false;
+
+    if (defragmenter->pass_open)
+    {
+        const u64 completed_value =
+            vulkan_queue_timeline_poll(context, &context->queue_scheduler->graphics);
+        if (completed_value < defragmenter->pass_value)
+            return false;
+
+        if (end_pass(context, defragmenter))
+        {
+            finish(context, defragmenter);
+            return false;
+        }
+    }
+
+    // VK_SUCCESS : nothing left to move
+    if (vmaBeginDefragmentationPass(context->vma_allocator, defragmenter->vma_context,
+                                    &defragmenter->pass) == VK_SUCCESS)
+    {
+        finish(context, defragmenter);
+        return false;
+    }
+
+    begin_pass(context, defragmenter, command);
+
+    defragmenter->pass_open = true;
+    defragmenter->pass_value = context->queue_scheduler->frame_value;
+
+    // every move was declined, no copy to wait for
+    if (defragmenter->moves.empty())
+    {
+        if (end_pass(context, defragmenter))
+            finish(context, defragmenter);
+        return false;
+    }
+
+    ++defragmenter->generation;
+    return true;
+}
+
+void vulkan_defragmenter_end(RenderContext* context, Defragmenter* defragmenter)
+{
+    assert(context);
+    assert(defragmenter);
+
+    if (!vulkan_defragmenter_is_running(defragmenter))
+        return;
+
+    if (defragmenter->pass_open)
+    {
+        vulkan_queue_timeline_wait(context, &context->queue_scheduler->graphics,
+                                   defragmenter->pass_value);
+        end_pass(context, defragmenter);
+    }
+
+    finish(context, defragmenter);
+}
@@ -0,0 +1,34 @@
+#ifndef VULKAN_DEFRAGMENTER_H
+#define VULKAN_DEFRAGMENTER_H
+
+#include "vulkan_types.inl"
+
+/*
+     Defragmenter : incremental VMA defragmentation, at most one pass per frame and one pass
+     in flight. A pass creates the moved resources in their new place, records the copies at
+     the start of the frame's graphics command and swaps the new VkBuffer / VkImage into the
+     resource pools, so handles stay valid and later frames read the new copy. The old
+     resources and their memory are released once that frame retired.
+     Only device local buffers and textures owned by the pools move, host visible memory may
+     be mapped and render targets are dedicated or aliased by the render graph.
+     Resources must not be destroyed while a run is going, push them to the deletion queue.
+*/
+// starts a run unless one is going. a pass moves at most max_bytes_per_pass and
+// max_allocations_per_pass, 0 leaves that limit off
+void vulkan_defragmenter_begin(RenderContext* context, Defragmenter* defragmenter,
+                               u64 max_bytes_per_pass, u32 max_allocations_per_pass);
+
+// once a frame, on the graphics command after the ownership acquires and before anything
+// reads pooled resources. true when resources got new handles this frame
+b8 vulkan_defragmenter_update(RenderContext* context, Defragmenter* defragmenter,
+                              Command* command);
+
+// stops the run, blocks until the pass in flight retired
+void vulkan_defragmenter_end(RenderContext* context, Defragmenter* defragmenter);
+
+inline b8 vulkan_defragmenter_is_running(const Defragmenter* defragmenter)
+{
+    return defragmenter->vma_context != VK_NULL_HANDLE;
+}
+
+#endif  // !VULKAN_DEFRAGMENTER_H
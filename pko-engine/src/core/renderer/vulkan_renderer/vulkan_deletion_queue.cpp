@@ -0,0 +1,149 @@
+#include "vulkan_deletion_queue.h"
+
+#include "vulkan_buffer.h"
+#include "vulkan_command_buffer.h"
+#include "vulkan_image.h"
+#include "vulkan_memory_allocate.h"
+#include "vulkan_queue.h"
+
+static void destroy_entry(RenderContext* context, DeletionEntry* entry)
+{
+    switch (entry->type)
+    {
+        case DELETION_TYPE_BUFFER:
+            vulkan_buffer_destroy(context, entry->buffer);
+            break;
+        case DELETION_TYPE_TEXTURE:
+            vulkan_texture_destroy(context, entry->texture);
+            break;
+        case DELETION_TYPE_RENDER_TARGET:
+            vulkan_rendertarget_destroy(context, entry->render_target);
+            break;
+        case DELETION_TYPE_SWAPCHAIN:
+            vulkan_swapchain_destroy(context, entry->swapchain);
+            break;
+        case DELETION_TYPE_COMMAND:
+            vulkan_command_pool_destroy(context, &entry->command);
+            break;
+        case DELETION_TYPE_ALLOCATION:
+            vulkan_memory_untag(context, entry->allocation);
+            vmaFreeMemory(context->vma_allocator, entry->allocation);
+            break;
+    }
+}
+
+static void push_entry(RenderContext* context, DeletionEntry* entry, u64 value)
+{
+    assert(context->deletion_queue);
+
+    entry->value = value != 0 ? value : vulkan_deletion_queue_current_value(context);
+    context->deletion_queue->entries.push_back(*entry);
+}
+
+void vulkan_deletion_queue_create(RenderContext* context)
+{
+    assert(context);
+
+    context->deletion_queue = new DeletionQueue();
+}
+
+void vulkan_deletion_queue_destroy(RenderContext* context)
+{
+    assert(context);
+
+    if (context->deletion_queue == NULL)
+        return;
+
+    for (DeletionEntry& entry : context->deletion_queue->entries)
+        destroy_entry(context, &entry);
+
+    delete context->deletion_queue;
+    context->deletion_queue = NULL;
+}
+
+u64 vulkan_deletion_queue_current_value(RenderContext* context)
+{
+    assert(context->queue_scheduler);
+
+    return context->queue_scheduler->graphics.submitted_value + 1;
+}
+
+void vulkan_deletion_queue_push_buffer(RenderContext* context, BufferHandle buffer, u64 value)
+{
+    DeletionEntry entry{};
+    entry.type = DELETION_TYPE_BUFFER;
+    entry.buffer = buffer;
+
+    push_entry(context, &entry, value);
+}
+
+void vulkan_deletion_queue_push_texture(RenderContext* context, TextureHandle texture, u64 value)
+{
+    DeletionEntry entry{};
+    entry.type = DELETION_TYPE_TEXTURE;
+    entry.texture = texture;
+
+    push_entry(context, &entry, value);
+}
+
+void vulkan_deletion_queue_push_rendertarget(RenderContext* context,
+                                             RenderTargetHandle render_target, u64 value)
+{
+    DeletionEntry entry{};
+    entry.type = DELETION_TYPE_RENDER_TARGET;
+    entry.render_target = render_target;
+
+    push_entry(context, &entry, value);
+}
+
+void vulkan_deletion_queue_push_swapchain(RenderContext* context, VulkanSwapchain* swapchain,
+                                          u64 value)
+{
+    DeletionEntry entry{};
+    entry.type = DELETION_TYPE_SWAPCHAIN;
+    entry.swapchain = swapchain;
+
+    push_entry(context, &entry, value);
+}
+
+void vulkan_deletion_queue_push_allocation(RenderContext* context, VmaAllocation allocation,
+                                           u64 value)
+{
+    DeletionEntry entry{};
+    entry.type = DELETION_TYPE_ALLOCATION;
+    entry.allocation = allocation;
+
+    push_entry(context, &entry, value);
+}
+
+void vulkan_deletion_queue_push_command(RenderContext* context, Command* command, u64 value)
+{
+    DeletionEntry entry{};
+    entry.type = DELETION_TYPE_COMMAND;
+    entry.command = *command;
+
+    push_entry(context, &entry, value);
+}
+
+void vulkan_deletion_queue_retire(RenderContext* context)
+{
+    DeletionQueue* deletion_queue = context->deletion_queue;
+
+    if (deletion_queue->entries.empty())
+        return;
+
+    u64 completed_value =
+        vulkan_queue_timeline_poll(context, &context->queue_scheduler->graphics);
+
+    // keep push order for the survivors, entries may carry explicit values
+    u32 alive_count = 0;
+    for (DeletionEntry& entry : deletion_queue->entries)
+    {
+        if (entry.value <= completed_value)
+            destroy_entry(context, &entry);
+        else
+            deletion_queue->entries[alive_count++] = entry;
+    }
+
+    deletion_queue->entries.resize(alive_count);
+}
@@ -0,0 +1,35 @@
+#ifndef VULKAN_DELETION_QUEUE_H
+#define VULKAN_DELETION_QUEUE_H
+
+#include "vulkan_types.inl"
+
+/*
+     Deletion queue : destroys resources once the graphics timeline passed the last frame
+     that may use them, instead of idling the device.
+     Entries pushed without a value are keyed to the next frame to be submitted, which covers
+     everything already recorded, including uploads still pending on the transfer queue.
+*/
+void vulkan_deletion_queue_create(RenderContext* context);
+// destroys every entry, the device has to be idle
+void vulkan_deletion_queue_destroy(RenderContext* context);
+
+u64 vulkan_deletion_queue_current_value(RenderContext* context);
+
+void vulkan_deletion_queue_push_buffer(RenderContext* context, BufferHandle buffer,
+                                       u64 value = 0);
+void vulkan_deletion_queue_push_texture(RenderContext* context, TextureHandle texture,
+                                        u64 value = 0);
+void vulkan_deletion_queue_push_rendertarget(RenderContext* context,
+                                             RenderTargetHandle render_target, u64 value = 0);
+void vulkan_deletion_queue_push_swapchain(RenderContext* context, VulkanSwapchain* swapchain,
+                                          u64 value = 0);
+// memory that resources were placed in, push after them
+void vulkan_deletion_queue_push_allocation(RenderContext* context, VmaAllocation allocation,
+                                           u64 value = 0);
+// command pool of a one time submit on the graphics queue
+void vulkan_deletion_queue_push_command(RenderContext* context, Command* command, u64 value = 0);
+
+// destroy retired entries, never blocks
+void vulkan_deletion_queue_retire(RenderContext* context);
+
+#endif  // !VULKAN_DELETION_QUEUE_H
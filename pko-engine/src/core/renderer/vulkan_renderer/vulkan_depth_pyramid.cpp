@@ -0,0 +1,295 @@
+#include "vulkan_depth_pyramid.h"
+
+#include "core/profiler.h"
+#include "core/renderer/depth_pyramid.h"
+#include "vulkan_buffer.h"
+#include "vulkan_command_buffer.h"
+#include "vulkan_deletion_queue.h"
+#include "vulkan_image.h"
+#include "vulkan_pipeline.h"
+
+#include <cstring>
+#include <iostream>
+
+// size of the mips array of depth_pyramid.comp, two 64x64 tiles deep past mip 0
+static const u32 PYRAMID_SHADER_MIPS = 13;
+// mip 0 texels a group reduces per side
+static const u32 PYRAMID_TILE_SIZE = 64;
+
+// matches depth_pyramid.comp
+typedef struct PyramidConstants
+{
+    i32 depth_size[2];
+    u32 mip_count;
+    u32 group_count;
+} PyramidConstants;
+
+static void update_set(RenderContext* context, DepthPyramid* pyramid, u32 frame,
+                       VkImageView depth_view)
+{
+    if (pyramid->set_versions[frame] == pyramid->version &&
+        pyramid->set_depth_views[frame] == depth_view)
+        return;
+
+    const VkDescriptorSet set = pyramid->sets[frame];
+
+    VkDescriptorImageInfo depth_info{pyramid->sampler, depth_view,
+                                     VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+
+    // every element of the array is valid, levels past the chain repeat the last one and are
+    // never written
+    VkDescriptorImageInfo mip_infos[PYRAMID_SHADER_MIPS];
+    for (u32 mip = 0; mip < PYRAMID_SHADER_MIPS; ++mip)
+    {
+        const u32 level = mip < pyramid->mips ? mip : pyramid->mips - 1;
+        mip_infos[mip] = {VK_NULL_HANDLE, vulkan_texture_get_uav(context, pyramid->texture, level),
+                          VK_IMAGE_LAYOUT_GENERAL};
+    }
+
+    VkDescriptorBufferInfo counter_info{vulkan_buffer_get(context, pyramid->counter)->handle, 0,
+                                        sizeof(u32)};
+
+    VkWriteDescriptorSet writes[3];
+    for (VkWriteDescriptorSet& write : writes)
+    {
+        write = {VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
+        write.dstSet = set;
+    }
+    writes[0].dstBinding = 0;
+    writes[0].descriptorCount = 1;
+    writes[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    writes[0].pImageInfo = &depth_info;
+    writes[1].dstBinding = 1;
+    writes[1].descriptorCount = PYRAMID_SHADER_MIPS;
+    writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    writes[1].pImageInfo = mip_infos;
+    writes[2].dstBinding = 2;
+    writes[2].descriptorCount = 1;
+    writes[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    writes[2].pBufferInfo = &counter_info;
+
+    vkUpdateDescriptorSets(context->device_context.handle, 3, writes, 0, NULL);
+    pyramid->set_versions[frame] = pyramid->version;
+    pyramid->set_depth_views[frame] = depth_view;
+}
+
+b8 vulkan_depth_pyramid_create(RenderContext* context, DepthPyramid* pyramid)
+{
+    assert(context);
+    assert(pyramid);
+
+    // the shader declares the mips rg32f
+    if (!context->device_context.features.shaderStorageImageExtendedFormats)
+    {
+        std::cout << "depth pyramid needs shaderStorageImageExtendedFormats" << std::endl;
+        return false;
+    }
+
+    VkDescriptorSetLayoutBinding bindings[3] = {};
+    bindings[0].binding = 0;
+    bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    bindings[0].descriptorCount = 1;
+    bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    bindings[1].binding = 1;
+    bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    bindings[1].descriptorCount = PYRAMID_SHADER_MIPS;
+    bindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    bindings[2].binding = 2;
+    bindings[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[2].descriptorCount = 1;
+    bindings[2].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+    VkDescriptorSetLayoutCreateInfo set_layout_info{
+        VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO};
+    set_layout_info.bindingCount = 3;
+    set_layout_info.pBindings = bindings;
+    VK_CHECK(vkCreateDescriptorSetLayout(context->device_context.handle, &set_layout_info,
+                                         context->allocator, &pyramid->set_layout));
+
+    VkPushConstantRange range{VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PyramidConstants)};
+    if (!vulkan_compute_pipeline_create(context, "shader/depth_pyramid.comp.spv", 1, &range, 1,
+                                        &pyramid->set_layout, &pyramid->pipeline))
+    {
+        std::cout << "depth pyramid pipeline failed to create" << std::endl;
+        vulkan_depth_pyramid_destroy(context, pyramid);
+        return false;
+    }
+
+    VkSamplerCreateInfo sampler_info{VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO};
+    sampler_info.magFilter = VK_FILTER_NEAREST;
+    sampler_info.minFilter = VK_FILTER_NEAREST;
+    sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    sampler_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_info.maxLod = VK_LOD_CLAMP_NONE;
+    VK_CHECK(vkCreateSampler(context->device_context.handle, &sampler_info, context->allocator,
+                             &pyramid->sampler));
+
+    b8 allocated = true;
+    for (u32 frame = 0; frame < MAX_FRAME; ++frame)
+    {
+        allocated &=
+            context->pDynamicDescriptorAllocators[0].allocate(&pyramid->sets[frame],
+                                                              pyramid->set_layout);
+    }
+
+    if (!allocated)
+    {
+        std::cout << "depth pyramid descriptor sets failed to allocate" << std::endl;
+        vulkan_depth_pyramid_destroy(context, pyramid);
+        return false;
+    }
+
+    // never moved by the defragmenter, the sets keep the handle. zeroed before the first build
+    vulkan_buffer_create(context, sizeof(u32),
+                         VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                         VMA_MEMORY_USAGE_AUTO, 0, &pyramid->counter, MEMORY_CATEGORY_UNIFORM);
+
+    pyramid->version = 1;
+    return true;
+}
+
+void vulkan_depth_pyramid_destroy(RenderContext* context, DepthPyramid* pyramid)
+{
+    assert(context);
+    assert(pyramid);
+
+    vulkan_pipeline_destroy(context, &pyramid->pipeline);
+    vkDestroyDescriptorSetLayout(context->device_context.handle, pyramid->set_layout,
+                                 context->allocator);
+    vkDestroySampler(context->device_context.handle, pyramid->sampler, context->allocator);
+
+    if (pyramid->counter.id != 0)
+        vulkan_buffer_destroy(context, pyramid->counter);
+    if (pyramid->texture.id != 0)
+        vulkan_texture_destroy(context, pyramid->texture);
+
+    // the sets go back with the pools of the descriptor allocator
+    *pyramid = DepthPyramid{};
+}
+
+void vulkan_depth_pyramid_resize(RenderContext* context, DepthPyramid* pyramid, u32 depth_width,
+                                 u32 depth_height)
+{
+    assert(context);
+    assert(pyramid);
+    assert(depth_width <= PYRAMID_TILE_SIZE * PYRAMID_TILE_SIZE * 2 &&
+           depth_height <= PYRAMID_TILE_SIZE * PYRAMID_TILE_SIZE * 2 &&
+           "depth is too large for two passes of tiles");
+
+    if (pyramid->texture.id != 0 && pyramid->depth_width == depth_width &&
+        pyramid->depth_height == depth_height)
+        return;
+
+    // frames in flight still sample the old one
+    if (pyramid->texture.id != 0)
+        vulkan_deletion_queue_push_texture(context, pyramid->texture);
+
+    u32 width, height;
+    depth_pyramid_level_size(depth_width, depth_height, 0, &width, &height);
+    const u32 mips = depth_pyramid_level_count(
+        depth_width, depth_height,
+        MAX_MIP_LEVELS < PYRAMID_SHADER_MIPS ? MAX_MIP_LEVELS : PYRAMID_SHADER_MIPS);
+
+    TextureDesc desc{};
+    desc.width = width;
+    desc.height = height;
+    desc.mip_levels = mips;
+    desc.sample_count = 1;
+    desc.vulkan_format = VK_FORMAT_R32G32_SFLOAT;
+    desc.start_state = RESOURCE_STATE_SHADER_RESOURCE;
+    // storage includes sampled, a full chain view for readers and a view per mip to write
+    desc.type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    desc.category = MEMORY_CATEGORY_RENDER_TARGET;
+    vulkan_texture_create(context, &desc, &pyramid->texture);
+
+    pyramid->depth_width = depth_width;
+    pyramid->depth_height = depth_height;
+    pyramid->mips = mips;
+    pyramid->valid = false;
+    ++pyramid->version;
+}
+
+void vulkan_depth_pyramid_prepare(RenderContext* context, DepthPyramid* pyramid,
+                                  Command* command)
+{
+    assert(pyramid->texture.id != 0 && "resize before the first frame");
+
+    if (pyramid->valid)
+        return;
+
+    TextureBarrier barrier{vulkan_texture_get(context, pyramid->texture), RESOURCE_STATE_UNDEFINED,
+                           RESOURCE_STATE_SHADER_RESOURCE};
+    vulkan_command_resource_barrier(command, NULL, 0, &barrier, 1, NULL, 0);
+}
+
+void vulkan_depth_pyramid_build(RenderContext* context, DepthPyramid* pyramid, Command* command,
+                                u32 frame, RenderTarget* depth,
+                                const glm::mat4& view_projection)
+{
+    PKO_PROFILE_FUNCTION();
+
+    assert(command);
+    assert(depth);
+    assert(depth->width == pyramid->depth_width && depth->height == pyramid->depth_height);
+
+    update_set(context, pyramid, frame, depth->descriptor);
+
+    Texture* texture = vulkan_texture_get(context, pyramid->texture);
+    Buffer* counter = vulkan_buffer_get(context, pyramid->counter);
+
+    // the last group of every dispatch puts the counter back, it starts at zero once per
+    // queue family, the contents do not survive a move without an ownership transfer
+    if (!pyramid->valid || pyramid->counter_family_index != command->queue_family_index)
+    {
+        BufferBarrier clear_barrier{counter, RESOURCE_STATE_UNORDERED_ACCESS,
+                                    RESOURCE_STATE_COPY_DEST};
+        vulkan_command_resource_barrier(command, &clear_barrier, 1, NULL, 0, NULL, 0);
+        vulkan_command_flush_barriers(command);
+        vkCmdFillBuffer(command->buffer, counter->handle, 0, sizeof(u32), 0);
+
+        BufferBarrier counter_barrier{counter, RESOURCE_STATE_COPY_DEST,
+                                      RESOURCE_STATE_UNORDERED_ACCESS};
+        vulkan_command_resource_barrier(command, &counter_barrier, 1, NULL, 0, NULL, 0);
+    }
+    else
+    {
+        // the dispatch of the previous frame has to be done with it
+        BufferBarrier counter_barrier{counter, RESOURCE_STATE_UNORDERED_ACCESS,
+                                      RESOURCE_STATE_UNORDERED_ACCESS};
+        vulkan_command_resource_barrier(command, &counter_barrier, 1, NULL, 0, NULL, 0);
+    }
+
+    // every texel is rewritten. graphics still orders against the readers of the previous
+    // build, compute gets the pyramid back from graphics each frame and discards it
+    const ResourceState texture_state = pyramid->valid && command->type == QUEUE_TYPE_GRAPHICS
+                                            ? RESOURCE_STATE_SHADER_RESOURCE
+                                            : RESOURCE_STATE_UNDEFINED;
+    TextureBarrier write_barrier{texture, texture_state, RESOURCE_STATE_UNORDERED_ACCESS};
+    vulkan_command_resource_barrier(command, NULL, 0, &write_barrier, 1, NULL, 0);
+
+    const u32 groups_x = (texture->width + PYRAMID_TILE_SIZE - 1) / PYRAMID_TILE_SIZE;
+    const u32 groups_y = (texture->height + PYRAMID_TILE_SIZE - 1) / PYRAMID_TILE_SIZE;
+
+    PyramidConstants constants{};
+    constants.depth_size[0] = (i32)pyramid->depth_width;
+    constants.depth_size[1] = (i32)pyramid->depth_height;
+    constants.mip_count = pyramid->mips;
+    constants.group_count = groups_x * groups_y;
+
+    vulkan_pipeline_bind(command, VK_PIPELINE_BIND_POINT_COMPUTE, &pyramid->pipeline);
+    vkCmdBindDescriptorSets(command->buffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                            pyramid->pipeline.layout, 0, 1, &pyramid->sets[frame], 0, NULL);
+    vkCmdPushConstants(command->buffer, pyramid->pipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                       sizeof(constants), &constants);
+    vulkan_command_dispatch(command, groups_x, groups_y, 1);
+
+    TextureBarrier read_barrier{texture, RESOURCE_STATE_UNORDERED_ACCESS,
+                                RESOURCE_STATE_SHADER_RESOURCE};
+    vulkan_command_resource_barrier(command, NULL, 0, &read_barrier, 1, NULL, 0);
+
+    memcpy(pyramid->view_projection, &view_projection, sizeof(pyramid->view_projection));
+    pyramid->valid = true;
+    pyramid->counter_family_index = command->queue_family_index;
+}
@@ -0,0 +1,44 @@
+#ifndef VULKAN_DEPTH_PYRAMID_H
+#define VULKAN_DEPTH_PYRAMID_H
+
+#include "vulkan_types.inl"
+
+#include <glm/glm.hpp>
+
+/*
+     Depth pyramid : min and max of the scene depth over every level of a mip chain, r holds
+     the nearest and g the farthest depth a texel covers. Occlusion tests read the max, screen
+     space effects march the min.
+
+     Every level comes out of one dispatch, after the single pass downsampler: a group of 256
+     threads reduces a 64x64 tile of mip 0 down to one texel of mip 6, four levels in registers
+     and the rest through shared memory. Groups count themselves out on an atomic, the last one
+     to finish reads mip 6 back and reduces it down to mip 12 the same way. Depth extents up to
+     8192 get the full chain.
+     Halving rounds up, texel x of a level covers x * 2 and x * 2 + 1 of the level above
+     clamped to its last texel, so odd extents keep their last row and column.
+*/
+
+// loads shader/depth_pyramid.comp.spv, false when the device cannot store rg32f or the
+// shader is missing
+b8 vulkan_depth_pyramid_create(RenderContext* context, DepthPyramid* pyramid);
+// the device has to be idle
+void vulkan_depth_pyramid_destroy(RenderContext* context, DepthPyramid* pyramid);
+
+// follows the extent of the scene depth, the pyramid is invalid until built again
+void vulkan_depth_pyramid_resize(RenderContext* context, DepthPyramid* pyramid, u32 depth_width,
+                                 u32 depth_height);
+
+// depth has to be in RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE and was rendered with
+// view_projection. leaves the pyramid in RESOURCE_STATE_SHADER_RESOURCE. command is the
+// graphics one or the async compute one, see vulkan_queue_scheduler_hand_to_compute
+void vulkan_depth_pyramid_build(RenderContext* context, DepthPyramid* pyramid, Command* command,
+                                u32 frame, RenderTarget* depth,
+                                const glm::mat4& view_projection);
+
+// brings a pyramid that was never built into RESOURCE_STATE_SHADER_RESOURCE, for readers
+// that bind it before the first build
+void vulkan_depth_pyramid_prepare(RenderContext* context, DepthPyramid* pyramid,
+                                  Command* command);
+
+#endif  // !VULKAN_DEPTH_PYRAMID_H
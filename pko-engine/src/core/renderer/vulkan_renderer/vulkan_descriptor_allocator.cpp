@@ -1,4 +1,5 @@
 #include "vulkan_types.inl"
+#include "vulkan_metrics.h"
 
 #include <algorithm>
 
@@ -31,6 +32,7 @@ bool DescriptorAllocator::allocate(VkDescriptorSet* set, VkDescriptorSetLayout l
 
 	switch (result) {
 	case VK_SUCCESS:
+		vulkan_metrics_add(METRIC_DESCRIPTOR_SETS_ALLOCATED, 1);
 		return true;
 	case VK_ERROR_FRAGMENTED_POOL:
 	case VK_ERROR_OUT_OF_POOL_MEMORY:
@@ -48,8 +50,10 @@ bool DescriptorAllocator::allocate(VkDescriptorSet* set, VkDescriptorSetLayout l
 		alloc_info.descriptorPool = current_pool;
 		result = vkAllocateDescriptorSets(device, &alloc_info, set);
 		
-		if (result == VK_SUCCESS)
+		if (result == VK_SUCCESS) {
+			vulkan_metrics_add(METRIC_DESCRIPTOR_SETS_ALLOCATED, 1);
 			return true;
+		}
 	}
 
 	return false;
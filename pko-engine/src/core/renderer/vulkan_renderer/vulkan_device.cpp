@@ -2,6 +2,7 @@
 
 #include "vulkan_types.inl"
 
+#include <algorithm>
 #include <iostream>
 
 struct queue_family_info
@@ -36,70 +37,84 @@ b8 vulkan_device_create(RenderContext* context, DeviceContext* device_context)
         true,   // b8 use_compute;
         true,   // b8 use_transfer;
         false,  // b8 use_discrete_gpu;
-        {VK_KHR_SWAPCHAIN_EXTENSION_NAME, VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME}};
+        {VK_KHR_SWAPCHAIN_EXTENSION_NAME, VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME,
+         VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME}};
 
     if (!pick_physical_device(context, &requirements))
     {
         return false;
     }
 
-    u32 queue_count = 1;
-
-    b8 present_shares_graphics_queue = (context->device_context.graphics_family.index ==
-                                        context->device_context.present_family.index);
-
-    b8 transfer_shares_graphics_queue = (context->device_context.graphics_family.index ==
-                                         context->device_context.transfer_family.index);
-
-    if (context->device_context.compute_family.index != UINT32_MAX)
-        ++queue_count;
-
-    if (!present_shares_graphics_queue)
+    // optional, VMA falls back to estimating the budget from the heap sizes
+    u32 extension_count = 0;
+    VK_CHECK(vkEnumerateDeviceExtensionProperties(context->device_context.physical_device, 0,
+                                                  &extension_count, 0));
+    std::vector<VkExtensionProperties> extensions(extension_count);
+    VK_CHECK(vkEnumerateDeviceExtensionProperties(context->device_context.physical_device, 0,
+                                                  &extension_count, extensions.data()));
+
+    // optional too, indirect draws fall back to a fixed draw count
+    device_context->memory_budget = false;
+    device_context->draw_indirect_count = false;
+    for (const VkExtensionProperties& extension : extensions)
     {
-        ++queue_count;
-    }
-
-    if (!transfer_shares_graphics_queue)
-    {
-        ++queue_count;
+        if (strcmp(extension.extensionName, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) == 0)
+        {
+            requirements.extensions_name.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+            device_context->memory_budget = true;
+        }
+        else if (strcmp(extension.extensionName, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME) == 0)
+        {
+            requirements.extensions_name.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+            device_context->draw_indirect_count = true;
+        }
     }
 
-    std::vector<VkDeviceQueueCreateInfo> queue_create_infos(queue_count);
-    std::vector<u32> queue_indices(queue_count);
-    u32 queue_index_count = 0;
-    queue_indices.at(queue_index_count++) = context->device_context.graphics_family.index;
-
-    if (!present_shares_graphics_queue)
-    {
-        queue_indices.at(queue_index_count++) = context->device_context.present_family.index;
-    }
+    // families alias whenever the device has no dedicated queue, create each family once
+    u32 family_indices[] = {context->device_context.graphics_family.index,
+                            context->device_context.present_family.index,
+                            context->device_context.transfer_family.index,
+                            context->device_context.compute_family.index};
 
-    if (!transfer_shares_graphics_queue)
+    std::vector<u32> queue_indices;
+    for (u32 family_index : family_indices)
     {
-        queue_indices.at(queue_index_count++) = context->device_context.transfer_family.index;
+        if (family_index != UINT32_MAX &&
+            std::find(queue_indices.begin(), queue_indices.end(), family_index) ==
+                queue_indices.end())
+        {
+            queue_indices.push_back(family_index);
+        }
     }
 
-    if (context->device_context.compute_family.index != UINT32_MAX)
-    {
-        queue_indices.at(queue_index_count) = context->device_context.compute_family.index;
-    }
+    u32 queue_count = (u32)queue_indices.size();
+    std::vector<VkDeviceQueueCreateInfo> queue_create_infos(queue_count);
 
+    static const f32 queue_priorities = 1;
     for (u32 i = 0; i < queue_count; ++i)
     {
         queue_create_infos.at(i).sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
         queue_create_infos.at(i).flags = 0;
         queue_create_infos.at(i).queueFamilyIndex = queue_indices.at(i);
         queue_create_infos.at(i).queueCount = 1;
-
-        f32 queue_priorities = 1;
         queue_create_infos.at(i).pQueuePriorities = &queue_priorities;
     }
 
+    // frame pacing and cross queue sync run on one timeline semaphore per queue
+    VkPhysicalDeviceTimelineSemaphoreFeatures timelineSemaphoreFeatures{};
+    timelineSemaphoreFeatures.sType =
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+    timelineSemaphoreFeatures.pNext = nullptr;
+
+    VkPhysicalDeviceSynchronization2FeaturesKHR synchronization2Features{};
+    synchronization2Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES_KHR;
+    synchronization2Features.pNext = &timelineSemaphoreFeatures;
+
     VkPhysicalDeviceDynamicRenderingFeaturesKHR dynamicRenderingFeaturesKHR{};
     dynamicRenderingFeaturesKHR.sType =
         VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR;
     dynamicRenderingFeaturesKHR.dynamicRendering = VK_TRUE;
-    dynamicRenderingFeaturesKHR.pNext = nullptr;
+    dynamicRenderingFeaturesKHR.pNext = &synchronization2Features;
 
     VkPhysicalDeviceDescriptorIndexingFeatures descriptorIndexingFeatures{};
     descriptorIndexingFeatures.sType =
@@ -118,6 +133,8 @@ b8 vulkan_device_create(RenderContext* context, DeviceContext* device_context)
     assert(descriptorIndexingFeatures.descriptorBindingUniformBufferUpdateAfterBind);
     assert(descriptorIndexingFeatures.shaderStorageBufferArrayNonUniformIndexing);
     assert(descriptorIndexingFeatures.descriptorBindingStorageBufferUpdateAfterBind);
+    assert(timelineSemaphoreFeatures.timelineSemaphore);
+    assert(synchronization2Features.synchronization2);
 
     VkDeviceCreateInfo device_create_info{VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO};
     device_create_info.pNext = &deviceFeatures;
@@ -279,34 +296,45 @@ b8 check_physical_device_requirements(VkPhysicalDevice device, VkSurfaceKHR surf
 
     for (u32 i = 0; i < queue_families_count; ++i)
     {
-        if (requirements->use_graphics &&
-            (graphics_queue_family_index == UINT32_MAX || present_queue_family_index == UINT32_MAX))
-        {
-            if ((queue_families.at(i).queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0)
-                graphics_queue_family_index = i;
+        VkQueueFlags queue_flags = queue_families.at(i).queueFlags;
 
-            VkBool32 present_supported;
+        if (requirements->use_graphics && graphics_queue_family_index == UINT32_MAX &&
+            (queue_flags & VK_QUEUE_GRAPHICS_BIT) != 0)
+            graphics_queue_family_index = i;
+
+        if (requirements->use_present)
+        {
+            VkBool32 present_supported = VK_FALSE;
             vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &present_supported);
 
-            if (present_supported && requirements->use_present)
-            {
+            // prefer presenting from the graphics family
+            if (present_supported && (present_queue_family_index == UINT32_MAX ||
+                                      i == graphics_queue_family_index))
                 present_queue_family_index = i;
-            }
         }
 
-        if (requirements->use_transfer)
+        // dedicated transfer family (copy engine) first, then any non graphics family
+        if (requirements->use_transfer && (queue_flags & VK_QUEUE_TRANSFER_BIT) != 0 &&
+            (queue_flags & VK_QUEUE_GRAPHICS_BIT) == 0)
         {
-            if ((queue_families.at(i).queueFlags & VK_QUEUE_TRANSFER_BIT) != 0)
+            if (transfer_queue_family_index == UINT32_MAX ||
+                (queue_flags & VK_QUEUE_COMPUTE_BIT) == 0)
                 transfer_queue_family_index = i;
         }
 
-        if (requirements->use_compute && (graphics_queue_family_index != i))
-        {
-            if ((queue_families.at(i).queueFlags & VK_QUEUE_COMPUTE_BIT) != 0)
-                compute_queue_family_index = i;
-        }
+        if (requirements->use_compute && compute_queue_family_index == UINT32_MAX &&
+            (queue_flags & VK_QUEUE_COMPUTE_BIT) != 0 && (queue_flags & VK_QUEUE_GRAPHICS_BIT) == 0)
+            compute_queue_family_index = i;
     }
 
+    // no dedicated family, alias the graphics family (graphics always supports transfer and
+    // compute), the queue scheduler skips ownership transfers in that case
+    if (requirements->use_transfer && transfer_queue_family_index == UINT32_MAX)
+        transfer_queue_family_index = graphics_queue_family_index;
+
+    if (requirements->use_compute && compute_queue_family_index == UINT32_MAX)
+        compute_queue_family_index = graphics_queue_family_index;
+
     if (requirements->use_graphics)
     {
         if (graphics_queue_family_index == UINT32_MAX)
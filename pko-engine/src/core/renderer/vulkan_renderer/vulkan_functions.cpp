@@ -4,5 +4,6 @@
 #define VK_GLOBAL_LEVEL_FUNCTION( fun ) PFN_##fun fun;
 #define VK_INSTANCE_LEVEL_FUNCTION( fun ) PFN_##fun fun;
 #define VK_DEVICE_LEVEL_FUNCTION( fun ) PFN_##fun fun;
+#define VK_DEVICE_LEVEL_FUNCTION_FROM_EXTENSION( fun ) PFN_##fun fun;
 
 #include "list_of_functions.inl"
\ No newline at end of file
@@ -11,5 +11,6 @@
 #define VK_GLOBAL_LEVEL_FUNCTION(fun) extern PFN_##fun fun;
 #define VK_INSTANCE_LEVEL_FUNCTION(fun) extern PFN_##fun fun;
 #define VK_DEVICE_LEVEL_FUNCTION(fun) extern PFN_##fun fun;
+#define VK_DEVICE_LEVEL_FUNCTION_FROM_EXTENSION(fun) extern PFN_##fun fun;
 
 #include "list_of_functions.inl"
\ No newline at end of file
@@ -0,0 +1,569 @@
+#include "vulkan_gpu_culling.h"
+
+#include "core/profiler.h"
+#include "core/renderer/culling.h"
+#include "vulkan_buffer.h"
+#include "vulkan_command_buffer.h"
+#include "vulkan_deletion_queue.h"
+#include "vulkan_depth_pyramid.h"
+#include "vulkan_image.h"
+#include "vulkan_indirect.h"
+#include "vulkan_pipeline.h"
+#include "vulkan_transform_buffer.h"
+#include "vulkan_uniform_ring.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+// local_size_x of cull.comp and cull_compact.comp
+static const u32 CULL_GROUP_SIZE = 64;
+
+static const u32 CULL_BINDING_COUNT = 10;
+
+// std430 layouts of the shaders
+typedef struct GpuCullDraw
+{
+    u32 index_count;
+    u32 first_index;
+    i32 vertex_offset;
+    u32 first_instance;
+    u32 instance_count;
+    u32 batch;
+    u32 batch_first_command;
+    u32 pad;
+    f32 bounds[4];
+} GpuCullDraw;
+
+typedef struct GpuCullInstance
+{
+    u32 transform_index;
+    u32 draw_index;
+} GpuCullInstance;
+
+// std140, matches cull.comp
+typedef struct GpuCullConstants
+{
+    glm::mat4 view_projection;
+    glm::mat4 previous_view_projection;
+    glm::vec4 frustum_planes[6];
+    // depth width, depth height, pyramid mips, pyramid valid
+    u32 pyramid[4];
+    // instances, draws
+    u32 counts[4];
+} GpuCullConstants;
+
+static VkDescriptorSetLayout create_set_layout(RenderContext* context,
+                                               const VkDescriptorType* types, u32 count)
+{
+    VkDescriptorSetLayoutBinding bindings[CULL_BINDING_COUNT] = {};
+    for (u32 i = 0; i < count; ++i)
+    {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = types[i];
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+
+    VkDescriptorSetLayoutCreateInfo set_layout_info{
+        VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO};
+    set_layout_info.bindingCount = count;
+    set_layout_info.pBindings = bindings;
+
+    VkDescriptorSetLayout set_layout = VK_NULL_HANDLE;
+    VK_CHECK(vkCreateDescriptorSetLayout(context->device_context.handle, &set_layout_info,
+                                         context->allocator, &set_layout));
+    return set_layout;
+}
+
+static void write_buffer(VkWriteDescriptorSet* write, VkDescriptorBufferInfo* info,
+                         VkDescriptorSet set, u32 binding, VkBuffer buffer, u64 offset, u64 range)
+{
+    info->buffer = buffer;
+    info->offset = offset;
+    info->range = range;
+
+    *write = {VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
+    write->dstSet = set;
+    write->dstBinding = binding;
+    write->descriptorCount = 1;
+    write->descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    write->pBufferInfo = info;
+}
+
+static void write_image(VkWriteDescriptorSet* write, VkDescriptorImageInfo* info,
+                        VkDescriptorSet set, u32 binding, VkDescriptorType type,
+                        VkSampler sampler, VkImageView view, VkImageLayout layout)
+{
+    info->sampler = sampler;
+    info->imageView = view;
+    info->imageLayout = layout;
+
+    *write = {VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
+    write->dstSet = set;
+    write->dstBinding = binding;
+    write->descriptorCount = 1;
+    write->descriptorType = type;
+    write->pImageInfo = info;
+}
+
+static void update_cull_set(RenderContext* context, GpuCulling* culling, UniformRing* ring,
+                            TransformBuffer* transforms, u32 frame)
+{
+    DepthPyramid* pyramid = culling->depth_pyramid;
+    if (culling->cull_set_versions[frame] == culling->version &&
+        culling->cull_set_pyramid_versions[frame] == pyramid->version)
+        return;
+
+    const VkDescriptorSet set = culling->cull_sets[frame];
+    const u64 capacity_bytes = culling->capacity * sizeof(u32);
+
+    vulkan_uniform_ring_write_descriptor(context, ring, set, 0, sizeof(GpuCullConstants));
+    vulkan_transform_buffer_write_descriptor(context, transforms, set, 1);
+
+    VkWriteDescriptorSet writes[8];
+    VkDescriptorBufferInfo buffer_infos[7];
+    const VkBuffer commands = vulkan_buffer_get(context, culling->commands)->handle;
+
+    write_buffer(&writes[0], &buffer_infos[0], set, 2,
+                 vulkan_buffer_get(context, culling->draws)->handle, 0, VK_WHOLE_SIZE);
+    write_buffer(&writes[1], &buffer_infos[1], set, 3,
+                 vulkan_buffer_get(context, culling->instances)->handle, 0, VK_WHOLE_SIZE);
+    write_buffer(&writes[2], &buffer_infos[2], set, 4,
+                 vulkan_buffer_get(context, culling->draw_counts)->handle, 0, capacity_bytes);
+    write_buffer(&writes[3], &buffer_infos[3], set, 5,
+                 vulkan_buffer_get(context, culling->retest)->handle, 0, capacity_bytes);
+    write_buffer(&writes[4], &buffer_infos[4], set, 6,
+                 vulkan_buffer_get(context, culling->culled_instances)->handle, 0,
+                 capacity_bytes);
+    write_buffer(&writes[5], &buffer_infos[5], set, 7, commands, 0,
+                 culling->capacity * sizeof(VkDrawIndexedIndirectCommand));
+    write_buffer(&writes[6], &buffer_infos[6], set, 8, commands, culling->count_offset,
+                 capacity_bytes);
+
+    VkDescriptorImageInfo image_info;
+    write_image(&writes[7], &image_info, set, 9, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                pyramid->sampler, vulkan_texture_get(context, pyramid->texture)->srv_descriptor,
+                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+    vkUpdateDescriptorSets(context->device_context.handle, 8, writes, 0, NULL);
+    culling->cull_set_versions[frame] = culling->version;
+    culling->cull_set_pyramid_versions[frame] = pyramid->version;
+}
+
+b8 vulkan_gpu_culling_create(RenderContext* context, GpuCulling* culling, u32 capacity,
+                             DepthPyramid* depth_pyramid)
+{
+    assert(context);
+    assert(culling);
+    assert(capacity > 0);
+    assert(depth_pyramid);
+
+    const VkDescriptorType cull_types[CULL_BINDING_COUNT] = {
+        VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,  // constants
+        VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,  // transforms
+        VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,          // draws
+        VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,          // instances
+        VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,          // draw counts
+        VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,          // retest flags
+        VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,          // culled instances
+        VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,          // commands
+        VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,          // batch counts
+        VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER   // depth pyramid
+    };
+
+    culling->cull_set_layout = create_set_layout(context, cull_types, CULL_BINDING_COUNT);
+
+    // the phase, cull_compact.comp declares it too so both layouts stay compatible
+    VkPushConstantRange cull_range{VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(u32)};
+
+    if (!vulkan_compute_pipeline_create(context, "shader/cull.comp.spv", 1, &cull_range, 1,
+                                        &culling->cull_set_layout, &culling->cull_pipeline) ||
+        !vulkan_compute_pipeline_create(context, "shader/cull_compact.comp.spv", 1, &cull_range,
+                                        1, &culling->cull_set_layout,
+                                        &culling->compact_pipeline))
+    {
+        std::cout << "gpu culling pipelines failed to create" << std::endl;
+        vulkan_gpu_culling_destroy(context, culling);
+        return false;
+    }
+
+    b8 allocated = true;
+    for (u32 frame = 0; frame < MAX_FRAME; ++frame)
+    {
+        allocated &= context->pDynamicDescriptorAllocators[0].allocate(
+            &culling->cull_sets[frame], culling->cull_set_layout);
+    }
+
+    if (!allocated)
+    {
+        std::cout << "gpu culling descriptor sets failed to allocate" << std::endl;
+        vulkan_gpu_culling_destroy(context, culling);
+        return false;
+    }
+
+    // the count region is bound on its own, its offset has to suit a storage descriptor
+    u64 alignment = context->device_context.properties.limits.minStorageBufferOffsetAlignment;
+    if (alignment < 4)
+        alignment = 4;
+
+    culling->capacity = capacity;
+    culling->count_offset =
+        (capacity * sizeof(VkDrawIndexedIndirectCommand) + alignment - 1) & ~(alignment - 1);
+
+    // never moved by the defragmenter, the sets and recorded draws keep the handles
+    vulkan_buffer_create(context, capacity * sizeof(u32),
+                         VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                         VMA_MEMORY_USAGE_AUTO, 0, &culling->draw_counts,
+                         MEMORY_CATEGORY_UNIFORM);
+    vulkan_buffer_create(context, capacity * sizeof(u32), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                         VMA_MEMORY_USAGE_AUTO, 0, &culling->retest, MEMORY_CATEGORY_UNIFORM);
+    vulkan_buffer_create(context, capacity * sizeof(u32),
+                         VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                         VMA_MEMORY_USAGE_AUTO, 0, &culling->culled_instances,
+                         MEMORY_CATEGORY_UNIFORM);
+    vulkan_buffer_create(context, culling->count_offset + capacity * sizeof(u32),
+                         VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+                             VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                         VMA_MEMORY_USAGE_AUTO, 0, &culling->commands, MEMORY_CATEGORY_INDIRECT);
+
+    culling->draw_count_supported = context->device_context.draw_indirect_count;
+    culling->multi_draw = context->device_context.features.multiDrawIndirect;
+    culling->depth_pyramid = depth_pyramid;
+    culling->version = 1;
+
+    // an empty draw list until set_draws, the sets always name live buffers
+    vulkan_gpu_culling_set_draws(context, culling, NULL, 0, NULL, 0);
+
+    return true;
+}
+
+void vulkan_gpu_culling_destroy(RenderContext* context, GpuCulling* culling)
+{
+    assert(context);
+    assert(culling);
+
+    vulkan_pipeline_destroy(context, &culling->cull_pipeline);
+    vulkan_pipeline_destroy(context, &culling->compact_pipeline);
+
+    vkDestroyDescriptorSetLayout(context->device_context.handle, culling->cull_set_layout,
+                                 context->allocator);
+
+    BufferHandle* buffers[] = {&culling->draws,       &culling->instances,
+                               &culling->draw_counts, &culling->retest,
+                               &culling->culled_instances, &culling->commands};
+    for (BufferHandle* buffer : buffers)
+    {
+        if (buffer->id != 0)
+            vulkan_buffer_destroy(context, *buffer);
+    }
+    for (u32 frame = 0; frame < MAX_FRAME; ++frame)
+    {
+        if (culling->readbacks[frame].id != 0)
+            vulkan_buffer_destroy(context, culling->readbacks[frame]);
+    }
+
+    // the sets go back with the pools of the descriptor allocator
+    *culling = GpuCulling{};
+}
+
+void vulkan_gpu_culling_set_draws(RenderContext* context, GpuCulling* culling,
+                                  const instanced_draw* draws, u32 draw_count,
+                                  const u32* instances, u32 instance_count)
+{
+    PKO_PROFILE_FUNCTION();
+
+    assert(instance_count <= culling->capacity && "gpu culling is full");
+
+    vulkan_indirect_build_batches(draws, draw_count, &culling->batches);
+
+    std::vector<GpuCullDraw> gpu_draws(draw_count);
+    for (u32 b = 0; b < culling->batches.size(); ++b)
+    {
+        const IndirectBatch& batch = culling->batches[b];
+        for (u32 d = batch.first_command; d < batch.first_command + batch.max_command_count; ++d)
+        {
+            const instanced_draw& draw = draws[d];
+            GpuCullDraw& gpu_draw = gpu_draws[d];
+            gpu_draw.index_count = draw.index_count;
+            gpu_draw.first_index = draw.first_index;
+            gpu_draw.vertex_offset = draw.vertex_offset;
+            gpu_draw.first_instance = draw.first_instance;
+            gpu_draw.instance_count = draw.instance_count;
+            gpu_draw.batch = b;
+            gpu_draw.batch_first_command = batch.first_command;
+            memcpy(gpu_draw.bounds, &draw.bounds, sizeof(gpu_draw.bounds));
+        }
+    }
+
+    culling->first_instances.resize(draw_count);
+    for (u32 d = 0; d < draw_count; ++d)
+        culling->first_instances[d] = draws[d].first_instance;
+
+    std::vector<GpuCullInstance> gpu_instances(instance_count);
+    for (u32 d = 0; d < draw_count; ++d)
+    {
+        for (u32 i = draws[d].first_instance;
+             i < draws[d].first_instance + draws[d].instance_count; ++i)
+            gpu_instances[i] = {instances[i], d};
+    }
+
+    // frames in flight still cull with the old ones
+    if (culling->draws.id != 0)
+        vulkan_deletion_queue_push_buffer(context, culling->draws);
+    if (culling->instances.id != 0)
+        vulkan_deletion_queue_push_buffer(context, culling->instances);
+
+    // written once per draw list, host visible is fine and needs no upload on another queue
+    const u32 draws_size = (draw_count ? draw_count : 1) * sizeof(GpuCullDraw);
+    const u32 instances_size = (instance_count ? instance_count : 1) * sizeof(GpuCullInstance);
+    vulkan_buffer_create(context, draws_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                         VMA_MEMORY_USAGE_AUTO,
+                         VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT |
+                             VMA_ALLOCATION_CREATE_MAPPED_BIT,
+                         &culling->draws, MEMORY_CATEGORY_MESH);
+    vulkan_buffer_create(context, instances_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                         VMA_MEMORY_USAGE_AUTO,
+                         VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT |
+                             VMA_ALLOCATION_CREATE_MAPPED_BIT,
+                         &culling->instances, MEMORY_CATEGORY_MESH);
+    if (draw_count)
+    {
+        vulkan_buffer_upload(context, vulkan_buffer_get(context, culling->draws),
+                             gpu_draws.data(), draws_size);
+        vulkan_buffer_upload(context, vulkan_buffer_get(context, culling->instances),
+                             gpu_instances.data(), instances_size);
+    }
+
+    culling->draw_count = draw_count;
+    culling->instance_count = instance_count;
+    ++culling->version;
+}
+
+void vulkan_gpu_culling_begin_frame(RenderContext* context, GpuCulling* culling,
+                                    UniformRing* ring, TransformBuffer* transforms, u32 frame,
+                                    const glm::mat4& view_projection)
+{
+    const DepthPyramid* pyramid = culling->depth_pyramid;
+    assert(pyramid->texture.id != 0 && "resize the pyramid before the first frame");
+
+    // the pyramid is rebuilt later in the frame, until then it holds the previous depth
+    GpuCullConstants constants{};
+    constants.view_projection = view_projection;
+    if (pyramid->valid)
+        memcpy(&constants.previous_view_projection, pyramid->view_projection,
+               sizeof(pyramid->view_projection));
+    else
+        constants.previous_view_projection = view_projection;
+    Frustum frustum;
+    frustum_from_matrix(view_projection, &frustum);
+    memcpy(constants.frustum_planes, frustum.planes, sizeof(constants.frustum_planes));
+    constants.pyramid[0] = pyramid->depth_width;
+    constants.pyramid[1] = pyramid->depth_height;
+    constants.pyramid[2] = pyramid->mips;
+    constants.pyramid[3] = pyramid->valid;
+    constants.counts[0] = culling->instance_count;
+    constants.counts[1] = culling->draw_count;
+
+    culling->constants_offset = vulkan_uniform_ring_push(ring, &constants, sizeof(constants));
+    culling->transform_offset = vulkan_transform_buffer_offset(transforms, frame);
+
+    update_cull_set(context, culling, ring, transforms, frame);
+}
+
+static void bind_cull_set(GpuCulling* culling, Command* command, Pipeline* pipeline, u32 frame,
+                          GpuCullPhase phase)
+{
+    vulkan_pipeline_bind(command, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+
+    const u32 dynamic_offsets[2] = {culling->constants_offset, culling->transform_offset};
+    vkCmdBindDescriptorSets(command->buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline->layout, 0,
+                            1, &culling->cull_sets[frame], 2, dynamic_offsets);
+
+    const u32 phase_constant = phase;
+    vkCmdPushConstants(command->buffer, pipeline->layout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                       sizeof(phase_constant), &phase_constant);
+}
+
+// a readback holds the commands and then the batch counts of the early phase, then the same
+// for the late one
+static u64 readback_phase_size(const GpuCulling* culling)
+{
+    return culling->capacity * (sizeof(VkDrawIndexedIndirectCommand) + sizeof(u32));
+}
+
+static void copy_to_readback(RenderContext* context, GpuCulling* culling, Command* command,
+                             u32 frame, GpuCullPhase phase)
+{
+    Buffer* commands = vulkan_buffer_get(context, culling->commands);
+    Buffer* readback = vulkan_buffer_get(context, culling->readbacks[frame]);
+
+    BufferBarrier copy_barrier{commands, RESOURCE_STATE_UNORDERED_ACCESS,
+                               RESOURCE_STATE_COPY_SOURCE};
+    vulkan_command_resource_barrier(command, &copy_barrier, 1, NULL, 0, NULL, 0);
+    vulkan_command_flush_barriers(command);
+
+    const u64 batch_count = culling->batches.size();
+    const u64 phase_offset = phase * readback_phase_size(culling);
+    VkBufferCopy regions[2] = {};
+    regions[0].dstOffset = phase_offset;
+    regions[0].size = culling->draw_count * sizeof(VkDrawIndexedIndirectCommand);
+    regions[1].srcOffset = culling->count_offset;
+    regions[1].dstOffset = phase_offset + culling->capacity * sizeof(VkDrawIndexedIndirectCommand);
+    regions[1].size = batch_count * sizeof(u32);
+    vkCmdCopyBuffer(command->buffer, commands->handle, readback->handle, 2, regions);
+
+    // read once the frame retired
+    BufferBarrier host_barrier{readback, RESOURCE_STATE_COPY_DEST, RESOURCE_STATE_HOST_READ};
+    vulkan_command_resource_barrier(command, &host_barrier, 1, NULL, 0, NULL, 0);
+    vulkan_command_flush_barriers(command);
+
+    culling->readback_versions[frame] = culling->version;
+}
+
+void vulkan_gpu_culling_cull(RenderContext* context, GpuCulling* culling, Command* command,
+                             u32 frame, GpuCullPhase phase)
+{
+    PKO_PROFILE_FUNCTION();
+
+    assert(command);
+
+    // the test never reads a pyramid the constants call invalid, but the descriptor still has
+    // to name the layout it is in
+    if (phase == GPU_CULL_PHASE_EARLY)
+        vulkan_depth_pyramid_prepare(context, culling->depth_pyramid, command);
+
+    if (culling->instance_count == 0)
+        return;
+
+    Buffer* draw_counts = vulkan_buffer_get(context, culling->draw_counts);
+    Buffer* retest = vulkan_buffer_get(context, culling->retest);
+    Buffer* culled_instances = vulkan_buffer_get(context, culling->culled_instances);
+    Buffer* commands = vulkan_buffer_get(context, culling->commands);
+
+    // the previous phase drew from them. zeroed commands keep the calls without a count
+    // harmless past what was compacted
+    BufferBarrier clear_barriers[2] = {
+        {draw_counts, RESOURCE_STATE_UNORDERED_ACCESS, RESOURCE_STATE_COPY_DEST},
+        {commands, RESOURCE_STATE_INDIRECT_ARGUMENT, RESOURCE_STATE_COPY_DEST}};
+    vulkan_command_resource_barrier(command, clear_barriers, 2, NULL, 0, NULL, 0);
+    vulkan_command_flush_barriers(command);
+
+    vkCmdFillBuffer(command->buffer, draw_counts->handle, 0, culling->draw_count * sizeof(u32), 0);
+    vkCmdFillBuffer(command->buffer, commands->handle, 0, VK_WHOLE_SIZE, 0);
+
+    BufferBarrier cull_barriers[4] = {
+        {draw_counts, RESOURCE_STATE_COPY_DEST, RESOURCE_STATE_UNORDERED_ACCESS},
+        {commands, RESOURCE_STATE_COPY_DEST, RESOURCE_STATE_UNORDERED_ACCESS},
+        {culled_instances, RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER,
+         RESOURCE_STATE_UNORDERED_ACCESS},
+        // written by the early phase, read by the late one
+        {retest, RESOURCE_STATE_UNORDERED_ACCESS, RESOURCE_STATE_UNORDERED_ACCESS}};
+    vulkan_command_resource_barrier(command, cull_barriers, 4, NULL, 0, NULL, 0);
+
+    bind_cull_set(culling, command, &culling->cull_pipeline, frame, phase);
+    vulkan_command_dispatch(
+        command, (culling->instance_count + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+
+    // survivors per draw are final once every instance was tested
+    BufferBarrier compact_barrier{draw_counts, RESOURCE_STATE_UNORDERED_ACCESS,
+                                  RESOURCE_STATE_UNORDERED_ACCESS};
+    vulkan_command_resource_barrier(command, &compact_barrier, 1, NULL, 0, NULL, 0);
+
+    bind_cull_set(culling, command, &culling->compact_pipeline, frame, phase);
+    vulkan_command_dispatch(command,
+                            (culling->draw_count + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+
+    ResourceState commands_state = RESOURCE_STATE_UNORDERED_ACCESS;
+    if (culling->readbacks[frame].id != 0)
+    {
+        copy_to_readback(context, culling, command, frame, phase);
+        commands_state = RESOURCE_STATE_COPY_SOURCE;
+    }
+
+    BufferBarrier draw_barriers[2] = {
+        {commands, commands_state, RESOURCE_STATE_INDIRECT_ARGUMENT},
+        {culled_instances, RESOURCE_STATE_UNORDERED_ACCESS,
+         RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER}};
+    vulkan_command_resource_barrier(command, draw_barriers, 2, NULL, 0, NULL, 0);
+}
+
+void vulkan_gpu_culling_record_draws(RenderContext* context, GpuCulling* culling,
+                                     Command* command, Pipeline* pipeline)
+{
+    if (culling->instance_count == 0)
+        return;
+
+    // count offset and the zeroed tail serve every path vulkan_indirect_buffer_record has
+    vulkan_indirect_record_batches(
+        command, culling->batches.data(), 0, (u32)culling->batches.size(),
+        vulkan_buffer_get(context, culling->commands)->handle, 0, culling->count_offset,
+        culling->draw_count_supported, culling->multi_draw, pipeline,
+        vulkan_buffer_get(context, culling->culled_instances)->handle, false);
+}
+
+void vulkan_gpu_culling_set_readback(RenderContext* context, GpuCulling* culling, b8 enabled)
+{
+    for (u32 frame = 0; frame < MAX_FRAME; ++frame)
+    {
+        BufferHandle* readback = &culling->readbacks[frame];
+        culling->readback_versions[frame] = 0;
+
+        if (!enabled && readback->id != 0)
+        {
+            // frames in flight may still copy into it
+            vulkan_deletion_queue_push_buffer(context, *readback);
+            *readback = {};
+        }
+        else if (enabled && readback->id == 0)
+        {
+            vulkan_buffer_create(context, 2 * readback_phase_size(culling),
+                                 VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_AUTO,
+                                 VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT |
+                                     VMA_ALLOCATION_CREATE_MAPPED_BIT,
+                                 readback, MEMORY_CATEGORY_STAGING);
+        }
+    }
+}
+
+b8 vulkan_gpu_culling_read_visible(RenderContext* context, GpuCulling* culling, u32 frame,
+                                   u32* out_instance_counts)
+{
+    assert(out_instance_counts);
+
+    if (culling->readbacks[frame].id == 0 ||
+        culling->readback_versions[frame] != culling->version)
+        return false;
+
+    Buffer* readback = vulkan_buffer_get(context, culling->readbacks[frame]);
+    vmaInvalidateAllocation(context->vma_allocator, readback->allocation, 0, VK_WHOLE_SIZE);
+
+    memset(out_instance_counts, 0, culling->draw_count * sizeof(u32));
+    for (u32 phase = GPU_CULL_PHASE_EARLY; phase <= GPU_CULL_PHASE_LATE; ++phase)
+    {
+        const u8* base = (const u8*)readback->mapped_data + phase * readback_phase_size(culling);
+        const VkDrawIndexedIndirectCommand* commands = (const VkDrawIndexedIndirectCommand*)base;
+        const u32* counts =
+            (const u32*)(base + culling->capacity * sizeof(VkDrawIndexedIndirectCommand));
+
+        for (u32 b = 0; b < culling->batches.size(); ++b)
+        {
+            const IndirectBatch& batch = culling->batches[b];
+            const u32 count = counts[b] < batch.max_command_count ? counts[b]
+                                                                  : batch.max_command_count;
+            // the commands of a batch come from its own draws, in the order of the atomics
+            const u32* first = culling->first_instances.data() + batch.first_command;
+            const u32* last = first + batch.max_command_count;
+            for (u32 c = batch.first_command; c < batch.first_command + count; ++c)
+            {
+                const u32* found = std::lower_bound(first, last, commands[c].firstInstance);
+                if (found != last && *found == commands[c].firstInstance)
+                    out_instance_counts[found - culling->first_instances.data()] +=
+                        commands[c].instanceCount;
+            }
+        }
+    }
+
+    culling->readback_versions[frame] = 0;
+    return true;
+}
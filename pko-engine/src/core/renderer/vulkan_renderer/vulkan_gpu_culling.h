@@ -0,0 +1,71 @@
+#ifndef VULKAN_GPU_CULLING_H
+#define VULKAN_GPU_CULLING_H
+
+#include "vulkan_types.inl"
+
+#include "vulkan_mesh.h"
+
+#include <glm/glm.hpp>
+
+/*
+     GPU culling : a compute pass tests the bounding sphere of every instance against the
+     frustum and against the max of a depth pyramid, survivors are appended to the instance
+     stream of their draw and a second dispatch compacts the draws that kept any into the front
+     of their indirect batch, with the batch count next to the commands. The CPU only records
+     fixed dispatches and indirect calls, the same every frame whatever is visible.
+
+     Two phases keep objects that became visible from popping in a frame late:
+       early : instances visible last frame are tested against the pyramid of the last frame
+               and drawn. frustum survivors that failed the occlusion test are flagged
+       late  : the owner rebuilds the pyramid from the depth of the early draws and the
+               flagged instances are tested again, the ones that show up are drawn on top
+     Without a pyramid, the first frame or after a resize, the early phase draws everything
+     in the frustum and the late phase finds nothing to retest.
+     Everything is recorded on the thread recording the frame, into the primary.
+*/
+
+enum GpuCullPhase
+{
+    GPU_CULL_PHASE_EARLY = 0,
+    GPU_CULL_PHASE_LATE = 1
+};
+
+// loads shader/cull.comp.spv and cull_compact.comp.spv. capacity is the most instances a draw
+// list may have. depth_pyramid is owned, resized and built by the caller
+b8 vulkan_gpu_culling_create(RenderContext* context, GpuCulling* culling, u32 capacity,
+                             DepthPyramid* depth_pyramid);
+// the device has to be idle
+void vulkan_gpu_culling_destroy(RenderContext* context, GpuCulling* culling);
+
+// whenever the draw list changed. instances holds the transform index of every instance in
+// the order the draws read them, as vulkan_draw_items_group returns it
+void vulkan_gpu_culling_set_draws(RenderContext* context, GpuCulling* culling,
+                                  const instanced_draw* draws, u32 draw_count,
+                                  const u32* instances, u32 instance_count);
+
+// constants of the frame into the ring and the sets of the frame slot brought up to date.
+// after the ring began the frame and before the passes are recorded
+void vulkan_gpu_culling_begin_frame(RenderContext* context, GpuCulling* culling,
+                                    UniformRing* ring, TransformBuffer* transforms, u32 frame,
+                                    const glm::mat4& view_projection);
+
+// clears the counts, culls and compacts. the commands and the instance stream are left ready
+// for vulkan_gpu_culling_record_draws
+void vulkan_gpu_culling_cull(RenderContext* context, GpuCulling* culling, Command* command,
+                             u32 frame, GpuCullPhase phase);
+
+// one indirect call per batch, inside rendering. pipeline and descriptor sets with the
+// transform buffer have to be bound
+void vulkan_gpu_culling_record_draws(RenderContext* context, GpuCulling* culling,
+                                     Command* command, Pipeline* pipeline);
+
+// copies what both phases compacted into a host buffer of the frame slot, to check the device
+// against a CPU cull. off by default, the copies cost bandwidth every frame
+void vulkan_gpu_culling_set_readback(RenderContext* context, GpuCulling* culling, b8 enabled);
+
+// instances per draw both phases of frame drew, into out_instance_counts of draw_count, after
+// the frame retired. false when the slot holds no copy of the current draw list
+b8 vulkan_gpu_culling_read_visible(RenderContext* context, GpuCulling* culling, u32 frame,
+                                   u32* out_instance_counts);
+
+#endif  // !VULKAN_GPU_CULLING_H
@@ -1,9 +1,12 @@
 #include "vulkan_image.h"
 
+#include "core/profiler.h"
 #include "vendor/mmgr/mmgr.h"
 #include "vulkan_buffer.h"
 #include "vulkan_command_buffer.h"
+#include "vulkan_deletion_queue.h"
 #include "vulkan_device.h"
+#include "vulkan_memory_allocate.h"
 #include "vulkan_types.inl"
 
 #define STB_IMAGE_IMPLEMENTATION
@@ -11,55 +14,71 @@
 
 #include "stb_image.h"
 
+static void fill_image_create_info(const TextureDesc* desc, VkImageCreateInfo* imgCreateInfo);
+
+static void rendertarget_texture_desc(const RenderTargetDesc* desc, TextureDesc* textureDesc)
+{
+    const bool isDepth = is_image_format_depth_only(desc->vulkan_format) ||
+                         is_image_format_depth_stencil(desc->vulkan_format);
+
+    *textureDesc = {};
+    textureDesc->width = desc->width;
+    textureDesc->height = desc->height;
+    textureDesc->mip_levels = desc->mip_levels;
+    textureDesc->sample_count = 1;
+    textureDesc->start_state =
+        !isDepth ? RESOURCE_STATE_RENDER_TARGET : RESOURCE_STATE_DEPTH_WRITE;
+    textureDesc->vulkan_format = desc->vulkan_format;
+    textureDesc->clear_value = desc->clear_value;
+    // render targets are always sampled, storage ones are written by compute as well
+    textureDesc->type = is_descriptor_type_storage_image(desc->descriptor_type)
+                            ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE
+                            : VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+    textureDesc->native_handle = desc->native_handle;
+    textureDesc->alias_allocation = desc->alias_allocation;
+    textureDesc->category = MEMORY_CATEGORY_RENDER_TARGET;
+}
+
 b8 vulkan_rendertarget_create(RenderContext* context, RenderTargetDesc* desc,
-                              RenderTarget** out_render_target)
+                              RenderTargetHandle* out_render_target)
 {
     assert(context);
     assert(desc);
     assert(out_render_target);
+    assert(desc->mip_levels <= MAX_MIP_LEVELS);
 
-    RenderTarget* render_target = (RenderTarget*)alloc_aligned_memory(
-        sizeof(RenderTarget) + ((desc->descriptor_type & VK_DESCRIPTOR_TYPE_STORAGE_IMAGE)
-                                    ? sizeof(VkImageView) * desc->mip_levels
-                                    : 0),
-        16);
-    render_target->array_descriptors = (VkImageView*)(render_target + 1);
+    TextureDesc textureDesc;
+    rendertarget_texture_desc(desc, &textureDesc);
 
-    const bool isDepth = is_image_format_depth_only(desc->vulkan_format) ||
-                         is_image_format_depth_stencil(desc->vulkan_format);
-    assert(render_target);
-
-    TextureDesc textureDesc = {};
-    textureDesc.width = desc->width;
-    textureDesc.height = desc->height;
-    textureDesc.mip_levels = desc->mip_levels;
-    textureDesc.sample_count = 1;
-    textureDesc.start_state = !isDepth ? RESOURCE_STATE_RENDER_TARGET : RESOURCE_STATE_DEPTH_WRITE;
-    textureDesc.type = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
-    textureDesc.vulkan_format = desc->vulkan_format;
-    textureDesc.clear_value = desc->clear_value;
-    textureDesc.type = VkDescriptorType(desc->descriptor_type | VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE);
-    textureDesc.native_handle = desc->native_handle;
-
-    vulkan_texture_create(context, &textureDesc, &render_target->texture);
+    TextureHandle texture_handle;
+    vulkan_texture_create(context, &textureDesc, &texture_handle);
+    const Texture* texture = vulkan_texture_get(context, texture_handle);
+
+    RenderTarget* render_target = NULL;
+    RenderTargetCold* render_target_cold = NULL;
+    out_render_target->id =
+        context->render_target_pool->create(&render_target, &render_target_cold);
 
+    render_target->texture = texture_handle;
+    render_target->image = texture->image;
+    render_target->aspect_mask = texture->aspect_mask;
     render_target->width = desc->width;
     render_target->height = desc->height;
     render_target->mip_levels = desc->mip_levels;
     render_target->vulkan_format = desc->vulkan_format;
-    render_target->descriptors = desc->descriptor_type;
     render_target->clear_value = desc->clear_value;
+    render_target_cold->descriptors = desc->descriptor_type;
 
     // TODO(FUTURE)
-    render_target->array_size = 1;
-    render_target->depth = 1;
+    render_target_cold->array_size = 1;
+    render_target_cold->depth = 1;
     render_target->sample_count = VK_SAMPLE_COUNT_1_BIT;
-    render_target->sample_quality = 0;
+    render_target_cold->sample_quality = 0;
 
     // srv
     VkImageViewCreateInfo imgViewCreateInfo = {VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO};
     imgViewCreateInfo.flags = 0;
-    imgViewCreateInfo.image = render_target->texture->image;
+    imgViewCreateInfo.image = render_target->image;
     imgViewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
     imgViewCreateInfo.format = render_target->vulkan_format;
     imgViewCreateInfo.components.r = VK_COMPONENT_SWIZZLE_R;
@@ -82,7 +101,8 @@ b8 vulkan_rendertarget_create(RenderContext* context, RenderTargetDesc* desc,
         {
             imgViewCreateInfo.subresourceRange.baseMipLevel = i;
             VK_CHECK(vkCreateImageView(context->device_context.handle, &imgViewCreateInfo,
-                                       context->allocator, &render_target->array_descriptors[i]));
+                                       context->allocator,
+                                       &render_target_cold->array_descriptors[i]));
         }
     }
 
@@ -91,12 +111,12 @@ b8 vulkan_rendertarget_create(RenderContext* context, RenderTargetDesc* desc,
     vulkan_command_buffer_allocate(context, &oneTimeSubmit, true);
     vulkan_command_buffer_begin(&oneTimeSubmit, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
 
-    TextureBarrier textureBarrier;
-    textureBarrier.current_state = RESOURCE_STATE_UNDEFINED;
-    textureBarrier.new_state = desc->start_state;
-    textureBarrier.texture = render_target->texture;
+    RenderTargetBarrier renderTargetBarrier{};
+    renderTargetBarrier.current_state = RESOURCE_STATE_UNDEFINED;
+    renderTargetBarrier.new_state = desc->start_state;
+    renderTargetBarrier.render_target = render_target;
 
-    vulkan_command_resource_barrier(&oneTimeSubmit, NULL, 0, &textureBarrier, 1, NULL, 0);
+    vulkan_command_resource_barrier(&oneTimeSubmit, NULL, 0, NULL, 0, &renderTargetBarrier, 1);
 
     vulkan_command_buffer_end(&oneTimeSubmit);
 
@@ -106,15 +126,28 @@ b8 vulkan_rendertarget_create(RenderContext* context, RenderTargetDesc* desc,
 
     VK_CHECK(
         vkQueueSubmit(context->device_context.graphics_queue, 1, &submit_info, VK_NULL_HANDLE));
-    vkQueueWaitIdle(context->device_context.graphics_queue);
 
-     *out_render_target = render_target;
+    // the next frame on the graphics queue runs after the transition, no queue idle
+    if (context->deletion_queue)
+    {
+        vulkan_deletion_queue_push_command(context, &oneTimeSubmit);
+    }
+    else
+    {
+        vkQueueWaitIdle(context->device_context.graphics_queue);
+        vulkan_command_pool_destroy(context, &oneTimeSubmit);
+    }
 
     return true;
 }
 
-void vulkan_rendertarget_destroy(RenderContext* context, RenderTarget* render_target)
+void vulkan_rendertarget_destroy(RenderContext* context, RenderTargetHandle render_target_handle)
 {
+    RenderTarget* render_target = vulkan_rendertarget_get(context, render_target_handle);
+    RenderTargetCold* render_target_cold =
+        context->render_target_pool->get_cold(render_target_handle.id);
+    assert(render_target && "stale render target handle");
+
     vulkan_texture_destroy(context, render_target->texture);
 
     if (render_target->descriptor != VK_NULL_HANDLE)
@@ -123,31 +156,67 @@ void vulkan_rendertarget_destroy(RenderContext* context, RenderTarget* render_ta
                            context->allocator);
     }
 
-    if (render_target->array_descriptors)
+    if (render_target->mip_levels > 1)
     {
         for (u32 i = 0; i < render_target->mip_levels; ++i)
         {
-            vkDestroyImageView(context->device_context.handle, render_target->array_descriptors[i],
-                               context->allocator);
+            vkDestroyImageView(context->device_context.handle,
+                               render_target_cold->array_descriptors[i], context->allocator);
         }
     }
 
-    SAFE_FREE(render_target);
+    context->render_target_pool->release(render_target_handle.id);
+}
+
+void vulkan_rendertarget_get_memory_requirements(RenderContext* context,
+                                                 const RenderTargetDesc* desc,
+                                                 VkMemoryRequirements* out_requirements)
+{
+    TextureDesc textureDesc;
+    rendertarget_texture_desc(desc, &textureDesc);
+
+    // a throwaway image with the exact create info, the allocation is not known yet
+    VkImageCreateInfo imgCreateInfo;
+    fill_image_create_info(&textureDesc, &imgCreateInfo);
+
+    VkImage image = VK_NULL_HANDLE;
+    VK_CHECK(
+        vkCreateImage(context->device_context.handle, &imgCreateInfo, context->allocator, &image));
+    vkGetImageMemoryRequirements(context->device_context.handle, image, out_requirements);
+    vkDestroyImage(context->device_context.handle, image, context->allocator);
+}
+
+RenderTarget* vulkan_rendertarget_get(RenderContext* context,
+                                      RenderTargetHandle render_target_handle)
+{
+    return context->render_target_pool->get(render_target_handle.id);
+}
+
+VkImageView vulkan_rendertarget_get_mip_view(RenderContext* context,
+                                             RenderTargetHandle render_target_handle, u32 mip)
+{
+    RenderTargetCold* render_target_cold =
+        context->render_target_pool->get_cold(render_target_handle.id);
+    assert(render_target_cold);
+
+    return render_target_cold->array_descriptors[mip];
 }
 
 b8 vulkan_swapchain_create(RenderContext* context, const SwapchainDesc* desc,
-                           VulkanSwapchain** ppSwapchain)
+                           VulkanSwapchain** ppSwapchain, VkSwapchainKHR old_swapchain)
 {
     assert(context);
     assert(desc);
     assert(ppSwapchain);
 
     VulkanSwapchain* swapchain = (VulkanSwapchain*)alloc_aligned_memory(
-        sizeof(VulkanSwapchain) + sizeof(RenderTarget*) * desc->image_count + sizeof(SwapchainDesc),
+        sizeof(VulkanSwapchain) + sizeof(RenderTargetHandle) * desc->image_count +
+            sizeof(SwapchainDesc),
         16);
-    swapchain->render_targets = (RenderTarget**)(swapchain + 1);
+    swapchain->render_targets = (RenderTargetHandle*)(swapchain + 1);
     swapchain->desc = (SwapchainDesc*)(swapchain->render_targets + desc->image_count);
     assert(swapchain);
+    *swapchain->desc = *desc;
 
     uint32_t width = desc->width;
     uint32_t height = desc->height;
@@ -233,20 +302,21 @@ b8 vulkan_swapchain_create(RenderContext* context, const SwapchainDesc* desc,
     swapchain_create_info.imageArrayLayers = 1;
     swapchain_create_info.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
 
+    // must outlive vkCreateSwapchainKHR
+    u32 queue_family_indices[] = {context->device_context.graphics_family.index,
+                                  context->device_context.present_family.index};
+
     if (context->device_context.graphics_family.index !=
         context->device_context.present_family.index)
     {
         swapchain_create_info.imageSharingMode = VK_SHARING_MODE_CONCURRENT;
         swapchain_create_info.queueFamilyIndexCount = 2;
-        u32 queue_family_indices[] = {context->device_context.graphics_family.index,
-                                      context->device_context.transfer_family.index};
         swapchain_create_info.pQueueFamilyIndices = queue_family_indices;
     }
     else
     {
         swapchain_create_info.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
         swapchain_create_info.queueFamilyIndexCount = 1;
-        u32 queue_family_indices[] = {context->device_context.graphics_family.index};
         swapchain_create_info.pQueueFamilyIndices = queue_family_indices;
     }
 
@@ -255,7 +325,7 @@ b8 vulkan_swapchain_create(RenderContext* context, const SwapchainDesc* desc,
     swapchain_create_info.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
     swapchain_create_info.presentMode = selected_present_mode;
     swapchain_create_info.clipped = VK_TRUE;
-    swapchain_create_info.oldSwapchain = 0;
+    swapchain_create_info.oldSwapchain = old_swapchain;
 
     VK_CHECK(vkCreateSwapchainKHR(context->device_context.handle, &swapchain_create_info,
                                   context->allocator, &swapchain->handle));
@@ -337,13 +407,17 @@ b8 vulkan_swapchain_recreate(RenderContext* context, VulkanSwapchain** out_swapc
 {
     assert(out_swapchain);
 
-    VulkanSwapchain* swapchain = *out_swapchain;
-    SwapchainDesc swapchainDesc = *swapchain->desc;
-    vulkan_swapchain_destroy(context, swapchain);
+    VulkanSwapchain* old_swapchain = *out_swapchain;
+    SwapchainDesc swapchainDesc = *old_swapchain->desc;
+    VulkanSwapchain* swapchain = NULL;
 
-    if (!vulkan_swapchain_create(context, &swapchainDesc, &swapchain))
+    // the driver can reuse the old images, the old swapchain itself is destroyed once the
+    // frames presenting from it retire
+    if (!vulkan_swapchain_create(context, &swapchainDesc, &swapchain, old_swapchain->handle))
         return false;
 
+    vulkan_deletion_queue_push_swapchain(context, old_swapchain);
+
     *out_swapchain = swapchain;
 
     return true;
@@ -376,6 +450,8 @@ b8 acquire_next_image_index_swapchain(RenderContext* context, VulkanSwapchain* s
                                       u64 timeout_ns, VkSemaphore image_available_semaphore,
                                       VkFence fence, u32* image_index)
 {
+    PKO_PROFILE_FUNCTION();
+
     VkResult result =
         vkAcquireNextImageKHR(context->device_context.handle, swapchain->handle, timeout_ns,
                               image_available_semaphore, fence, image_index);
@@ -400,6 +476,8 @@ b8 present_image_swapchain(RenderContext* context, VulkanSwapchain* swapchain,
                            VkQueue present_queue, VkSemaphore render_complete_semaphore,
                            u32 current_image_index)
 {
+    PKO_PROFILE_FUNCTION();
+
     VkPresentInfoKHR present_info{VK_STRUCTURE_TYPE_PRESENT_INFO_KHR};
     present_info.waitSemaphoreCount = 1;
     present_info.pWaitSemaphores = &render_complete_semaphore;
@@ -491,14 +569,27 @@ VkSampleCountFlagBits to_vulkan_sample_count(u32 sampleCount)
     return VK_SAMPLE_COUNT_FLAG_BITS_MAX_ENUM;
 }
 
+// descriptor types are plain enum values, not flags. a storage image is sampled as well
+bool is_descriptor_type_storage_image(VkDescriptorType type)
+{
+    return type == VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+}
+
+bool is_descriptor_type_sampled_image(VkDescriptorType type)
+{
+    return type == VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE ||
+           type == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER ||
+           type == VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+}
+
 VkImageUsageFlags descriptor_type_to_vulkan_image_usage(VkDescriptorType type)
 {
     VkImageUsageFlags flags = 0;
 
-    if (type & VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE)
+    if (is_descriptor_type_sampled_image(type))
         flags |= VK_IMAGE_USAGE_SAMPLED_BIT;
 
-    if (type & VK_DESCRIPTOR_TYPE_STORAGE_IMAGE)
+    if (is_descriptor_type_storage_image(type))
         flags |= VK_IMAGE_USAGE_STORAGE_BIT;
 
     return flags;
@@ -520,6 +611,12 @@ VkImageUsageFlags resource_state_to_vulkan_image_usage(ResourceState state)
     if (state & RESOURCE_STATE_COPY_SOURCE)
         flags |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
 
+    if (state & RESOURCE_STATE_UNORDERED_ACCESS)
+        flags |= VK_IMAGE_USAGE_STORAGE_BIT;
+
+    if (state & RESOURCE_STATE_SHADER_RESOURCE)
+        flags |= VK_IMAGE_USAGE_SAMPLED_BIT;
+
     return flags;
 }
 
@@ -570,6 +667,15 @@ VkImageLayout resource_state_to_vulkan_image_layout(ResourceState state)
             break;
         case RESOURCE_STATE_DEPTH_READ:
             result = VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_STENCIL_READ_ONLY_OPTIMAL;
+            break;
+        case RESOURCE_STATE_UNORDERED_ACCESS:
+            result = VK_IMAGE_LAYOUT_GENERAL;
+            break;
+        case RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE:
+        case RESOURCE_STATE_PIXEL_SHADER_RESOURCE:
+        case RESOURCE_STATE_SHADER_RESOURCE:
+            result = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+            break;
         case RESOURCE_STATE_PRESENT:
             result = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
             break;
@@ -584,24 +690,79 @@ VkImageLayout resource_state_to_vulkan_image_layout(ResourceState state)
     return result;
 }
 
-void vulkan_texture_create(RenderContext* context, TextureDesc* desc, Texture** ptexture)
+static void fill_image_create_info(const TextureDesc* desc, VkImageCreateInfo* imgCreateInfo)
+{
+    *imgCreateInfo = {VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO};
+    imgCreateInfo->pNext = NULL;
+    imgCreateInfo->flags = 0;
+    imgCreateInfo->imageType = VK_IMAGE_TYPE_2D;
+    imgCreateInfo->format = desc->vulkan_format;
+    imgCreateInfo->extent.width = desc->width;
+    imgCreateInfo->extent.height = desc->height;
+    imgCreateInfo->extent.depth = 1;
+    imgCreateInfo->mipLevels = desc->mip_levels;
+    imgCreateInfo->arrayLayers = 1;
+    imgCreateInfo->samples = to_vulkan_sample_count(desc->sample_count);
+    imgCreateInfo->tiling = VK_IMAGE_TILING_OPTIMAL;
+    imgCreateInfo->usage = descriptor_type_to_vulkan_image_usage(desc->type) |
+                           resource_state_to_vulkan_image_usage(desc->start_state);
+    imgCreateInfo->sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    imgCreateInfo->queueFamilyIndexCount = 0;
+    imgCreateInfo->pQueueFamilyIndices = nullptr;
+    imgCreateInfo->initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    imgCreateInfo->usage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+}
+
+static void create_texture_views(RenderContext* context, Texture* texture,
+                                 TextureCold* texture_cold, VkFormat format, b8 srv,
+                                 u32 uav_count)
+{
+    // SRV
+    VkImageViewCreateInfo viewCreateInfo{VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO};
+    viewCreateInfo.pNext = NULL;
+    viewCreateInfo.flags = 0;
+    viewCreateInfo.image = texture->image;
+    viewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewCreateInfo.format = format;
+    viewCreateInfo.components.r = VK_COMPONENT_SWIZZLE_R;
+    viewCreateInfo.components.g = VK_COMPONENT_SWIZZLE_G;
+    viewCreateInfo.components.b = VK_COMPONENT_SWIZZLE_B;
+    viewCreateInfo.components.a = VK_COMPONENT_SWIZZLE_A;
+    viewCreateInfo.subresourceRange.baseArrayLayer = 0;
+    viewCreateInfo.subresourceRange.layerCount = 1;
+    viewCreateInfo.subresourceRange.baseMipLevel = 0;
+    viewCreateInfo.subresourceRange.levelCount = texture->mip_levels;
+    viewCreateInfo.subresourceRange.aspectMask = texture->aspect_mask;
+
+    if (srv)
+    {
+        VK_CHECK(vkCreateImageView(context->device_context.handle, &viewCreateInfo,
+                                   context->allocator, &texture->srv_descriptor));
+    }
+
+    viewCreateInfo.subresourceRange.levelCount = 1;
+    for (u32 i = 0; i < uav_count; ++i)
+    {
+        viewCreateInfo.subresourceRange.baseMipLevel = i;
+        VK_CHECK(vkCreateImageView(context->device_context.handle, &viewCreateInfo,
+                                   context->allocator, &texture_cold->uav_descriptors[i]));
+    }
+
+    texture_cold->uav_descriptor_count = uav_count;
+}
+
+void vulkan_texture_create(RenderContext* context, TextureDesc* desc, TextureHandle* out_texture)
 {
     assert(context);
     assert(desc);
-    assert(ptexture);
+    assert(out_texture);
+    assert(desc->mip_levels <= MAX_MIP_LEVELS);
 
-    Texture* texture = (Texture*)alloc_aligned_memory(
-        sizeof(Texture) + desc->type & VK_DESCRIPTOR_TYPE_STORAGE_IMAGE
-            ? sizeof(VkImageView) * desc->mip_levels
-            : 0,
-        16);
-    memset(texture, 0,
-           sizeof(sizeof(Texture) + desc->type & VK_DESCRIPTOR_TYPE_STORAGE_IMAGE
-                      ? sizeof(VkImageView) * desc->mip_levels
-                      : 0));
+    const b8 is_storage_image = is_descriptor_type_storage_image(desc->type);
 
-    if (desc->type & VK_DESCRIPTOR_TYPE_STORAGE_IMAGE)
-        texture->uav_descriptors = (VkImageView*)(texture + 1);
+    Texture* texture = NULL;
+    TextureCold* texture_cold = NULL;
+    out_texture->id = context->texture_pool->create(&texture, &texture_cold);
 
     if (desc->native_handle == NULL)
     {
@@ -619,78 +780,53 @@ void vulkan_texture_create(RenderContext* context, TextureDesc* desc, Texture**
     texture->sample_count = desc->sample_count;
     texture->mip_levels = desc->mip_levels;
 
-    if (texture->image == VK_NULL_HANDLE)
-    {
-        VkImageCreateInfo imgCreateInfo = {VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO};
-        imgCreateInfo.pNext = NULL;
-        imgCreateInfo.flags = 0;
-        imgCreateInfo.imageType = VK_IMAGE_TYPE_2D;
-        imgCreateInfo.format = desc->vulkan_format;
-        imgCreateInfo.extent.width = desc->width;
-        imgCreateInfo.extent.height = desc->height;
-        imgCreateInfo.extent.depth = 1;
-        imgCreateInfo.mipLevels = desc->mip_levels;
-        imgCreateInfo.arrayLayers = 1;
-        imgCreateInfo.samples = to_vulkan_sample_count(desc->sample_count);
-        imgCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
-        imgCreateInfo.usage = descriptor_type_to_vulkan_image_usage(desc->type) |
-                              resource_state_to_vulkan_image_usage(desc->start_state);
-        imgCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-        imgCreateInfo.queueFamilyIndexCount = 0;
-        imgCreateInfo.pQueueFamilyIndices = nullptr;
-        imgCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-        imgCreateInfo.usage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
-
-        VmaAllocationCreateInfo allocCreateInfo = {};
-        allocCreateInfo.usage = VMA_MEMORY_USAGE_AUTO;
-        allocCreateInfo.flags = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT;
-
-        VK_CHECK(vmaCreateImage(context->vma_allocator, &imgCreateInfo, &allocCreateInfo,
-                                &texture->image, &texture->pAlloc, nullptr));
-    }
+    texture_cold->resting_state = desc->start_state;
 
-    // SRV
-    VkImageViewCreateInfo viewCreateInfo{VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO};
-    viewCreateInfo.pNext = NULL;
-    viewCreateInfo.flags = 0;
-    viewCreateInfo.image = texture->image;
-    viewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-    viewCreateInfo.format = desc->vulkan_format;
-    viewCreateInfo.components.r = VK_COMPONENT_SWIZZLE_R;
-    viewCreateInfo.components.g = VK_COMPONENT_SWIZZLE_G;
-    viewCreateInfo.components.b = VK_COMPONENT_SWIZZLE_B;
-    viewCreateInfo.components.a = VK_COMPONENT_SWIZZLE_A;
-    viewCreateInfo.subresourceRange.baseArrayLayer = 0;
-    viewCreateInfo.subresourceRange.layerCount = 1;
-    viewCreateInfo.subresourceRange.baseMipLevel = 0;
-    viewCreateInfo.subresourceRange.levelCount = desc->mip_levels;
-    viewCreateInfo.subresourceRange.aspectMask = format_to_vulkan_image_aspect(desc->vulkan_format);
-    texture->aspect_mask = format_to_vulkan_image_aspect(desc->vulkan_format);
-
-    if (desc->type & VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE)
+    if (texture->image == VK_NULL_HANDLE)
     {
-        VK_CHECK(vkCreateImageView(context->device_context.handle, &viewCreateInfo,
-                                   context->allocator, &texture->srv_descriptor));
-    }
+        VkImageCreateInfo imgCreateInfo;
+        fill_image_create_info(desc, &imgCreateInfo);
+        texture_cold->create_info = imgCreateInfo;
 
-    if (desc->type & VK_DESCRIPTOR_TYPE_STORAGE_IMAGE)
-    {
-        viewCreateInfo.subresourceRange.levelCount = 1;
-        for (u32 i = 0; i < desc->mip_levels; ++i)
+        if (desc->alias_allocation != VK_NULL_HANDLE)
+        {
+            // the allocation belongs to the caller, destroy leaves it alone
+            VK_CHECK(vkCreateImage(context->device_context.handle, &imgCreateInfo,
+                                   context->allocator, &texture->image));
+            VK_CHECK(vmaBindImageMemory(context->vma_allocator, desc->alias_allocation,
+                                        texture->image));
+        }
+        else
         {
-            viewCreateInfo.subresourceRange.baseMipLevel = i;
-            VK_CHECK(vkCreateImageView(context->device_context.handle, &viewCreateInfo,
-                                       context->allocator, &texture->uav_descriptors[i]));
+            const MemoryCategory category =
+                desc->category != MEMORY_CATEGORY_OTHER ? desc->category : MEMORY_CATEGORY_TEXTURE;
+
+            // render targets keep their own memory, textures share blocks so the
+            // defragmenter can compact them
+            VmaAllocationCreateInfo allocCreateInfo = {};
+            allocCreateInfo.usage = VMA_MEMORY_USAGE_AUTO;
+            if (category == MEMORY_CATEGORY_RENDER_TARGET)
+                allocCreateInfo.flags = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT;
+
+            VK_CHECK(vmaCreateImage(context->vma_allocator, &imgCreateInfo, &allocCreateInfo,
+                                    &texture->image, &texture_cold->allocation, nullptr));
+            vulkan_memory_tag(context, texture_cold->allocation, category);
         }
     }
 
-    *ptexture = texture;
+    texture->aspect_mask = format_to_vulkan_image_aspect(desc->vulkan_format);
+    create_texture_views(context, texture, texture_cold, desc->vulkan_format,
+                         is_descriptor_type_sampled_image(desc->type),
+                         is_storage_image ? desc->mip_levels : 0);
 }
 
-void vulkan_texture_destroy(RenderContext* context, Texture* texture)
+void vulkan_texture_destroy(RenderContext* context, TextureHandle texture_handle)
 {
     assert(context);
-    assert(texture);
+
+    Texture* texture = vulkan_texture_get(context, texture_handle);
+    TextureCold* texture_cold = context->texture_pool->get_cold(texture_handle.id);
+    assert(texture && "stale texture handle");
 
     if (texture->srv_descriptor != VK_NULL_HANDLE)
     {
@@ -698,115 +834,50 @@ void vulkan_texture_destroy(RenderContext* context, Texture* texture)
                            context->allocator);
     }
 
-    if (texture->uav_descriptors)
+    for (u32 i = 0; i < texture_cold->uav_descriptor_count; ++i)
     {
-        for (u32 i = 0; i < texture->mip_levels; ++i)
-        {
-            vkDestroyImageView(context->device_context.handle, texture->uav_descriptors[i],
-                               context->allocator);
-        }
+        vkDestroyImageView(context->device_context.handle, texture_cold->uav_descriptors[i],
+                           context->allocator);
     }
 
     if (texture->owns_image && (texture->image != VK_NULL_HANDLE))
     {
-        vmaDestroyImage(context->vma_allocator, texture->image, texture->pAlloc);
+        vulkan_memory_untag(context, texture_cold->allocation);
+        vmaDestroyImage(context->vma_allocator, texture->image, texture_cold->allocation);
     }
+
+    context->texture_pool->release(texture_handle.id);
 }
 
-b8 load_image_from_file(RenderContext* context, const char* file, Texture* texture)
+Texture* vulkan_texture_get(RenderContext* context, TextureHandle texture_handle)
 {
-    i32 tex_width, tex_height, tex_channels;
-    stbi_uc* pixels = stbi_load(file, &tex_width, &tex_height, &tex_channels, STBI_rgb_alpha);
-
-    if (!pixels)
-    {
-        std::cout << "failed to load texture file " << file << std::endl;
-        return false;
-    }
-
-    void* pixel_ptr = pixels;
-
-    Buffer staging_buffer;
-    u32 staging_buffer_size = tex_width * tex_height * 4;
-
-    vulkan_buffer_create(
-        context, staging_buffer_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_AUTO,
-        VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
-        &staging_buffer);
-    vulkan_buffer_upload(context, &staging_buffer, pixel_ptr, staging_buffer_size);
-    stbi_image_free(pixels);
-
-    // vulkan_image_create(
-    //     context, VK_IMAGE_TYPE_2D,
-    //     tex_width, tex_height,
-    //     VK_FORMAT_R8G8B8A8_SRGB,
-    //     VK_IMAGE_TILING_OPTIMAL,
-    //     VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
-    //     VMA_MEMORY_USAGE_GPU_ONLY,
-    //     true,
-    //     VK_IMAGE_ASPECT_COLOR_BIT,
-    //     out_image
-    //);
-
-    // create one time submit command buffer for image copy from staging buffer
-    Command one_time_submit;
-
-    vulkan_command_pool_create(context, &one_time_submit, QUEUE_TYPE_TRANSFER);
-    vulkan_command_buffer_allocate(context, &one_time_submit, true);
-
-    vulkan_command_buffer_begin(&one_time_submit, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
-
-    // vulkan_image_layout_transition(
-    //     out_image,
-    //     &one_time_submit,
-    //     VK_IMAGE_LAYOUT_UNDEFINED,
-    //     VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-    //     0,
-    //     VK_ACCESS_TRANSFER_WRITE_BIT,
-    //     VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-    //     VK_PIPELINE_STAGE_TRANSFER_BIT
-    //);
-
-    VkBufferImageCopy copy_region = {};
-    copy_region.bufferOffset = 0;
-    copy_region.bufferRowLength = 0;
-    copy_region.bufferImageHeight = 0;
-
-    // TODO: mipmap
-    copy_region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    copy_region.imageSubresource.mipLevel = 0;
-    copy_region.imageSubresource.baseArrayLayer = 0;
-    copy_region.imageSubresource.layerCount = 1;
-    copy_region.imageExtent = {texture->width, texture->height, 1};
-
-    // copy the buffer into the image
-    vkCmdCopyBufferToImage(one_time_submit.buffer, staging_buffer.handle, texture->image,
-                           VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy_region);
-
-    // vulkan_image_layout_transition(
-    //     out_image,
-    //     &one_time_submit,
-    //     VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-    //     VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-    //     VK_ACCESS_TRANSFER_WRITE_BIT,
-    //     VK_ACCESS_SHADER_READ_BIT,
-    //     VK_PIPELINE_STAGE_TRANSFER_BIT,
-    //     VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT
-    //);
-
-    vulkan_command_buffer_end(&one_time_submit);
-
-    VkSubmitInfo submit_info = {};
-    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submit_info.commandBufferCount = 1;
-    submit_info.pCommandBuffers = &one_time_submit.buffer;
+    return context->texture_pool->get(texture_handle.id);
+}
 
-    VK_CHECK(
-        vkQueueSubmit(context->device_context.transfer_queue, 1, &submit_info, VK_NULL_HANDLE));
-    vkQueueWaitIdle(context->device_context.transfer_queue);
-    vulkan_command_pool_destroy(context, &one_time_submit);
+void vulkan_texture_recreate_views(RenderContext* context, TextureHandle texture_handle,
+                                   VkImageView* out_old_views, u32* out_old_view_count)
+{
+    Texture* texture = vulkan_texture_get(context, texture_handle);
+    TextureCold* texture_cold = context->texture_pool->get_cold(texture_handle.id);
+    assert(texture && "stale texture handle");
+
+    u32 old_view_count = 0;
+    const b8 srv = texture->srv_descriptor != VK_NULL_HANDLE;
+    if (srv)
+        out_old_views[old_view_count++] = texture->srv_descriptor;
+    for (u32 i = 0; i < texture_cold->uav_descriptor_count; ++i)
+        out_old_views[old_view_count++] = texture_cold->uav_descriptors[i];
+    *out_old_view_count = old_view_count;
+
+    texture->srv_descriptor = VK_NULL_HANDLE;
+    create_texture_views(context, texture, texture_cold, texture_cold->create_info.format, srv,
+                         texture_cold->uav_descriptor_count);
+}
 
-    vulkan_buffer_destroy(context, &staging_buffer);
+VkImageView vulkan_texture_get_uav(RenderContext* context, TextureHandle texture_handle, u32 mip)
+{
+    TextureCold* texture_cold = context->texture_pool->get_cold(texture_handle.id);
+    assert(texture_cold && mip < texture_cold->uav_descriptor_count);
 
-    return true;
-}
\ No newline at end of file
+    return texture_cold->uav_descriptors[mip];
+}
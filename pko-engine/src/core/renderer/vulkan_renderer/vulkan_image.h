@@ -8,21 +8,38 @@
 bool is_image_format_depth_only(VkFormat format);
 bool is_image_format_depth_stencil(VkFormat format);
 VkSampleCountFlagBits to_vulkan_sample_count(u32 sampleCount);
+bool is_descriptor_type_storage_image(VkDescriptorType type);
+bool is_descriptor_type_sampled_image(VkDescriptorType type);
 VkImageUsageFlags descriptor_type_to_vulkan_image_usage(VkDescriptorType type);
 VkImageUsageFlags resource_state_to_vulkan_image_usage(ResourceState state);
 VkImageAspectFlags format_to_vulkan_image_aspect(VkFormat format);
 VkImageLayout resource_state_to_vulkan_image_layout(ResourceState state);
 
-void vulkan_texture_create(RenderContext* context, TextureDesc* desc, Texture** textures);
-
-void vulkan_texture_destroy(RenderContext* context, Texture* texture);
+void vulkan_texture_create(RenderContext* context, TextureDesc* desc, TextureHandle* out_texture);
+void vulkan_texture_destroy(RenderContext* context, TextureHandle texture);
+// transient pointer into the texture pool, NULL for a stale handle
+Texture* vulkan_texture_get(RenderContext* context, TextureHandle texture);
+VkImageView vulkan_texture_get_uav(RenderContext* context, TextureHandle texture, u32 mip);
+// new views of texture->image after the image was replaced, the old views are handed back
+// for the caller to destroy once no frame uses them. out_old_views holds MAX_MIP_LEVELS + 1
+void vulkan_texture_recreate_views(RenderContext* context, TextureHandle texture,
+                                   VkImageView* out_old_views, u32* out_old_view_count);
 
 b8 vulkan_rendertarget_create(RenderContext* context, RenderTargetDesc* desc,
-                              RenderTarget** out_render_target);
-void vulkan_rendertarget_destroy(RenderContext* context, RenderTarget* render_target);
+                              RenderTargetHandle* out_render_target);
+void vulkan_rendertarget_destroy(RenderContext* context, RenderTargetHandle render_target);
+// what an image created from desc needs, for placing several render targets in one allocation
+void vulkan_rendertarget_get_memory_requirements(RenderContext* context,
+                                                 const RenderTargetDesc* desc,
+                                                 VkMemoryRequirements* out_requirements);
+// transient pointer into the render target pool, NULL for a stale handle
+RenderTarget* vulkan_rendertarget_get(RenderContext* context, RenderTargetHandle render_target);
+VkImageView vulkan_rendertarget_get_mip_view(RenderContext* context,
+                                             RenderTargetHandle render_target, u32 mip);
 
 b8 vulkan_swapchain_create(RenderContext* context, const SwapchainDesc* desc,
-                           VulkanSwapchain** swapchain);
+                           VulkanSwapchain** swapchain,
+                           VkSwapchainKHR old_swapchain = VK_NULL_HANDLE);
 b8 vulkan_swapchain_destroy(RenderContext* context, VulkanSwapchain* swapchain);
 b8 vulkan_swapchain_recreate(RenderContext* context, VulkanSwapchain** out_swapchain);
 void vulkan_swapchain_get_support_info(RenderContext* context,
@@ -33,8 +50,6 @@ void vulkan_framebuffer_create(RenderContext* context, VulkanRenderpass* renderp
                                VkFramebuffer* out_framebuffer);
 void vulkan_framebuffer_destroy(RenderContext* context, VkFramebuffer* framebuffer);
 
-b8 load_image_from_file(RenderContext* context, const char* pFile, Texture* texture);
-
 b8 acquire_next_image_index_swapchain(RenderContext* context, VulkanSwapchain* swapchain,
                                       u64 timeout_ns, VkSemaphore semaphore, VkFence fence,
                                       u32* image_index);
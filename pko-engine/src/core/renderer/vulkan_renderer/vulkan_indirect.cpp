@@ -0,0 +1,258 @@
+#include "vulkan_indirect.h"
+
+#include "core/profiler.h"
+#include "vulkan_buffer.h"
+#include "vulkan_metrics.h"
+#include "vulkan_pipeline.h"
+
+void vulkan_indirect_build_batches(const instanced_draw* draws, u32 count,
+                                   std::vector<IndirectBatch>* out_batches)
+{
+    assert(out_batches);
+
+    out_batches->clear();
+
+    for (u32 i = 0; i < count; ++i)
+    {
+        const instanced_draw& draw = draws[i];
+
+        // the grouping sorted by pipeline and buffers, equal draws are already adjacent
+        if (out_batches->empty() || out_batches->back().pipeline != draw.pipeline ||
+            out_batches->back().vertex_buffer != draw.vertex_buffer ||
+            out_batches->back().index_buffer != draw.index_buffer)
+        {
+            IndirectBatch batch{};
+            batch.pipeline = draw.pipeline;
+            batch.vertex_buffer = draw.vertex_buffer;
+            batch.position_buffer = draw.position_buffer;
+            batch.index_buffer = draw.index_buffer;
+            batch.first_command = i;
+            out_batches->push_back(batch);
+        }
+
+        ++out_batches->back().max_command_count;
+    }
+}
+
+u32 vulkan_indirect_build_commands(const instanced_draw* draws, const u8* visible,
+                                   const IndirectBatch* batches, u32 batch_count,
+                                   VkDrawIndexedIndirectCommand* out_commands, u32* out_counts)
+{
+    assert(out_commands);
+    assert(out_counts);
+
+    u32 written = 0;
+
+    for (u32 b = 0; b < batch_count; ++b)
+    {
+        const IndirectBatch& batch = batches[b];
+        VkDrawIndexedIndirectCommand* command = out_commands + batch.first_command;
+
+        for (u32 i = batch.first_command; i < batch.first_command + batch.max_command_count; ++i)
+        {
+            if (visible && !visible[i])
+                continue;
+
+            const instanced_draw& draw = draws[i];
+            command->indexCount = draw.index_count;
+            command->instanceCount = draw.instance_count;
+            command->firstIndex = draw.first_index;
+            command->vertexOffset = draw.vertex_offset;
+            command->firstInstance = draw.first_instance;
+            ++command;
+        }
+
+        const u32 visible_count = (u32)(command - (out_commands + batch.first_command));
+        out_counts[b] = visible_count;
+        written += visible_count;
+
+        // drawn without a count the tail has to be harmless
+        for (u32 i = visible_count; i < batch.max_command_count; ++i, ++command)
+            *command = VkDrawIndexedIndirectCommand{};
+    }
+
+    return written;
+}
+
+void vulkan_indirect_buffer_create(RenderContext* context, IndirectDrawBuffer* indirect,
+                                   u32 capacity)
+{
+    assert(context);
+    assert(indirect);
+    assert(capacity > 0);
+
+    // indirect offsets have to be multiples of 4, flushes of nonCoherentAtomSize
+    u64 alignment = context->device_context.properties.limits.nonCoherentAtomSize;
+    if (alignment < 4)
+        alignment = 4;
+
+    indirect->capacity = capacity;
+    // a batch holds at least one draw, there are never more counts than commands
+    indirect->count_offset = capacity * sizeof(VkDrawIndexedIndirectCommand);
+    indirect->frame_stride =
+        (indirect->count_offset + capacity * sizeof(u32) + alignment - 1) & ~(alignment - 1);
+
+    vulkan_buffer_create(context, indirect->frame_stride * MAX_FRAME,
+                         VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VMA_MEMORY_USAGE_AUTO,
+                         VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT |
+                             VMA_ALLOCATION_CREATE_MAPPED_BIT,
+                         &indirect->buffer, MEMORY_CATEGORY_INDIRECT);
+
+    Buffer* buffer = vulkan_buffer_get(context, indirect->buffer);
+    indirect->handle = buffer->handle;
+    indirect->mapped_data = (u8*)buffer->mapped_data;
+    assert(indirect->mapped_data && "indirect buffer needs host visible memory");
+
+    indirect->draw_count = context->device_context.draw_indirect_count;
+    indirect->multi_draw = context->device_context.features.multiDrawIndirect;
+}
+
+void vulkan_indirect_buffer_destroy(RenderContext* context, IndirectDrawBuffer* indirect)
+{
+    assert(context);
+    assert(indirect);
+
+    vulkan_buffer_destroy(context, indirect->buffer);
+    indirect->buffer = {};
+    indirect->handle = VK_NULL_HANDLE;
+    indirect->mapped_data = NULL;
+    indirect->batches.clear();
+}
+
+void vulkan_indirect_buffer_set_draws(IndirectDrawBuffer* indirect, const instanced_draw* draws,
+                                      u32 count)
+{
+    assert(count <= indirect->capacity && "indirect buffer is full");
+
+    vulkan_indirect_build_batches(draws, count, &indirect->batches);
+}
+
+void vulkan_indirect_buffer_build(RenderContext* context, IndirectDrawBuffer* indirect,
+                                  u32 frame, const instanced_draw* draws, const u8* visible)
+{
+    PKO_PROFILE_FUNCTION();
+
+    assert(frame < MAX_FRAME);
+
+    if (indirect->batches.empty())
+        return;
+
+    u8* region = indirect->mapped_data + indirect->frame_stride * frame;
+    const u32 written = vulkan_indirect_build_commands(
+        draws, visible, indirect->batches.data(), (u32)indirect->batches.size(),
+        (VkDrawIndexedIndirectCommand*)region, (u32*)(region + indirect->count_offset));
+
+    // from the draws, the region is write combined and slow to read back
+    u64 instance_count = 0;
+    u64 triangle_count = 0;
+    const IndirectBatch& last = indirect->batches.back();
+    const u32 draw_count = last.first_command + last.max_command_count;
+    for (u32 i = 0; i < draw_count; ++i)
+    {
+        if (visible && !visible[i])
+            continue;
+
+        instance_count += draws[i].instance_count;
+        triangle_count += (u64)(draws[i].index_count / 3) * draws[i].instance_count;
+    }
+
+    // commands executed by the device, the calls recorded are one per batch
+    vulkan_metrics_add(METRIC_DRAWS, written);
+    vulkan_metrics_add(METRIC_DRAW_INSTANCES, instance_count);
+    vulkan_metrics_add(METRIC_INDEXED_TRIANGLES, triangle_count);
+
+    const u64 command_bytes = draw_count * sizeof(VkDrawIndexedIndirectCommand);
+    const u64 count_bytes = indirect->batches.size() * sizeof(u32);
+    vulkan_metrics_add(METRIC_BYTES_UPLOADED, command_bytes + count_bytes);
+
+    // no-op on coherent memory
+    Buffer* buffer = vulkan_buffer_get(context, indirect->buffer);
+    vmaFlushAllocation(context->vma_allocator, buffer->allocation,
+                       indirect->frame_stride * frame, indirect->count_offset + count_bytes);
+}
+
+void vulkan_indirect_record_batches(Command* command, const IndirectBatch* batches,
+                                    u32 first_batch, u32 batch_count, VkBuffer buffer,
+                                    u64 commands_offset, u64 counts_offset, b8 draw_count,
+                                    b8 multi_draw, Pipeline* pipeline, VkBuffer instance_buffer,
+                                    b8 position_only)
+{
+    assert(command);
+    assert(pipeline);
+
+    if (batch_count == 0)
+        return;
+
+    const u32 stride = sizeof(VkDrawIndexedIndirectCommand);
+
+    // firstInstance picks the range of the stream, the binding offset stays 0
+    VkDeviceSize instance_offset = 0;
+    vkCmdBindVertexBuffers(command->buffer, 1, 1, &instance_buffer, &instance_offset);
+
+    Pipeline* bound_pipeline = pipeline;
+    VkBuffer bound_vertex_buffer = VK_NULL_HANDLE;
+    VkBuffer bound_index_buffer = VK_NULL_HANDLE;
+
+    for (u32 b = first_batch; b < first_batch + batch_count; ++b)
+    {
+        const IndirectBatch& batch = batches[b];
+        Pipeline* batch_pipeline = position_only ? pipeline : batch.pipeline;
+        const VkBuffer vertex_buffer = position_only ? batch.position_buffer : batch.vertex_buffer;
+
+        // the layout is shared, bound descriptor sets survive the switch
+        if (batch_pipeline != bound_pipeline)
+        {
+            vulkan_pipeline_bind(command, VK_PIPELINE_BIND_POINT_GRAPHICS, batch_pipeline);
+            bound_pipeline = batch_pipeline;
+        }
+
+        if (vertex_buffer != bound_vertex_buffer)
+        {
+            VkDeviceSize offset = 0;
+            vkCmdBindVertexBuffers(command->buffer, 0, 1, &vertex_buffer, &offset);
+            bound_vertex_buffer = vertex_buffer;
+        }
+
+        if (batch.index_buffer != bound_index_buffer)
+        {
+            vkCmdBindIndexBuffer(command->buffer, batch.index_buffer, 0, VK_INDEX_TYPE_UINT32);
+            bound_index_buffer = batch.index_buffer;
+        }
+
+        const u64 batch_offset = commands_offset + batch.first_command * stride;
+
+        if (draw_count)
+        {
+            vkCmdDrawIndexedIndirectCountKHR(command->buffer, buffer, batch_offset, buffer,
+                                             counts_offset + b * sizeof(u32),
+                                             batch.max_command_count, stride);
+        }
+        else if (multi_draw)
+        {
+            vkCmdDrawIndexedIndirect(command->buffer, buffer, batch_offset,
+                                     batch.max_command_count, stride);
+        }
+        else
+        {
+            for (u32 i = 0; i < batch.max_command_count; ++i)
+            {
+                vkCmdDrawIndexedIndirect(command->buffer, buffer, batch_offset + i * stride, 1,
+                                         stride);
+            }
+        }
+    }
+}
+
+void vulkan_indirect_buffer_record(Command* command, const IndirectDrawBuffer* indirect,
+                                   u32 frame, Pipeline* pipeline, VkBuffer instance_buffer,
+                                   u32 first_batch, u32 batch_count, b8 position_only)
+{
+    assert(first_batch + batch_count <= indirect->batches.size());
+
+    const u64 region_offset = indirect->frame_stride * frame;
+    vulkan_indirect_record_batches(command, indirect->batches.data(), first_batch, batch_count,
+                                   indirect->handle, region_offset,
+                                   region_offset + indirect->count_offset, indirect->draw_count,
+                                   indirect->multi_draw, pipeline, instance_buffer,
+                                   position_only);
+}
@@ -0,0 +1,62 @@
+#ifndef VULKAN_INDIRECT_H
+#define VULKAN_INDIRECT_H
+
+#include "vulkan_types.inl"
+
+#include "vulkan_mesh.h"
+
+#include <vector>
+
+/*
+     Indirect draws : the draw list is split into batches of draws sharing pipeline and
+     geometry buffers when it changes. Every frame the commands of the visible draws are
+     written into the region of the frame and each batch goes out as one
+     vkCmdDrawIndexedIndirect, or vkCmdDrawIndexedIndirectCount reading its count from the
+     buffer, so recording costs the same however many draws are visible.
+     The tail of a batch is filled with zero instance commands, a call that ignores the count
+     still draws only the visible ones, and recorded calls stay valid while visibility changes.
+     The builders only touch memory and can be timed without a device.
+*/
+
+// batches over draws, consecutive draws with the same pipeline and buffers share one
+void vulkan_indirect_build_batches(const instanced_draw* draws, u32 count,
+                                   std::vector<IndirectBatch>* out_batches);
+
+// commands of the visible draws packed at the front of every batch, its count into
+// out_counts. visible holds a flag per draw, NULL draws everything. returns the commands
+// written that draw something
+u32 vulkan_indirect_build_commands(const instanced_draw* draws, const u8* visible,
+                                   const IndirectBatch* batches, u32 batch_count,
+                                   VkDrawIndexedIndirectCommand* out_commands, u32* out_counts);
+
+void vulkan_indirect_buffer_create(RenderContext* context, IndirectDrawBuffer* indirect,
+                                   u32 capacity);
+// the device has to be idle
+void vulkan_indirect_buffer_destroy(RenderContext* context, IndirectDrawBuffer* indirect);
+
+// rebuilds the batches, whenever the draw list changed
+void vulkan_indirect_buffer_set_draws(IndirectDrawBuffer* indirect, const instanced_draw* draws,
+                                      u32 count);
+
+// writes the region of frame, after the frame retired. draws is the list given to set_draws
+void vulkan_indirect_buffer_build(RenderContext* context, IndirectDrawBuffer* indirect,
+                                  u32 frame, const instanced_draw* draws, const u8* visible);
+
+// one indirect call per batch in [first_batch, first_batch + batch_count) of batches. the
+// commands of a batch start at commands_offset + first_command * stride in buffer, its count is
+// the u32 at counts_offset + b * 4. without draw_count the tail has to be zero instance
+// commands. position_only draws every batch with pipeline from its position buffer, the
+// same commands fill a depth only pass
+void vulkan_indirect_record_batches(Command* command, const IndirectBatch* batches,
+                                    u32 first_batch, u32 batch_count, VkBuffer buffer,
+                                    u64 commands_offset, u64 counts_offset, b8 draw_count,
+                                    b8 multi_draw, Pipeline* pipeline, VkBuffer instance_buffer,
+                                    b8 position_only);
+
+// the batches over the region of frame, the instance stream goes to binding 1.
+// pipeline and descriptor sets with the transform buffer have to be bound
+void vulkan_indirect_buffer_record(Command* command, const IndirectDrawBuffer* indirect,
+                                   u32 frame, Pipeline* pipeline, VkBuffer instance_buffer,
+                                   u32 first_batch, u32 batch_count, b8 position_only);
+
+#endif  // !VULKAN_INDIRECT_H
@@ -2,6 +2,25 @@
 
 #include "vulkan_memory_allocate.h"
 
+#include <cstdio>
+#include <iostream>
+
+// below this the callback only fires for heaps that are about to run out
+static const f32 DEFAULT_PRESSURE_FRACTION = 0.9f;
+// a heap under pressure has to fall this far below the threshold before it can fire again,
+// usage hovering at the threshold would otherwise report every few frames
+static const f32 PRESSURE_RELEASE_MARGIN = 0.05f;
+
+static const char* category_names[MEMORY_CATEGORY_COUNT] = {
+	"other",
+	"mesh",
+	"texture",
+	"render target",
+	"staging",
+	"uniform",
+	"indirect"
+};
+
 void vulkan_memory_allocator_create(RenderContext* context)
 {
 	VmaVulkanFunctions vulkan_functions = {};
@@ -13,14 +32,147 @@ void vulkan_memory_allocator_create(RenderContext* context)
 	vma_allocator_create_info.device = context->device_context.handle;
 	vma_allocator_create_info.instance = context->instance;
 	vma_allocator_create_info.pVulkanFunctions = &vulkan_functions;
+	// needed for vkGetPhysicalDeviceMemoryProperties2 behind the budget query
+	vma_allocator_create_info.vulkanApiVersion = VK_API_VERSION_1_2;
+	if (context->device_context.memory_budget)
+		vma_allocator_create_info.flags |= VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT;
 	VK_CHECK(vmaCreateAllocator(&vma_allocator_create_info, &context->vma_allocator));
+
+	context->buffer_pool = new BufferPool();
+	context->texture_pool = new TexturePool();
+	context->render_target_pool = new RenderTargetPool();
+
+	context->memory_budget = new MemoryBudget();
+	context->memory_budget->pressure_fraction = DEFAULT_PRESSURE_FRACTION;
+	vulkan_memory_poll_budgets(context);
 }
 
 void vulkan_memory_allocator_destroy(RenderContext* context)
 {
+	// whatever is still alive at this point leaked its handle
+	if (context->buffer_pool->size() || context->texture_pool->size() || context->render_target_pool->size()) {
+		std::cout << "resource leak: " << context->buffer_pool->size() << " buffers, "
+			<< context->texture_pool->size() << " textures, "
+			<< context->render_target_pool->size() << " render targets" << std::endl;
+	}
+
+	for (u32 i = 0; i < MEMORY_CATEGORY_COUNT; ++i) {
+		const u64 count = context->memory_budget->category_counts[i].load(std::memory_order_relaxed);
+		if (count) {
+			std::cout << "memory leak: " << count << " " << category_names[i] << " allocations, "
+				<< context->memory_budget->category_bytes[i].load(std::memory_order_relaxed) << " bytes" << std::endl;
+		}
+	}
+
+	delete context->buffer_pool;
+	delete context->texture_pool;
+	delete context->render_target_pool;
+	delete context->memory_budget;
+	context->buffer_pool = NULL;
+	context->texture_pool = NULL;
+	context->render_target_pool = NULL;
+	context->memory_budget = NULL;
+
 	vmaDestroyAllocator(context->vma_allocator);
 }
 
+void vulkan_memory_tag(RenderContext* context, VmaAllocation allocation, MemoryCategory category)
+{
+	assert(category < MEMORY_CATEGORY_COUNT);
+
+	if (allocation == VK_NULL_HANDLE)
+		return;
+
+	vmaSetAllocationUserData(context->vma_allocator, allocation, (void*)(uintptr_t)category);
+	vmaSetAllocationName(context->vma_allocator, allocation, category_names[category]);
+
+	VmaAllocationInfo info;
+	vmaGetAllocationInfo(context->vma_allocator, allocation, &info);
+
+	context->memory_budget->category_bytes[category].fetch_add(info.size, std::memory_order_relaxed);
+	context->memory_budget->category_counts[category].fetch_add(1, std::memory_order_relaxed);
+}
+
+void vulkan_memory_untag(RenderContext* context, VmaAllocation allocation)
+{
+	if (allocation == VK_NULL_HANDLE)
+		return;
+
+	VmaAllocationInfo info;
+	vmaGetAllocationInfo(context->vma_allocator, allocation, &info);
+
+	const u32 category = (u32)(uintptr_t)info.pUserData;
+	assert(category < MEMORY_CATEGORY_COUNT);
+
+	context->memory_budget->category_bytes[category].fetch_sub(info.size, std::memory_order_relaxed);
+	context->memory_budget->category_counts[category].fetch_sub(1, std::memory_order_relaxed);
+}
+
+void vulkan_memory_poll_budgets(RenderContext* context)
+{
+	MemoryBudget* budget = context->memory_budget;
+
+	const VkPhysicalDeviceMemoryProperties* memory_properties = NULL;
+	vmaGetMemoryProperties(context->vma_allocator, &memory_properties);
+
+	// without VK_EXT_memory_budget VMA estimates usage from its own blocks
+	vmaSetCurrentFrameIndex(context->vma_allocator, context->current_frame);
+	vmaGetHeapBudgets(context->vma_allocator, budget->heaps);
+	budget->heap_count = memory_properties->memoryHeapCount;
 
+	u32 pressure_heaps = 0;
+	for (u32 i = 0; i < budget->heap_count; ++i) {
+		const VmaBudget& heap = budget->heaps[i];
+		const b8 was_over = (budget->pressure_heaps & (1u << i)) != 0;
+		const f32 fraction = was_over ? budget->pressure_fraction - PRESSURE_RELEASE_MARGIN
+			: budget->pressure_fraction;
+		if (heap.budget && (f64)heap.usage > (f64)heap.budget * fraction)
+			pressure_heaps |= 1u << i;
+	}
 
+	const u32 new_heaps = pressure_heaps & ~budget->pressure_heaps;
+	budget->pressure_heaps = pressure_heaps;
+
+	if (budget->pressure_fn == NULL)
+		return;
+
+	for (u32 i = 0; i < budget->heap_count; ++i) {
+		if (new_heaps & (1u << i))
+			budget->pressure_fn(context, i, budget->heaps[i].usage, budget->heaps[i].budget, budget->pressure_user_data);
+	}
+}
+
+void vulkan_memory_set_pressure_callback(RenderContext* context, f32 fraction, MemoryPressureFn fn,
+	void* user_data)
+{
+	assert(fraction > 0.0f);
 
+	context->memory_budget->pressure_fraction = fraction;
+	context->memory_budget->pressure_fn = fn;
+	context->memory_budget->pressure_user_data = user_data;
+	// heaps already over the new threshold report on the next poll
+	context->memory_budget->pressure_heaps = 0;
+}
+
+b8 vulkan_memory_dump_stats(RenderContext* context, const char* path)
+{
+	FILE* file = fopen(path, "w");
+	if (file == NULL) {
+		std::cout << "failed to open " << path << " for the memory stats" << std::endl;
+		return false;
+	}
+
+	char* stats = NULL;
+	vmaBuildStatsString(context->vma_allocator, &stats, VK_TRUE);
+	fputs(stats, file);
+	vmaFreeStatsString(context->vma_allocator, stats);
+
+	fclose(file);
+	return true;
+}
+
+const char* vulkan_memory_category_name(MemoryCategory category)
+{
+	assert(category < MEMORY_CATEGORY_COUNT);
+	return category_names[category];
+}
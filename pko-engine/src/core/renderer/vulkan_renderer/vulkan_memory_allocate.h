@@ -3,10 +3,30 @@
 
 #include "defines.h"
 
-struct RenderContext;
+#include "vulkan_types.inl"
 
 void vulkan_memory_allocator_create(RenderContext* context);
 void vulkan_memory_allocator_destroy(RenderContext* context);
 
+/*
+	Every allocation is tagged with a MemoryCategory right after it is made and untagged right
+	before it is freed, the category lives in the VMA user data so the free side does not need
+	to know it. Tagging also names the allocation, the stats dump shows the category per block.
+*/
+void vulkan_memory_tag(RenderContext* context, VmaAllocation allocation, MemoryCategory category);
+void vulkan_memory_untag(RenderContext* context, VmaAllocation allocation);
+
+// once a frame, refreshes the heap budgets and fires the pressure callback
+void vulkan_memory_poll_budgets(RenderContext* context);
+
+// fn is called once when a heap's usage goes over fraction of its budget and again only after
+// it fell back below, NULL fn removes it
+void vulkan_memory_set_pressure_callback(RenderContext* context, f32 fraction, MemoryPressureFn fn,
+	void* user_data);
+
+// vmaBuildStatsString with the detailed map, false if the file could not be written
+b8 vulkan_memory_dump_stats(RenderContext* context, const char* path);
+
+const char* vulkan_memory_category_name(MemoryCategory category);
 
 #endif // !VULKAN_MEMORY_ALLOCATE_H
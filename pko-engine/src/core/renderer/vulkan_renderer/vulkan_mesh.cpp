@@ -1,7 +1,14 @@
 #include "vulkan_mesh.h"
 
+#include "core/profiler.h"
+#include "core/renderer/culling.h"
 #include "vulkan_buffer.h"
+#include "vulkan_deletion_queue.h"
+#include "vulkan_pipeline.h"
+#include "vulkan_queue.h"
+#include "vulkan_transform_buffer.h"
 
+#include <algorithm>
 #include <iostream>
 #include <memory>
 
@@ -15,93 +22,107 @@ vulkan_render_object::vulkan_render_object(VulkanContext* context_, const char*
 	position = glm::vec3(0.0f);
 	scale = glm::vec3(1.0f);
 	rotation = glm::vec3(0.0f);
+	transform_index = 0;
+	vertex_buffer = {};
+	index_buffer = {};
+	position_buffer = {};
 
 	load_model(path);
 }
 
 void vulkan_render_object::upload_mesh()
 {
-	u32 mesh_count = meshes.size();
-
-	vertex_buffers.resize(mesh_count);
-	index_buffers.resize(mesh_count);
-
-	for (u32 i = 0; i < mesh_count; ++i) {
-
-		Buffer staging_buffer;
-
-		vulkan_buffer_create(
-			pContext,
-			meshes[i].vertices.size() * sizeof(vertex),
-			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-			VMA_MEMORY_USAGE_AUTO,
-			VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
-			&staging_buffer);
-
-		void* data;
-		VK_CHECK(vmaMapMemory(pContext->vma_allocator, staging_buffer.allocation, &data));
-
-		memcpy(data, meshes[i].vertices.data(), meshes[i].vertices.size() * sizeof(vertex));
-
-		vmaUnmapMemory(pContext->vma_allocator, staging_buffer.allocation);
-
-		vulkan_buffer_create(
-			pContext,
-			meshes[i].vertices.size() * sizeof(vertex),
-			VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-			VMA_MEMORY_USAGE_AUTO,
-			VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT,
-			&vertex_buffers[i]);
+	PKO_PROFILE_FUNCTION();
 
-		vulkan_buffer_copy(pContext, &staging_buffer, &vertex_buffers[i], meshes[i].vertices.size() * sizeof(vertex));
-		vulkan_buffer_destroy(pContext, &staging_buffer);
-
-
-		if (meshes[i].indices.size() > 0) {
-
-			Buffer index_staging_buffer;
-
-			vulkan_buffer_create(
-				pContext,
-				meshes[i].indices.size() * sizeof(u32),
-				VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-				VMA_MEMORY_USAGE_AUTO,
-				VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
-				&index_staging_buffer);
-
-			VK_CHECK(vmaMapMemory(pContext->vma_allocator, index_staging_buffer.allocation, &data));
-
-			memcpy(data, meshes[i].indices.data(), meshes[i].indices.size() * sizeof(u32));
+	if (meshes.empty())
+		return;
 
-			vmaUnmapMemory(pContext->vma_allocator, index_staging_buffer.allocation);
+	// packed once here, one copy per buffer instead of one per mesh
+	std::vector<vertex> vertices;
+	std::vector<u32> indices;
 
-			vulkan_buffer_create(
-				pContext,
-				meshes[i].indices.size() * sizeof(u32),
-				VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-				VMA_MEMORY_USAGE_AUTO,
-				VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT,
-				&index_buffers[i]
-			);
+	for (auto& mesh : meshes) {
+		mesh.first_index = (u32)indices.size();
+		mesh.vertex_offset = (i32)vertices.size();
 
-			vulkan_buffer_copy(pContext, &index_staging_buffer, &index_buffers[i], meshes[i].indices.size() * sizeof(u32));
-			vulkan_buffer_destroy(pContext, &index_staging_buffer);
-		}
+		vertices.insert(vertices.end(), mesh.vertices.begin(), mesh.vertices.end());
+		indices.insert(indices.end(), mesh.indices.begin(), mesh.indices.end());
 	}
+
+	// copies are recorded on the transfer queue and overlap graphics,
+	// the next graphics submission waits for them and acquires the buffers
+	// no dedicated memory, the buffers share blocks so the defragmenter can compact them
+	QueueScheduler* scheduler = pContext->queue_scheduler;
+	assert(scheduler);
+
+	vulkan_buffer_create(
+		pContext,
+		vertices.size() * sizeof(vertex),
+		VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+		VMA_MEMORY_USAGE_AUTO,
+		0,
+		&vertex_buffer,
+		MEMORY_CATEGORY_MESH);
+
+	vulkan_queue_scheduler_upload_buffer(pContext, scheduler,
+		vulkan_buffer_get(pContext, vertex_buffer),
+		vertices.data(), vertices.size() * sizeof(vertex), 0,
+		RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER);
+
+	vulkan_buffer_create(
+		pContext,
+		indices.size() * sizeof(u32),
+		VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+		VMA_MEMORY_USAGE_AUTO,
+		0,
+		&index_buffer,
+		MEMORY_CATEGORY_MESH
+	);
+
+	vulkan_queue_scheduler_upload_buffer(pContext, scheduler,
+		vulkan_buffer_get(pContext, index_buffer),
+		indices.data(), indices.size() * sizeof(u32), 0,
+		RESOURCE_STATE_INDEX_BUFFER);
+
+	// full precision, a depth pre-pass has to produce the depth of the shaded pass bit for bit
+	std::vector<glm::vec3> positions(vertices.size());
+	for (u32 i = 0; i < vertices.size(); ++i)
+		positions[i] = vertices[i].position;
+
+	vulkan_buffer_create(
+		pContext,
+		positions.size() * sizeof(glm::vec3),
+		VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+		VMA_MEMORY_USAGE_AUTO,
+		0,
+		&position_buffer,
+		MEMORY_CATEGORY_MESH);
+
+	vulkan_queue_scheduler_upload_buffer(pContext, scheduler,
+		vulkan_buffer_get(pContext, position_buffer),
+		positions.data(), positions.size() * sizeof(glm::vec3), 0,
+		RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER);
 }
 
 void vulkan_render_object::vulkan_render_object_destroy()
 {
+	// frames in flight may still draw the object, destroy once they retire
 	for (auto& mesh : meshes) {
 		for (auto& texture : mesh.textures)
-			vulkan_texture_destroy(pContext, &texture);
+			vulkan_deletion_queue_push_texture(pContext, texture);
 	}
 
-	for (auto& vertex_buffer : vertex_buffers)
-		vmaDestroyBuffer(pContext->vma_allocator, vertex_buffer.handle, vertex_buffer.allocation);
-
-	for(auto& index_buffer: index_buffers)
-		vmaDestroyBuffer(pContext->vma_allocator, index_buffer.handle, index_buffer.allocation);
+	// an object without meshes never created them
+	if (vertex_buffer.id != 0)
+		vulkan_deletion_queue_push_buffer(pContext, vertex_buffer);
+	if (index_buffer.id != 0)
+		vulkan_deletion_queue_push_buffer(pContext, index_buffer);
+	if (position_buffer.id != 0)
+		vulkan_deletion_queue_push_buffer(pContext, position_buffer);
+
+	vertex_buffer = {};
+	index_buffer = {};
+	position_buffer = {};
 }
 
 vulkan_render_object::~vulkan_render_object()
@@ -110,8 +131,12 @@ vulkan_render_object::~vulkan_render_object()
 
 void vulkan_render_object::load_model(std::string path)
 {
+	PKO_PROFILE_FUNCTION();
+
 	Assimp::Importer import;
-	const aiScene* scene = import.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs);
+	// FindInstances folds duplicated meshes into one, the nodes keep referencing it
+	const aiScene* scene = import.ReadFile(path,
+		aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_FindInstances);
 
 	if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
 	{
@@ -120,22 +145,45 @@ void vulkan_render_object::load_model(std::string path)
 	}
 	//directory = path.substr(0, path.find_last_of('/'));
 
-	process_node(scene->mRootNode, scene);
-
+	// meshes are loaded once and keep the scene's indices, nodes only reference them
+	for (unsigned int i = 0; i < scene->mNumMeshes; i++)
+		meshes.push_back(process_mesh(scene->mMeshes[i], scene));
+
+	// the object transform is the root, every node of the file is below it
+	std::vector<u32> parents(1, SCENE_NODE_NONE);
+	std::vector<glm::mat4> locals(1, get_transform_matrix());
+	process_node(scene->mRootNode, 0, &parents, &locals);
+
+	// instances were given nodes in file order
+	std::vector<u32> nodes;
+	scene_hierarchy_build(&hierarchy, parents.data(), locals.data(), (u32)parents.size(), &nodes);
+	for (auto& instance : mesh_instances)
+		instance.node = nodes[instance.node];
+	scene_hierarchy_update(&hierarchy, NULL);
 }
 
-void vulkan_render_object::process_node(aiNode* node_, const aiScene* scene_)
+void vulkan_render_object::process_node(aiNode* node_, u32 parent, std::vector<u32>* parents,
+	std::vector<glm::mat4>* locals)
 {
+	// aiMatrix4x4 is row major
+	const aiMatrix4x4& m = node_->mTransformation;
+	const u32 node = (u32)parents->size();
+	parents->push_back(parent);
+	locals->push_back(glm::mat4(
+		m.a1, m.b1, m.c1, m.d1,
+		m.a2, m.b2, m.c2, m.d2,
+		m.a3, m.b3, m.c3, m.d3,
+		m.a4, m.b4, m.c4, m.d4));
+
 	// process all the node's meshes (if any)
 	for (unsigned int i = 0; i < node_->mNumMeshes; i++)
 	{
-		aiMesh* mesh = scene_->mMeshes[node_->mMeshes[i]];
-		meshes.push_back(process_mesh(mesh, scene_));
+		mesh_instances.push_back({ node_->mMeshes[i], node });
 	}
 	// then do the same for each of its children
 	for (unsigned int i = 0; i < node_->mNumChildren; i++)
 	{
-		process_node(node_->mChildren[i], scene_);
+		process_node(node_->mChildren[i], node, parents, locals);
 	}
 }
 
@@ -143,7 +191,7 @@ mesh vulkan_render_object::process_mesh(aiMesh* mesh_, const aiScene* scene_)
 {
 	std::vector<vertex> vertices;
 	std::vector<u32> indices;
-	std::vector<Texture> textures;
+	std::vector<TextureHandle> textures;
 
 	for (unsigned int i = 0; i < mesh_->mNumVertices; i++)
 	{
@@ -180,24 +228,47 @@ mesh vulkan_render_object::process_mesh(aiMesh* mesh_, const aiScene* scene_)
 		for (unsigned int j = 0; j < face.mNumIndices; j++)
 			indices.push_back(face.mIndices[j]);
 	}
+	// every draw is indexed, unindexed meshes get the trivial index list
+	if (indices.empty()) {
+		for (unsigned int i = 0; i < mesh_->mNumVertices; i++)
+			indices.push_back(i);
+	}
 	// process material
 	if (mesh_->mMaterialIndex >= 0)
 	{
 		aiMaterial* material = scene_->mMaterials[mesh_->mMaterialIndex];
-		std::vector<Texture> diffuseMaps = load_material_textures(material,
+		std::vector<TextureHandle> diffuseMaps = load_material_textures(material,
 			aiTextureType_DIFFUSE, "texture_diffuse");
 		textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
-		std::vector<Texture> specularMaps = load_material_textures(material,
+		std::vector<TextureHandle> specularMaps = load_material_textures(material,
 			aiTextureType_SPECULAR, "texture_specular");
 		textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
 	}
 
-	return { vertices, indices, textures };
+	// around the center of the box, loose but one pass over the vertices
+	glm::vec3 box_min(0.0f);
+	glm::vec3 box_max(0.0f);
+	if (!vertices.empty()) {
+		box_min = box_max = vertices[0].position;
+		for (const vertex& v : vertices) {
+			box_min = glm::min(box_min, v.position);
+			box_max = glm::max(box_max, v.position);
+		}
+	}
+	const glm::vec3 center = (box_min + box_max) * 0.5f;
+	f32 radius_squared = 0.0f;
+	for (const vertex& v : vertices) {
+		const glm::vec3 offset = v.position - center;
+		radius_squared = glm::max(radius_squared, glm::dot(offset, offset));
+	}
+
+	return { vertices, indices, textures, 0, 0,
+		glm::vec4(center, glm::sqrt(radius_squared)), box_min, box_max };
 }
 
-std::vector<Texture> vulkan_render_object::load_material_textures(aiMaterial* mat, aiTextureType type, std::string typeName)
+std::vector<TextureHandle> vulkan_render_object::load_material_textures(aiMaterial* mat, aiTextureType type, std::string typeName)
 {
-	std::vector<Texture> textures;
+	std::vector<TextureHandle> textures;
 	//for (unsigned int i = 0; i < mat->GetTextureCount(type); i++)
 	//{
 	//	aiString str;
@@ -235,6 +306,15 @@ void vulkan_render_object::rotate(float degree, glm::vec3 axis)
 void vulkan_render_object::draw(VkCommandBuffer command_buffer)
 {
 	u32 mesh_count = meshes.size();
+	if (mesh_count == 0)
+		return;
+
+	VkDeviceSize offset = 0 ;
+	Buffer* vertex_buffer_ = vulkan_buffer_get(pContext, vertex_buffer);
+	vkCmdBindVertexBuffers(command_buffer, 0, 1, &vertex_buffer_->handle, &offset);
+
+	Buffer* index_buffer_ = vulkan_buffer_get(pContext, index_buffer);
+	vkCmdBindIndexBuffer(command_buffer, index_buffer_->handle, 0, VK_INDEX_TYPE_UINT32);
 
 	for (u32 i = 0; i < mesh_count; ++i) {
 
@@ -243,19 +323,352 @@ void vulkan_render_object::draw(VkCommandBuffer command_buffer)
 			//meshes[i].textures[j]
 		}
 
-		VkDeviceSize offset = 0 ;
-		vkCmdBindVertexBuffers(command_buffer, 0, 1, &vertex_buffers[i].handle, &offset);
-		
-		if (meshes[i].indices.size() > 0) {
-			vkCmdBindIndexBuffer(command_buffer, index_buffers[i].handle, 0, VK_INDEX_TYPE_UINT32);
-			vkCmdDrawIndexed(command_buffer, meshes[i].indices.size(), 1, 0, 0, 0);
+		vkCmdDrawIndexed(command_buffer, meshes[i].indices.size(), 1, meshes[i].first_index,
+			meshes[i].vertex_offset, 0);
+	}
+}
+
+void vulkan_render_object::build_draw_list(Pipeline* pipeline, std::vector<draw_item>* out_items) const
+{
+	assert(out_items);
+
+	if (mesh_instances.empty())
+		return;
+
+	const VkBuffer vertex_handle = vulkan_buffer_get(pContext, vertex_buffer)->handle;
+	const VkBuffer index_handle = vulkan_buffer_get(pContext, index_buffer)->handle;
+	const VkBuffer position_handle = vulkan_buffer_get(pContext, position_buffer)->handle;
+
+	for (u32 i = 0; i < mesh_instances.size(); ++i) {
+		const mesh& mesh_ = meshes[mesh_instances[i].mesh_index];
+
+		draw_item item{};
+		item.pipeline = pipeline;
+		if (!mesh_.textures.empty())
+			item.material = mesh_.textures[0];
+		item.vertex_buffer = vertex_handle;
+		item.position_buffer = position_handle;
+		item.index_buffer = index_handle;
+		item.first_index = mesh_.first_index;
+		item.vertex_offset = mesh_.vertex_offset;
+		item.index_count = mesh_.indices.size();
+		item.bounds = mesh_.bounds;
+
+		item.transform_index = transform_index + i;
+
+		out_items->push_back(item);
+	}
+}
+
+void vulkan_render_object::write_transforms(TransformBuffer* transforms) const
+{
+	assert(transforms);
+
+	for (u32 i = 0; i < mesh_instances.size(); ++i)
+		vulkan_transform_buffer_set(transforms, transform_index + i, hierarchy.worlds[mesh_instances[i].node]);
+}
+
+b8 vulkan_render_object::update_transforms(TransformBuffer* transforms, JobSystem* jobs)
+{
+	PKO_PROFILE_FUNCTION();
+
+	assert(transforms);
+
+	if (mesh_instances.empty())
+		return false;
+
+	// setting it every frame would recompute the whole tree every frame
+	const glm::mat4 model = get_transform_matrix();
+	if (model != hierarchy.locals[0])
+		scene_hierarchy_set_local(&hierarchy, 0, model);
+
+	if (scene_hierarchy_update(&hierarchy, jobs) == 0)
+		return false;
+
+	b8 moved = false;
+	for (u32 i = 0; i < mesh_instances.size(); ++i) {
+		const u32 node = mesh_instances[i].node;
+		if (hierarchy.updated[node]) {
+			vulkan_transform_buffer_set(transforms, transform_index + i, hierarchy.worlds[node]);
+			moved = true;
+		}
+	}
+
+	return moved;
+}
+
+void vulkan_render_object::build_bounds(std::vector<glm::vec3>* out_mins, std::vector<glm::vec3>* out_maxs) const
+{
+	assert(out_mins);
+	assert(out_maxs);
+
+	for (u32 i = 0; i < mesh_instances.size(); ++i) {
+		const mesh& mesh_ = meshes[mesh_instances[i].mesh_index];
+
+		glm::vec3 world_min, world_max;
+		aabb_transform(hierarchy.worlds[mesh_instances[i].node], mesh_.aabb_min, mesh_.aabb_max,
+			&world_min, &world_max);
+		out_mins->push_back(world_min);
+		out_maxs->push_back(world_max);
+	}
+}
+
+void vulkan_render_object::build_spheres(std::vector<glm::vec4>* out_spheres) const
+{
+	assert(out_spheres);
+
+	for (u32 i = 0; i < mesh_instances.size(); ++i) {
+		const mesh& mesh_ = meshes[mesh_instances[i].mesh_index];
+		out_spheres->push_back(sphere_transform(hierarchy.worlds[mesh_instances[i].node], mesh_.bounds));
+	}
+}
+
+void vulkan_render_object::spawn_entities(RenderWorld* world)
+{
+	assert(world);
+
+	const u32 components = RENDER_COMPONENT_BIT(RENDER_COMPONENT_COUNT) - 1;
+
+	entities.resize(mesh_instances.size());
+	for (u32 i = 0; i < mesh_instances.size(); ++i) {
+		const mesh& mesh_ = meshes[mesh_instances[i].mesh_index];
+		const glm::mat4& world_ = hierarchy.worlds[mesh_instances[i].node];
+
+		entities[i] = render_world_create(world, components);
+
+		u32 row;
+		RenderChunkView view = render_world_view(world, entities[i], &row);
+		view.transforms[row] = world_;
+
+		glm::vec3 world_min, world_max;
+		aabb_transform(world_, mesh_.aabb_min, mesh_.aabb_max, &world_min, &world_max);
+		view.min_x[row] = world_min.x;
+		view.min_y[row] = world_min.y;
+		view.min_z[row] = world_min.z;
+		view.max_x[row] = world_max.x;
+		view.max_y[row] = world_max.y;
+		view.max_z[row] = world_max.z;
+
+		view.meshes[row] = { mesh_instances[i].mesh_index, i };
+		view.materials[row] = { mesh_.textures.empty() ? 0u : mesh_.textures[0].id };
+	}
+}
+
+void vulkan_render_object::sync_entities(RenderWorld* world, JobSystem* jobs) const
+{
+	PKO_PROFILE_FUNCTION();
+
+	assert(world);
+
+	if (hierarchy.updated_count == 0)
+		return;
+
+	const u32 required = RENDER_COMPONENT_BIT(RENDER_COMPONENT_TRANSFORM) |
+		RENDER_COMPONENT_BIT(RENDER_COMPONENT_BOUNDS) | RENDER_COMPONENT_BIT(RENDER_COMPONENT_MESH);
+	render_world_for_each_chunk(world, required, jobs, [&](const RenderChunkView& view, u32) {
+		for (u32 row = 0; row < view.count; ++row) {
+			const mesh_instance& instance = mesh_instances[view.meshes[row].instance];
+			if (!hierarchy.updated[instance.node])
+				continue;
+
+			const mesh& mesh_ = meshes[instance.mesh_index];
+			const glm::mat4& world_ = hierarchy.worlds[instance.node];
+			view.transforms[row] = world_;
+
+			glm::vec3 world_min, world_max;
+			aabb_transform(world_, mesh_.aabb_min, mesh_.aabb_max, &world_min, &world_max);
+			view.min_x[row] = world_min.x;
+			view.min_y[row] = world_min.y;
+			view.min_z[row] = world_min.z;
+			view.max_x[row] = world_max.x;
+			view.max_y[row] = world_max.y;
+			view.max_z[row] = world_max.z;
+		}
+	});
+}
+
+void vulkan_render_object::build_occluders(u32 max_triangles, std::vector<glm::vec3>* out_triangles) const
+{
+	PKO_PROFILE_FUNCTION();
+
+	assert(out_triangles);
+
+	struct candidate {
+		f32 area;
+		u32 instance;
+		u32 first_index;
+	};
+
+	std::vector<candidate> candidates;
+	for (u32 i = 0; i < mesh_instances.size(); ++i) {
+		const mesh& mesh_ = meshes[mesh_instances[i].mesh_index];
+		// sizes in world space, translations do not change them
+		const glm::mat3 linear(hierarchy.worlds[mesh_instances[i].node]);
+		for (u32 t = 0; t + 2 < mesh_.indices.size(); t += 3) {
+			const glm::vec3 a = linear * mesh_.vertices[mesh_.indices[t]].position;
+			const glm::vec3 b = linear * mesh_.vertices[mesh_.indices[t + 1]].position;
+			const glm::vec3 c = linear * mesh_.vertices[mesh_.indices[t + 2]].position;
+			candidates.push_back({ glm::length(glm::cross(b - a, c - a)), i, t });
 		}
-		else {
-			vkCmdDraw(command_buffer, meshes[i].vertices.size(), 1, 0, 0);
+	}
+
+	// largest first, ties in file order so the set is the same every load
+	auto larger = [](const candidate& a, const candidate& b) {
+		if (a.area != b.area)
+			return a.area > b.area;
+		if (a.instance != b.instance)
+			return a.instance < b.instance;
+		return a.first_index < b.first_index;
+	};
+	if (candidates.size() > max_triangles) {
+		std::nth_element(candidates.begin(), candidates.begin() + max_triangles, candidates.end(), larger);
+		candidates.resize(max_triangles);
+	}
+	// back in file order, neighbouring triangles rasterize into the same rows
+	std::sort(candidates.begin(), candidates.end(), [](const candidate& a, const candidate& b) {
+		return a.instance != b.instance ? a.instance < b.instance : a.first_index < b.first_index;
+	});
+
+	for (const candidate& c : candidates) {
+		const mesh& mesh_ = meshes[mesh_instances[c.instance].mesh_index];
+		const glm::mat4& world = hierarchy.worlds[mesh_instances[c.instance].node];
+		for (u32 v = 0; v < 3; ++v) {
+			const glm::vec3& position = mesh_.vertices[mesh_.indices[c.first_index + v]].position;
+			out_triangles->push_back(glm::vec3(world * glm::vec4(position, 1.0f)));
 		}
 	}
 }
 
+// pipeline first, binding it is the most expensive change, then material and geometry
+static bool draw_item_less(const draw_item& a, const draw_item& b)
+{
+	if (a.pipeline != b.pipeline)
+		return a.pipeline < b.pipeline;
+	if (a.material.id != b.material.id)
+		return a.material.id < b.material.id;
+	if (a.vertex_buffer != b.vertex_buffer)
+		return a.vertex_buffer < b.vertex_buffer;
+	if (a.index_buffer != b.index_buffer)
+		return a.index_buffer < b.index_buffer;
+	if (a.first_index != b.first_index)
+		return a.first_index < b.first_index;
+	if (a.vertex_offset != b.vertex_offset)
+		return a.vertex_offset < b.vertex_offset;
+	if (a.index_count != b.index_count)
+		return a.index_count < b.index_count;
+	return a.transform_index < b.transform_index;
+}
+
+static bool draw_item_same_draw(const draw_item& a, const draw_item& b)
+{
+	return a.pipeline == b.pipeline && a.material.id == b.material.id &&
+		a.vertex_buffer == b.vertex_buffer && a.index_buffer == b.index_buffer &&
+		a.first_index == b.first_index && a.vertex_offset == b.vertex_offset &&
+		a.index_count == b.index_count;
+}
+
+void vulkan_draw_items_group(const draw_item* items, u32 count,
+	std::vector<instanced_draw>* out_draws, std::vector<u32>* out_instances)
+{
+	PKO_PROFILE_FUNCTION();
+
+	assert(out_draws);
+	assert(out_instances);
+
+	out_draws->clear();
+	out_instances->clear();
+	out_instances->reserve(count);
+
+	std::vector<draw_item> sorted(items, items + count);
+	std::sort(sorted.begin(), sorted.end(), draw_item_less);
+
+	for (u32 i = 0; i < count; ++i) {
+		const draw_item& item = sorted[i];
+
+		if (i == 0 || !draw_item_same_draw(sorted[i - 1], item)) {
+			instanced_draw draw{};
+			draw.pipeline = item.pipeline;
+			draw.vertex_buffer = item.vertex_buffer;
+			draw.position_buffer = item.position_buffer;
+			draw.index_buffer = item.index_buffer;
+			draw.first_index = item.first_index;
+			draw.vertex_offset = item.vertex_offset;
+			draw.index_count = item.index_count;
+			draw.bounds = item.bounds;
+			draw.first_instance = (u32)out_instances->size();
+			out_draws->push_back(draw);
+		}
+
+		++out_draws->back().instance_count;
+		out_instances->push_back(item.transform_index);
+	}
+}
+
+void vulkan_instanced_draws_record(Command* command, Pipeline* pipeline, VkBuffer instance_buffer,
+	const instanced_draw* draws, u32 count, b8 position_only)
+{
+	assert(command);
+	assert(pipeline);
+
+	if (count == 0)
+		return;
+
+	// firstInstance picks the range of the stream, the binding offset stays 0
+	VkDeviceSize instance_offset = 0;
+	vkCmdBindVertexBuffers(command->buffer, 1, 1, &instance_buffer, &instance_offset);
+
+	Pipeline* bound_pipeline = pipeline;
+	VkBuffer bound_vertex_buffer = VK_NULL_HANDLE;
+	VkBuffer bound_index_buffer = VK_NULL_HANDLE;
+
+	for (u32 i = 0; i < count; ++i) {
+		const instanced_draw& draw = draws[i];
+
+		Pipeline* draw_pipeline = position_only ? pipeline : draw.pipeline;
+		const VkBuffer vertex_buffer_ = position_only ? draw.position_buffer : draw.vertex_buffer;
+
+		// the layout is shared, bound descriptor sets survive the switch
+		if (draw_pipeline != bound_pipeline) {
+			vulkan_pipeline_bind(command, VK_PIPELINE_BIND_POINT_GRAPHICS, draw_pipeline);
+			bound_pipeline = draw_pipeline;
+		}
+
+		if (vertex_buffer_ != bound_vertex_buffer) {
+			VkDeviceSize offset = 0;
+			vkCmdBindVertexBuffers(command->buffer, 0, 1, &vertex_buffer_, &offset);
+			bound_vertex_buffer = vertex_buffer_;
+		}
+
+		if (draw.index_buffer != bound_index_buffer) {
+			vkCmdBindIndexBuffer(command->buffer, draw.index_buffer, 0, VK_INDEX_TYPE_UINT32);
+			bound_index_buffer = draw.index_buffer;
+		}
+
+		vkCmdDrawIndexed(command->buffer, draw.index_count, draw.instance_count,
+			draw.first_index, draw.vertex_offset, draw.first_instance);
+	}
+}
+
+draw_list_stats vulkan_instanced_draws_stats(Pipeline* pipeline, const instanced_draw* draws,
+	u32 count)
+{
+	draw_list_stats stats{};
+	stats.draws = count;
+
+	Pipeline* bound_pipeline = pipeline;
+	for (u32 i = 0; i < count; ++i) {
+		stats.instances += draws[i].instance_count;
+		stats.triangles += (u64)(draws[i].index_count / 3) * draws[i].instance_count;
+
+		if (draws[i].pipeline != bound_pipeline) {
+			++stats.pipeline_switches;
+			bound_pipeline = draws[i].pipeline;
+		}
+	}
+
+	return stats;
+}
+
 vertex_input_description vulkan_render_object::get_vertex_input_description()
 {
 	vertex_input_description result;
@@ -267,7 +680,15 @@ vertex_input_description vulkan_render_object::get_vertex_input_description()
 
 	result.bindings.push_back(input_binding_description);
 
-	std::vector<VkVertexInputAttributeDescription> input_attribute_descriptions(3);
+	// the instance stream, one transform index per instance
+	VkVertexInputBindingDescription instance_binding_description;
+	instance_binding_description.binding = 1;
+	instance_binding_description.stride = sizeof(u32);
+	instance_binding_description.inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+
+	result.bindings.push_back(instance_binding_description);
+
+	std::vector<VkVertexInputAttributeDescription> input_attribute_descriptions(4);
 
 	input_attribute_descriptions[0].binding = 0;
 	input_attribute_descriptions[0].format = VK_FORMAT_R32G32B32_SFLOAT;
@@ -284,6 +705,47 @@ vertex_input_description vulkan_render_object::get_vertex_input_description()
 	input_attribute_descriptions[2].location = 2;
 	input_attribute_descriptions[2].offset = offsetof(vertex, uv);
 
+	input_attribute_descriptions[3].binding = 1;
+	input_attribute_descriptions[3].format = VK_FORMAT_R32_UINT;
+	input_attribute_descriptions[3].location = 3;
+	input_attribute_descriptions[3].offset = 0;
+
+	result.attributes = input_attribute_descriptions;
+
+	return result;
+}
+
+vertex_input_description vulkan_render_object::get_position_input_description()
+{
+	vertex_input_description result;
+
+	VkVertexInputBindingDescription position_binding_description;
+	position_binding_description.binding = 0;
+	position_binding_description.stride = sizeof(glm::vec3);
+	position_binding_description.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+	result.bindings.push_back(position_binding_description);
+
+	VkVertexInputBindingDescription instance_binding_description;
+	instance_binding_description.binding = 1;
+	instance_binding_description.stride = sizeof(u32);
+	instance_binding_description.inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+
+	result.bindings.push_back(instance_binding_description);
+
+	// the locations of get_vertex_input_description, shaders declare the same inputs
+	std::vector<VkVertexInputAttributeDescription> input_attribute_descriptions(2);
+
+	input_attribute_descriptions[0].binding = 0;
+	input_attribute_descriptions[0].format = VK_FORMAT_R32G32B32_SFLOAT;
+	input_attribute_descriptions[0].location = 0;
+	input_attribute_descriptions[0].offset = 0;
+
+	input_attribute_descriptions[1].binding = 1;
+	input_attribute_descriptions[1].format = VK_FORMAT_R32_UINT;
+	input_attribute_descriptions[1].location = 3;
+	input_attribute_descriptions[1].offset = 0;
+
 	result.attributes = input_attribute_descriptions;
 
 	return result;
@@ -5,6 +5,9 @@
 
 #include "vulkan_image.h"
 
+#include "core/renderer/render_world.h"
+#include "core/renderer/scene_hierarchy.h"
+
 #include <glm/glm.hpp>
 
 #include <assimp/Importer.hpp>
@@ -15,10 +18,39 @@
 #include <vector>
 #include <string>
 
-struct model_constant {
-	glm::mat4 model;
-	glm::mat3 normal_matrix;
-	glm::vec3 padding;
+// one mesh instance of the scene. buffers are resolved on the main thread,
+// recording threads never look into the resource pools
+struct draw_item {
+	Pipeline* pipeline;
+	// first texture of the mesh, there is no material beyond its textures
+	TextureHandle material;
+	VkBuffer vertex_buffer;
+	// positions only, for depth only passes. follows vertex_buffer, it is no sort key
+	VkBuffer position_buffer;
+	VkBuffer index_buffer;
+	u32 first_index;
+	i32 vertex_offset;
+	u32 index_count;
+	// into the transform buffer
+	u32 transform_index;
+	// bounding sphere of the mesh, xyz center and w radius before the transform
+	glm::vec4 bounds;
+};
+
+// draw items with the same pipeline, material and geometry merged into one instanced draw.
+// instance i reads its transform index from the instance stream at first_instance + i
+struct instanced_draw {
+	Pipeline* pipeline;
+	VkBuffer vertex_buffer;
+	VkBuffer position_buffer;
+	VkBuffer index_buffer;
+	u32 first_index;
+	i32 vertex_offset;
+	u32 index_count;
+	u32 first_instance;
+	u32 instance_count;
+	// shared by every instance, they draw the same mesh
+	glm::vec4 bounds;
 };
 
 struct vertex_input_description {
@@ -37,8 +69,22 @@ struct vertex {
 struct mesh {
 	std::vector<vertex> vertices;
 	std::vector<u32> indices;
-	std::vector<Texture> textures;
-	glm::mat4 transform_matrix;
+	std::vector<TextureHandle> textures;
+	// into the buffers shared by all meshes of the object, set by upload_mesh
+	u32 first_index;
+	i32 vertex_offset;
+	// xyz center and w radius of a sphere around the vertices, in mesh space
+	glm::vec4 bounds;
+	// box around the vertices, in mesh space
+	glm::vec3 aabb_min;
+	glm::vec3 aabb_max;
+};
+
+// a node referencing a mesh, meshes repeated in the file share one mesh and its buffers
+struct mesh_instance {
+	u32 mesh_index;
+	// into the hierarchy of the object, its world is the transform of the instance
+	u32 node;
 };
 
 class vulkan_render_object {
@@ -51,28 +97,87 @@ public:
 	void load_model(std::string path);
 
 	std::vector<mesh> meshes;
+	std::vector<mesh_instance> mesh_instances;
+	// node 0 holds the object transform, the nodes of the file hang below it
+	SceneHierarchy hierarchy;
 
 	static vertex_input_description get_vertex_input_description();
+	// position_buffer at binding 0 and the instance stream, for depth only pipelines
+	static vertex_input_description get_position_input_description();
 
-	std::vector<Buffer> vertex_buffers;
-	std::vector<Buffer> index_buffers;
+	// every mesh packed into one pair, indirect draws can only address ranges of the bound buffers
+	BufferHandle vertex_buffer;
+	BufferHandle index_buffer;
+	// the positions of vertex_buffer tightly packed, same vertex offsets. a depth pass fetches
+	// 12 bytes per vertex instead of the whole vertex
+	BufferHandle position_buffer;
 
 	glm::mat4 get_transform_matrix() const;
 	void rotate(float degree, glm::vec3 axis);
 	void draw(VkCommandBuffer command_buffer);
+	// appends one item per mesh instance, call after upload_mesh
+	void build_draw_list(Pipeline* pipeline, std::vector<draw_item>* out_items) const;
+	// world of every mesh instance
+	void write_transforms(TransformBuffer* transforms) const;
+	// takes over a changed object transform, updates the hierarchy and writes the worlds of
+	// the mesh instances it recomputed. false when none moved. jobs may be NULL
+	b8 update_transforms(TransformBuffer* transforms, JobSystem* jobs);
+	// world space box of every mesh instance, in the order of build_draw_list
+	void build_bounds(std::vector<glm::vec3>* out_mins, std::vector<glm::vec3>* out_maxs) const;
+	// world space bounding sphere of every mesh instance, in the order of build_draw_list
+	void build_spheres(std::vector<glm::vec4>* out_spheres) const;
+	// the max_triangles largest triangles of the object in world space, 3 vertices each. a
+	// subset of the surfaces stands in for a simplified mesh and never occludes too much
+	void build_occluders(u32 max_triangles, std::vector<glm::vec3>* out_triangles) const;
 
 	glm::vec3 position;
 	glm::vec3 scale;
 	glm::vec3 rotation;
+	// first of mesh_instances.size() slots in the transform buffer
+	u32 transform_index;
+	// entity of every mesh instance, in the order of mesh_instances
+	std::vector<Entity> entities;
+
+	// one entity per mesh instance with every render component, call after upload_mesh
+	void spawn_entities(RenderWorld* world);
+	// copies the worlds and boxes of the instances the last update_transforms moved into
+	// their entities. the world holds the entities of this object only. jobs may be NULL
+	void sync_entities(RenderWorld* world, JobSystem* jobs) const;
 
 private:
-	void process_node(aiNode* node, const aiScene* scene);
+	// appends the node and its subtree, parents before children
+	void process_node(aiNode* node, u32 parent, std::vector<u32>* parents,
+		std::vector<glm::mat4>* locals);
 	mesh process_mesh(aiMesh* mesh, const aiScene* scene);
-	std::vector<Texture> load_material_textures(aiMaterial* mat, aiTextureType type,
+	std::vector<TextureHandle> load_material_textures(aiMaterial* mat, aiTextureType type,
 		std::string typeName);
 
 	VulkanContext* pContext;
 };
 
+// sorts the items by pipeline, material and geometry and merges equal ones.
+// out_instances gets the transform index of every instance in the order the draws read them
+void vulkan_draw_items_group(const draw_item* items, u32 count,
+	std::vector<instanced_draw>* out_draws, std::vector<u32>* out_instances);
+
+// what recording a draw list submits. recording counts nothing, pre-recorded draws replay
+// without recording again, so the owner adds these once per submitted frame
+struct draw_list_stats {
+	u64 draws;
+	u64 instances;
+	u64 triangles;
+	// binds after pipeline, the one bound before the first draw
+	u64 pipeline_switches;
+};
+
+draw_list_stats vulkan_instanced_draws_stats(Pipeline* pipeline, const instanced_draw* draws,
+	u32 count);
+
+// binds the instance stream to binding 1, then vertex and index buffers and draw per draw.
+// pipeline and descriptor sets with the transform buffer have to be bound already.
+// position_only draws everything with pipeline from the position buffers, for depth only passes
+void vulkan_instanced_draws_record(Command* command, Pipeline* pipeline, VkBuffer instance_buffer,
+	const instanced_draw* draws, u32 count, b8 position_only);
+
 
 #endif // !VULKAN_MESH_H
\ No newline at end of file
@@ -0,0 +1,168 @@
+#include "vulkan_metrics.h"
+
+#include <atomic>
+#include <cstdio>
+#include <iostream>
+#include <string>
+
+static std::atomic<u64> counters[METRIC_COUNT];
+
+static FrameMetrics history[METRICS_HISTORY];
+// frames closed so far, history[(frame_count - 1) % METRICS_HISTORY] is the last one
+static u64 frame_count = 0;
+static u64 flushed_count = 0;
+
+static std::string output_path;
+static MetricsFormat output_format = METRICS_FORMAT_CSV;
+static u32 output_flush_interval = 0;
+
+static const char* counter_names[METRIC_COUNT] = {
+    "draws",
+    "draw_instances",
+    "indexed_triangles",
+    "pipeline_binds",
+    "descriptor_sets_allocated",
+    "barriers_issued",
+    "barriers_elided",
+    "bytes_uploaded",
+    "fragment_shader_invocations",
+    "vma_allocations",
+    "vma_allocation_bytes",
+};
+
+const char* vulkan_metrics_counter_name(MetricCounter counter)
+{
+    assert(counter < METRIC_COUNT);
+    return counter_names[counter];
+}
+
+void vulkan_metrics_init(const char* path, MetricsFormat format, u32 flush_interval)
+{
+    for (u32 i = 0; i < METRIC_COUNT; ++i)
+        counters[i].store(0, std::memory_order_relaxed);
+
+    frame_count = 0;
+    flushed_count = 0;
+    output_path = path ? path : "";
+    output_format = format;
+    // everything not flushed has to still be in the ring
+    output_flush_interval = flush_interval < METRICS_HISTORY ? flush_interval : METRICS_HISTORY;
+
+    if (output_path.empty())
+        return;
+
+    FILE* file = fopen(output_path.c_str(), "w");
+    if (file == NULL)
+    {
+        std::cout << "metrics: failed to open " << output_path << std::endl;
+        output_path.clear();
+        return;
+    }
+
+    if (output_format == METRICS_FORMAT_CSV)
+    {
+        fprintf(file, "frame,cpu_frame_ms,gpu_frame_ms");
+        for (u32 i = 0; i < METRIC_COUNT; ++i)
+            fprintf(file, ",%s", counter_names[i]);
+        fprintf(file, "\n");
+    }
+
+    fclose(file);
+}
+
+static void flush()
+{
+    if (output_path.empty() || flushed_count == frame_count)
+        return;
+
+    FILE* file = fopen(output_path.c_str(), "a");
+    if (file == NULL)
+        return;
+
+    // frames that fell out of the ring before a flush are lost, init clamps the interval
+    u64 first = flushed_count;
+    if (frame_count - first > METRICS_HISTORY)
+        first = frame_count - METRICS_HISTORY;
+
+    for (u64 i = first; i < frame_count; ++i)
+    {
+        const FrameMetrics& metrics = history[i % METRICS_HISTORY];
+
+        if (output_format == METRICS_FORMAT_CSV)
+        {
+            fprintf(file, "%llu,%.4f,%.4f", (unsigned long long)metrics.frame,
+                    metrics.cpu_frame_ms, metrics.gpu_frame_ms);
+            for (u32 c = 0; c < METRIC_COUNT; ++c)
+                fprintf(file, ",%llu", (unsigned long long)metrics.counters[c]);
+            fprintf(file, "\n");
+        }
+        else
+        {
+            fprintf(file, "{\"frame\":%llu,\"cpu_frame_ms\":%.4f,\"gpu_frame_ms\":%.4f",
+                    (unsigned long long)metrics.frame, metrics.cpu_frame_ms,
+                    metrics.gpu_frame_ms);
+            for (u32 c = 0; c < METRIC_COUNT; ++c)
+                fprintf(file, ",\"%s\":%llu", counter_names[c],
+                        (unsigned long long)metrics.counters[c]);
+            fprintf(file, "}\n");
+        }
+    }
+
+    fclose(file);
+    flushed_count = frame_count;
+}
+
+void vulkan_metrics_shutdown()
+{
+    flush();
+    output_path.clear();
+}
+
+void vulkan_metrics_add(MetricCounter counter, u64 value)
+{
+    assert(counter < METRIC_COUNT);
+    counters[counter].fetch_add(value, std::memory_order_relaxed);
+}
+
+void vulkan_metrics_end_frame(RenderContext* context, f32 cpu_frame_ms, f32 gpu_frame_ms)
+{
+    assert(context);
+
+    const VkPhysicalDeviceMemoryProperties* memory_properties = NULL;
+    vmaGetMemoryProperties(context->vma_allocator, &memory_properties);
+
+    VmaBudget budgets[VK_MAX_MEMORY_HEAPS];
+    vmaGetHeapBudgets(context->vma_allocator, budgets);
+
+    u64 allocations = 0;
+    u64 allocation_bytes = 0;
+    for (u32 i = 0; i < memory_properties->memoryHeapCount; ++i)
+    {
+        allocations += budgets[i].statistics.allocationCount;
+        allocation_bytes += budgets[i].statistics.allocationBytes;
+    }
+
+    FrameMetrics& metrics = history[frame_count % METRICS_HISTORY];
+    metrics.frame = frame_count;
+    metrics.cpu_frame_ms = cpu_frame_ms;
+    metrics.gpu_frame_ms = gpu_frame_ms;
+
+    for (u32 i = 0; i < METRIC_COUNT; ++i)
+        metrics.counters[i] = counters[i].exchange(0, std::memory_order_relaxed);
+
+    metrics.counters[METRIC_VMA_ALLOCATIONS] = allocations;
+    metrics.counters[METRIC_VMA_ALLOCATION_BYTES] = allocation_bytes;
+
+    ++frame_count;
+
+    if (output_flush_interval > 0 && frame_count - flushed_count >= output_flush_interval)
+        flush();
+}
+
+const FrameMetrics* vulkan_metrics_get_frame(u32 frames_ago)
+{
+    if (frames_ago >= frame_count || frames_ago >= METRICS_HISTORY)
+        return NULL;
+
+    return &history[(frame_count - 1 - frames_ago) % METRICS_HISTORY];
+}
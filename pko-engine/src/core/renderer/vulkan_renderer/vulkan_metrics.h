@@ -0,0 +1,27 @@
+#ifndef VULKAN_METRICS_H
+#define VULKAN_METRICS_H
+
+#include "vulkan_types.inl"
+
+/*
+     Frame metrics : counters are summed over a frame from any thread, the end of the frame
+     closes them into a ring of the last METRICS_HISTORY frames and starts from zero.
+     With an output path the ring is appended to the file every flush_interval frames, so a
+     long session leaves a record of every frame without a debugger attached.
+*/
+// path may be NULL to only keep the ring
+void vulkan_metrics_init(const char* path, MetricsFormat format, u32 flush_interval);
+// flushes what is left
+void vulkan_metrics_shutdown();
+
+// thread safe
+void vulkan_metrics_add(MetricCounter counter, u64 value);
+
+// samples the VMA totals, closes the frame and flushes when due
+void vulkan_metrics_end_frame(RenderContext* context, f32 cpu_frame_ms, f32 gpu_frame_ms);
+
+// 0 is the last closed frame, NULL past the history
+const FrameMetrics* vulkan_metrics_get_frame(u32 frames_ago);
+const char* vulkan_metrics_counter_name(MetricCounter counter);
+
+#endif  // !VULKAN_METRICS_H
@@ -0,0 +1,167 @@
+#include "vulkan_parallel_recorder.h"
+
+#include "core/job_system.h"
+#include "core/profiler.h"
+#include "vulkan_command_buffer.h"
+
+void vulkan_parallel_recorder_create(RenderContext* context, ParallelRecorder* recorder,
+                                     JobSystem* jobs)
+{
+    assert(context);
+    assert(recorder);
+    assert(jobs);
+
+    recorder->jobs = jobs;
+    recorder->slice_count = jobs->worker_count();
+    recorder->max_slices = 0;
+    recorder->commands.resize(MAX_FRAME * recorder->slice_count);
+    recorder->recorded.reserve(recorder->slice_count);
+
+    for (u32 i = 0; i < MAX_FRAME; ++i)
+    {
+        recorder->frame_versions[i] = 0;
+        recorder->frame_slice_counts[i] = 0;
+    }
+
+    for (Command& command : recorder->commands)
+    {
+        vulkan_command_pool_create(context, &command, QUEUE_TYPE_GRAPHICS);
+        vulkan_command_buffer_allocate(context, &command, false);
+    }
+}
+
+void vulkan_parallel_recorder_destroy(RenderContext* context, ParallelRecorder* recorder)
+{
+    assert(context);
+    assert(recorder);
+
+    for (Command& command : recorder->commands)
+        vulkan_command_pool_destroy(context, &command);
+
+    recorder->commands.clear();
+    recorder->recorded.clear();
+    recorder->slice_count = 0;
+    recorder->jobs = NULL;
+}
+
+// records the slices of this frame slot, returns the number of slices
+static u32 record_slices(RenderContext* context, ParallelRecorder* recorder,
+                         const RenderDesc* desc, u32 item_count, u32 min_items_per_slice,
+                         RecordRangeFn record, void* user_data,
+                         VkCommandBufferUsageFlags buffer_usage)
+{
+    if (item_count == 0)
+        return 0;
+
+    if (min_items_per_slice == 0)
+        min_items_per_slice = 1;
+
+    const u32 max_slices = recorder->max_slices != 0 ? recorder->max_slices : recorder->slice_count;
+    u32 slice_size = (item_count + max_slices - 1) / max_slices;
+    if (slice_size < min_items_per_slice)
+        slice_size = min_items_per_slice;
+
+    const u32 slice_count = (item_count + slice_size - 1) / slice_size;
+    assert(slice_count <= recorder->slice_count);
+
+    Command* frame_commands = &recorder->commands[context->current_frame * recorder->slice_count];
+
+    // the profiler may count the fragments of the pass executing them
+    const VkPhysicalDeviceFeatures& features = context->device_context.features;
+    const VkQueryPipelineStatisticFlags pipeline_statistics =
+        features.pipelineStatisticsQuery && features.inheritedQueries
+            ? VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT
+            : 0;
+
+    // one slice per job, the slice index picks the pool so the worker index does not matter
+    recorder->jobs->parallel_for(slice_count, 1, [&](u32 first_slice, u32 count, u32) {
+        for (u32 slice = first_slice; slice < first_slice + count; ++slice)
+        {
+            PKO_PROFILE_ZONE("record slice");
+
+            Command* secondary = &frame_commands[slice];
+            const u32 first = slice * slice_size;
+            const u32 last = first + slice_size < item_count ? first + slice_size : item_count;
+
+            vulkan_command_pool_reset(secondary);
+            vulkan_command_buffer_begin_secondary(secondary, desc, buffer_usage,
+                                                  pipeline_statistics);
+            record(secondary, first, last - first, user_data);
+            vulkan_command_buffer_end(secondary);
+        }
+    });
+
+    return slice_count;
+}
+
+static void execute_slices(RenderContext* context, ParallelRecorder* recorder, Command* command,
+                           u32 slice_count)
+{
+    const Command* frame_commands =
+        &recorder->commands[context->current_frame * recorder->slice_count];
+
+    recorder->recorded.clear();
+    for (u32 slice = 0; slice < slice_count; ++slice)
+        recorder->recorded.push_back(frame_commands[slice].buffer);
+
+    vulkan_command_execute_secondaries(command, (u32)recorder->recorded.size(),
+                                       recorder->recorded.data());
+}
+
+void vulkan_parallel_recorder_set_max_slices(ParallelRecorder* recorder, u32 max_slices)
+{
+    assert(recorder);
+    assert(max_slices <= recorder->slice_count);
+
+    recorder->max_slices = max_slices;
+
+    // static secondaries were split for the old limit
+    for (u32 i = 0; i < MAX_FRAME; ++i)
+        recorder->frame_versions[i] = 0;
+}
+
+void vulkan_parallel_recorder_record(RenderContext* context, ParallelRecorder* recorder,
+                                     Command* command, const RenderDesc* desc, u32 item_count,
+                                     u32 min_items_per_slice, RecordRangeFn record,
+                                     void* user_data)
+{
+    assert(context);
+    assert(recorder);
+    assert(command);
+    assert(desc && desc->secondary_contents);
+    assert(record);
+
+    const u32 slice_count =
+        record_slices(context, recorder, desc, item_count, min_items_per_slice, record,
+                      user_data, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+    recorder->frame_versions[context->current_frame] = 0;
+    recorder->frame_slice_counts[context->current_frame] = slice_count;
+
+    execute_slices(context, recorder, command, slice_count);
+}
+
+void vulkan_parallel_recorder_record_static(RenderContext* context, ParallelRecorder* recorder,
+                                            Command* command, const RenderDesc* desc,
+                                            u32 item_count, u32 min_items_per_slice,
+                                            RecordRangeFn record, void* user_data, u64 version)
+{
+    assert(context);
+    assert(recorder);
+    assert(command);
+    assert(desc && desc->secondary_contents);
+    assert(record);
+    assert(version != 0);
+
+    const u32 frame = context->current_frame;
+
+    // every frame slot has its own copy, so a pending frame never shares a secondary with the
+    // one being recorded and no simultaneous use is needed
+    if (recorder->frame_versions[frame] != version)
+    {
+        recorder->frame_slice_counts[frame] = record_slices(
+            context, recorder, desc, item_count, min_items_per_slice, record, user_data, 0);
+        recorder->frame_versions[frame] = version;
+    }
+
+    execute_slices(context, recorder, command, recorder->frame_slice_counts[frame]);
+}
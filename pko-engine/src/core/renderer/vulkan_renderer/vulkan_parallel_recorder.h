@@ -0,0 +1,39 @@
+#ifndef VULKAN_PARALLEL_RECORDER_H
+#define VULKAN_PARALLEL_RECORDER_H
+
+#include "vulkan_types.inl"
+
+/*
+     Parallel recorder : a draw list is split into one contiguous slice per worker of the job
+     system, every slice is recorded into its own secondary command buffer from its own pool,
+     so no pool is ever touched by two threads. The primary executes the secondaries in
+     slice order, which keeps the draw order of the list.
+     Pools are per frame in flight, a slot is reset only after its frame retired.
+     Per frame recording overwrites the static copy of the slot, switching back re-records.
+*/
+void vulkan_parallel_recorder_create(RenderContext* context, ParallelRecorder* recorder,
+                                     JobSystem* jobs);
+// the device has to be idle
+void vulkan_parallel_recorder_destroy(RenderContext* context, ParallelRecorder* recorder);
+
+// at most max_slices slices, and so threads, per recording, 0 is one per worker. static
+// recordings are redone on their next call
+void vulkan_parallel_recorder_set_max_slices(ParallelRecorder* recorder, u32 max_slices);
+
+// command has to be inside a rendering scope begun from desc with secondary_contents.
+// slices hold at least min_items_per_slice items, a short list stays on one thread.
+// record runs on worker threads, it may not create or destroy pooled resources
+void vulkan_parallel_recorder_record(RenderContext* context, ParallelRecorder* recorder,
+                                     Command* command, const RenderDesc* desc, u32 item_count,
+                                     u32 min_items_per_slice, RecordRangeFn record,
+                                     void* user_data);
+
+// same as above, but the secondaries of a frame slot are kept and only re-recorded when
+// version differs from the one they were recorded with. bump the version whenever the draw
+// list, the pipelines or the viewport change, data read through descriptors may change freely
+void vulkan_parallel_recorder_record_static(RenderContext* context, ParallelRecorder* recorder,
+                                            Command* command, const RenderDesc* desc,
+                                            u32 item_count, u32 min_items_per_slice,
+                                            RecordRangeFn record, void* user_data, u64 version);
+
+#endif  // !VULKAN_PARALLEL_RECORDER_H
@@ -1,5 +1,6 @@
 #include "vulkan_pipeline.h"
 #include "vulkan_shader.h"
+#include "vulkan_metrics.h"
 
 #include "core/file_handle.h"
 #include <iostream>
@@ -315,6 +316,185 @@ b8 vulkan_graphics_pipeline_create(RenderContext* context, VulkanRenderpass* ren
 	return true;
 }
 
+b8 vulkan_graphics_pipeline_create(RenderContext* context, const GraphicsPipelineDesc* desc, Pipeline* out_pipeline)
+{
+	assert(context);
+	assert(desc);
+	assert(out_pipeline);
+	assert(desc->color_format_count <= MAX_COLOR_ATTACHMENT);
+
+	VkShaderModule vertex_shader_module;
+
+	if (!vulkan_shader_module_create(context, &vertex_shader_module, desc->vertex_file_path)) {
+		std::cout << " vertex shader module failed to create" << std::endl;
+		return false;
+	}
+
+	VkShaderModule fragment_shader_module = VK_NULL_HANDLE;
+
+	// depth only pipelines have no fragment stage
+	if (desc->fragment_file_path && !vulkan_shader_module_create(context, &fragment_shader_module, desc->fragment_file_path)) {
+		std::cout << "frag shader module failed to create" << std::endl;
+		vkDestroyShaderModule(context->device_context.handle, vertex_shader_module, context->allocator);
+		return false;
+	}
+
+	VkPipelineShaderStageCreateInfo shader_stages[] = {
+		pipeline_shader_stage_create_info(VK_SHADER_STAGE_VERTEX_BIT, vertex_shader_module),
+		pipeline_shader_stage_create_info(VK_SHADER_STAGE_FRAGMENT_BIT, fragment_shader_module)
+	};
+
+	VkPipelineVertexInputStateCreateInfo vert_input_info{ VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO };
+	vert_input_info.vertexBindingDescriptionCount = desc->binding_description_count;
+	vert_input_info.pVertexBindingDescriptions = desc->binding_descriptions;
+	vert_input_info.vertexAttributeDescriptionCount = desc->attribute_description_count;
+	vert_input_info.pVertexAttributeDescriptions = desc->attribute_descriptions;
+
+	VkPipelineInputAssemblyStateCreateInfo input_assembly_info = pipeline_input_assembly_state_create_info(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
+
+	// counts only, the values come from vkCmdSetViewport and vkCmdSetScissor
+	VkPipelineViewportStateCreateInfo viewport_info{ VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO };
+	viewport_info.viewportCount = 1;
+	viewport_info.scissorCount = 1;
+
+	VkPipelineRasterizationStateCreateInfo rasterizer = pipeline_rasterization_state_create_info(VK_POLYGON_MODE_FILL);
+	VkPipelineMultisampleStateCreateInfo multisampling = pipeline_multisample_state_create_info();
+	VkPipelineDepthStencilStateCreateInfo depth_stencil_info = depth_stencil_create_info(desc->depth_test, desc->depth_write, desc->depth_compare_op);
+
+	VkPipelineColorBlendAttachmentState color_blend_attachments[MAX_COLOR_ATTACHMENT];
+	for (u32 i = 0; i < desc->color_format_count; ++i)
+		color_blend_attachments[i] = pipeline_color_blend_attachment_state();
+
+	VkPipelineColorBlendStateCreateInfo color_blend_info{ VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO };
+	color_blend_info.logicOpEnable = VK_FALSE;
+	color_blend_info.logicOp = VK_LOGIC_OP_COPY;
+	color_blend_info.attachmentCount = desc->color_format_count;
+	color_blend_info.pAttachments = color_blend_attachments;
+
+	VkDynamicState dynamic_states[] = {
+	VK_DYNAMIC_STATE_VIEWPORT,
+	VK_DYNAMIC_STATE_SCISSOR
+	};
+
+	VkPipelineDynamicStateCreateInfo dynamic_state_info{ VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO };
+	dynamic_state_info.dynamicStateCount = sizeof(dynamic_states) / sizeof(VkDynamicState);
+	dynamic_state_info.pDynamicStates = dynamic_states;
+
+	VkPipelineRenderingCreateInfoKHR rendering_info{ VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO_KHR };
+	rendering_info.colorAttachmentCount = desc->color_format_count;
+	rendering_info.pColorAttachmentFormats = desc->color_formats;
+	rendering_info.depthAttachmentFormat = desc->depth_format;
+
+	VkPipelineLayoutCreateInfo pipeline_layout_info = pipeline_layout_create_info(
+		desc->descriptor_set_layouts, desc->descriptor_set_layout_count, desc->push_constant_ranges, desc->push_constant_range_count);
+
+	VK_CHECK(vkCreatePipelineLayout(context->device_context.handle, &pipeline_layout_info, context->allocator, &out_pipeline->layout));
+
+	VkGraphicsPipelineCreateInfo graphics_pipeline_create_info{ VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO };
+	graphics_pipeline_create_info.pNext = &rendering_info;
+	graphics_pipeline_create_info.stageCount = fragment_shader_module != VK_NULL_HANDLE ? 2 : 1;
+	graphics_pipeline_create_info.pStages = shader_stages;
+	graphics_pipeline_create_info.pVertexInputState = &vert_input_info;
+	graphics_pipeline_create_info.pInputAssemblyState = &input_assembly_info;
+	graphics_pipeline_create_info.pViewportState = &viewport_info;
+	graphics_pipeline_create_info.pRasterizationState = &rasterizer;
+	graphics_pipeline_create_info.pMultisampleState = &multisampling;
+	graphics_pipeline_create_info.pDepthStencilState = &depth_stencil_info;
+	graphics_pipeline_create_info.pColorBlendState = &color_blend_info;
+	graphics_pipeline_create_info.pDynamicState = &dynamic_state_info;
+	graphics_pipeline_create_info.layout = out_pipeline->layout;
+	graphics_pipeline_create_info.renderPass = VK_NULL_HANDLE;
+	graphics_pipeline_create_info.basePipelineHandle = VK_NULL_HANDLE;
+	graphics_pipeline_create_info.basePipelineIndex = -1;
+
+	VK_CHECK(vkCreateGraphicsPipelines(context->device_context.handle, VK_NULL_HANDLE, 1, &graphics_pipeline_create_info, context->allocator, &out_pipeline->handle));
+
+	vkDestroyShaderModule(context->device_context.handle, vertex_shader_module, context->allocator);
+	if (fragment_shader_module != VK_NULL_HANDLE)
+		vkDestroyShaderModule(context->device_context.handle, fragment_shader_module, context->allocator);
+
+	return true;
+}
+
+b8 vulkan_compute_pipeline_create(
+	RenderContext* context,
+	Shader* shader,
+	u32 push_constant_range_count,
+	VkPushConstantRange* push_constant_range,
+	u32 descriptor_set_layout_count,
+	VkDescriptorSetLayout* descriptor_set_layouts,
+	Pipeline* out_pipeline
+)
+{
+	assert(context);
+	assert(shader);
+	assert(out_pipeline);
+
+	if (shader->mCompStageIndex == (u32)(-1) || shader->pShaderModules[shader->mCompStageIndex] == nullptr) {
+		std::cout << "compute pipeline create failed: shader has no compute stage" << std::endl;
+		return false;
+	}
+
+	VkPipelineShaderStageCreateInfo comp_create_info = pipeline_shader_stage_create_info(
+		VK_SHADER_STAGE_COMPUTE_BIT, shader->pShaderModules[shader->mCompStageIndex]->module);
+
+	VkPipelineLayoutCreateInfo pipeline_layout_info = pipeline_layout_create_info(
+		descriptor_set_layouts, descriptor_set_layout_count, push_constant_range, push_constant_range_count);
+
+	VK_CHECK(vkCreatePipelineLayout(context->device_context.handle, &pipeline_layout_info, context->allocator, &out_pipeline->layout));
+
+	VkComputePipelineCreateInfo compute_pipeline_create_info{ VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO };
+	compute_pipeline_create_info.stage = comp_create_info;
+	compute_pipeline_create_info.layout = out_pipeline->layout;
+	compute_pipeline_create_info.basePipelineHandle = VK_NULL_HANDLE;
+	compute_pipeline_create_info.basePipelineIndex = -1;
+
+	VK_CHECK(vkCreateComputePipelines(context->device_context.handle, VK_NULL_HANDLE, 1, &compute_pipeline_create_info, context->allocator, &out_pipeline->handle));
+
+	// shader module is owned by the Shader, release it with vulkan_shader_destroy
+
+	return true;
+}
+
+b8 vulkan_compute_pipeline_create(
+	RenderContext* context,
+	const char* compute_file_path,
+	u32 push_constant_range_count,
+	VkPushConstantRange* push_constant_range,
+	u32 descriptor_set_layout_count,
+	VkDescriptorSetLayout* descriptor_set_layouts,
+	Pipeline* out_pipeline
+)
+{
+	assert(context);
+	assert(compute_file_path);
+	assert(out_pipeline);
+
+	VkShaderModule compute_shader_module;
+
+	if (!vulkan_shader_module_create(context, &compute_shader_module, compute_file_path)) {
+		std::cout << "compute shader module failed to create" << std::endl;
+		return false;
+	}
+
+	VkPipelineLayoutCreateInfo pipeline_layout_info = pipeline_layout_create_info(
+		descriptor_set_layouts, descriptor_set_layout_count, push_constant_range, push_constant_range_count);
+
+	VK_CHECK(vkCreatePipelineLayout(context->device_context.handle, &pipeline_layout_info, context->allocator, &out_pipeline->layout));
+
+	VkComputePipelineCreateInfo compute_pipeline_create_info{ VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO };
+	compute_pipeline_create_info.stage = pipeline_shader_stage_create_info(VK_SHADER_STAGE_COMPUTE_BIT, compute_shader_module);
+	compute_pipeline_create_info.layout = out_pipeline->layout;
+	compute_pipeline_create_info.basePipelineHandle = VK_NULL_HANDLE;
+	compute_pipeline_create_info.basePipelineIndex = -1;
+
+	VK_CHECK(vkCreateComputePipelines(context->device_context.handle, VK_NULL_HANDLE, 1, &compute_pipeline_create_info, context->allocator, &out_pipeline->handle));
+
+	vkDestroyShaderModule(context->device_context.handle, compute_shader_module, context->allocator);
+
+	return true;
+}
+
 void vulkan_pipeline_destroy(RenderContext* context, Pipeline* pipeline)
 {
 	//vkQueueWaitIdle(context->device_context.graphics_queue);
@@ -333,6 +513,9 @@ void vulkan_pipeline_destroy(RenderContext* context, Pipeline* pipeline)
 void vulkan_pipeline_bind(Command* command_buffer,VkPipelineBindPoint bind_point ,Pipeline* pipeline) {
 	//TODO: command buffer
 	vkCmdBindPipeline(command_buffer->buffer, bind_point, pipeline->handle);
+	// binds of secondaries are counted by their owner, a replay records nothing
+	if (!command_buffer->is_secondary)
+		vulkan_metrics_add(METRIC_PIPELINE_BINDS, 1);
 }
 
 b8 vulkan_shader_module_create(RenderContext* context, VkShaderModule* out_shader_module, const char* path)
@@ -41,6 +41,34 @@ b8 vulkan_graphics_pipeline_create(
 	VkPipelineLayout pipeline_layout
 );
 
+// dynamic rendering, viewport and scissor are dynamic state
+b8 vulkan_graphics_pipeline_create(
+	RenderContext* pContext,
+	const GraphicsPipelineDesc* desc,
+	Pipeline* out_pipeline
+);
+
+b8 vulkan_compute_pipeline_create(
+	RenderContext* pContext,
+	Shader* shader,
+	u32 push_constant_range_count,
+	VkPushConstantRange* push_constant_range,
+	u32 descriptor_set_layout_count,
+	VkDescriptorSetLayout* descriptor_set_layouts,
+	Pipeline* out_pipeline
+);
+
+// straight from a SPIR-V file, for compute shaders whose layout is written by hand
+b8 vulkan_compute_pipeline_create(
+	RenderContext* pContext,
+	const char* compute_file_path,
+	u32 push_constant_range_count,
+	VkPushConstantRange* push_constant_range,
+	u32 descriptor_set_layout_count,
+	VkDescriptorSetLayout* descriptor_set_layouts,
+	Pipeline* out_pipeline
+);
+
 void vulkan_pipeline_destroy(
 	RenderContext* pContext,
 	Pipeline* pipeline
@@ -0,0 +1,398 @@
+#include "vulkan_profiler.h"
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#include "imgui/imgui.h"
+
+b8 vulkan_gpu_profiler_create(RenderContext* context, GpuProfiler* profiler)
+{
+    assert(context);
+    assert(profiler);
+
+    DeviceContext* device = &context->device_context;
+
+    u32 family_count = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(device->physical_device, &family_count, NULL);
+    std::vector<VkQueueFamilyProperties> families(family_count);
+    vkGetPhysicalDeviceQueueFamilyProperties(device->physical_device, &family_count,
+                                             families.data());
+
+    const u32 valid_bits = families[device->graphics_family.index].timestampValidBits;
+
+    profiler->supported = valid_bits != 0 && device->properties.limits.timestampPeriod > 0.0f;
+    profiler->timestamp_mask = valid_bits >= 64 ? ~0ull : (1ull << valid_bits) - 1;
+    profiler->timestamp_period = device->properties.limits.timestampPeriod;
+    profiler->current_frame = 0;
+    profiler->open_depth = 0;
+
+    // counted around passes recorded into secondaries, which need both
+    profiler->statistics_supported =
+        device->features.pipelineStatisticsQuery && device->features.inheritedQueries;
+    profiler->statistics_open = false;
+    profiler->fragment_invocations = 0;
+
+    if (profiler->statistics_supported)
+    {
+        VkQueryPoolCreateInfo statistics_info{VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO};
+        statistics_info.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+        statistics_info.queryCount = 1;
+        statistics_info.pipelineStatistics =
+            VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+
+        for (u32 i = 0; i < MAX_FRAME; ++i)
+        {
+            VK_CHECK(vkCreateQueryPool(device->handle, &statistics_info, context->allocator,
+                                       &profiler->statistics_pools[i]));
+            profiler->statistics_written[i] = false;
+        }
+    }
+
+    if (!profiler->supported)
+    {
+        std::cout << "gpu profiler: graphics queue has no timestamps" << std::endl;
+        return false;
+    }
+
+    VkQueryPoolCreateInfo create_info{VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO};
+    create_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    create_info.queryCount = MAX_GPU_PROFILE_SCOPES * 2;
+
+    for (u32 i = 0; i < MAX_FRAME; ++i)
+    {
+        VK_CHECK(vkCreateQueryPool(device->handle, &create_info, context->allocator,
+                                   &profiler->query_pools[i]));
+        profiler->records[i].reserve(MAX_GPU_PROFILE_SCOPES);
+        profiler->query_counts[i] = 0;
+    }
+
+    profiler->results.resize(MAX_GPU_PROFILE_SCOPES * 2);
+
+    return true;
+}
+
+void vulkan_gpu_profiler_destroy(RenderContext* context, GpuProfiler* profiler)
+{
+    assert(context);
+    assert(profiler);
+
+    for (u32 i = 0; i < MAX_FRAME; ++i)
+    {
+        if (profiler->query_pools[i] != VK_NULL_HANDLE)
+            vkDestroyQueryPool(context->device_context.handle, profiler->query_pools[i],
+                               context->allocator);
+
+        profiler->query_pools[i] = VK_NULL_HANDLE;
+        profiler->records[i].clear();
+
+        if (profiler->statistics_pools[i] != VK_NULL_HANDLE)
+            vkDestroyQueryPool(context->device_context.handle, profiler->statistics_pools[i],
+                               context->allocator);
+
+        profiler->statistics_pools[i] = VK_NULL_HANDLE;
+    }
+
+    profiler->stats.clear();
+    profiler->supported = false;
+    profiler->statistics_supported = false;
+}
+
+static u32 find_stats(GpuProfiler* profiler, const char* name, u32 depth)
+{
+    for (u32 i = 0; i < profiler->stats.size(); ++i)
+    {
+        if (profiler->stats[i].name == name)
+            return i;
+    }
+
+    GpuProfileStats stats{};
+    stats.name = name;
+    stats.depth = depth;
+    profiler->stats.push_back(stats);
+
+    return (u32)profiler->stats.size() - 1;
+}
+
+static void add_sample(GpuProfileStats* stats, f32 ms)
+{
+    stats->samples_ms[stats->next_sample] = ms;
+    stats->next_sample = (stats->next_sample + 1) % GPU_PROFILE_HISTORY;
+    if (stats->sample_count < GPU_PROFILE_HISTORY)
+        ++stats->sample_count;
+    stats->last_ms = ms;
+}
+
+void vulkan_gpu_profiler_begin_frame(RenderContext* context, GpuProfiler* profiler,
+                                     Command* command)
+{
+    assert(context);
+    assert(profiler);
+    assert(command);
+
+    const u32 frame = context->current_frame;
+    profiler->current_frame = frame;
+    profiler->open_depth = 0;
+
+    if (profiler->statistics_supported)
+    {
+        // a frame that counted nothing leaves the last value, its query was never reset
+        u64 invocations = 0;
+        if (profiler->statistics_written[frame] &&
+            vkGetQueryPoolResults(context->device_context.handle,
+                                  profiler->statistics_pools[frame], 0, 1, sizeof(u64),
+                                  &invocations, sizeof(u64),
+                                  VK_QUERY_RESULT_64_BIT) == VK_SUCCESS)
+        {
+            profiler->fragment_invocations = invocations;
+        }
+
+        profiler->statistics_written[frame] = false;
+        profiler->statistics_open = false;
+        vkCmdResetQueryPool(command->buffer, profiler->statistics_pools[frame], 0, 1);
+    }
+
+    if (!profiler->supported)
+        return;
+
+    const u32 query_count = profiler->query_counts[frame];
+
+    if (query_count > 0)
+    {
+        // the frame that wrote these has retired, no wait bit so a driver that disagrees
+        // returns VK_NOT_READY instead of blocking and the frame is dropped
+        VkResult result = vkGetQueryPoolResults(
+            context->device_context.handle, profiler->query_pools[frame], 0, query_count,
+            query_count * sizeof(u64), profiler->results.data(), sizeof(u64),
+            VK_QUERY_RESULT_64_BIT);
+
+        if (result == VK_SUCCESS)
+        {
+            for (const GpuProfileRecord& record : profiler->records[frame])
+            {
+                if (record.end_query == GPU_PROFILE_SCOPE_INVALID)
+                    continue;
+
+                const u64 begin = profiler->results[record.begin_query] & profiler->timestamp_mask;
+                const u64 end = profiler->results[record.end_query] & profiler->timestamp_mask;
+                const u64 ticks = (end - begin) & profiler->timestamp_mask;
+
+                add_sample(&profiler->stats[record.stats_index],
+                           (f32)(ticks * profiler->timestamp_period * 1e-6));
+            }
+        }
+    }
+
+    profiler->records[frame].clear();
+    profiler->query_counts[frame] = 0;
+
+    vkCmdResetQueryPool(command->buffer, profiler->query_pools[frame], 0,
+                        MAX_GPU_PROFILE_SCOPES * 2);
+}
+
+u32 vulkan_gpu_profiler_begin_scope(GpuProfiler* profiler, Command* command, const char* name)
+{
+    assert(profiler);
+    assert(command);
+    assert(command->type == QUEUE_TYPE_GRAPHICS);
+
+    const u32 frame = profiler->current_frame;
+
+    if (!profiler->supported || profiler->records[frame].size() >= MAX_GPU_PROFILE_SCOPES)
+        return GPU_PROFILE_SCOPE_INVALID;
+
+    GpuProfileRecord record{};
+    record.stats_index = find_stats(profiler, name, profiler->open_depth);
+    record.begin_query = profiler->query_counts[frame]++;
+    record.end_query = GPU_PROFILE_SCOPE_INVALID;
+
+    vkCmdWriteTimestamp(command->buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                        profiler->query_pools[frame], record.begin_query);
+
+    profiler->records[frame].push_back(record);
+    ++profiler->open_depth;
+
+    return (u32)profiler->records[frame].size() - 1;
+}
+
+void vulkan_gpu_profiler_end_scope(GpuProfiler* profiler, Command* command, u32 scope)
+{
+    assert(profiler);
+    assert(command);
+
+    if (scope == GPU_PROFILE_SCOPE_INVALID)
+        return;
+
+    const u32 frame = profiler->current_frame;
+    GpuProfileRecord& record = profiler->records[frame][scope];
+
+    record.end_query = profiler->query_counts[frame]++;
+    vkCmdWriteTimestamp(command->buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                        profiler->query_pools[frame], record.end_query);
+
+    --profiler->open_depth;
+}
+
+void vulkan_gpu_profiler_begin_fragment_count(GpuProfiler* profiler, Command* command)
+{
+    assert(profiler);
+    assert(command);
+    assert(!command->is_rendering);
+
+    const u32 frame = profiler->current_frame;
+
+    // a query is written once between resets
+    if (!profiler->statistics_supported || profiler->statistics_written[frame])
+        return;
+
+    vkCmdBeginQuery(command->buffer, profiler->statistics_pools[frame], 0, 0);
+    profiler->statistics_written[frame] = true;
+    profiler->statistics_open = true;
+}
+
+void vulkan_gpu_profiler_end_fragment_count(GpuProfiler* profiler, Command* command)
+{
+    assert(profiler);
+    assert(command);
+    assert(!command->is_rendering);
+
+    if (!profiler->statistics_open)
+        return;
+
+    vkCmdEndQuery(command->buffer, profiler->statistics_pools[profiler->current_frame], 0);
+    profiler->statistics_open = false;
+}
+
+u64 vulkan_gpu_profiler_get_fragment_invocations(const GpuProfiler* profiler)
+{
+    assert(profiler);
+
+    return profiler->fragment_invocations;
+}
+
+f32 vulkan_gpu_profiler_get_last_ms(const GpuProfiler* profiler, const char* name)
+{
+    assert(profiler);
+
+    for (const GpuProfileStats& stats : profiler->stats)
+    {
+        if (stats.name == name)
+            return stats.last_ms;
+    }
+
+    return 0.0f;
+}
+
+static void rolling_stats(const GpuProfileStats& stats, f32* out_min, f32* out_avg,
+                          f32* out_max)
+{
+    *out_min = 0.0f;
+    *out_avg = 0.0f;
+    *out_max = 0.0f;
+
+    if (stats.sample_count == 0)
+        return;
+
+    f32 min = stats.samples_ms[0];
+    f32 max = stats.samples_ms[0];
+    f32 sum = 0.0f;
+
+    for (u32 i = 0; i < stats.sample_count; ++i)
+    {
+        const f32 ms = stats.samples_ms[i];
+        min = ms < min ? ms : min;
+        max = ms > max ? ms : max;
+        sum += ms;
+    }
+
+    *out_min = min;
+    *out_avg = sum / stats.sample_count;
+    *out_max = max;
+}
+
+void vulkan_gpu_profiler_draw_imgui(GpuProfiler* profiler)
+{
+    assert(profiler);
+
+    ImGui::Begin("gpu profiler");
+
+    if (!profiler->supported)
+    {
+        ImGui::Text("timestamps not supported");
+        ImGui::End();
+        return;
+    }
+
+    if (ImGui::Button("export csv"))
+        vulkan_gpu_profiler_export_csv(profiler, "gpu_profile.csv");
+
+    ImGui::Columns(4);
+    ImGui::Text("scope");
+    ImGui::NextColumn();
+    ImGui::Text("min ms");
+    ImGui::NextColumn();
+    ImGui::Text("avg ms");
+    ImGui::NextColumn();
+    ImGui::Text("max ms");
+    ImGui::NextColumn();
+    ImGui::Separator();
+
+    for (const GpuProfileStats& stats : profiler->stats)
+    {
+        f32 min, avg, max;
+        rolling_stats(stats, &min, &avg, &max);
+
+        ImGui::Text("%*s%s", stats.depth * 2, "", stats.name.c_str());
+        ImGui::NextColumn();
+        ImGui::Text("%.3f", min);
+        ImGui::NextColumn();
+        ImGui::Text("%.3f", avg);
+        ImGui::NextColumn();
+        ImGui::Text("%.3f", max);
+        ImGui::NextColumn();
+    }
+
+    ImGui::Columns(1);
+    ImGui::End();
+}
+
+b8 vulkan_gpu_profiler_export_csv(const GpuProfiler* profiler, const char* path)
+{
+    assert(profiler);
+    assert(path);
+
+    FILE* file = fopen(path, "w");
+    if (file == NULL)
+    {
+        std::cout << "gpu profiler: failed to open " << path << std::endl;
+        return false;
+    }
+
+    fprintf(file, "scope,depth,min_ms,avg_ms,max_ms,last_ms,samples\n");
+    for (const GpuProfileStats& stats : profiler->stats)
+    {
+        f32 min, avg, max;
+        rolling_stats(stats, &min, &avg, &max);
+        fprintf(file, "%s,%u,%.4f,%.4f,%.4f,%.4f,%u\n", stats.name.c_str(), stats.depth, min,
+                avg, max, stats.last_ms, stats.sample_count);
+    }
+
+    fprintf(file, "\nscope,sample,ms\n");
+    for (const GpuProfileStats& stats : profiler->stats)
+    {
+        // the ring starts at next_sample once it is full
+        const u32 first =
+            stats.sample_count < GPU_PROFILE_HISTORY ? 0 : stats.next_sample;
+
+        for (u32 i = 0; i < stats.sample_count; ++i)
+        {
+            const u32 index = (first + i) % GPU_PROFILE_HISTORY;
+            fprintf(file, "%s,%u,%.4f\n", stats.name.c_str(), i, stats.samples_ms[index]);
+        }
+    }
+
+    fclose(file);
+    std::cout << "gpu profiler: wrote " << path << std::endl;
+
+    return true;
+}
@@ -0,0 +1,43 @@
+#ifndef VULKAN_PROFILER_H
+#define VULKAN_PROFILER_H
+
+#include "vulkan_types.inl"
+
+/*
+     GPU profiler : named scopes write a timestamp pair into the query pool of the frame being
+     recorded. The pool of a frame slot is read back when the slot comes around again, by then
+     the graphics timeline has passed it, so the read never waits on the GPU.
+     Scopes are recorded on the graphics command only and may nest, but not inside a rendering
+     scope that runs secondary command buffers.
+     Fragment shader invocations of one range per frame are counted by a pipeline statistics
+     query beside the timestamps, divided by the pixels of the target they give the overdraw.
+*/
+b8 vulkan_gpu_profiler_create(RenderContext* context, GpuProfiler* profiler);
+// the device has to be idle
+void vulkan_gpu_profiler_destroy(RenderContext* context, GpuProfiler* profiler);
+
+// collect the results this frame slot wrote last time and reset its pool, call right after
+// the graphics command begins
+void vulkan_gpu_profiler_begin_frame(RenderContext* context, GpuProfiler* profiler,
+                                     Command* command);
+
+// returns GPU_PROFILE_SCOPE_INVALID when the frame ran out of queries
+u32 vulkan_gpu_profiler_begin_scope(GpuProfiler* profiler, Command* command, const char* name);
+void vulkan_gpu_profiler_end_scope(GpuProfiler* profiler, Command* command, u32 scope);
+
+// one range per frame, begun and ended outside rendering scopes. secondaries executed inside
+// have to be begun with VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT
+void vulkan_gpu_profiler_begin_fragment_count(GpuProfiler* profiler, Command* command);
+void vulkan_gpu_profiler_end_fragment_count(GpuProfiler* profiler, Command* command);
+// of the frame MAX_FRAME behind, 0 before the first readback or without statistics queries
+u64 vulkan_gpu_profiler_get_fragment_invocations(const GpuProfiler* profiler);
+
+// latest sample of a scope, 0 before the first readback
+f32 vulkan_gpu_profiler_get_last_ms(const GpuProfiler* profiler, const char* name);
+
+// rolling min, avg and max of every scope, inside an ImGui frame
+void vulkan_gpu_profiler_draw_imgui(GpuProfiler* profiler);
+// one row per scope, then the raw samples oldest first
+b8 vulkan_gpu_profiler_export_csv(const GpuProfiler* profiler, const char* path);
+
+#endif  // !VULKAN_PROFILER_H
@@ -0,0 +1,540 @@
+#include "vulkan_queue.h"
+
+#include "core/profiler.h"
+#include "vulkan_buffer.h"
+#include "vulkan_command_buffer.h"
+
+#include <iostream>
+
+void vulkan_queue_timeline_create(RenderContext* context, QueueTimeline* timeline)
+{
+    VkSemaphoreTypeCreateInfo type_create_info{VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO};
+    type_create_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    type_create_info.initialValue = 0;
+
+    VkSemaphoreCreateInfo semaphore_create_info{VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO};
+    semaphore_create_info.pNext = &type_create_info;
+
+    VK_CHECK(vkCreateSemaphore(context->device_context.handle, &semaphore_create_info,
+                               context->allocator, &timeline->semaphore));
+
+    timeline->submitted_value = 0;
+    timeline->completed_value = 0;
+}
+
+void vulkan_queue_timeline_destroy(RenderContext* context, QueueTimeline* timeline)
+{
+    vkDestroySemaphore(context->device_context.handle, timeline->semaphore, context->allocator);
+    timeline->semaphore = VK_NULL_HANDLE;
+}
+
+u64 vulkan_queue_timeline_poll(RenderContext* context, QueueTimeline* timeline)
+{
+    VK_CHECK(vkGetSemaphoreCounterValue(context->device_context.handle, timeline->semaphore,
+                                        &timeline->completed_value));
+
+    return timeline->completed_value;
+}
+
+void vulkan_queue_timeline_wait(RenderContext* context, QueueTimeline* timeline, u64 value)
+{
+    if (timeline->completed_value >= value)
+        return;
+
+    VkSemaphoreWaitInfo wait_info{VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO};
+    wait_info.semaphoreCount = 1;
+    wait_info.pSemaphores = &timeline->semaphore;
+    wait_info.pValues = &value;
+
+    VK_CHECK(vkWaitSemaphores(context->device_context.handle, &wait_info, UINT64_MAX));
+    timeline->completed_value = value;
+}
+
+static void async_queue_create(RenderContext* context, AsyncQueue* queue, QueueType type,
+                               VkQueue handle)
+{
+    queue->queue = handle;
+    queue->type = type;
+    queue->queue_family_index = get_queue_family_index(&context->device_context, type);
+    queue->wait_stages = 0;
+    queue->is_recording = false;
+    queue->waits_on_graphics = false;
+    queue->has_pending_wait = false;
+    queue->pending_wait_stages = 0;
+
+    vulkan_queue_timeline_create(context, &queue->timeline);
+
+    for (u32 i = 0; i < MAX_FRAME; ++i)
+    {
+        vulkan_command_pool_create(context, &queue->commands[i], type);
+        vulkan_command_buffer_allocate(context, &queue->commands[i], true);
+        queue->slot_values[i] = 0;
+    }
+}
+
+static void async_queue_destroy(RenderContext* context, AsyncQueue* queue)
+{
+    for (u32 i = 0; i < MAX_FRAME; ++i)
+    {
+        for (Buffer& staging_buffer : queue->staging_buffers[i])
+            vulkan_buffer_destroy(context, &staging_buffer);
+
+        queue->staging_buffers[i].clear();
+        vulkan_command_pool_destroy(context, &queue->commands[i]);
+    }
+
+    vulkan_queue_timeline_destroy(context, &queue->timeline);
+}
+
+// free staging buffers of every slot the queue timeline has passed, without blocking
+static void async_queue_retire(RenderContext* context, AsyncQueue* queue, u32 recording_frame)
+{
+    u64 completed_value = vulkan_queue_timeline_poll(context, &queue->timeline);
+
+    for (u32 i = 0; i < MAX_FRAME; ++i)
+    {
+        if ((queue->is_recording && i == recording_frame) ||
+            queue->slot_values[i] > completed_value)
+            continue;
+
+        for (Buffer& staging_buffer : queue->staging_buffers[i])
+            vulkan_buffer_destroy(context, &staging_buffer);
+
+        queue->staging_buffers[i].clear();
+    }
+}
+
+// submit the recorded slot, signaling the next value of the queue timeline. a wait semaphore
+// is optional, the value is ignored without one
+static b8 async_queue_submit(AsyncQueue* queue, u32 frame, VkSemaphore wait_semaphore,
+                             u64 wait_value)
+{
+    if (!queue->is_recording)
+        return false;
+
+    Command* command = &queue->commands[frame];
+    vulkan_command_buffer_end(command);
+
+    u64 signal_value = ++queue->timeline.submitted_value;
+    queue->slot_values[frame] = signal_value;
+
+    VkTimelineSemaphoreSubmitInfo timeline_submit_info{
+        VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO};
+    timeline_submit_info.signalSemaphoreValueCount = 1;
+    timeline_submit_info.pSignalSemaphoreValues = &signal_value;
+
+    // the producer is unknown to this queue, wait before anything runs
+    VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+
+    VkSubmitInfo submit_info{VK_STRUCTURE_TYPE_SUBMIT_INFO};
+    submit_info.pNext = &timeline_submit_info;
+    if (wait_semaphore != VK_NULL_HANDLE)
+    {
+        timeline_submit_info.waitSemaphoreValueCount = 1;
+        timeline_submit_info.pWaitSemaphoreValues = &wait_value;
+
+        submit_info.waitSemaphoreCount = 1;
+        submit_info.pWaitSemaphores = &wait_semaphore;
+        submit_info.pWaitDstStageMask = &wait_stage;
+    }
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &command->buffer;
+    submit_info.signalSemaphoreCount = 1;
+    submit_info.pSignalSemaphores = &queue->timeline.semaphore;
+
+    VK_CHECK(vkQueueSubmit(queue->queue, 1, &submit_info, VK_NULL_HANDLE));
+
+    queue->is_recording = false;
+
+    return true;
+}
+
+static AsyncQueue* get_async_queue(QueueScheduler* scheduler, QueueType type)
+{
+    assert(type == QUEUE_TYPE_TRANSFER || type == QUEUE_TYPE_COMPUTE);
+
+    return type == QUEUE_TYPE_TRANSFER ? &scheduler->transfer : &scheduler->compute;
+}
+
+b8 vulkan_queue_scheduler_create(RenderContext* context, QueueScheduler* scheduler)
+{
+    assert(context);
+    assert(scheduler);
+
+    scheduler->graphics_family_index = context->device_context.graphics_family.index;
+    scheduler->current_frame = 0;
+    scheduler->frame_value = 0;
+
+    vulkan_queue_timeline_create(context, &scheduler->graphics);
+
+    async_queue_create(context, &scheduler->transfer, QUEUE_TYPE_TRANSFER,
+                       context->device_context.transfer_queue);
+    async_queue_create(context, &scheduler->compute, QUEUE_TYPE_COMPUTE,
+                       context->device_context.compute_queue);
+
+    std::cout << "queue scheduler created (transfer: "
+              << (scheduler->transfer.queue_family_index != scheduler->graphics_family_index
+                      ? "dedicated"
+                      : "graphics")
+              << ", compute: "
+              << (vulkan_queue_scheduler_has_async_compute(scheduler) ? "dedicated" : "graphics")
+              << ")" << std::endl;
+
+    return true;
+}
+
+void vulkan_queue_scheduler_destroy(RenderContext* context, QueueScheduler* scheduler)
+{
+    // every timeline has to be idle, the caller waits for the device
+    assert(context);
+    assert(scheduler);
+
+    async_queue_destroy(context, &scheduler->transfer);
+    async_queue_destroy(context, &scheduler->compute);
+    vulkan_queue_timeline_destroy(context, &scheduler->graphics);
+
+    scheduler->buffer_acquires.clear();
+    scheduler->texture_acquires.clear();
+    scheduler->acquire_buffers.clear();
+    scheduler->acquire_textures.clear();
+}
+
+u64 vulkan_queue_scheduler_begin_frame(RenderContext* context, QueueScheduler* scheduler)
+{
+    PKO_PROFILE_FUNCTION();
+
+    // a frame that never got submitted keeps its value
+    u64 frame_value = scheduler->graphics.submitted_value + 1;
+
+    // the frame that last used these per frame resources, no fence to reset
+    if (frame_value > MAX_FRAME)
+        vulkan_queue_timeline_wait(context, &scheduler->graphics, frame_value - MAX_FRAME);
+
+    async_queue_retire(context, &scheduler->transfer, scheduler->current_frame);
+    async_queue_retire(context, &scheduler->compute, scheduler->current_frame);
+
+    scheduler->frame_value = frame_value;
+
+    return frame_value;
+}
+
+Command* vulkan_queue_scheduler_get_command(RenderContext* context, QueueScheduler* scheduler,
+                                            QueueType type)
+{
+    AsyncQueue* queue = get_async_queue(scheduler, type);
+    u32 frame = scheduler->current_frame;
+
+    if (!queue->is_recording)
+    {
+        // the slot was submitted MAX_FRAME submissions ago, this rarely blocks
+        vulkan_queue_timeline_wait(context, &queue->timeline, queue->slot_values[frame]);
+
+        for (Buffer& staging_buffer : queue->staging_buffers[frame])
+            vulkan_buffer_destroy(context, &staging_buffer);
+
+        queue->staging_buffers[frame].clear();
+
+        vulkan_command_pool_reset(&queue->commands[frame]);
+        vulkan_command_buffer_begin(&queue->commands[frame],
+                                    VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+        queue->is_recording = true;
+    }
+
+    return &queue->commands[frame];
+}
+
+void vulkan_queue_scheduler_release_buffer(RenderContext* context, QueueScheduler* scheduler,
+                                           QueueType type, Buffer* buffer,
+                                           ResourceState current_state, ResourceState new_state)
+{
+    AsyncQueue* queue = get_async_queue(scheduler, type);
+    Command* command = vulkan_queue_scheduler_get_command(context, scheduler, type);
+
+    BufferBarrier release{};
+    release.buffer = buffer;
+    release.current_state = current_state;
+    release.new_state = new_state;
+    release.release = true;
+    release.queue_family_index = scheduler->graphics_family_index;
+
+    vulkan_command_resource_barrier(command, &release, 1, NULL, 0, NULL, 0);
+
+    // graphics only waits where the resource is consumed
+    queue->wait_stages |=
+        get_pipeline_stage_flags(resource_state_to_access_flags(new_state), QUEUE_TYPE_GRAPHICS);
+
+    if (queue->queue_family_index != scheduler->graphics_family_index)
+    {
+        BufferBarrier acquire = release;
+        acquire.release = false;
+        acquire.acquire = true;
+        acquire.queue_family_index = queue->queue_family_index;
+
+        scheduler->buffer_acquires.push_back(acquire);
+        scheduler->acquire_buffers.push_back(*buffer);
+    }
+}
+
+void vulkan_queue_scheduler_release_texture(RenderContext* context, QueueScheduler* scheduler,
+                                            QueueType type, Texture* texture,
+                                            ResourceState current_state,
+                                            ResourceState new_state)
+{
+    AsyncQueue* queue = get_async_queue(scheduler, type);
+    Command* command = vulkan_queue_scheduler_get_command(context, scheduler, type);
+
+    // barriers of one batch are unordered, a pending write barrier on the image has to land
+    // before it leaves the queue
+    vulkan_command_flush_barriers(command);
+
+    // release and acquire carry the same layout transition
+    TextureBarrier release{};
+    release.texture = texture;
+    release.current_state = current_state;
+    release.new_state = new_state;
+    release.release = true;
+    release.queue_family_index = scheduler->graphics_family_index;
+
+    vulkan_command_resource_barrier(command, NULL, 0, &release, 1, NULL, 0);
+
+    queue->wait_stages |=
+        get_pipeline_stage_flags(resource_state_to_access_flags(new_state), QUEUE_TYPE_GRAPHICS);
+
+    // on a shared family the acquire is elided, it still hands the state to the barrier
+    // tracking of the graphics command
+    TextureBarrier acquire = release;
+    acquire.release = false;
+    acquire.acquire = queue->queue_family_index != scheduler->graphics_family_index;
+    acquire.queue_family_index = queue->queue_family_index;
+    if (!acquire.acquire)
+        acquire.current_state = new_state;
+
+    scheduler->texture_acquires.push_back(acquire);
+    scheduler->acquire_textures.push_back(*texture);
+}
+
+b8 vulkan_queue_scheduler_has_async_compute(QueueScheduler* scheduler)
+{
+    return scheduler->compute.queue_family_index != scheduler->graphics_family_index;
+}
+
+Command* vulkan_queue_scheduler_hand_to_compute(RenderContext* context,
+                                                QueueScheduler* scheduler,
+                                                Command* graphics_command, Texture* texture,
+                                                ResourceState state)
+{
+    assert(graphics_command && graphics_command->type == QUEUE_TYPE_GRAPHICS);
+    assert(vulkan_queue_scheduler_has_async_compute(scheduler));
+
+    AsyncQueue* compute = &scheduler->compute;
+
+    // the write barrier into state may still be pending on the graphics command
+    vulkan_command_flush_barriers(graphics_command);
+
+    TextureBarrier release{};
+    release.texture = texture;
+    release.current_state = state;
+    release.new_state = state;
+    release.release = true;
+    release.queue_family_index = compute->queue_family_index;
+
+    vulkan_command_resource_barrier(graphics_command, NULL, 0, &release, 1, NULL, 0);
+    vulkan_command_flush_barriers(graphics_command);
+
+    Command* command = vulkan_queue_scheduler_get_command(context, scheduler, QUEUE_TYPE_COMPUTE);
+
+    TextureBarrier acquire = release;
+    acquire.release = false;
+    acquire.acquire = true;
+    acquire.queue_family_index = scheduler->graphics_family_index;
+
+    vulkan_command_resource_barrier(command, NULL, 0, &acquire, 1, NULL, 0);
+
+    compute->waits_on_graphics = true;
+
+    return command;
+}
+
+void vulkan_queue_scheduler_upload_buffer(RenderContext* context, QueueScheduler* scheduler,
+                                          Buffer* dst_buffer, const void* data, u64 size,
+                                          u64 dst_offset, ResourceState new_state)
+{
+    assert(dst_buffer);
+    assert(data);
+
+    Buffer staging_buffer;
+    vulkan_buffer_create(
+        context, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_AUTO,
+        VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+        &staging_buffer, MEMORY_CATEGORY_STAGING);
+    vulkan_buffer_upload(context, &staging_buffer, (void*)data, (u32)size);
+
+    Command* command = vulkan_queue_scheduler_get_command(context, scheduler, QUEUE_TYPE_TRANSFER);
+
+    // releases of earlier uploads go out before the copy
+    vulkan_command_flush_barriers(command);
+
+    VkBufferCopy buffer_copy{0, dst_offset, size};
+    vkCmdCopyBuffer(command->buffer, staging_buffer.handle, dst_buffer->handle, 1, &buffer_copy);
+
+    scheduler->transfer.staging_buffers[scheduler->current_frame].push_back(staging_buffer);
+
+    vulkan_queue_scheduler_release_buffer(context, scheduler, QUEUE_TYPE_TRANSFER, dst_buffer,
+                                          RESOURCE_STATE_COPY_DEST, new_state);
+}
+
+void vulkan_queue_scheduler_upload_texture(RenderContext* context, QueueScheduler* scheduler,
+                                           Texture* dst_texture, const void* data, u64 size,
+                                           ResourceState new_state)
+{
+    assert(dst_texture);
+    assert(data);
+    // the barriers below cover every level while the copy writes one
+    assert(dst_texture->mip_levels == 1 && "only single level textures are uploaded");
+
+    Buffer staging_buffer;
+    vulkan_buffer_create(
+        context, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_AUTO,
+        VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+        &staging_buffer, MEMORY_CATEGORY_STAGING);
+    vulkan_buffer_upload(context, &staging_buffer, (void*)data, (u32)size);
+
+    Command* command = vulkan_queue_scheduler_get_command(context, scheduler, QUEUE_TYPE_TRANSFER);
+
+    // previous contents are discarded, the copy needs the transfer layout before it runs
+    TextureBarrier copy_barrier{};
+    copy_barrier.texture = dst_texture;
+    copy_barrier.current_state = RESOURCE_STATE_UNDEFINED;
+    copy_barrier.new_state = RESOURCE_STATE_COPY_DEST;
+
+    vulkan_command_resource_barrier(command, NULL, 0, &copy_barrier, 1, NULL, 0);
+    vulkan_command_flush_barriers(command);
+
+    VkBufferImageCopy copy_region{};
+    copy_region.imageSubresource.aspectMask = dst_texture->aspect_mask;
+    copy_region.imageSubresource.mipLevel = 0;
+    copy_region.imageSubresource.baseArrayLayer = 0;
+    copy_region.imageSubresource.layerCount = 1;
+    copy_region.imageExtent = {dst_texture->width, dst_texture->height, 1};
+
+    vkCmdCopyBufferToImage(command->buffer, staging_buffer.handle, dst_texture->image,
+                           VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy_region);
+
+    scheduler->transfer.staging_buffers[scheduler->current_frame].push_back(staging_buffer);
+
+    vulkan_queue_scheduler_release_texture(context, scheduler, QUEUE_TYPE_TRANSFER, dst_texture,
+                                           RESOURCE_STATE_COPY_DEST, new_state);
+}
+
+void vulkan_queue_scheduler_acquire(QueueScheduler* scheduler, Command* graphics_command)
+{
+    assert(graphics_command);
+
+    if (scheduler->buffer_acquires.empty() && scheduler->texture_acquires.empty())
+        return;
+
+    for (u32 i = 0; i < scheduler->buffer_acquires.size(); ++i)
+        scheduler->buffer_acquires[i].buffer = &scheduler->acquire_buffers[i];
+
+    for (u32 i = 0; i < scheduler->texture_acquires.size(); ++i)
+        scheduler->texture_acquires[i].texture = &scheduler->acquire_textures[i];
+
+    vulkan_command_resource_barrier(graphics_command, scheduler->buffer_acquires.data(),
+                                    (u32)scheduler->buffer_acquires.size(),
+                                    scheduler->texture_acquires.data(),
+                                    (u32)scheduler->texture_acquires.size(), NULL, 0);
+
+    scheduler->buffer_acquires.clear();
+    scheduler->texture_acquires.clear();
+    scheduler->acquire_buffers.clear();
+    scheduler->acquire_textures.clear();
+}
+
+void vulkan_queue_scheduler_submit_frame(RenderContext* context, QueueScheduler* scheduler,
+                                         Command* graphics_command, VkSemaphore wait_semaphore,
+                                         VkPipelineStageFlags wait_stage,
+                                         VkSemaphore signal_semaphore)
+{
+    PKO_PROFILE_FUNCTION();
+
+    assert(graphics_command);
+
+    u32 frame = scheduler->current_frame;
+
+    VkSemaphore wait_semaphores[3] = {wait_semaphore};
+    u64 wait_values[3] = {0};  // ignored for the binary semaphore
+    VkPipelineStageFlags wait_stages[3] = {wait_stage};
+    u32 wait_count = 1;
+
+    // uploads first, graphics only stalls at the stages consuming their output
+    AsyncQueue* transfer = &scheduler->transfer;
+    VkPipelineStageFlags transfer_wait_stages = transfer->wait_stages;
+    if (async_queue_submit(transfer, frame, VK_NULL_HANDLE, 0))
+    {
+        // nothing released means the consumer is unknown, wait conservatively
+        wait_semaphores[wait_count] = transfer->timeline.semaphore;
+        wait_values[wait_count] = transfer->timeline.submitted_value;
+        wait_stages[wait_count] =
+            transfer_wait_stages != 0 ? transfer_wait_stages : VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+        ++wait_count;
+
+        transfer->wait_stages = 0;
+    }
+
+    // compute of the previous frame went out behind its graphics command, this frame stalls
+    // only where its releases are consumed
+    AsyncQueue* compute = &scheduler->compute;
+    if (compute->has_pending_wait)
+    {
+        wait_semaphores[wait_count] = compute->timeline.semaphore;
+        wait_values[wait_count] = compute->timeline.submitted_value;
+        wait_stages[wait_count] = compute->pending_wait_stages != 0
+                                      ? compute->pending_wait_stages
+                                      : VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+        ++wait_count;
+
+        compute->has_pending_wait = false;
+        compute->pending_wait_stages = 0;
+    }
+
+    VkSemaphore signal_semaphores[2] = {scheduler->graphics.semaphore, signal_semaphore};
+    u64 signal_values[2] = {scheduler->frame_value, 0};
+
+    VkTimelineSemaphoreSubmitInfo timeline_submit_info{
+        VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO};
+    timeline_submit_info.waitSemaphoreValueCount = wait_count;
+    timeline_submit_info.pWaitSemaphoreValues = wait_values;
+    timeline_submit_info.signalSemaphoreValueCount = 2;
+    timeline_submit_info.pSignalSemaphoreValues = signal_values;
+
+    VkSubmitInfo submit_info{VK_STRUCTURE_TYPE_SUBMIT_INFO};
+    submit_info.pNext = &timeline_submit_info;
+    submit_info.waitSemaphoreCount = wait_count;
+    submit_info.pWaitSemaphores = wait_semaphores;
+    submit_info.pWaitDstStageMask = wait_stages;
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &graphics_command->buffer;
+    submit_info.signalSemaphoreCount = 2;
+    submit_info.pSignalSemaphores = signal_semaphores;
+
+    VK_CHECK(vkQueueSubmit(context->device_context.graphics_queue, 1, &submit_info,
+                           VK_NULL_HANDLE));
+
+    scheduler->graphics.submitted_value = scheduler->frame_value;
+
+    // runs next to the present of this frame and the start of the next one
+    VkPipelineStageFlags compute_wait_stages = compute->wait_stages;
+    if (async_queue_submit(compute, frame,
+                           compute->waits_on_graphics ? scheduler->graphics.semaphore
+                                                      : VK_NULL_HANDLE,
+                           scheduler->frame_value))
+    {
+        compute->has_pending_wait = true;
+        compute->pending_wait_stages = compute_wait_stages;
+
+        compute->wait_stages = 0;
+        compute->waits_on_graphics = false;
+    }
+
+    scheduler->current_frame = (frame + 1) % MAX_FRAME;
+}
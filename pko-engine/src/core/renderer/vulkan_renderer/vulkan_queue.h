@@ -0,0 +1,78 @@
+#ifndef VULKAN_QUEUE_H
+#define VULKAN_QUEUE_H
+
+#include "vulkan_types.inl"
+
+void vulkan_queue_timeline_create(RenderContext* context, QueueTimeline* timeline);
+void vulkan_queue_timeline_destroy(RenderContext* context, QueueTimeline* timeline);
+// refresh and return the value the GPU has passed, never blocks
+u64 vulkan_queue_timeline_poll(RenderContext* context, QueueTimeline* timeline);
+void vulkan_queue_timeline_wait(RenderContext* context, QueueTimeline* timeline, u64 value);
+
+/*
+     Queue scheduler : records uploads on the transfer queue and submits them right before
+     the graphics queue, async compute is submitted right after it.
+     Every queue owns one timeline semaphore. The graphics timeline counts frames, the
+     transfer and compute timelines count submissions.
+     Graphics waits on the transfer value of the same frame and on the compute value of the
+     previous one, compute waits on the graphics value of its frame.
+     Resources written on those queues are released to the graphics family, the matching
+     acquire is recorded by vulkan_queue_scheduler_acquire. When a family aliases the graphics
+     family no ownership transfer is recorded and the semaphore alone orders the work.
+     Compute reading the output of a frame (the depth pyramid) overlaps the present of that
+     frame and the start of the next one, which waits only at the stages reading its results.
+     Culling feeds the draws of its own frame and stays on the graphics command.
+*/
+b8 vulkan_queue_scheduler_create(RenderContext* context, QueueScheduler* scheduler);
+void vulkan_queue_scheduler_destroy(RenderContext* context, QueueScheduler* scheduler);
+
+// blocks only until the frame MAX_FRAME behind has retired, returns the new frame value
+u64 vulkan_queue_scheduler_begin_frame(RenderContext* context, QueueScheduler* scheduler);
+
+// begins the transfer or compute command of the current frame on first use
+Command* vulkan_queue_scheduler_get_command(RenderContext* context, QueueScheduler* scheduler,
+                                            QueueType type);
+
+// buffer and texture have to stay alive until the next graphics submission, the pointers
+// may come from the resource pools, the pending acquire keeps a copy
+void vulkan_queue_scheduler_release_buffer(RenderContext* context, QueueScheduler* scheduler,
+                                           QueueType type, Buffer* buffer,
+                                           ResourceState current_state, ResourceState new_state);
+void vulkan_queue_scheduler_release_texture(RenderContext* context, QueueScheduler* scheduler,
+                                            QueueType type, Texture* texture,
+                                            ResourceState current_state,
+                                            ResourceState new_state);
+
+// true when compute has its own family, otherwise compute is recorded on the graphics command
+b8 vulkan_queue_scheduler_has_async_compute(QueueScheduler* scheduler);
+
+// releases a texture the graphics command wrote to the compute family and returns the compute
+// command with the acquire recorded. compute of the frame runs once graphics has finished,
+// release the results with vulkan_queue_scheduler_release_texture(QUEUE_TYPE_COMPUTE)
+Command* vulkan_queue_scheduler_hand_to_compute(RenderContext* context,
+                                                QueueScheduler* scheduler,
+                                                Command* graphics_command, Texture* texture,
+                                                ResourceState state);
+
+// copy through a staging buffer on the transfer queue, no queue idle
+void vulkan_queue_scheduler_upload_buffer(RenderContext* context, QueueScheduler* scheduler,
+                                          Buffer* dst_buffer, const void* data, u64 size,
+                                          u64 dst_offset, ResourceState new_state);
+
+// same for a texture with a single mip level, the previous contents are discarded
+void vulkan_queue_scheduler_upload_texture(RenderContext* context, QueueScheduler* scheduler,
+                                           Texture* dst_texture, const void* data, u64 size,
+                                           ResourceState new_state);
+
+// record pending ownership acquires on the graphics command
+void vulkan_queue_scheduler_acquire(QueueScheduler* scheduler, Command* graphics_command);
+
+// submit recorded transfer work followed by the graphics command, which signals
+// the frame value, and the compute work behind it. wait/signal semaphores are the binary
+// ones of the swapchain
+void vulkan_queue_scheduler_submit_frame(RenderContext* context, QueueScheduler* scheduler,
+                                         Command* graphics_command, VkSemaphore wait_semaphore,
+                                         VkPipelineStageFlags wait_stage,
+                                         VkSemaphore signal_semaphore);
+
+#endif  // !VULKAN_QUEUE_H
@@ -0,0 +1,702 @@
+#include "vulkan_render_graph.h"
+
+#include "core/profiler.h"
+#include "vulkan_command_buffer.h"
+#include "vulkan_deletion_queue.h"
+#include "vulkan_image.h"
+#include "vulkan_memory_allocate.h"
+#include "vulkan_profiler.h"
+
+#include <algorithm>
+#include <iostream>
+
+constexpr u32 RENDER_GRAPH_INVALID_INDEX = ~0u;
+
+static u32 format_bytes_per_texel(VkFormat format)
+{
+    switch (format)
+    {
+        case VK_FORMAT_R8_UNORM:
+        case VK_FORMAT_S8_UINT:
+            return 1;
+        case VK_FORMAT_R8G8_UNORM:
+        case VK_FORMAT_R16_SFLOAT:
+        case VK_FORMAT_D16_UNORM:
+            return 2;
+        case VK_FORMAT_R16G16B16A16_SFLOAT:
+        case VK_FORMAT_R32G32_SFLOAT:
+        case VK_FORMAT_D32_SFLOAT_S8_UINT:
+            return 8;
+        case VK_FORMAT_R32G32B32A32_SFLOAT:
+            return 16;
+        default:
+            return 4;
+    }
+}
+
+// only used to order the alias plan, realize queries the real requirements
+static u64 estimate_size(const RenderTargetDesc* desc)
+{
+    u64 size = 0;
+    u32 width = desc->width;
+    u32 height = desc->height;
+
+    for (u32 i = 0; i < std::max(desc->mip_levels, 1u); ++i)
+    {
+        size += (u64)width * height * format_bytes_per_texel(desc->vulkan_format);
+        width = std::max(width / 2, 1u);
+        height = std::max(height / 2, 1u);
+    }
+
+    return size;
+}
+
+static RenderGraphResource add_resource(RenderGraph* graph, RenderGraphResourceNode* node)
+{
+    assert(!graph->realized);
+
+    node->render_target = {};
+    node->first_step = RENDER_GRAPH_INVALID_INDEX;
+    node->last_step = RENDER_GRAPH_INVALID_INDEX;
+    node->alias_slot = RENDER_GRAPH_INVALID_INDEX;
+
+    graph->resources.push_back(*node);
+    graph->compiled = false;
+
+    return (RenderGraphResource)graph->resources.size() - 1;
+}
+
+RenderGraphResource vulkan_render_graph_create_rendertarget(RenderGraph* graph, const char* name,
+                                                            const RenderTargetDesc* desc)
+{
+    assert(graph && desc);
+
+    RenderGraphResourceNode node{};
+    node.name = name;
+    node.desc = *desc;
+    node.initial_state = RESOURCE_STATE_UNDEFINED;
+    node.final_state = RESOURCE_STATE_UNDEFINED;
+
+    return add_resource(graph, &node);
+}
+
+RenderGraphResource vulkan_render_graph_import_rendertarget(RenderGraph* graph, const char* name,
+                                                            ResourceState initial_state,
+                                                            ResourceState final_state)
+{
+    assert(graph);
+
+    RenderGraphResourceNode node{};
+    node.name = name;
+    node.imported = true;
+    node.initial_state = initial_state;
+    node.final_state = final_state;
+
+    return add_resource(graph, &node);
+}
+
+void vulkan_render_graph_bind_import(RenderGraph* graph, RenderGraphResource resource,
+                                     RenderTargetHandle render_target)
+{
+    assert(resource < graph->resources.size() && graph->resources[resource].imported);
+
+    graph->resources[resource].render_target = render_target;
+}
+
+u32 vulkan_render_graph_add_pass(RenderGraph* graph, const char* name,
+                                 RenderGraphExecuteFn execute, void* user_data)
+{
+    assert(graph && execute);
+
+    RenderGraphPass pass{};
+    pass.name = name;
+    pass.execute = execute;
+    pass.user_data = user_data;
+
+    graph->passes.push_back(pass);
+    graph->compiled = false;
+
+    return (u32)graph->passes.size() - 1;
+}
+
+static void add_access(RenderGraph* graph, u32 pass, RenderGraphResource resource,
+                       ResourceState state, u8 write)
+{
+    assert(pass < graph->passes.size());
+    assert(resource < graph->resources.size());
+
+    RenderGraphAccess access{};
+    access.resource = resource;
+    access.state = state;
+    access.write = write;
+
+    graph->passes[pass].accesses.push_back(access);
+    graph->compiled = false;
+}
+
+void vulkan_render_graph_pass_read(RenderGraph* graph, u32 pass, RenderGraphResource resource,
+                                   ResourceState state)
+{
+    add_access(graph, pass, resource, state, false);
+}
+
+void vulkan_render_graph_pass_write(RenderGraph* graph, u32 pass, RenderGraphResource resource,
+                                    ResourceState state)
+{
+    add_access(graph, pass, resource, state, true);
+}
+
+void vulkan_render_graph_pass_side_effect(RenderGraph* graph, u32 pass)
+{
+    assert(pass < graph->passes.size());
+
+    graph->passes[pass].side_effect = true;
+    graph->compiled = false;
+}
+
+static b8 validate(RenderGraph* graph)
+{
+    std::vector<u8> written(graph->resources.size(), 0);
+    for (u32 i = 0; i < graph->resources.size(); ++i)
+        written[i] = graph->resources[i].imported;
+
+    for (const RenderGraphPass& pass : graph->passes)
+    {
+        for (const RenderGraphAccess& access : pass.accesses)
+        {
+            if (!access.write && !written[access.resource])
+            {
+                std::cout << "render graph: pass " << pass.name << " reads "
+                          << graph->resources[access.resource].name << " before any write"
+                          << std::endl;
+                return false;
+            }
+        }
+
+        for (const RenderGraphAccess& access : pass.accesses)
+        {
+            if (access.write)
+                written[access.resource] = true;
+        }
+    }
+
+    return true;
+}
+
+// walk backwards, a pass survives when it has side effects, writes an imported resource or
+// writes something a surviving later pass reads
+static void cull_passes(RenderGraph* graph)
+{
+    std::vector<u8> needed(graph->resources.size(), 0);
+
+    for (u32 i = (u32)graph->passes.size(); i-- > 0;)
+    {
+        RenderGraphPass& pass = graph->passes[i];
+
+        b8 alive = pass.side_effect;
+        for (const RenderGraphAccess& access : pass.accesses)
+        {
+            if (access.write &&
+                (graph->resources[access.resource].imported || needed[access.resource]))
+                alive = true;
+        }
+
+        pass.culled = !alive;
+        if (!alive)
+            continue;
+
+        // the write replaces the contents, earlier producers only matter if this pass reads
+        for (const RenderGraphAccess& access : pass.accesses)
+        {
+            if (access.write && !graph->resources[access.resource].imported)
+                needed[access.resource] = false;
+        }
+
+        for (const RenderGraphAccess& access : pass.accesses)
+        {
+            if (!access.write)
+                needed[access.resource] = true;
+        }
+    }
+}
+
+static void compute_lifetimes(RenderGraph* graph)
+{
+    for (u32 i = 0; i < graph->passes.size(); ++i)
+    {
+        if (graph->passes[i].culled)
+            continue;
+
+        RenderGraphStep step{};
+        step.pass = i;
+        graph->steps.push_back(step);
+
+        const u32 step_index = (u32)graph->steps.size() - 1;
+        for (const RenderGraphAccess& access : graph->passes[i].accesses)
+        {
+            RenderGraphResourceNode& node = graph->resources[access.resource];
+            if (node.first_step == RENDER_GRAPH_INVALID_INDEX)
+                node.first_step = step_index;
+            node.last_step = step_index;
+        }
+    }
+}
+
+// greedy first fit, largest first : a transient joins the first slot whose members it never
+// overlaps in time, otherwise opens a new slot
+static void plan_aliasing(RenderGraph* graph)
+{
+    std::vector<RenderGraphResource> transients;
+    for (u32 i = 0; i < graph->resources.size(); ++i)
+    {
+        RenderGraphResourceNode& node = graph->resources[i];
+        if (node.imported || node.first_step == RENDER_GRAPH_INVALID_INDEX)
+            continue;
+
+        node.estimated_size = estimate_size(&node.desc);
+        transients.push_back(i);
+    }
+
+    std::stable_sort(transients.begin(), transients.end(),
+                     [graph](RenderGraphResource a, RenderGraphResource b) {
+                         return graph->resources[a].estimated_size >
+                                graph->resources[b].estimated_size;
+                     });
+
+    for (RenderGraphResource resource : transients)
+    {
+        RenderGraphResourceNode& node = graph->resources[resource];
+
+        u32 slot_index = RENDER_GRAPH_INVALID_INDEX;
+        for (u32 i = 0; i < graph->alias_slots.size() && slot_index == RENDER_GRAPH_INVALID_INDEX;
+             ++i)
+        {
+            b8 overlaps = false;
+            for (RenderGraphResource member : graph->alias_slots[i].resources)
+            {
+                const RenderGraphResourceNode& other = graph->resources[member];
+                if (node.first_step <= other.last_step && other.first_step <= node.last_step)
+                    overlaps = true;
+            }
+
+            if (!overlaps)
+                slot_index = i;
+        }
+
+        if (slot_index == RENDER_GRAPH_INVALID_INDEX)
+        {
+            graph->alias_slots.push_back(RenderGraphAliasSlot{});
+            slot_index = (u32)graph->alias_slots.size() - 1;
+        }
+
+        RenderGraphAliasSlot& slot = graph->alias_slots[slot_index];
+        slot.resources.push_back(resource);
+        slot.estimated_size = std::max(slot.estimated_size, node.estimated_size);
+        node.alias_slot = slot_index;
+    }
+
+    for (RenderGraphAliasSlot& slot : graph->alias_slots)
+    {
+        std::sort(slot.resources.begin(), slot.resources.end(),
+                  [graph](RenderGraphResource a, RenderGraphResource b) {
+                      return graph->resources[a].first_step < graph->resources[b].first_step;
+                  });
+    }
+}
+
+// later reads up to the next write that share the layout are folded into the first
+// transition, so they need no barrier of their own
+static ResourceState widen_read_state(RenderGraph* graph, u32 step_index,
+                                      RenderGraphResource resource, ResourceState state)
+{
+    const VkImageLayout layout = resource_state_to_vulkan_image_layout(state);
+
+    for (u32 i = step_index + 1; i < graph->steps.size(); ++i)
+    {
+        for (const RenderGraphAccess& access : graph->passes[graph->steps[i].pass].accesses)
+        {
+            if (access.resource != resource)
+                continue;
+
+            if (access.write)
+                return state;
+
+            ResourceState widened = ResourceState(state | access.state);
+            if (resource_state_to_vulkan_image_layout(widened) != layout)
+                return state;
+
+            state = widened;
+        }
+    }
+
+    return state;
+}
+
+static void plan_barriers(RenderGraph* graph)
+{
+    const u32 resource_count = (u32)graph->resources.size();
+
+    std::vector<ResourceState> states(resource_count);
+    std::vector<u32> first_barriers(resource_count, RENDER_GRAPH_INVALID_INDEX);
+    for (u32 i = 0; i < resource_count; ++i)
+        states[i] = graph->resources[i].initial_state;
+
+    std::vector<RenderGraphAccess> merged;
+    for (u32 step_index = 0; step_index < graph->steps.size(); ++step_index)
+    {
+        RenderGraphStep& step = graph->steps[step_index];
+        step.first_barrier = (u32)graph->barriers.size();
+
+        // one state per resource and pass
+        merged.clear();
+        for (const RenderGraphAccess& access : graph->passes[step.pass].accesses)
+        {
+            auto it = std::find_if(merged.begin(), merged.end(), [&](const RenderGraphAccess& m) {
+                return m.resource == access.resource;
+            });
+
+            if (it == merged.end())
+            {
+                merged.push_back(access);
+            }
+            else
+            {
+                it->state = ResourceState(it->state | access.state);
+                it->write |= access.write;
+            }
+        }
+
+        for (const RenderGraphAccess& access : merged)
+        {
+            const ResourceState current_state = states[access.resource];
+            ResourceState new_state = access.state;
+
+            if (!access.write)
+            {
+                // an earlier read already moved it into a state covering this one
+                if (!is_resource_state_write(current_state) &&
+                    (current_state & new_state) == new_state)
+                    continue;
+
+                new_state = widen_read_state(graph, step_index, access.resource, new_state);
+            }
+            else if (current_state == new_state && !is_resource_state_write(current_state))
+            {
+                continue;
+            }
+
+            // same write state across passes still needs the write-after-write dependency
+            RenderGraphBarrier barrier{};
+            barrier.resource = access.resource;
+            barrier.current_state = current_state;
+            barrier.new_state = new_state;
+
+            if (current_state == RESOURCE_STATE_UNDEFINED)
+                first_barriers[access.resource] = (u32)graph->barriers.size();
+
+            graph->barriers.push_back(barrier);
+            states[access.resource] = new_state;
+        }
+
+        step.barrier_count = (u32)graph->barriers.size() - step.first_barrier;
+    }
+
+    graph->final_barrier_offset = (u32)graph->barriers.size();
+    for (u32 i = 0; i < resource_count; ++i)
+    {
+        const RenderGraphResourceNode& node = graph->resources[i];
+        if (!node.imported || node.final_state == RESOURCE_STATE_UNDEFINED ||
+            states[i] == node.final_state)
+            continue;
+
+        RenderGraphBarrier barrier{};
+        barrier.resource = i;
+        barrier.current_state = states[i];
+        barrier.new_state = node.final_state;
+        graph->barriers.push_back(barrier);
+    }
+    graph->final_barrier_count = (u32)graph->barriers.size() - graph->final_barrier_offset;
+
+    // the first use of a slot member waits on the member before it, the first member on the
+    // last one of the previous frame
+    for (const RenderGraphAliasSlot& slot : graph->alias_slots)
+    {
+        const u32 member_count = (u32)slot.resources.size();
+        for (u32 i = 0; i < member_count; ++i)
+        {
+            RenderGraphResource resource = slot.resources[i];
+            RenderGraphResource previous = slot.resources[(i + member_count - 1) % member_count];
+
+            if (first_barriers[resource] != RENDER_GRAPH_INVALID_INDEX)
+                graph->barriers[first_barriers[resource]].alias_state = states[previous];
+        }
+    }
+}
+
+b8 vulkan_render_graph_compile(RenderGraph* graph)
+{
+    PKO_PROFILE_FUNCTION();
+
+    assert(graph);
+    assert(!graph->realized);
+
+    graph->steps.clear();
+    graph->barriers.clear();
+    graph->alias_slots.clear();
+    graph->final_barrier_offset = 0;
+    graph->final_barrier_count = 0;
+    graph->compiled = false;
+
+    for (RenderGraphResourceNode& node : graph->resources)
+    {
+        node.first_step = RENDER_GRAPH_INVALID_INDEX;
+        node.last_step = RENDER_GRAPH_INVALID_INDEX;
+        node.alias_slot = RENDER_GRAPH_INVALID_INDEX;
+    }
+
+    if (!validate(graph))
+        return false;
+
+    cull_passes(graph);
+    compute_lifetimes(graph);
+    plan_aliasing(graph);
+    plan_barriers(graph);
+
+    graph->compiled = true;
+    return true;
+}
+
+static void print_state(ResourceState state)
+{
+    static const struct
+    {
+        ResourceState state;
+        const char* name;
+    } names[] = {
+        {RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER, "VERTEX_AND_CONSTANT_BUFFER"},
+        {RESOURCE_STATE_INDEX_BUFFER, "INDEX_BUFFER"},
+        {RESOURCE_STATE_RENDER_TARGET, "RENDER_TARGET"},
+        {RESOURCE_STATE_UNORDERED_ACCESS, "UNORDERED_ACCESS"},
+        {RESOURCE_STATE_DEPTH_WRITE, "DEPTH_WRITE"},
+        {RESOURCE_STATE_DEPTH_READ, "DEPTH_READ"},
+        {RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, "NON_PIXEL_SHADER_RESOURCE"},
+        {RESOURCE_STATE_PIXEL_SHADER_RESOURCE, "PIXEL_SHADER_RESOURCE"},
+        {RESOURCE_STATE_INDIRECT_ARGUMENT, "INDIRECT_ARGUMENT"},
+        {RESOURCE_STATE_PRESENT, "PRESENT"},
+        {RESOURCE_STATE_COPY_DEST, "COPY_DEST"},
+        {RESOURCE_STATE_COPY_SOURCE, "COPY_SOURCE"},
+        {RESOURCE_STATE_COMMON, "COMMON"},
+        {RESOURCE_STATE_HOST_READ, "HOST_READ"},
+    };
+
+    if (state == RESOURCE_STATE_UNDEFINED)
+    {
+        std::cout << "UNDEFINED";
+        return;
+    }
+
+    const char* separator = "";
+    for (const auto& entry : names)
+    {
+        if (state & entry.state)
+        {
+            std::cout << separator << entry.name;
+            separator = "|";
+        }
+    }
+}
+
+static void print_barriers(const RenderGraph* graph, u32 first, u32 count)
+{
+    for (u32 i = first; i < first + count; ++i)
+    {
+        const RenderGraphBarrier& barrier = graph->barriers[i];
+
+        std::cout << "    barrier " << graph->resources[barrier.resource].name << " : ";
+        print_state(barrier.current_state);
+        std::cout << " -> ";
+        print_state(barrier.new_state);
+
+        if (barrier.alias_state != RESOURCE_STATE_UNDEFINED)
+        {
+            std::cout << " (after alias ";
+            print_state(barrier.alias_state);
+            std::cout << ")";
+        }
+
+        std::cout << std::endl;
+    }
+}
+
+void vulkan_render_graph_print(const RenderGraph* graph)
+{
+    assert(graph->compiled);
+
+    for (const RenderGraphPass& pass : graph->passes)
+    {
+        if (pass.culled)
+            std::cout << "culled " << pass.name << std::endl;
+    }
+
+    for (u32 i = 0; i < graph->steps.size(); ++i)
+    {
+        const RenderGraphStep& step = graph->steps[i];
+
+        std::cout << "step " << i << " : " << graph->passes[step.pass].name << std::endl;
+        print_barriers(graph, step.first_barrier, step.barrier_count);
+    }
+
+    std::cout << "final" << std::endl;
+    print_barriers(graph, graph->final_barrier_offset, graph->final_barrier_count);
+
+    for (u32 i = 0; i < graph->alias_slots.size(); ++i)
+    {
+        const RenderGraphAliasSlot& slot = graph->alias_slots[i];
+
+        std::cout << "alias slot " << i << " (~" << slot.estimated_size << " bytes) :";
+        for (RenderGraphResource resource : slot.resources)
+        {
+            const RenderGraphResourceNode& node = graph->resources[resource];
+            std::cout << " " << node.name << "[" << node.first_step << "," << node.last_step
+                      << "]";
+        }
+        std::cout << std::endl;
+    }
+}
+
+void vulkan_render_graph_realize(RenderContext* context, RenderGraph* graph)
+{
+    assert(graph->compiled && !graph->realized);
+
+    for (u32 i = 0; i < graph->alias_slots.size(); ++i)
+    {
+        RenderGraphAliasSlot& slot = graph->alias_slots[i];
+
+        VkMemoryRequirements slot_requirements{};
+        slot_requirements.alignment = 1;
+        slot_requirements.memoryTypeBits = ~0u;
+
+        for (RenderGraphResource resource : slot.resources)
+        {
+            VkMemoryRequirements requirements;
+            vulkan_rendertarget_get_memory_requirements(context, &graph->resources[resource].desc,
+                                                        &requirements);
+
+            slot_requirements.size = std::max(slot_requirements.size, requirements.size);
+            slot_requirements.alignment =
+                std::max(slot_requirements.alignment, requirements.alignment);
+            slot_requirements.memoryTypeBits &= requirements.memoryTypeBits;
+        }
+
+        slot.allocation = VK_NULL_HANDLE;
+        if (slot_requirements.memoryTypeBits != 0)
+        {
+            VmaAllocationCreateInfo alloc_create_info{};
+            alloc_create_info.requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+
+            VK_CHECK(vmaAllocateMemory(context->vma_allocator, &slot_requirements,
+                                       &alloc_create_info, &slot.allocation, NULL));
+            vulkan_memory_tag(context, slot.allocation, MEMORY_CATEGORY_RENDER_TARGET);
+        }
+        else
+        {
+            // the barriers stay conservative, only the memory saving is lost
+            std::cout << "render graph: alias slot " << i
+                      << " has no common memory type, members get their own memory"
+                      << std::endl;
+        }
+
+        for (RenderGraphResource resource : slot.resources)
+        {
+            RenderGraphResourceNode& node = graph->resources[resource];
+
+            RenderTargetDesc desc = node.desc;
+            desc.alias_allocation = slot.allocation;
+            vulkan_rendertarget_create(context, &desc, &node.render_target);
+        }
+    }
+
+    graph->realized = true;
+}
+
+static void record_barriers(RenderContext* context, RenderGraph* graph, Command* command,
+                            u32 first, u32 count)
+{
+    if (count == 0)
+        return;
+
+    graph->scratch_barriers.resize(count);
+    for (u32 i = 0; i < count; ++i)
+    {
+        const RenderGraphBarrier& barrier = graph->barriers[first + i];
+
+        RenderTargetBarrier& render_target_barrier = graph->scratch_barriers[i];
+        render_target_barrier = {};
+        render_target_barrier.render_target =
+            vulkan_render_graph_get_rendertarget(context, graph, barrier.resource);
+        render_target_barrier.current_state = barrier.current_state;
+        render_target_barrier.new_state = barrier.new_state;
+        render_target_barrier.alias_state = barrier.alias_state;
+    }
+
+    vulkan_command_resource_barrier(command, NULL, 0, NULL, 0, graph->scratch_barriers.data(),
+                                    count);
+}
+
+void vulkan_render_graph_execute(RenderContext* context, RenderGraph* graph, Command* command)
+{
+    assert(graph->compiled && graph->realized);
+
+    for (const RenderGraphStep& step : graph->steps)
+    {
+        record_barriers(context, graph, command, step.first_barrier, step.barrier_count);
+
+        RenderGraphPass& pass = graph->passes[step.pass];
+
+        u32 scope = GPU_PROFILE_SCOPE_INVALID;
+        if (context->gpu_profiler)
+            scope = vulkan_gpu_profiler_begin_scope(context->gpu_profiler, command, pass.name);
+
+        {
+            PKO_PROFILE_ZONE(pass.name);
+            pass.execute(context, graph, command, pass.user_data);
+        }
+
+        if (context->gpu_profiler)
+            vulkan_gpu_profiler_end_scope(context->gpu_profiler, command, scope);
+    }
+
+    record_barriers(context, graph, command, graph->final_barrier_offset,
+                    graph->final_barrier_count);
+}
+
+void vulkan_render_graph_destroy(RenderContext* context, RenderGraph* graph)
+{
+    if (graph->realized)
+    {
+        // frames in flight may still use them, the allocation goes after its render targets
+        for (const RenderGraphAliasSlot& slot : graph->alias_slots)
+        {
+            for (RenderGraphResource resource : slot.resources)
+                vulkan_deletion_queue_push_rendertarget(context,
+                                                        graph->resources[resource].render_target);
+
+            if (slot.allocation != VK_NULL_HANDLE)
+                vulkan_deletion_queue_push_allocation(context, slot.allocation);
+        }
+    }
+
+    *graph = RenderGraph();
+}
+
+RenderTarget* vulkan_render_graph_get_rendertarget(RenderContext* context, RenderGraph* graph,
+                                                   RenderGraphResource resource)
+{
+    assert(resource < graph->resources.size());
+
+    RenderTarget* render_target =
+        vulkan_rendertarget_get(context, graph->resources[resource].render_target);
+    assert(render_target && "render graph resource is not bound");
+
+    return render_target;
+}
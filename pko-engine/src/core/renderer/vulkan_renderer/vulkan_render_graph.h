@@ -0,0 +1,45 @@
+#ifndef VULKAN_RENDER_GRAPH_H
+#define VULKAN_RENDER_GRAPH_H
+
+#include "vulkan_types.inl"
+
+/*
+     Render graph : passes are declared in execution order, a pass may only read what an
+     earlier pass wrote or what was imported. A write without a read of the same resource
+     overwrites it, passes that need the previous contents declare both.
+     Transient render targets are owned by the graph, imported ones (the swapchain image) are
+     bound every frame and returned to their final state after the last pass.
+*/
+RenderGraphResource vulkan_render_graph_create_rendertarget(RenderGraph* graph, const char* name,
+                                                            const RenderTargetDesc* desc);
+RenderGraphResource vulkan_render_graph_import_rendertarget(RenderGraph* graph, const char* name,
+                                                            ResourceState initial_state,
+                                                            ResourceState final_state);
+void vulkan_render_graph_bind_import(RenderGraph* graph, RenderGraphResource resource,
+                                     RenderTargetHandle render_target);
+
+u32 vulkan_render_graph_add_pass(RenderGraph* graph, const char* name,
+                                 RenderGraphExecuteFn execute, void* user_data);
+void vulkan_render_graph_pass_read(RenderGraph* graph, u32 pass, RenderGraphResource resource,
+                                   ResourceState state);
+void vulkan_render_graph_pass_write(RenderGraph* graph, u32 pass, RenderGraphResource resource,
+                                    ResourceState state);
+void vulkan_render_graph_pass_side_effect(RenderGraph* graph, u32 pass);
+
+// culls, orders and plans barriers and aliasing, touches no GPU object
+b8 vulkan_render_graph_compile(RenderGraph* graph);
+// dump the compiled steps, barriers and alias slots
+void vulkan_render_graph_print(const RenderGraph* graph);
+
+// allocate the alias slots and create the transient render targets in them
+void vulkan_render_graph_realize(RenderContext* context, RenderGraph* graph);
+// one batched barrier call before each pass, then the pass itself
+void vulkan_render_graph_execute(RenderContext* context, RenderGraph* graph, Command* command);
+// transient resources go through the deletion queue, the graph is empty afterwards
+void vulkan_render_graph_destroy(RenderContext* context, RenderGraph* graph);
+
+// transient pointer into the render target pool
+RenderTarget* vulkan_render_graph_get_rendertarget(RenderContext* context, RenderGraph* graph,
+                                                   RenderGraphResource resource);
+
+#endif  // !VULKAN_RENDER_GRAPH_H
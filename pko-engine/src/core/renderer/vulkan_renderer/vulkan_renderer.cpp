@@ -3,6 +3,7 @@
 #define VMA_IMPLEMENTATION
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <chrono>
 #include <iostream>
 
 #include "vulkan_types.inl"
@@ -10,16 +11,34 @@
 #include "core/application.h"
 #include "core/event.h"
 #include "core/input.h"
+#include "core/job_system.h"
+#include "core/profiler.h"
 #include "core/renderer/camera.h"
+#include "core/renderer/culling.h"
+#include "core/renderer/occlusion.h"
+#include "core/renderer/render_world.h"
 #include "platform/platform.h"
 #include "vendor/mmgr/mmgr.h"
 #include "vulkan_buffer.h"
 #include "vulkan_command_buffer.h"
+#include "vulkan_defragmenter.h"
+#include "vulkan_deletion_queue.h"
+#include "vulkan_depth_pyramid.h"
 #include "vulkan_device.h"
+#include "vulkan_gpu_culling.h"
 #include "vulkan_image.h"
+#include "vulkan_indirect.h"
 #include "vulkan_memory_allocate.h"
+#include "vulkan_mesh.h"
+#include "vulkan_metrics.h"
+#include "vulkan_parallel_recorder.h"
 #include "vulkan_pipeline.h"
+#include "vulkan_profiler.h"
+#include "vulkan_queue.h"
+#include "vulkan_render_graph.h"
 #include "vulkan_shader.h"
+#include "vulkan_transform_buffer.h"
+#include "vulkan_uniform_ring.h"
 
 #include "imgui/backends/imgui_impl_vulkan.h"
 #include "imgui/backends/imgui_impl_win32.h"
@@ -31,13 +50,145 @@ static RenderContext context{};
 Command cmds[MAX_FRAME];
 
 VulkanSwapchain* swapchain = NULL;
+// binary semaphores only for the swapchain, frame pacing runs on the graphics timeline
 VkSemaphore ready_to_render_semaphores[MAX_FRAME];
 VkSemaphore image_available_semaphores[MAX_FRAME];
-VkFence render_fences[MAX_FRAME];
 
-RenderTarget* depth_render_target = NULL;
+RenderTargetHandle depth_render_target = {};
+
+static RenderGraph render_graph;
+static RenderGraphResource backbuffer = RENDER_GRAPH_RESOURCE_INVALID;
+static RenderGraphResource scene_depth = RENDER_GRAPH_RESOURCE_INVALID;
+
+struct global_uniform
+{
+    glm::mat4 projection;
+    glm::mat4 view;
+};
+
+static const VkFormat SCENE_DEPTH_FORMAT = VK_FORMAT_D32_SFLOAT;
+// waking another thread for fewer draws than this costs more than recording them
+static const u32 MIN_DRAWS_PER_SLICE = 256;
+
+// frames between fragmentation checks, and the share of block memory left unused that starts
+// a defragmentation run
+static const u32 DEFRAG_CHECK_INTERVAL = 600;
+static const f32 DEFRAG_UNUSED_FRACTION = 0.25f;
+static const u64 DEFRAG_MIN_UNUSED_BYTES = 32ull << 20;
+// per frame copy budget of a pass
+static const u64 DEFRAG_BYTES_PER_PASS = 16ull << 20;
+static const u32 DEFRAG_ALLOCATIONS_PER_PASS = 64;
+
+static GpuProfiler gpu_profiler = {};
+static Defragmenter defragmenter = {};
+static JobSystem job_system;
+static ParallelRecorder scene_recorder;
+static Pipeline scene_pipeline = {};
+
+// depth of the scene first from the position stream, then shaded with EQUAL and no depth
+// writes so every pixel runs the fragment shader once. on the CPU culled path only, culling
+// on the device splits the scene around the pyramid instead
+static Pipeline depth_prepass_pipeline = {};
+static Pipeline scene_equal_pipeline = {};
+static ParallelRecorder prepass_recorder;
+static bool depth_prepass_available = false;
+static bool scene_depth_prepass = false;
+// the one scene_draws was built with
+static Pipeline* scene_draw_pipeline = NULL;
+static VkDescriptorSetLayout global_set_layout = VK_NULL_HANDLE;
+// per frame constants of every pass, one region per frame in flight
+static const u32 UNIFORM_RING_FRAME_SIZE = 64 * 1024;
+static UniformRing uniform_ring = {};
+static VkDescriptorSet global_set = VK_NULL_HANDLE;
+// the global constants are the first push of a frame, so the offset of a frame slot never
+// changes and pre-recorded draws can keep it
+static u32 global_uniform_offset = 0;
+// object transforms of the scene, drawn through firstInstance
+static const u32 MAX_SCENE_TRANSFORMS = 16384;
+static TransformBuffer scene_transforms = {};
+static vulkan_render_object* scene_object = NULL;
+// mesh instances merged into instanced draws, regrouped only when the scene changes
+static std::vector<instanced_draw> scene_draws;
+static u32 scene_item_count = 0;
+// counted when scene_draws is built, the secondaries drawing it may be replays
+static draw_list_stats scene_draw_stats = {};
+// transform index per instance, read through binding 1 at firstInstance + instance
+static BufferHandle scene_instance_buffer = {};
+// one indirect call per batch instead of a draw per instanced draw, needs firstInstance in
+// indirect commands for the instance stream
+static IndirectDrawBuffer scene_indirect = {};
+static bool scene_draw_indirect = true;
+// min and max of the scene depth, built after the depth is final. the occlusion test of the
+// gpu culling reads it
+static DepthPyramid depth_pyramid = {};
+static bool depth_pyramid_available = false;
+// the scene depth of the frame was rendered with
+static glm::mat4 scene_view_projection = glm::mat4(1.0f);
+// visibility decided on the device, needs the indirect path and the culling shaders
+static GpuCulling gpu_culling = {};
+static bool gpu_culling_available = false;
+static bool scene_gpu_culling = true;
+static GpuCullPhase cull_phases[2] = {GPU_CULL_PHASE_EARLY, GPU_CULL_PHASE_LATE};
+// what the device drew against the sphere test of culling.cpp, compared once the frame slot
+// retired. equal without a pyramid, never more with one
+static bool scene_gpu_culling_check = false;
+static std::vector<glm::vec4> scene_item_spheres;
+static std::vector<u32> gpu_check_expected[MAX_FRAME];
+static u64 gpu_check_versions[MAX_FRAME] = {};
+static bool gpu_check_occlusion[MAX_FRAME] = {};
+static u32 gpu_check_mismatches = 0;
+static u32 gpu_check_frames = 0;
+static u32 gpu_check_differing_frames = 0;
+// frustum culling of the indirect commands on the host when the device does not cull. the
+// tree is over the world boxes of the draw items, built when the draw list changes
+static Bvh scene_bvh;
+static bool scene_cpu_culling = true;
+// draw item of every instance, in the order of the instance stream
+static std::vector<u32> scene_instance_items;
+static std::vector<u8> scene_item_visible;
+// the mesh instances as entities, chunks of plain arrays the workers walk front to back.
+// the frustum test over them is the alternative to the BVH
+static RenderWorld scene_world;
+static bool scene_ecs_culling = false;
+// a draw stays when any of its instances is visible, the stream is not compacted per frame
+static std::vector<u8> scene_draw_visible;
+static u32 scene_visible_items = 0;
+// world boxes of the draw items for the occlusion test
+static std::vector<glm::vec3> scene_item_mins;
+static std::vector<glm::vec3> scene_item_maxs;
+// the largest triangles of the scene rasterized on the workers every frame, items the frustum
+// kept are tested against them. the frames in flight keep the device busy meanwhile
+static const u32 OCCLUSION_WIDTH = 256;
+static const u32 OCCLUSION_HEIGHT = 128;
+static const u32 MAX_OCCLUDER_TRIANGLES = 4096;
+static OcclusionBuffer scene_occlusion = {};
+static std::vector<glm::vec3> scene_occluders;
+static bool scene_cpu_occlusion = true;
+static u32 scene_occluded_items = 0;
+// the passes change with the culling mode, rebuilt before the next frame records
+static bool render_graph_dirty = false;
+// record the scene once per frame slot and replay it until scene_version changes
+static bool prerecord_static_scene = true;
+// bumped whenever the draw list, the scene pipeline or the viewport change
+static u64 scene_version = 1;
 
 void drawImgui();
+static b8 build_render_graph();
+static void on_memory_pressure(RenderContext* context, u32 heap_index, u64 usage, u64 budget,
+                               void* user_data);
+static b8 create_scene();
+static void destroy_scene();
+static void rebuild_scene_draws();
+static void rebuild_scene_bounds();
+static bool use_indirect_draws();
+static bool use_gpu_culling();
+static bool use_depth_prepass();
+static bool use_async_depth_pyramid();
+static Pipeline* scene_shading_pipeline();
+static const u8* cull_scene_draws(const glm::mat4& view_projection);
+static void check_gpu_culling(u32 frame);
+static void check_fragmentation(u32 frame_number);
+static void add_scene_metrics();
 
 static VKAPI_ATTR VkBool32 debugCallback(VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
                                          VkDebugUtilsMessageTypeFlagsEXT messageTypes,
@@ -126,9 +277,29 @@ b8 VulkanRenderer::Init()
         return false;
 
     vulkan_memory_allocator_create(&context);
+    // nothing streams yet, so all there is to do is say it
+    vulkan_memory_set_pressure_callback(&context, 0.9f, on_memory_pressure, NULL);
 
     vulkan_get_device_queue(&context.device_context);
 
+    context.queue_scheduler = new QueueScheduler();
+    if (!vulkan_queue_scheduler_create(&context, context.queue_scheduler))
+    {
+        std::cout << "create queue scheduler failed" << std::endl;
+        return false;
+    }
+
+    vulkan_deletion_queue_create(&context);
+
+    vulkan_uniform_ring_create(&context, &uniform_ring, UNIFORM_RING_FRAME_SIZE);
+
+    // appended every 120 frames so a spike can be matched to what the frame did
+    vulkan_metrics_init("frame_metrics.csv", METRICS_FORMAT_CSV, 120);
+
+    // without timestamps the window just says so, the graph records no scopes
+    if (vulkan_gpu_profiler_create(&context, &gpu_profiler))
+        context.gpu_profiler = &gpu_profiler;
+
     // validation debug logger create
 #if defined(_DEBUG)
     createDebugUtilMessage();
@@ -148,6 +319,12 @@ b8 VulkanRenderer::Init()
 
     initImgui();
 
+    if (!build_render_graph())
+    {
+        std::cout << "render graph compile failed" << std::endl;
+        return false;
+    }
+
     for (u32 i = 0; i < MAX_FRAME; ++i)
     {
         VkSemaphoreCreateInfo semaphore_create_info{VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO};
@@ -155,10 +332,6 @@ b8 VulkanRenderer::Init()
                                    context.allocator, &image_available_semaphores[i]));
         VK_CHECK(vkCreateSemaphore(context.device_context.handle, &semaphore_create_info,
                                    context.allocator, &ready_to_render_semaphores[i]));
-        VkFenceCreateInfo fence_create_info{VK_STRUCTURE_TYPE_FENCE_CREATE_INFO};
-        fence_create_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-        vkCreateFence(context.device_context.handle, &fence_create_info, context.allocator,
-                      &render_fences[i]);
     }
     std::cout << "sync objects created" << std::endl;
 
@@ -178,6 +351,12 @@ b8 VulkanRenderer::Init()
         vulkan_command_buffer_allocate(&context, &cmds[i], true);
     }
 
+    if (!create_scene())
+    {
+        std::cout << "create scene failed" << std::endl;
+        return false;
+    }
+
     /*
      * global descriptor initialize
      */
@@ -258,52 +437,446 @@ void VulkanRenderer::Load(ReloadDesc* desc)
 
 void VulkanRenderer::UnLoad(ReloadDesc* desc) {}
 
-void VulkanRenderer::Update(float deltaTime) {}
+void VulkanRenderer::Update(float deltaTime)
+{
+    PKO_PROFILE_FUNCTION();
+}
 
 void VulkanRenderer::Draw()
 {
-    context.current_frame = frame_number_++ % MAX_FRAME;
-    VK_CHECK(vkWaitForFences(context.device_context.handle, 1,
-                             &render_fences[context.current_frame], true, UINT64_MAX));
-    VK_CHECK(
-        vkResetFences(context.device_context.handle, 1, &render_fences[context.current_frame]));
+    PKO_PROFILE_FUNCTION();
+
+    const auto cpu_begin = std::chrono::steady_clock::now();
+
+    // waits for the frame MAX_FRAME behind on the graphics timeline
+    vulkan_queue_scheduler_begin_frame(&context, context.queue_scheduler);
+    context.current_frame = context.queue_scheduler->current_frame;
+    ++frame_number_;
+
+    vulkan_deletion_queue_retire(&context);
+    // after the retire, memory freed by it already counts
+    vulkan_memory_poll_budgets(&context);
 
     if (!acquire_next_image_index_swapchain(&context, swapchain, UINT64_MAX,
                                             image_available_semaphores[context.current_frame], 0,
                                             &context.image_index))
     {
         std::cout << "image acquire failed" << std::endl;
+        recreateSwapchain();
         return;
     }
 
+    // toggled from the ui, which draws inside the graph
+    if (render_graph_dirty)
+    {
+        render_graph_dirty = false;
+        // the draw list carries the pipeline of the shaded pass
+        if (scene_object && scene_draw_pipeline != scene_shading_pipeline())
+            rebuild_scene_draws();
+        vulkan_render_graph_destroy(&context, &render_graph);
+        if (!build_render_graph())
+        {
+            std::cout << "render graph compile failed" << std::endl;
+        }
+    }
+
+    // the frame that last used this region has retired
+    vulkan_uniform_ring_begin_frame(&uniform_ring, context.current_frame);
+
+    global_uniform uniform{};
+    uniform.projection =
+        glm::perspective(glm::radians(45.0f),
+                         (f32)swapchain->desc->width / (f32)swapchain->desc->height, 0.1f, 100.0f);
+    uniform.view = glm::lookAt(glm::vec3(0.0f, 0.0f, -10.0f), glm::vec3(0.0f, 0.0f, 1.0f),
+                               glm::vec3(0.0f, -1.0f, 0.0f));
+    global_uniform_offset = vulkan_uniform_ring_push(&uniform_ring, &uniform, sizeof(uniform));
+    scene_view_projection = uniform.projection * uniform.view;
+
+    // moved nodes reach the transform buffer before its region is written, the boxes and
+    // occluders of the CPU culling follow them
+    if (scene_object && scene_object->update_transforms(&scene_transforms, &job_system))
+    {
+        rebuild_scene_bounds();
+        scene_object->sync_entities(&scene_world, &job_system);
+        scene_occluders.clear();
+        scene_object->build_occluders(MAX_OCCLUDER_TRIANGLES, &scene_occluders);
+    }
+    vulkan_transform_buffer_upload(&context, &scene_transforms, context.current_frame);
+    if (use_gpu_culling())
+    {
+        if (scene_gpu_culling_check)
+            check_gpu_culling(context.current_frame);
+        vulkan_gpu_culling_begin_frame(&context, &gpu_culling, &uniform_ring, &scene_transforms,
+                                       context.current_frame, scene_view_projection);
+    }
+
     Command* command = &cmds[context.current_frame];
-    RenderTarget* rendertarget = swapchain->render_targets[context.current_frame];
 
     vulkan_command_pool_reset(command);
     vulkan_command_buffer_begin(command, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
 
-    // Present to RenderTarget
-    TextureBarrier textureBarrier{};
-    textureBarrier.current_state = RESOURCE_STATE_PRESENT;
-    textureBarrier.new_state = RESOURCE_STATE_RENDER_TARGET;
-    textureBarrier.texture = rendertarget->texture;
+    vulkan_gpu_profiler_begin_frame(&context, &gpu_profiler, command);
+    const u32 frame_scope = vulkan_gpu_profiler_begin_scope(&gpu_profiler, command, "frame");
 
-    vulkan_command_resource_barrier(command, NULL, 0, &textureBarrier, 1, NULL, 0);
+    // take ownership of everything uploaded this frame or computed behind the last one
+    vulkan_queue_scheduler_acquire(context.queue_scheduler, command);
+
+    // moved buffers have new handles, the draw list and the pre-recorded draws bake them in
+    check_fragmentation(frame_number_);
+    if (vulkan_defragmenter_update(&context, &defragmenter, command))
+        rebuild_scene_draws();
+
+    // after the draw list settled for the frame, culled on the device the commands never
+    // leave it
+    if (use_indirect_draws() && !use_gpu_culling())
+    {
+        const u8* visible =
+            scene_cpu_culling ? cull_scene_draws(scene_view_projection) : NULL;
+        vulkan_indirect_buffer_build(&context, &scene_indirect, context.current_frame,
+                                     scene_draws.data(), visible);
+    }
+
+    // barriers between passes and back to present come from the compiled graph
+    vulkan_render_graph_bind_import(&render_graph, backbuffer,
+                                    swapchain->render_targets[context.image_index]);
+    vulkan_render_graph_execute(&context, &render_graph, command);
+
+    vulkan_gpu_profiler_end_scope(&gpu_profiler, command, frame_scope);
+    vulkan_command_buffer_end(command);
+
+    vulkan_uniform_ring_flush(&context, &uniform_ring);
+
+    const BarrierStats barrier_stats = vulkan_command_get_barrier_stats(command);
+    vulkan_metrics_add(METRIC_BARRIERS_ISSUED, barrier_stats.issued);
+    vulkan_metrics_add(METRIC_BARRIERS_ELIDED, barrier_stats.elided);
+    vulkan_metrics_add(METRIC_FRAGMENT_SHADER_INVOCATIONS,
+                       vulkan_gpu_profiler_get_fragment_invocations(&gpu_profiler));
+    add_scene_metrics();
+
+    // transfer and compute go out first, graphics signals the frame value on its timeline
+    vulkan_queue_scheduler_submit_frame(&context, context.queue_scheduler, command,
+                                        image_available_semaphores[context.current_frame],
+                                        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                                        ready_to_render_semaphores[context.current_frame]);
+
+    if (!present_image_swapchain(&context, swapchain, context.device_context.present_queue,
+                                 ready_to_render_semaphores[context.current_frame],
+                                 context.image_index))
+    {
+        recreateSwapchain();
+    }
+
+    const f32 cpu_frame_ms =
+        std::chrono::duration<f32, std::milli>(std::chrono::steady_clock::now() - cpu_begin)
+            .count();
+    vulkan_metrics_end_frame(&context, cpu_frame_ms,
+                             vulkan_gpu_profiler_get_last_ms(&gpu_profiler, "frame"));
+}
+
+static void on_memory_pressure(RenderContext* context, u32 heap_index, u64 usage, u64 budget,
+                               void* user_data)
+{
+    // fires once per heap crossing, the live numbers are in the memory overlay
+    std::cout << "memory pressure: heap " << heap_index << " uses " << usage << " of "
+              << budget << " bytes" << std::endl;
+}
+
+void VulkanRenderer::recreateSwapchain()
+{
+    // no device idle, the old swapchain goes through the deletion queue
+    swapchain->desc->width = app_state_->width;
+    swapchain->desc->height = app_state_->height;
+
+    if (!vulkan_swapchain_recreate(&context, &swapchain))
+    {
+        std::cout << "swapchain recreate failed" << std::endl;
+    }
+
+    // pre-recorded draws have the old viewport baked in
+    ++scene_version;
+
+    // transient attachments follow the swapchain extent
+    vulkan_render_graph_destroy(&context, &render_graph);
+    if (!build_render_graph())
+    {
+        std::cout << "render graph compile failed" << std::endl;
+    }
+}
+
+static void check_fragmentation(u32 frame_number)
+{
+    if (frame_number % DEFRAG_CHECK_INTERVAL != 0 ||
+        vulkan_defragmenter_is_running(&defragmenter))
+        return;
+
+    u64 block_bytes = 0;
+    u64 allocation_bytes = 0;
+    const MemoryBudget* budget = context.memory_budget;
+    for (u32 i = 0; i < budget->heap_count; ++i)
+    {
+        block_bytes += budget->heaps[i].statistics.blockBytes;
+        allocation_bytes += budget->heaps[i].statistics.allocationBytes;
+    }
+
+    const u64 unused_bytes = block_bytes - allocation_bytes;
+    if (unused_bytes >= DEFRAG_MIN_UNUSED_BYTES &&
+        unused_bytes > (u64)(block_bytes * DEFRAG_UNUSED_FRACTION))
+    {
+        vulkan_defragmenter_begin(&context, &defragmenter, DEFRAG_BYTES_PER_PASS,
+                                  DEFRAG_ALLOCATIONS_PER_PASS);
+    }
+}
+
+// the scene pipelines share one layout
+static void bind_scene_state(Command* command, const RenderDesc* render_desc, Pipeline* pipeline)
+{
+    vulkan_pipeline_bind(command, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+
+    const VkRect2D& area = render_desc->render_area;
+    VkViewport viewport{(f32)area.offset.x, (f32)area.offset.y, (f32)area.extent.width,
+                        (f32)area.extent.height, 0.0f, 1.0f};
+    vkCmdSetViewport(command->buffer, 0, 1, &viewport);
+    vkCmdSetScissor(command->buffer, 0, 1, &area);
+
+    // offsets in binding order, constant per frame slot so pre-recorded draws stay valid
+    const u32 dynamic_offsets[2] = {
+        global_uniform_offset,
+        vulkan_transform_buffer_offset(&scene_transforms, context.current_frame)};
+    vkCmdBindDescriptorSets(command->buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline->layout,
+                            0, 1, &global_set, 2, dynamic_offsets);
+}
+
+static void record_draws(Command* command, u32 first, u32 count, Pipeline* pipeline,
+                         b8 position_only)
+{
+    const VkBuffer instance_buffer = vulkan_buffer_get(&context, scene_instance_buffer)->handle;
+    if (use_indirect_draws())
+    {
+        vulkan_indirect_buffer_record(command, &scene_indirect, context.current_frame, pipeline,
+                                      instance_buffer, first, count, position_only);
+    }
+    else
+    {
+        vulkan_instanced_draws_record(command, pipeline, instance_buffer,
+                                      scene_draws.data() + first, count, position_only);
+    }
+}
+
+static void record_scene_draws(Command* command, u32 first, u32 count, void* user_data)
+{
+    // secondaries inherit no state from the primary
+    bind_scene_state(command, (const RenderDesc*)user_data, scene_draw_pipeline);
+    record_draws(command, first, count, scene_draw_pipeline, false);
+}
+
+static void record_prepass_draws(Command* command, u32 first, u32 count, void* user_data)
+{
+    bind_scene_state(command, (const RenderDesc*)user_data, &depth_prepass_pipeline);
+    record_draws(command, first, count, &depth_prepass_pipeline, true);
+}
+
+// the same slices of the draw list, or of the indirect batches, for either pass
+static void record_scene_slices(RenderContext* context, ParallelRecorder* recorder,
+                                Command* command, RenderDesc* render_desc, RecordRangeFn record)
+{
+    const u32 record_count =
+        use_indirect_draws() ? (u32)scene_indirect.batches.size() : (u32)scene_draws.size();
+    if (prerecord_static_scene)
+    {
+        vulkan_parallel_recorder_record_static(context, recorder, command, render_desc,
+                                               record_count, MIN_DRAWS_PER_SLICE, record,
+                                               render_desc, scene_version);
+    }
+    else
+    {
+        vulkan_parallel_recorder_record(context, recorder, command, render_desc, record_count,
+                                        MIN_DRAWS_PER_SLICE, record, render_desc);
+    }
+}
+
+// once per submitted frame for the scene passes recorded through the parallel recorders
+static void add_scene_metrics()
+{
+    // culled on the device the draws are recorded on the primary every frame
+    if (use_gpu_culling())
+        return;
+
+    ParallelRecorder* recorders[2] = {&scene_recorder, &prepass_recorder};
+    const u32 recorder_count = use_depth_prepass() ? 2 : 1;
+    for (u32 i = 0; i < recorder_count; ++i)
+    {
+        const u32 slices = recorders[i]->frame_slice_counts[context.current_frame];
+        if (slices == 0)
+            continue;
+
+        // every slice binds the pipeline of its pass first, the pre-pass never switches
+        const b8 position_only = recorders[i] == &prepass_recorder;
+        vulkan_metrics_add(METRIC_PIPELINE_BINDS,
+                           slices + (position_only ? 0 : scene_draw_stats.pipeline_switches));
+
+        // indirect commands are counted as they are written for the frame
+        if (use_indirect_draws())
+            continue;
+
+        vulkan_metrics_add(METRIC_DRAWS, scene_draw_stats.draws);
+        vulkan_metrics_add(METRIC_DRAW_INSTANCES, scene_draw_stats.instances);
+        vulkan_metrics_add(METRIC_INDEXED_TRIANGLES, scene_draw_stats.triangles);
+    }
+}
+
+static void execute_depth_prepass(RenderContext* context, RenderGraph* graph, Command* command,
+                                  void* user_data)
+{
+    RenderTarget* depth = vulkan_render_graph_get_rendertarget(context, graph, scene_depth);
+
+    RenderTargetOperator depth_op{};
+    depth_op.load_op = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    depth_op.store_op = VK_ATTACHMENT_STORE_OP_STORE;
+
+    RenderDesc render_desc{};
+    render_desc.render_area = {{0, 0}, {depth->width, depth->height}};
+    render_desc.depth_target = depth;
+    render_desc.clear_depth.depthStencil = {1.0f, 0};
+    render_desc.is_depth_stencil = true;
+    render_desc.render_target_operators = &depth_op;
+    render_desc.secondary_contents = true;
+
+    vulkan_command_buffer_rendering(command, &render_desc);
+    record_scene_slices(context, &prepass_recorder, command, &render_desc, record_prepass_draws);
+    vulkan_command_buffer_rendering(command, NULL);
+}
+
+static void execute_scene_pass(RenderContext* context, RenderGraph* graph, Command* command,
+                               void* user_data)
+{
+    RenderTarget* rendertarget = vulkan_render_graph_get_rendertarget(context, graph, backbuffer);
+    RenderTarget* depth = vulkan_render_graph_get_rendertarget(context, graph, scene_depth);
+
+    RenderTargetOperator rendertarget_ops[2] = {};
+    rendertarget_ops[0].load_op = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    rendertarget_ops[0].store_op = VK_ATTACHMENT_STORE_OP_STORE;
+    // the pre-pass laid down the depth the EQUAL test compares against
+    rendertarget_ops[1].load_op =
+        use_depth_prepass() ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR;
+    // the pyramid pass reads it afterwards
+    rendertarget_ops[1].store_op =
+        depth_pyramid_available ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+
+    RenderDesc render_desc{};
+    render_desc.render_targets = &rendertarget;
+    render_desc.render_target_count = 1;
+    render_desc.clear_color = {{1.0f, 0.0f, 0.0f, 1.0f}};
+    render_desc.render_area = {{0, 0}, {rendertarget->width, rendertarget->height}};
+    render_desc.depth_target = depth;
+    render_desc.clear_depth.depthStencil = {1.0f, 0};
+    // the graph transitions depth to DEPTH_WRITE, which is the depth stencil layout
+    render_desc.is_depth_stencil = true;
+    render_desc.render_target_operators = rendertarget_ops;
+    render_desc.secondary_contents = true;
+
+    // shaded fragments over the pixels of the target is the overdraw the pre-pass removes
+    vulkan_gpu_profiler_begin_fragment_count(&gpu_profiler, command);
+    vulkan_command_buffer_rendering(command, &render_desc);
+
+    // slices of the draw list, or of the indirect batches, are recorded on the job system and
+    // executed in order
+    record_scene_slices(context, &scene_recorder, command, &render_desc, record_scene_draws);
+
+    vulkan_command_buffer_rendering(command, NULL);
+    vulkan_gpu_profiler_end_fragment_count(&gpu_profiler, command);
+}
+
+static void execute_cull_pass(RenderContext* context, RenderGraph* graph, Command* command,
+                              void* user_data)
+{
+    vulkan_gpu_culling_cull(context, &gpu_culling, command, context->current_frame,
+                            *(const GpuCullPhase*)user_data);
+}
+
+static void execute_depth_pyramid_pass(RenderContext* context, RenderGraph* graph,
+                                       Command* command, void* user_data)
+{
+    RenderTarget* depth = vulkan_render_graph_get_rendertarget(context, graph, scene_depth);
+
+    if (!use_async_depth_pyramid())
+    {
+        vulkan_depth_pyramid_build(context, &depth_pyramid, command, context->current_frame,
+                                   depth, scene_view_projection);
+        return;
+    }
+
+    // built on the compute queue once this frame is done, the next frame acquires the pyramid
+    // and the depth back
+    QueueScheduler* scheduler = context->queue_scheduler;
+    Texture* depth_texture = vulkan_texture_get(context, depth->texture);
+    Command* compute_command =
+        vulkan_queue_scheduler_hand_to_compute(context, scheduler, command, depth_texture,
+                                               RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+
+    vulkan_depth_pyramid_build(context, &depth_pyramid, compute_command, context->current_frame,
+                               depth, scene_view_projection);
+
+    vulkan_queue_scheduler_release_texture(context, scheduler, QUEUE_TYPE_COMPUTE,
+                                           vulkan_texture_get(context, depth_pyramid.texture),
+                                           RESOURCE_STATE_SHADER_RESOURCE,
+                                           RESOURCE_STATE_SHADER_RESOURCE);
+    vulkan_queue_scheduler_release_texture(context, scheduler, QUEUE_TYPE_COMPUTE, depth_texture,
+                                           RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE,
+                                           RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+}
+
+static void execute_culled_scene_pass(RenderContext* context, RenderGraph* graph,
+                                      Command* command, void* user_data)
+{
+    const GpuCullPhase phase = *(const GpuCullPhase*)user_data;
+
+    RenderTarget* rendertarget = vulkan_render_graph_get_rendertarget(context, graph, backbuffer);
+    RenderTarget* depth = vulkan_render_graph_get_rendertarget(context, graph, scene_depth);
+
+    // the late pass draws over the early one, the pyramid is built from the early depth
+    const VkAttachmentLoadOp load_op =
+        phase == GPU_CULL_PHASE_EARLY ? VK_ATTACHMENT_LOAD_OP_CLEAR : VK_ATTACHMENT_LOAD_OP_LOAD;
+    RenderTargetOperator rendertarget_ops[2] = {};
+    rendertarget_ops[0].load_op = load_op;
+    rendertarget_ops[0].store_op = VK_ATTACHMENT_STORE_OP_STORE;
+    rendertarget_ops[1].load_op = load_op;
+    rendertarget_ops[1].store_op = phase == GPU_CULL_PHASE_EARLY
+                                       ? VK_ATTACHMENT_STORE_OP_STORE
+                                       : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+
+    RenderDesc render_desc{};
+    render_desc.render_targets = &rendertarget;
+    render_desc.render_target_count = 1;
+    render_desc.clear_color = {{1.0f, 0.0f, 0.0f, 1.0f}};
+    render_desc.render_area = {{0, 0}, {rendertarget->width, rendertarget->height}};
+    render_desc.depth_target = depth;
+    render_desc.clear_depth.depthStencil = {1.0f, 0};
+    render_desc.is_depth_stencil = true;
+    render_desc.render_target_operators = rendertarget_ops;
+
+    vulkan_command_buffer_rendering(command, &render_desc);
+
+    // a fixed call per batch whatever survived, nothing to spread over the job system
+    bind_scene_state(command, &render_desc, &scene_pipeline);
+    vulkan_gpu_culling_record_draws(context, &gpu_culling, command, &scene_pipeline);
+
+    vulkan_command_buffer_rendering(command, NULL);
+}
+
+static void execute_imgui_pass(RenderContext* context, RenderGraph* graph, Command* command,
+                               void* user_data)
+{
+    RenderTarget* rendertarget = vulkan_render_graph_get_rendertarget(context, graph, backbuffer);
 
-    RenderTarget* rendertargets = rendertarget;
     RenderTargetOperator rendertarget_op{};
-    rendertarget_op.load_op = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    rendertarget_op.load_op = VK_ATTACHMENT_LOAD_OP_LOAD;
     rendertarget_op.store_op = VK_ATTACHMENT_STORE_OP_STORE;
 
     RenderDesc render_desc{};
-    render_desc.render_targets = &rendertargets;
+    render_desc.render_targets = &rendertarget;
     render_desc.render_target_count = 1;
-    render_desc.clear_color = {{1.0f, 0.0f, 0.0f, 1.0f}};
-    render_desc.render_area = {{0, 0}, {app_state_->width, app_state_->height}};
+    render_desc.render_area = {{0, 0}, {rendertarget->width, rendertarget->height}};
     render_desc.render_target_operators = &rendertarget_op;
-    // render_desc.depth_target = depth_render_target;
-    // render_desc.clear_depth = {1.0f, 0.0f};
-    // render_desc.is_depth_stencil = false;
 
     vulkan_command_buffer_rendering(command, &render_desc);
 
@@ -311,39 +884,476 @@ void VulkanRenderer::Draw()
 
     // end rendering explicitly
     vulkan_command_buffer_rendering(command, NULL);
+}
 
-    // RenderTarget to Present
-    textureBarrier = {};
-    textureBarrier.current_state = RESOURCE_STATE_RENDER_TARGET;
-    textureBarrier.new_state = RESOURCE_STATE_PRESENT;
-    textureBarrier.texture = rendertarget->texture;
+static b8 build_render_graph()
+{
+    backbuffer = vulkan_render_graph_import_rendertarget(&render_graph, "backbuffer",
+                                                         RESOURCE_STATE_PRESENT,
+                                                         RESOURCE_STATE_PRESENT);
+
+    RenderTargetDesc depth_desc{};
+    depth_desc.width = swapchain->desc->width;
+    depth_desc.height = swapchain->desc->height;
+    depth_desc.mip_levels = 1;
+    depth_desc.sample_count = 1;
+    depth_desc.vulkan_format = SCENE_DEPTH_FORMAT;
+    depth_desc.clear_value.depth = 1.0f;
+    depth_desc.start_state = RESOURCE_STATE_DEPTH_WRITE;
+    scene_depth = vulkan_render_graph_create_rendertarget(&render_graph, "scene_depth", &depth_desc);
+
+    if (depth_pyramid_available)
+        vulkan_depth_pyramid_resize(&context, &depth_pyramid, depth_desc.width, depth_desc.height);
+
+    if (use_gpu_culling())
+    {
+        // the culling passes only touch buffers and the pyramid, the graph keeps them in order
+        u32 cull_early_pass = vulkan_render_graph_add_pass(&render_graph, "cull_early",
+                                                           execute_cull_pass, &cull_phases[0]);
+        vulkan_render_graph_pass_side_effect(&render_graph, cull_early_pass);
+
+        u32 scene_early_pass = vulkan_render_graph_add_pass(
+            &render_graph, "scene_early", execute_culled_scene_pass, &cull_phases[0]);
+        vulkan_render_graph_pass_write(&render_graph, scene_early_pass, backbuffer,
+                                       RESOURCE_STATE_RENDER_TARGET);
+        vulkan_render_graph_pass_write(&render_graph, scene_early_pass, scene_depth,
+                                       RESOURCE_STATE_DEPTH_WRITE);
+
+        u32 pyramid_pass = vulkan_render_graph_add_pass(&render_graph, "depth_pyramid",
+                                                        execute_depth_pyramid_pass, NULL);
+        vulkan_render_graph_pass_read(&render_graph, pyramid_pass, scene_depth,
+                                      RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+        vulkan_render_graph_pass_side_effect(&render_graph, pyramid_pass);
+
+        u32 cull_late_pass = vulkan_render_graph_add_pass(&render_graph, "cull_late",
+                                                          execute_cull_pass, &cull_phases[1]);
+        vulkan_render_graph_pass_side_effect(&render_graph, cull_late_pass);
+
+        u32 scene_late_pass = vulkan_render_graph_add_pass(
+            &render_graph, "scene_late", execute_culled_scene_pass, &cull_phases[1]);
+        vulkan_render_graph_pass_read(&render_graph, scene_late_pass, backbuffer,
+                                      RESOURCE_STATE_RENDER_TARGET);
+        vulkan_render_graph_pass_write(&render_graph, scene_late_pass, backbuffer,
+                                       RESOURCE_STATE_RENDER_TARGET);
+        vulkan_render_graph_pass_read(&render_graph, scene_late_pass, scene_depth,
+                                      RESOURCE_STATE_DEPTH_WRITE);
+        vulkan_render_graph_pass_write(&render_graph, scene_late_pass, scene_depth,
+                                       RESOURCE_STATE_DEPTH_WRITE);
+    }
+    else
+    {
+        if (use_depth_prepass())
+        {
+            u32 prepass = vulkan_render_graph_add_pass(&render_graph, "depth_prepass",
+                                                       execute_depth_prepass, NULL);
+            vulkan_render_graph_pass_write(&render_graph, prepass, scene_depth,
+                                           RESOURCE_STATE_DEPTH_WRITE);
+        }
 
-    vulkan_command_resource_barrier(command, NULL, 0, &textureBarrier, 1, NULL, 0);
+        u32 scene_pass =
+            vulkan_render_graph_add_pass(&render_graph, "scene", execute_scene_pass, NULL);
+        vulkan_render_graph_pass_write(&render_graph, scene_pass, backbuffer,
+                                       RESOURCE_STATE_RENDER_TARGET);
+        if (use_depth_prepass())
+        {
+            vulkan_render_graph_pass_read(&render_graph, scene_pass, scene_depth,
+                                          RESOURCE_STATE_DEPTH_WRITE);
+        }
+        vulkan_render_graph_pass_write(&render_graph, scene_pass, scene_depth,
+                                       RESOURCE_STATE_DEPTH_WRITE);
 
-    vulkan_command_buffer_end(command);
+        if (depth_pyramid_available)
+        {
+            u32 pyramid_pass = vulkan_render_graph_add_pass(&render_graph, "depth_pyramid",
+                                                            execute_depth_pyramid_pass, NULL);
+            vulkan_render_graph_pass_read(&render_graph, pyramid_pass, scene_depth,
+                                          RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+            vulkan_render_graph_pass_side_effect(&render_graph, pyramid_pass);
+        }
+    }
 
-    VkPipelineStageFlags wait_stages = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
+    // draws over the scene, so it needs the previous contents
+    u32 imgui_pass = vulkan_render_graph_add_pass(&render_graph, "imgui", execute_imgui_pass, NULL);
+    vulkan_render_graph_pass_read(&render_graph, imgui_pass, backbuffer,
+                                  RESOURCE_STATE_RENDER_TARGET);
+    vulkan_render_graph_pass_write(&render_graph, imgui_pass, backbuffer,
+                                   RESOURCE_STATE_RENDER_TARGET);
 
-    VkSubmitInfo submit_info{VK_STRUCTURE_TYPE_SUBMIT_INFO};
-    submit_info.waitSemaphoreCount = 1;
-    submit_info.pWaitSemaphores = &image_available_semaphores[context.current_frame];
-    submit_info.pWaitDstStageMask = &wait_stages;
+    if (!vulkan_render_graph_compile(&render_graph))
+        return false;
 
-    submit_info.commandBufferCount = 1;
-    submit_info.pCommandBuffers = &command->buffer;
-    submit_info.signalSemaphoreCount = 1;
-    submit_info.pSignalSemaphores = &ready_to_render_semaphores[context.current_frame];
+    vulkan_render_graph_realize(&context, &render_graph);
+    return true;
+}
 
-    VK_CHECK(vkQueueSubmit(context.device_context.graphics_queue, 1, &submit_info,
-                           render_fences[context.current_frame]));
+static b8 create_scene()
+{
+    job_system.init();
+    vulkan_parallel_recorder_create(&context, &scene_recorder, &job_system);
+    vulkan_parallel_recorder_create(&context, &prepass_recorder, &job_system);
+
+    vulkan_transform_buffer_create(&context, &scene_transforms, MAX_SCENE_TRANSFORMS);
+    // never more draws than instances
+    vulkan_indirect_buffer_create(&context, &scene_indirect, MAX_SCENE_TRANSFORMS);
+    depth_pyramid_available = vulkan_depth_pyramid_create(&context, &depth_pyramid);
+    // without the shaders the scene is culled on the CPU as before
+    gpu_culling_available =
+        depth_pyramid_available &&
+        vulkan_gpu_culling_create(&context, &gpu_culling, MAX_SCENE_TRANSFORMS, &depth_pyramid);
+    // the graph was built before the scene, the pyramid and culling passes come in with the
+    // first frame
+    render_graph_dirty = depth_pyramid_available;
+
+    // 0 : global constants, 1 : object transforms
+    VkDescriptorSetLayoutBinding bindings[2] = {};
+    bindings[0].binding = 0;
+    bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    bindings[0].descriptorCount = 1;
+    bindings[0].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    bindings[1].binding = 1;
+    bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+    bindings[1].descriptorCount = 1;
+    bindings[1].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+    VkDescriptorSetLayoutCreateInfo set_layout_info{
+        VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO};
+    set_layout_info.bindingCount = 2;
+    set_layout_info.pBindings = bindings;
+    VK_CHECK(vkCreateDescriptorSetLayout(context.device_context.handle, &set_layout_info,
+                                         context.allocator, &global_set_layout));
+
+    // one set for every frame, the frame is picked by the dynamic offset
+    if (!context.pDynamicDescriptorAllocators[0].allocate(&global_set, global_set_layout))
+        return false;
 
-    if (!present_image_swapchain(&context, swapchain, context.device_context.present_queue,
-                                 ready_to_render_semaphores[context.current_frame],
-                                 context.image_index))
+    vulkan_uniform_ring_write_descriptor(&context, &uniform_ring, global_set, 0,
+                                         sizeof(global_uniform));
+    vulkan_transform_buffer_write_descriptor(&context, &scene_transforms, global_set, 1);
+
+    vertex_input_description vertex_input = vulkan_render_object::get_vertex_input_description();
+
+    const VkFormat color_format =
+        vulkan_rendertarget_get(&context, swapchain->render_targets[0])->vulkan_format;
+
+    GraphicsPipelineDesc pipeline_desc{};
+    pipeline_desc.vertex_file_path = "shader/test.vert.spv";
+    pipeline_desc.fragment_file_path = "shader/test.frag.spv";
+    pipeline_desc.binding_description_count = (u32)vertex_input.bindings.size();
+    pipeline_desc.binding_descriptions = vertex_input.bindings.data();
+    pipeline_desc.attribute_description_count = (u32)vertex_input.attributes.size();
+    pipeline_desc.attribute_descriptions = vertex_input.attributes.data();
+    pipeline_desc.descriptor_set_layout_count = 1;
+    pipeline_desc.descriptor_set_layouts = &global_set_layout;
+    pipeline_desc.color_format_count = 1;
+    pipeline_desc.color_formats = &color_format;
+    pipeline_desc.depth_format = SCENE_DEPTH_FORMAT;
+    pipeline_desc.depth_test = true;
+    pipeline_desc.depth_write = true;
+    pipeline_desc.depth_compare_op = VK_COMPARE_OP_LESS;
+
+    if (!vulkan_graphics_pipeline_create(&context, &pipeline_desc, &scene_pipeline))
+        return false;
+
+    // shades only what the pre-pass left in front
+    pipeline_desc.depth_write = false;
+    pipeline_desc.depth_compare_op = VK_COMPARE_OP_EQUAL;
+    depth_prepass_available =
+        vulkan_graphics_pipeline_create(&context, &pipeline_desc, &scene_equal_pipeline);
+
+    vertex_input_description position_input =
+        vulkan_render_object::get_position_input_description();
+
+    GraphicsPipelineDesc prepass_desc{};
+    prepass_desc.vertex_file_path = "shader/depth_only.vert.spv";
+    prepass_desc.binding_description_count = (u32)position_input.bindings.size();
+    prepass_desc.binding_descriptions = position_input.bindings.data();
+    prepass_desc.attribute_description_count = (u32)position_input.attributes.size();
+    prepass_desc.attribute_descriptions = position_input.attributes.data();
+    prepass_desc.descriptor_set_layout_count = 1;
+    prepass_desc.descriptor_set_layouts = &global_set_layout;
+    prepass_desc.depth_format = SCENE_DEPTH_FORMAT;
+    prepass_desc.depth_test = true;
+    prepass_desc.depth_write = true;
+    prepass_desc.depth_compare_op = VK_COMPARE_OP_LESS;
+
+    // without the shader the scene is drawn in one pass as before
+    depth_prepass_available =
+        depth_prepass_available &&
+        vulkan_graphics_pipeline_create(&context, &prepass_desc, &depth_prepass_pipeline);
+
+    // a missing model leaves an empty draw list, the pass still clears
+    scene_object = new vulkan_render_object(&context, "model/sponza.obj");
+    scene_object->upload_mesh();
+    if (!scene_object->mesh_instances.empty())
     {
-        vkDeviceWaitIdle(context.device_context.handle);
-        vulkan_swapchain_recreate(&context, &swapchain);
+        scene_object->transform_index =
+            vulkan_transform_buffer_add(&scene_transforms, scene_object->get_transform_matrix(),
+                                        (u32)scene_object->mesh_instances.size());
+        scene_object->write_transforms(&scene_transforms);
+        scene_object->spawn_entities(&scene_world);
     }
+    rebuild_scene_draws();
+
+    // moved buffers only rebuild the draw list, moved nodes rebuild the occluders
+    scene_object->build_occluders(MAX_OCCLUDER_TRIANGLES, &scene_occluders);
+    occlusion_buffer_create(&scene_occlusion, OCCLUSION_WIDTH, OCCLUSION_HEIGHT);
+
+    return true;
+}
+
+static void rebuild_scene_draws()
+{
+    scene_draw_pipeline = scene_shading_pipeline();
+
+    std::vector<draw_item> items;
+    if (scene_object)
+        scene_object->build_draw_list(scene_draw_pipeline, &items);
+
+    std::vector<u32> instances;
+    vulkan_draw_items_group(items.data(), (u32)items.size(), &scene_draws, &instances);
+    scene_item_count = (u32)items.size();
+
+    // the items of the object take consecutive transform slots in build_draw_list order
+    rebuild_scene_bounds();
+    scene_instance_items.resize(instances.size());
+    for (u32 i = 0; i < instances.size(); ++i)
+        scene_instance_items[i] = instances[i] - scene_object->transform_index;
+    scene_item_visible.assign(items.size(), 1);
+    scene_draw_visible.assign(scene_draws.size(), 1);
+
+    vulkan_indirect_buffer_set_draws(&scene_indirect, scene_draws.data(), (u32)scene_draws.size());
+    // the batches break wherever the pipeline does, both paths switch as often
+    scene_draw_stats = vulkan_instanced_draws_stats(scene_draw_pipeline, scene_draws.data(),
+                                                    (u32)scene_draws.size());
+    if (gpu_culling_available)
+    {
+        vulkan_gpu_culling_set_draws(&context, &gpu_culling, scene_draws.data(),
+                                     (u32)scene_draws.size(), instances.data(),
+                                     (u32)instances.size());
+    }
+
+    // frames in flight still read the old stream
+    if (scene_instance_buffer.id != 0)
+        vulkan_deletion_queue_push_buffer(&context, scene_instance_buffer);
+
+    // written once per scene change, host visible is fine and needs no upload on another queue
+    const u32 stream_size = (u32)(instances.empty() ? 1 : instances.size()) * sizeof(u32);
+    vulkan_buffer_create(&context, stream_size, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                         VMA_MEMORY_USAGE_AUTO,
+                         VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT |
+                             VMA_ALLOCATION_CREATE_MAPPED_BIT,
+                         &scene_instance_buffer, MEMORY_CATEGORY_MESH);
+    if (!instances.empty())
+    {
+        vulkan_buffer_upload(&context, vulkan_buffer_get(&context, scene_instance_buffer),
+                             instances.data(), stream_size);
+    }
+
+    ++scene_version;
+}
+
+// world boxes of the mesh instances and the BVH over them
+static void rebuild_scene_bounds()
+{
+    scene_item_mins.clear();
+    scene_item_maxs.clear();
+    scene_item_spheres.clear();
+    if (scene_object)
+    {
+        scene_object->build_bounds(&scene_item_mins, &scene_item_maxs);
+        scene_object->build_spheres(&scene_item_spheres);
+    }
+    bvh_build(scene_item_mins.data(), scene_item_maxs.data(), (u32)scene_item_mins.size(),
+              &scene_bvh);
+}
+
+static bool use_indirect_draws()
+{
+    return scene_draw_indirect && context.device_context.features.drawIndirectFirstInstance;
+}
+
+static bool use_gpu_culling()
+{
+    return gpu_culling_available && scene_gpu_culling && use_indirect_draws();
+}
+
+static bool use_depth_prepass()
+{
+    return depth_prepass_available && scene_depth_prepass && !use_gpu_culling();
+}
+
+// culling reads the pyramid inside the frame, otherwise it is only needed by the next one
+static bool use_async_depth_pyramid()
+{
+    return depth_pyramid_available && !use_gpu_culling() &&
+           vulkan_queue_scheduler_has_async_compute(context.queue_scheduler);
+}
+
+static Pipeline* scene_shading_pipeline()
+{
+    return use_depth_prepass() ? &scene_equal_pipeline : &scene_pipeline;
+}
+
+// visibility of every scene draw for the indirect build
+static const u8* cull_scene_draws(const glm::mat4& view_projection)
+{
+    PKO_PROFILE_FUNCTION();
+
+    Frustum frustum;
+    frustum_from_matrix(view_projection, &frustum);
+    if (scene_ecs_culling)
+    {
+        scene_visible_items = render_world_cull(&scene_world, frustum, &job_system);
+
+        // the entity of an item knows its instance, which is the item
+        const u32 required = RENDER_COMPONENT_BIT(RENDER_COMPONENT_MESH) |
+                             RENDER_COMPONENT_BIT(RENDER_COMPONENT_VISIBILITY);
+        render_world_for_each_chunk(&scene_world, required, &job_system,
+                                    [](const RenderChunkView& view, u32)
+                                    {
+                                        for (u32 row = 0; row < view.count; ++row)
+                                            scene_item_visible[view.meshes[row].instance] =
+                                                view.visible[row];
+                                    });
+    }
+    else
+    {
+        scene_visible_items = bvh_cull(scene_bvh, frustum, scene_item_visible.data());
+    }
+
+    scene_occluded_items = 0;
+    if (scene_cpu_occlusion)
+    {
+        occlusion_buffer_render(&scene_occlusion, view_projection, scene_occluders.data(),
+                                (u32)scene_occluders.size() / 3, &job_system);
+        scene_occluded_items = occlusion_cull_aabbs(
+            scene_occlusion, view_projection, scene_item_mins.data(), scene_item_maxs.data(),
+            (u32)scene_item_mins.size(), scene_item_visible.data(), &job_system);
+        scene_visible_items -= scene_occluded_items;
+    }
+
+    for (u32 d = 0; d < scene_draws.size(); ++d)
+    {
+        const instanced_draw& draw = scene_draws[d];
+        u8 visible = 0;
+        for (u32 i = draw.first_instance; i < draw.first_instance + draw.instance_count; ++i)
+        {
+            if (scene_item_visible[scene_instance_items[i]])
+            {
+                visible = 1;
+                break;
+            }
+        }
+        scene_draw_visible[d] = visible;
+    }
+
+    return scene_draw_visible.data();
+}
+
+static void check_gpu_culling(u32 frame)
+{
+    PKO_PROFILE_FUNCTION();
+
+    // the slot retired, what both phases drew for it
+    std::vector<u32> drawn(scene_draws.size());
+    if (gpu_check_versions[frame] == gpu_culling.version &&
+        vulkan_gpu_culling_read_visible(&context, &gpu_culling, frame, drawn.data()))
+    {
+        const std::vector<u32>& expected = gpu_check_expected[frame];
+        u32 mismatches = 0;
+        for (u32 d = 0; d < drawn.size(); ++d)
+        {
+            const b8 differs =
+                gpu_check_occlusion[frame] ? drawn[d] > expected[d] : drawn[d] != expected[d];
+            mismatches += differs ? 1 : 0;
+        }
+
+        // logged when the check starts or stops failing, the per-frame counts are in the overlay
+        if (mismatches && !gpu_check_mismatches)
+        {
+            std::cout << "gpu culling differs from the cpu in " << mismatches << " of "
+                      << drawn.size() << " draws" << std::endl;
+        }
+        else if (!mismatches && gpu_check_mismatches)
+        {
+            std::cout << "gpu culling matches the cpu again" << std::endl;
+        }
+        gpu_check_mismatches = mismatches;
+        gpu_check_differing_frames += mismatches ? 1 : 0;
+        ++gpu_check_frames;
+    }
+
+    // the frame about to be recorded, the pyramid it occlusion tests with is the current one
+    Frustum frustum;
+    frustum_from_matrix(scene_view_projection, &frustum);
+    std::vector<u8> item_visible(scene_item_spheres.size());
+    frustum_cull_spheres(frustum, scene_item_spheres.data(), (u32)scene_item_spheres.size(),
+                         item_visible.data());
+
+    std::vector<u32>& expected = gpu_check_expected[frame];
+    expected.assign(scene_draws.size(), 0);
+    for (u32 d = 0; d < scene_draws.size(); ++d)
+    {
+        const instanced_draw& draw = scene_draws[d];
+        for (u32 i = draw.first_instance; i < draw.first_instance + draw.instance_count; ++i)
+            expected[d] += item_visible[scene_instance_items[i]];
+    }
+    gpu_check_versions[frame] = gpu_culling.version;
+    gpu_check_occlusion[frame] = depth_pyramid.valid;
+}
+
+static void destroy_scene()
+{
+    scene_draws.clear();
+    scene_item_count = 0;
+    scene_bvh = {};
+    scene_item_mins.clear();
+    scene_item_maxs.clear();
+    scene_item_spheres.clear();
+    scene_occluders.clear();
+    scene_instance_items.clear();
+    scene_item_visible.clear();
+    scene_draw_visible.clear();
+    render_world_clear(&scene_world);
+
+    if (scene_instance_buffer.id != 0)
+    {
+        vulkan_deletion_queue_push_buffer(&context, scene_instance_buffer);
+        scene_instance_buffer = {};
+    }
+
+    if (scene_object)
+    {
+        scene_object->vulkan_render_object_destroy();
+        delete scene_object;
+        scene_object = NULL;
+    }
+
+    vulkan_pipeline_destroy(&context, &scene_pipeline);
+    vulkan_pipeline_destroy(&context, &scene_equal_pipeline);
+    vulkan_pipeline_destroy(&context, &depth_prepass_pipeline);
+    depth_prepass_available = false;
+    scene_draw_pipeline = NULL;
+    vulkan_indirect_buffer_destroy(&context, &scene_indirect);
+    if (gpu_culling_available)
+    {
+        vulkan_gpu_culling_destroy(&context, &gpu_culling);
+        gpu_culling_available = false;
+    }
+    if (depth_pyramid_available)
+    {
+        vulkan_depth_pyramid_destroy(&context, &depth_pyramid);
+        depth_pyramid_available = false;
+    }
+    vulkan_transform_buffer_destroy(&context, &scene_transforms);
+
+    vkDestroyDescriptorSetLayout(context.device_context.handle, global_set_layout,
+                                 context.allocator);
+    global_set_layout = VK_NULL_HANDLE;
+
+    vulkan_parallel_recorder_destroy(&context, &scene_recorder);
+    vulkan_parallel_recorder_destroy(&context, &prepass_recorder);
+    job_system.shutdown();
 }
 
 void drawImgui()
@@ -356,6 +1366,141 @@ void drawImgui()
 
     bool demo = true;
     ImGui::ShowDemoWindow(&demo);
+
+    ImGui::Begin("scene");
+    ImGui::Text("draws %u  mesh instances %u", (u32)scene_draws.size(), scene_item_count);
+    ImGui::Checkbox("pre-recorded draws", &prerecord_static_scene);
+    // pre-recorded draws were recorded for the other path, culling on the device needs
+    // other passes
+    if (ImGui::Checkbox("multi-draw indirect", &scene_draw_indirect))
+    {
+        ++scene_version;
+        render_graph_dirty = true;
+    }
+    if (gpu_culling_available && ImGui::Checkbox("gpu culling", &scene_gpu_culling))
+    {
+        ++scene_version;
+        render_graph_dirty = true;
+    }
+    if (use_gpu_culling())
+    {
+        if (ImGui::Checkbox("check gpu culling against the cpu", &scene_gpu_culling_check))
+        {
+            vulkan_gpu_culling_set_readback(&context, &gpu_culling, scene_gpu_culling_check);
+            gpu_check_frames = 0;
+            gpu_check_mismatches = 0;
+            gpu_check_differing_frames = 0;
+        }
+        if (scene_gpu_culling_check)
+        {
+            ImGui::Text("draws differing %u / %u  (%u of %u frames differed)", gpu_check_mismatches,
+                        (u32)scene_draws.size(), gpu_check_differing_frames, gpu_check_frames);
+        }
+    }
+    // the draw list switches to the EQUAL pipeline with the next graph
+    if (depth_prepass_available && !use_gpu_culling() &&
+        ImGui::Checkbox("depth pre-pass", &scene_depth_prepass))
+    {
+        render_graph_dirty = true;
+    }
+    if (gpu_profiler.statistics_supported && !use_gpu_culling())
+    {
+        const u64 pixels = (u64)swapchain->desc->width * swapchain->desc->height;
+        ImGui::Text("shaded fragments per pixel %.2f",
+                    (f64)vulkan_gpu_profiler_get_fragment_invocations(&gpu_profiler) / pixels);
+    }
+    if (use_indirect_draws())
+    {
+        ImGui::Text("indirect batches %u%s", (u32)scene_indirect.batches.size(),
+                    scene_indirect.draw_count ? "  (count buffer)" : "");
+    }
+    if (use_indirect_draws() && !use_gpu_culling())
+    {
+        ImGui::Checkbox("cpu frustum culling", &scene_cpu_culling);
+        if (scene_cpu_culling)
+        {
+            ImGui::Text("visible mesh instances %u / %u  (%s)", scene_visible_items,
+                        scene_item_count, cull_kernel_name(cull_kernel_best()));
+            ImGui::Checkbox("entity frustum culling", &scene_ecs_culling);
+            if (scene_ecs_culling)
+            {
+                u32 chunks = 0;
+                for (const RenderArchetype& archetype : scene_world.archetypes)
+                    chunks += (u32)archetype.chunks.size();
+                ImGui::Text("entities %u in %u chunks", scene_world.entity_count, chunks);
+            }
+            ImGui::Checkbox("cpu occlusion culling", &scene_cpu_occlusion);
+            if (scene_cpu_occlusion)
+            {
+                ImGui::Text("occluded %u  occluder triangles %u / %u", scene_occluded_items,
+                            scene_occlusion.rasterized_triangles,
+                            (u32)scene_occluders.size() / 3);
+            }
+        }
+    }
+    ImGui::End();
+
+    vulkan_gpu_profiler_draw_imgui(&gpu_profiler);
+
+    if (const FrameMetrics* metrics = vulkan_metrics_get_frame(0))
+    {
+        ImGui::Begin("frame metrics");
+        ImGui::Text("cpu %.3f ms  gpu %.3f ms", metrics->cpu_frame_ms, metrics->gpu_frame_ms);
+        for (u32 i = 0; i < METRIC_COUNT; ++i)
+        {
+            ImGui::Text("%s %llu", vulkan_metrics_counter_name((MetricCounter)i),
+                        (unsigned long long)metrics->counters[i]);
+        }
+        ImGui::End();
+    }
+
+    ImGui::Begin("memory");
+    const MemoryBudget* budget = context.memory_budget;
+    ImGui::Text(context.device_context.memory_budget ? "VK_EXT_memory_budget"
+                                                     : "estimated budget");
+    for (u32 i = 0; i < budget->heap_count; ++i)
+    {
+        const VmaBudget& heap = budget->heaps[i];
+        ImGui::Text("heap %u  %.1f / %.1f MB  (vma %.1f MB in %u blocks)%s", i,
+                    heap.usage / (1024.0 * 1024.0), heap.budget / (1024.0 * 1024.0),
+                    heap.statistics.blockBytes / (1024.0 * 1024.0),
+                    heap.statistics.blockCount,
+                    (budget->pressure_heaps & (1u << i)) ? "  under pressure" : "");
+    }
+    ImGui::Separator();
+    for (u32 i = 0; i < MEMORY_CATEGORY_COUNT; ++i)
+    {
+        ImGui::Text("%s  %.1f MB in %llu", vulkan_memory_category_name((MemoryCategory)i),
+                    budget->category_bytes[i].load(std::memory_order_relaxed) /
+                        (1024.0 * 1024.0),
+                    (unsigned long long)budget->category_counts[i].load(
+                        std::memory_order_relaxed));
+    }
+    if (ImGui::Button("dump vma stats"))
+        vulkan_memory_dump_stats(&context, "vma_stats.json");
+    ImGui::Separator();
+    if (vulkan_defragmenter_is_running(&defragmenter))
+    {
+        ImGui::Text("defragmenting");
+    }
+    else if (ImGui::Button("defragment"))
+    {
+        vulkan_defragmenter_begin(&context, &defragmenter, DEFRAG_BYTES_PER_PASS,
+                                  DEFRAG_ALLOCATIONS_PER_PASS);
+    }
+    ImGui::Text("last run  moved %u (%.1f MB)  freed %u blocks",
+                defragmenter.stats.allocationsMoved,
+                defragmenter.stats.bytesMoved / (1024.0 * 1024.0),
+                defragmenter.stats.deviceMemoryBlocksFreed);
+    ImGui::End();
+
+    ImGui::Begin("cpu profiler");
+    bool record_zones = Profiler::is_enabled();
+    if (ImGui::Checkbox("record zones", &record_zones))
+        Profiler::set_enabled(record_zones);
+    if (ImGui::Button("dump chrome trace"))
+        Profiler::dump_chrome_trace("cpu_trace.json");
+    ImGui::End();
     ImGuiIO& io = ImGui::GetIO();
     ImGui::Render();
     ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), command->buffer);
@@ -363,7 +1508,22 @@ void drawImgui()
 
 void VulkanRenderer::Shutdown()
 {
-    vkQueueWaitIdle(context.device_context.graphics_queue);
+    vkDeviceWaitIdle(context.device_context.handle);
+
+    vulkan_defragmenter_end(&context, &defragmenter);
+    vulkan_render_graph_destroy(&context, &render_graph);
+    destroy_scene();
+    vulkan_uniform_ring_destroy(&context, &uniform_ring);
+    vulkan_deletion_queue_destroy(&context);
+
+    vulkan_gpu_profiler_destroy(&context, &gpu_profiler);
+    context.gpu_profiler = NULL;
+
+    vulkan_metrics_shutdown();
+
+    vulkan_queue_scheduler_destroy(&context, context.queue_scheduler);
+    delete context.queue_scheduler;
+    context.queue_scheduler = NULL;
 
     for (u32 i = 0; i < MAX_FRAME; ++i)
     {
@@ -371,11 +1531,9 @@ void VulkanRenderer::Shutdown()
                            context.allocator);
         vkDestroySemaphore(context.device_context.handle, ready_to_render_semaphores[i],
                            context.allocator);
-        vkDestroyFence(context.device_context.handle, render_fences[i], context.allocator);
 
         image_available_semaphores[i] = VK_NULL_HANDLE;
         ready_to_render_semaphores[i] = VK_NULL_HANDLE;
-        render_fences[i] = VK_NULL_HANDLE;
     }
 
     vulkan_swapchain_destroy(&context, swapchain);
@@ -667,6 +1825,8 @@ b8 load_device_level_function()
         std::cout << "Could not load Device level function: " << #fun << "!" << std::endl; \
         return false;                                                                      \
     }
+#define VK_DEVICE_LEVEL_FUNCTION_FROM_EXTENSION(fun) \
+    fun = (PFN_##fun)vkGetDeviceProcAddr(context.device_context.handle, #fun);
 
 #include "list_of_functions.inl"
     return true;
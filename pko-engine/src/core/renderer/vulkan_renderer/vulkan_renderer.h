@@ -24,6 +24,7 @@ class VulkanRenderer : public Renderer {
   b8 createInstance();
   void createDebugUtilMessage();
   b8 createSurface();
+  void recreateSwapchain();
 };
 
 /*
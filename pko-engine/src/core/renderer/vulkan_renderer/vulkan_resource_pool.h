@@ -0,0 +1,122 @@
+#ifndef VULKAN_RESOURCE_POOL_H
+#define VULKAN_RESOURCE_POOL_H
+
+#include "defines.h"
+
+#include <cassert>
+#include <vector>
+
+// handle = generation << RESOURCE_HANDLE_INDEX_BITS | slot, 0 is never a live handle
+constexpr u32 RESOURCE_HANDLE_INDEX_BITS = 20;
+constexpr u32 RESOURCE_HANDLE_INDEX_MASK = (1u << RESOURCE_HANDLE_INDEX_BITS) - 1;
+constexpr u32 RESOURCE_HANDLE_GENERATION_MASK = (1u << (32 - RESOURCE_HANDLE_INDEX_BITS)) - 1;
+
+/*
+     Dense slot map : hot records are packed contiguously (what binding, barriers and
+     rendering read), cold records live in a parallel array only touched on create/destroy.
+     Releasing a slot bumps its generation, so a stale handle resolves to NULL instead of
+     aliasing whatever reuses the slot.
+     Pointers returned by get are transient, they are invalidated by the next create or
+     release on the same pool.
+*/
+template <typename Hot, typename Cold>
+class ResourcePool
+{
+   public:
+    u32 create(Hot** out_hot = NULL, Cold** out_cold = NULL)
+    {
+        u32 slot;
+        if (!free_slots.empty())
+        {
+            slot = free_slots.back();
+            free_slots.pop_back();
+        }
+        else
+        {
+            slot = (u32)sparse.size();
+            assert(slot <= RESOURCE_HANDLE_INDEX_MASK);
+            sparse.push_back(0);
+            generations.push_back(1);
+        }
+
+        sparse[slot] = (u32)hot.size();
+        hot.push_back(Hot{});
+        cold.push_back(Cold{});
+        dense_to_slot.push_back(slot);
+
+        if (out_hot)
+            *out_hot = &hot.back();
+        if (out_cold)
+            *out_cold = &cold.back();
+
+        return (generations[slot] << RESOURCE_HANDLE_INDEX_BITS) | slot;
+    }
+
+    void release(u32 handle)
+    {
+        assert(is_valid(handle));
+
+        u32 slot = handle & RESOURCE_HANDLE_INDEX_MASK;
+        u32 dense_index = sparse[slot];
+        u32 last_index = (u32)hot.size() - 1;
+
+        // swap the last record into the hole to keep the arrays dense
+        if (dense_index != last_index)
+        {
+            hot[dense_index] = hot[last_index];
+            cold[dense_index] = cold[last_index];
+            dense_to_slot[dense_index] = dense_to_slot[last_index];
+            sparse[dense_to_slot[dense_index]] = dense_index;
+        }
+
+        hot.pop_back();
+        cold.pop_back();
+        dense_to_slot.pop_back();
+
+        // generation 0 is skipped so a zero initialized handle never resolves
+        generations[slot] = (generations[slot] + 1) & RESOURCE_HANDLE_GENERATION_MASK;
+        if (generations[slot] == 0)
+            generations[slot] = 1;
+
+        free_slots.push_back(slot);
+    }
+
+    b8 is_valid(u32 handle) const
+    {
+        u32 slot = handle & RESOURCE_HANDLE_INDEX_MASK;
+        return handle != 0 && slot < sparse.size() &&
+               generations[slot] == (handle >> RESOURCE_HANDLE_INDEX_BITS);
+    }
+
+    Hot* get(u32 handle)
+    {
+        return is_valid(handle) ? &hot[sparse[handle & RESOURCE_HANDLE_INDEX_MASK]] : NULL;
+    }
+
+    Cold* get_cold(u32 handle)
+    {
+        return is_valid(handle) ? &cold[sparse[handle & RESOURCE_HANDLE_INDEX_MASK]] : NULL;
+    }
+
+    // iteration over live records, linear in the dense arrays
+    u32 size() const { return (u32)hot.size(); }
+    Hot* hot_data() { return hot.data(); }
+    Cold* cold_data() { return cold.data(); }
+
+    u32 handle_at(u32 dense_index) const
+    {
+        u32 slot = dense_to_slot[dense_index];
+        return (generations[slot] << RESOURCE_HANDLE_INDEX_BITS) | slot;
+    }
+
+   private:
+    std::vector<Hot> hot;
+    std::vector<Cold> cold;
+    std::vector<u32> dense_to_slot;
+
+    std::vector<u32> sparse;
+    std::vector<u32> generations;
+    std::vector<u32> free_slots;
+};
+
+#endif  // !VULKAN_RESOURCE_POOL_H
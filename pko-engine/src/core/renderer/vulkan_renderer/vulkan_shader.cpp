@@ -7,6 +7,7 @@
 #include <iostream>
 
 #include "core/file_handle.h"
+#include "core/profiler.h"
 #include "vulkan_buffer.h"
 #include "vulkan_pipeline.h"
 
@@ -68,6 +69,8 @@ b8 vulkan_shader_module_create(RenderContext* context,
 
 void vulkan_shader_reflect(ShaderReflection** ppOutShaderReflection,
                            ShaderModule* pShaderModule) {
+  PKO_PROFILE_FUNCTION();
+
   ShaderReflection* pShaderReflection =
       (ShaderReflection*)malloc(sizeof(ShaderReflection));
   memset(pShaderReflection, 0, sizeof(ShaderReflection));
@@ -628,6 +631,8 @@ void vulkan_shader_reflect(ShaderReflection** ppOutShaderReflection,
 
 void vulkan_shader_create(RenderContext* context, Shader** out_shader,
                           const ShaderLoadDesc* load_desc) {
+  PKO_PROFILE_FUNCTION();
+
   Shader* shader = (Shader*)(calloc(1, sizeof(Shader)));
   shader->mVertStageIndex = (u32)(-1);
   shader->mFragStageIndex = (u32)(-1);
@@ -4,6 +4,6 @@
 #include "vulkan_types.inl"
 
 void vulkan_shader_create(RenderContext* pContext, Shader** ppOutShader, const ShaderLoadDesc* pLoadDesc);
-void vulkan_shader_destroy(Shader* pShader);
+void vulkan_shader_destroy(RenderContext* pContext, Shader* pShader);
 
 #endif // !VULKAN_SHADER_H
@@ -0,0 +1,169 @@
+#include "vulkan_transform_buffer.h"
+
+#include "core/profiler.h"
+#include "vulkan_buffer.h"
+#include "vulkan_metrics.h"
+
+static const u8 ALL_FRAMES = (1u << MAX_FRAME) - 1;
+
+static void to_gpu_transform(const glm::mat4& model, GpuTransform* out_transform)
+{
+    // glm is column major, the rows of the top 3x4 go out
+    for (u32 row = 0; row < 3; ++row)
+    {
+        for (u32 column = 0; column < 4; ++column)
+            out_transform->rows[row][column] = model[column][row];
+    }
+}
+
+static void mark_dirty(TransformBuffer* transforms, u32 index)
+{
+    const u8 clean_frames = ~transforms->dirty_frames[index] & ALL_FRAMES;
+    for (u32 frame = 0; frame < MAX_FRAME; ++frame)
+    {
+        if (clean_frames & (1u << frame))
+            transforms->dirty_indices[frame].push_back(index);
+    }
+
+    transforms->dirty_frames[index] = ALL_FRAMES;
+}
+
+void vulkan_transform_buffer_create(RenderContext* context, TransformBuffer* transforms,
+                                    u32 capacity)
+{
+    assert(context);
+    assert(transforms);
+    assert(capacity > 0);
+
+    u64 alignment = context->device_context.properties.limits.minStorageBufferOffsetAlignment;
+    if (alignment == 0)
+        alignment = 1;
+
+    transforms->capacity = capacity;
+    transforms->frame_stride =
+        (capacity * sizeof(GpuTransform) + alignment - 1) & ~(alignment - 1);
+
+    vulkan_buffer_create(context, transforms->frame_stride * MAX_FRAME,
+                         VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_AUTO,
+                         VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT |
+                             VMA_ALLOCATION_CREATE_MAPPED_BIT,
+                         &transforms->buffer, MEMORY_CATEGORY_UNIFORM);
+
+    transforms->mapped_data = (u8*)vulkan_buffer_get(context, transforms->buffer)->mapped_data;
+    assert(transforms->mapped_data && "transform buffer needs host visible memory");
+
+    transforms->transforms.reserve(capacity);
+    transforms->dirty_frames.reserve(capacity);
+}
+
+void vulkan_transform_buffer_destroy(RenderContext* context, TransformBuffer* transforms)
+{
+    assert(context);
+    assert(transforms);
+
+    vulkan_buffer_destroy(context, transforms->buffer);
+    transforms->buffer = {};
+    transforms->mapped_data = NULL;
+
+    transforms->transforms.clear();
+    transforms->dirty_frames.clear();
+    transforms->free_indices.clear();
+    for (u32 i = 0; i < MAX_FRAME; ++i)
+        transforms->dirty_indices[i].clear();
+}
+
+u32 vulkan_transform_buffer_add(TransformBuffer* transforms, const glm::mat4& model, u32 count)
+{
+    assert(count > 0);
+
+    u32 index;
+    // freed slots are reused one at a time, ranges come from the end
+    if (count == 1 && !transforms->free_indices.empty())
+    {
+        index = transforms->free_indices.back();
+        transforms->free_indices.pop_back();
+    }
+    else
+    {
+        index = (u32)transforms->transforms.size();
+        assert(index + count <= transforms->capacity && "transform buffer is full");
+
+        transforms->transforms.resize(index + count);
+        transforms->dirty_frames.resize(index + count, 0);
+    }
+
+    for (u32 i = 0; i < count; ++i)
+        vulkan_transform_buffer_set(transforms, index + i, model);
+
+    return index;
+}
+
+void vulkan_transform_buffer_remove(TransformBuffer* transforms, u32 index, u32 count)
+{
+    assert(index + count <= transforms->transforms.size());
+
+    // the stale data stays in the regions, nothing indexes it any more
+    for (u32 i = 0; i < count; ++i)
+        transforms->free_indices.push_back(index + i);
+}
+
+void vulkan_transform_buffer_set(TransformBuffer* transforms, u32 index, const glm::mat4& model)
+{
+    assert(index < transforms->transforms.size());
+
+    to_gpu_transform(model, &transforms->transforms[index]);
+    mark_dirty(transforms, index);
+}
+
+void vulkan_transform_buffer_upload(RenderContext* context, TransformBuffer* transforms,
+                                    u32 frame)
+{
+    PKO_PROFILE_FUNCTION();
+
+    assert(frame < MAX_FRAME);
+
+    std::vector<u32>& dirty_indices = transforms->dirty_indices[frame];
+    if (dirty_indices.empty())
+        return;
+
+    GpuTransform* region =
+        (GpuTransform*)(transforms->mapped_data + transforms->frame_stride * frame);
+
+    u32 first = UINT32_MAX;
+    u32 last = 0;
+    for (u32 index : dirty_indices)
+    {
+        region[index] = transforms->transforms[index];
+        transforms->dirty_frames[index] &= ~(1u << frame);
+
+        first = index < first ? index : first;
+        last = index > last ? index : last;
+    }
+
+    vulkan_metrics_add(METRIC_BYTES_UPLOADED, dirty_indices.size() * sizeof(GpuTransform));
+    dirty_indices.clear();
+
+    // no-op on coherent memory
+    Buffer* buffer = vulkan_buffer_get(context, transforms->buffer);
+    vmaFlushAllocation(context->vma_allocator, buffer->allocation,
+                       transforms->frame_stride * frame + first * sizeof(GpuTransform),
+                       (last - first + 1) * sizeof(GpuTransform));
+}
+
+void vulkan_transform_buffer_write_descriptor(RenderContext* context,
+                                              TransformBuffer* transforms, VkDescriptorSet set,
+                                              u32 binding)
+{
+    VkDescriptorBufferInfo buffer_info{};
+    buffer_info.buffer = vulkan_buffer_get(context, transforms->buffer)->handle;
+    buffer_info.offset = 0;
+    buffer_info.range = transforms->capacity * sizeof(GpuTransform);
+
+    VkWriteDescriptorSet write{VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
+    write.dstSet = set;
+    write.dstBinding = binding;
+    write.descriptorCount = 1;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+    write.pBufferInfo = &buffer_info;
+    vkUpdateDescriptorSets(context->device_context.handle, 1, &write, 0, NULL);
+}
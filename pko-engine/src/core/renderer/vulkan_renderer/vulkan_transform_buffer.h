@@ -0,0 +1,41 @@
+#ifndef VULKAN_TRANSFORM_BUFFER_H
+#define VULKAN_TRANSFORM_BUFFER_H
+
+#include "vulkan_types.inl"
+
+#include <glm/glm.hpp>
+
+/*
+     Transform buffer : every object transform lives in one storage buffer the vertex shader
+     indexes with the transform index it reads from the instance stream, so an instanced or
+     indirect draw covers many objects without a push constant each.
+     Transforms are stored as 3x4 rows, the normal matrix is derived in the shader.
+     Only transforms set since a region was last written are copied into it, a change reaches
+     all MAX_FRAME regions over the next MAX_FRAME frames.
+*/
+void vulkan_transform_buffer_create(RenderContext* context, TransformBuffer* transforms,
+                                    u32 capacity);
+// the device has to be idle
+void vulkan_transform_buffer_destroy(RenderContext* context, TransformBuffer* transforms);
+
+// index for the instance stream, count consecutive transforms all set to model
+u32 vulkan_transform_buffer_add(TransformBuffer* transforms, const glm::mat4& model,
+                                u32 count = 1);
+void vulkan_transform_buffer_remove(TransformBuffer* transforms, u32 index, u32 count = 1);
+void vulkan_transform_buffer_set(TransformBuffer* transforms, u32 index, const glm::mat4& model);
+
+// writes the transforms that are stale in the region of frame, after the frame retired
+void vulkan_transform_buffer_upload(RenderContext* context, TransformBuffer* transforms,
+                                    u32 frame);
+
+inline u32 vulkan_transform_buffer_offset(const TransformBuffer* transforms, u32 frame)
+{
+    return (u32)(transforms->frame_stride * frame);
+}
+
+// points binding of set, a STORAGE_BUFFER_DYNAMIC, at one region
+void vulkan_transform_buffer_write_descriptor(RenderContext* context,
+                                              TransformBuffer* transforms, VkDescriptorSet set,
+                                              u32 binding);
+
+#endif  // !VULKAN_TRANSFORM_BUFFER_H
@@ -3,12 +3,15 @@
 
 #include "defines.h"
 #include "vulkan_functions.h"
+#include "vulkan_resource_pool.h"
 
 #define VMA_DYNAMIC_VULKAN_FUNCTIONS 1
 #define VMA_STATIC_VULKAN_FUNCTIONS 0
 #include <vk_mem_alloc.h>
 
+#include <atomic>
 #include <cassert>
+#include <string>
 #include <unordered_map>
 #include <vector>
 
@@ -22,6 +25,23 @@
 constexpr u32 MAX_FRAME = 3;
 constexpr u32 MAX_SHADER_STAGE_COUNT = 3;
 constexpr u32 MAX_COLOR_ATTACHMENT = 8;
+constexpr u32 MAX_MIP_LEVELS = 16;
+
+// 32 bit generational handles into the resource pools of RenderContext
+typedef struct TextureHandle
+{
+    u32 id;
+} TextureHandle;
+
+typedef struct BufferHandle
+{
+    u32 id;
+} BufferHandle;
+
+typedef struct RenderTargetHandle
+{
+    u32 id;
+} RenderTargetHandle;
 
 typedef union ClearValue
 {
@@ -39,6 +59,20 @@ typedef union ClearValue
     };
 } ClearValue;
 
+// what an allocation is used for, kept in its VMA user data for the budget overlay
+typedef enum MemoryCategory
+{
+    MEMORY_CATEGORY_OTHER,
+    MEMORY_CATEGORY_MESH,
+    MEMORY_CATEGORY_TEXTURE,
+    MEMORY_CATEGORY_RENDER_TARGET,
+    MEMORY_CATEGORY_STAGING,
+    MEMORY_CATEGORY_UNIFORM,
+    // indirect draw commands and their counts
+    MEMORY_CATEGORY_INDIRECT,
+    MEMORY_CATEGORY_COUNT
+} MemoryCategory;
+
 typedef enum QueueType
 {
     QUEUE_TYPE_GRAPHICS,
@@ -72,6 +106,10 @@ typedef struct DeviceContext
     VkQueue compute_queue;
 
     VkFormat depth_format;
+    // VK_EXT_memory_budget is enabled, budgets are the driver's instead of a heap size estimate
+    b8 memory_budget;
+    // VK_KHR_draw_indirect_count is enabled, indirect draws can read their count from a buffer
+    b8 draw_indirect_count;
 } DeviceContext;
 
 struct Image
@@ -83,12 +121,19 @@ struct Image
     u32 height;
 };
 
+struct BarrierBatch;
+
 typedef struct Command
 {
     VkCommandPool pool;
     VkCommandBuffer buffer;
     QueueType type;
+    u32 queue_family_index;
     bool is_rendering;
+    // secondaries may be recorded once and replayed, per frame metrics skip their recording
+    bool is_secondary;
+    // owned by the pool, copies of the command share it
+    BarrierBatch* barrier_batch;
 } Command;
 
 // This part of code is from https://github.com/ConfettiFX/The-Forge.
@@ -104,18 +149,29 @@ typedef enum ResourceState
     RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE = 0x40,
     RESOURCE_STATE_PIXEL_SHADER_RESOURCE = 0x80,
     RESOURCE_STATE_SHADER_RESOURCE = 0x40 | 0x80,
+    RESOURCE_STATE_INDIRECT_ARGUMENT = 0x100,
     RESOURCE_STATE_PRESENT = 0x200,
     RESOURCE_STATE_COPY_DEST = 0x400,
     RESOURCE_STATE_COPY_SOURCE = 0x800,
-    RESOURCE_STATE_COMMON = 0x1000
+    RESOURCE_STATE_COMMON = 0x1000,
+    // buffers read back on the CPU once the frame retired
+    RESOURCE_STATE_HOST_READ = 0x2000
 } ResourceState;
 
 typedef struct Buffer
 {
     VkBuffer handle;
     VmaAllocation allocation;
+    // persistent mapping of buffers created with VMA_ALLOCATION_CREATE_MAPPED_BIT, NULL otherwise
+    void* mapped_data;
 } Buffer;
 
+typedef struct BufferCold
+{
+    u64 size;
+    VkBufferUsageFlags usage;
+} BufferCold;
+
 typedef __declspec(align(32)) struct TextureDesc
 {
     u32 width : 16;
@@ -128,15 +184,16 @@ typedef __declspec(align(32)) struct TextureDesc
     VkDescriptorType type;
 
     const void* native_handle;
+    // bind the image into this allocation instead of allocating its own, the caller frees it
+    VmaAllocation alias_allocation;
+    // MEMORY_CATEGORY_OTHER is tracked as MEMORY_CATEGORY_TEXTURE
+    MemoryCategory category;
 } TextureDesc;
 
 typedef __declspec(align(32)) struct Texture
 {
     VkImage image;
     VkImageView srv_descriptor;
-    VkImageView* uav_descriptors;
-
-    VmaAllocation pAlloc;
 
     u32 width : 16;
     u32 height : 16;
@@ -147,6 +204,18 @@ typedef __declspec(align(32)) struct Texture
     u32 owns_image : 1;
 } Texture;
 
+typedef struct TextureCold
+{
+    VmaAllocation allocation;
+    // one view per mip for storage images
+    VkImageView uav_descriptors[MAX_MIP_LEVELS];
+    u32 uav_descriptor_count;
+    // to create the image again when defragmentation moves it
+    VkImageCreateInfo create_info;
+    // state the image is left in between frames, moves copy from and back to it
+    ResourceState resting_state;
+} TextureCold;
+
 typedef __declspec(align(32)) struct RenderTargetDesc
 {
     u32 width;
@@ -159,32 +228,47 @@ typedef __declspec(align(32)) struct RenderTargetDesc
     // For Descriptor
     VkDescriptorType descriptor_type;
     const void* native_handle;  // VkImage
+    // bind the image into this allocation instead of allocating its own
+    VmaAllocation alias_allocation;
 
 } RenderTargetDesc;
 
 typedef __declspec(align(64)) struct RenderTarget
 {
-    Texture* texture;
+    TextureHandle texture;
+    // cached from the texture, barriers and rendering never resolve the handle
+    VkImage image;
+    VkImageView descriptor;
     ClearValue clear_value;
-    u32 array_size : 16;
-    u32 depth : 16;
     u32 width : 16;
     u32 height : 16;
-    u32 descriptors : 20;
     u32 mip_levels : 10;
-    u32 sample_quality : 5;
+    u32 aspect_mask : 4;
     VkFormat vulkan_format;
     VkSampleCountFlagBits sample_count;
-    VkImageView descriptor;
-    VkImageView* array_descriptors;
 
 } RenderTarget;
 
+typedef struct RenderTargetCold
+{
+    // one view per mip for mipmapped targets
+    VkImageView array_descriptors[MAX_MIP_LEVELS];
+    u32 array_size : 16;
+    u32 depth : 16;
+    u32 descriptors : 20;
+    u32 sample_quality : 5;
+} RenderTargetCold;
+
 typedef struct RenderTargetBarrier
 {
     RenderTarget* render_target;
     ResourceState current_state;
     ResourceState new_state;
+    // leaving RESOURCE_STATE_UNDEFINED on aliased memory, waits on the previous occupant
+    ResourceState alias_state;
+    // transition only one mip level instead of the whole image
+    u8 subresource_barrier;
+    u8 mip_level;
 } RenderTargetBarrier;
 
 typedef struct TextureBarrier
@@ -192,6 +276,13 @@ typedef struct TextureBarrier
     Texture* texture;
     ResourceState current_state;
     ResourceState new_state;
+    // transition only one mip level instead of the whole image
+    u8 subresource_barrier;
+    u8 mip_level;
+    // queue family ownership transfer, queue_family_index is the other side of the transfer
+    u8 acquire;
+    u8 release;
+    u32 queue_family_index;
 } TextureBarrier;
 
 typedef struct BufferBarrier
@@ -199,8 +290,44 @@ typedef struct BufferBarrier
     Buffer* buffer;
     ResourceState current_state;
     ResourceState new_state;
+    // queue family ownership transfer, queue_family_index is the other side of the transfer
+    u8 acquire;
+    u8 release;
+    u32 queue_family_index;
 } BufferBarrier;
 
+typedef struct BarrierStats
+{
+    // barriers in vkCmdPipelineBarrier2 calls versus requests dropped or merged away
+    u64 issued;
+    u64 elided;
+    u64 batches;
+} BarrierStats;
+
+typedef struct ImageSubresourceState
+{
+    VkImage image;
+    u32 mip_level;
+    ResourceState state;
+} ImageSubresourceState;
+
+/*
+     Barrier batch : requests recorded on a command accumulate here and go out as one
+     vkCmdPipelineBarrier2KHR right before the next rendering, dispatch, copy or end.
+     Image states are tracked per mip for the current recording, the caller's current_state
+     only seeds the first transition of a subresource.
+*/
+typedef struct BarrierBatch
+{
+    std::vector<VkImageMemoryBarrier2KHR> image_barriers;
+    std::vector<VkBufferMemoryBarrier2KHR> buffer_barriers;
+    VkMemoryBarrier2KHR memory_barrier;
+    u8 has_memory_barrier;
+
+    std::vector<ImageSubresourceState> image_states;
+    BarrierStats stats;
+} BarrierBatch;
+
 typedef struct RenderTargetOperator
 {
     VkAttachmentLoadOp load_op;
@@ -224,6 +351,9 @@ typedef struct RenderDesc
 
     // Order sensitive
     RenderTargetOperator* render_target_operators;
+
+    // the scope only runs secondary command buffers, see vulkan_command_execute_secondaries
+    bool secondary_contents;
 };
 
 struct ShaderModule
@@ -326,7 +456,7 @@ typedef __declspec(align(16)) struct SwapchainDesc
 
 typedef struct VulkanSwapchain
 {
-    RenderTarget** render_targets;
+    RenderTargetHandle* render_targets;
 
     VkSwapchainKHR handle;
     SwapchainDesc* desc;
@@ -351,6 +481,523 @@ typedef struct Pipeline
     VkPipelineLayout layout;
 } Pipeline;
 
+// Graphics pipeline for dynamic rendering, no render pass object
+typedef struct GraphicsPipelineDesc
+{
+    const char* vertex_file_path;
+    const char* fragment_file_path;
+
+    u32 binding_description_count;
+    VkVertexInputBindingDescription* binding_descriptions;
+    u32 attribute_description_count;
+    VkVertexInputAttributeDescription* attribute_descriptions;
+
+    u32 push_constant_range_count;
+    VkPushConstantRange* push_constant_ranges;
+    u32 descriptor_set_layout_count;
+    VkDescriptorSetLayout* descriptor_set_layouts;
+
+    // must match the RenderDesc the pipeline is drawn in
+    u32 color_format_count;
+    const VkFormat* color_formats;
+    VkFormat depth_format;
+
+    bool depth_test;
+    bool depth_write;
+    VkCompareOp depth_compare_op;
+} GraphicsPipelineDesc;
+
+// Timeline semaphore of one queue, the value only ever grows
+typedef struct QueueTimeline
+{
+    VkSemaphore semaphore;
+    u64 submitted_value;  // value signaled by the last submission
+    u64 completed_value;  // last value the GPU was seen to pass
+} QueueTimeline;
+
+// Per frame work of the transfer or compute queue, waited on by the graphics submission
+typedef struct AsyncQueue
+{
+    VkQueue queue;
+    QueueType type;
+    u32 queue_family_index;
+
+    QueueTimeline timeline;
+    Command commands[MAX_FRAME];
+    // timeline value signaled by the last submission of each command slot
+    u64 slot_values[MAX_FRAME];
+    // staging buffers are released once the timeline passes the slot value
+    std::vector<Buffer> staging_buffers[MAX_FRAME];
+
+    // graphics stages consuming the output of this queue
+    VkPipelineStageFlags wait_stages;
+    b8 is_recording;
+
+    // compute goes out behind the graphics command it reads from, the next graphics
+    // submission waits on it at these stages
+    b8 waits_on_graphics;
+    b8 has_pending_wait;
+    VkPipelineStageFlags pending_wait_stages;
+} AsyncQueue;
+
+typedef struct QueueScheduler
+{
+    QueueTimeline graphics;
+    AsyncQueue transfer;
+    AsyncQueue compute;
+
+    u32 graphics_family_index;
+    u32 current_frame;
+    // graphics timeline value of the frame being recorded
+    u64 frame_value;
+
+    // ownership acquires the graphics queue records before touching released resources,
+    // barriers point at the copies since pool records may move before the acquire
+    std::vector<BufferBarrier> buffer_acquires;
+    std::vector<TextureBarrier> texture_acquires;
+    std::vector<Buffer> acquire_buffers;
+    std::vector<Texture> acquire_textures;
+} QueueScheduler;
+
+typedef enum DeletionType
+{
+    DELETION_TYPE_BUFFER,
+    DELETION_TYPE_TEXTURE,
+    DELETION_TYPE_RENDER_TARGET,
+    DELETION_TYPE_SWAPCHAIN,
+    DELETION_TYPE_COMMAND,
+    DELETION_TYPE_ALLOCATION
+} DeletionType;
+
+typedef struct DeletionEntry
+{
+    // graphics timeline value of the last frame that may use the resource
+    u64 value;
+    DeletionType type;
+    union
+    {
+        BufferHandle buffer;
+        TextureHandle texture;
+        RenderTargetHandle render_target;
+        VulkanSwapchain* swapchain;
+        Command command;
+        VmaAllocation allocation;
+    };
+} DeletionEntry;
+
+typedef struct DeletionQueue
+{
+    std::vector<DeletionEntry> entries;
+} DeletionQueue;
+
+// index into RenderGraph::resources
+typedef u32 RenderGraphResource;
+constexpr RenderGraphResource RENDER_GRAPH_RESOURCE_INVALID = ~0u;
+
+struct RenderContext;
+struct RenderGraph;
+typedef void (*RenderGraphExecuteFn)(RenderContext* context, RenderGraph* graph, Command* command,
+                                     void* user_data);
+
+typedef struct RenderGraphResourceNode
+{
+    const char* name;
+    // transient only, realized by the graph
+    RenderTargetDesc desc;
+    // imported : bound every frame, transient : created by vulkan_render_graph_realize
+    RenderTargetHandle render_target;
+    // imported resources enter and leave the frame in these states
+    ResourceState initial_state;
+    ResourceState final_state;
+    u8 imported;
+
+    // compiled, indices into RenderGraph::steps
+    u32 first_step;
+    u32 last_step;
+    u32 alias_slot;
+    u64 estimated_size;
+} RenderGraphResourceNode;
+
+typedef struct RenderGraphAccess
+{
+    RenderGraphResource resource;
+    ResourceState state;
+    u8 write;
+} RenderGraphAccess;
+
+typedef struct RenderGraphPass
+{
+    const char* name;
+    std::vector<RenderGraphAccess> accesses;
+    RenderGraphExecuteFn execute;
+    void* user_data;
+    // kept even when nothing reads its outputs
+    u8 side_effect;
+    u8 culled;
+} RenderGraphPass;
+
+typedef struct RenderGraphBarrier
+{
+    RenderGraphResource resource;
+    ResourceState current_state;
+    ResourceState new_state;
+    // first use of an aliased resource : state the previous occupant of the memory ends in
+    ResourceState alias_state;
+} RenderGraphBarrier;
+
+typedef struct RenderGraphStep
+{
+    u32 pass;
+    // range in RenderGraph::barriers recorded as one batch before the pass
+    u32 first_barrier;
+    u32 barrier_count;
+} RenderGraphStep;
+
+typedef struct RenderGraphAliasSlot
+{
+    // ordered by first use, lifetimes never overlap
+    std::vector<RenderGraphResource> resources;
+    u64 estimated_size;
+    VmaAllocation allocation;
+} RenderGraphAliasSlot;
+
+/*
+     Render graph : passes declare the states they read and write resources in, compile culls
+     passes nothing consumes, derives the barriers between passes and packs transient
+     attachments with disjoint lifetimes into shared memory. Compile touches no GPU object,
+     the plan stays in steps/barriers/alias_slots.
+*/
+typedef struct RenderGraph
+{
+    std::vector<RenderGraphResourceNode> resources;
+    std::vector<RenderGraphPass> passes;
+
+    std::vector<RenderGraphStep> steps;
+    std::vector<RenderGraphBarrier> barriers;
+    // imported resources back to their final state after the last step
+    u32 final_barrier_offset;
+    u32 final_barrier_count;
+    std::vector<RenderGraphAliasSlot> alias_slots;
+
+    // reused every frame for the render target barriers of one batch
+    std::vector<RenderTargetBarrier> scratch_barriers;
+
+    u8 compiled;
+    u8 realized;
+} RenderGraph;
+
+constexpr u32 MAX_GPU_PROFILE_SCOPES = 64;
+// samples per scope behind the rolling min, avg and max
+constexpr u32 GPU_PROFILE_HISTORY = 128;
+#define GPU_PROFILE_SCOPE_INVALID UINT32_MAX
+
+// one scope written in a frame, the name is resolved to its stats at begin
+typedef struct GpuProfileRecord
+{
+    u32 stats_index;
+    u32 begin_query;
+    u32 end_query;
+} GpuProfileRecord;
+
+typedef struct GpuProfileStats
+{
+    std::string name;
+    u32 depth;
+    f32 samples_ms[GPU_PROFILE_HISTORY];
+    u32 sample_count;
+    u32 next_sample;
+    f32 last_ms;
+} GpuProfileStats;
+
+// Timestamp query pool per frame in flight, read back once the frame retired
+typedef struct GpuProfiler
+{
+    VkQueryPool query_pools[MAX_FRAME];
+    // one fragment shader invocation count per frame, next to the timestamps
+    VkQueryPool statistics_pools[MAX_FRAME];
+    b8 statistics_written[MAX_FRAME];
+    b8 statistics_open;
+    u64 fragment_invocations;
+    // pipelineStatisticsQuery and inheritedQueries, scenes are drawn from secondaries
+    b8 statistics_supported;
+    std::vector<GpuProfileRecord> records[MAX_FRAME];
+    u32 query_counts[MAX_FRAME];
+    u32 current_frame;
+    u32 open_depth;
+
+    u64 timestamp_mask;
+    // nanoseconds per tick
+    f64 timestamp_period;
+    b8 supported;
+
+    std::vector<u64> results;
+    std::vector<GpuProfileStats> stats;
+} GpuProfiler;
+
+typedef enum MetricCounter
+{
+    METRIC_DRAWS,
+    // instances of all draws, equal to METRIC_DRAWS without instancing
+    METRIC_DRAW_INSTANCES,
+    METRIC_INDEXED_TRIANGLES,
+    METRIC_PIPELINE_BINDS,
+    METRIC_DESCRIPTOR_SETS_ALLOCATED,
+    METRIC_BARRIERS_ISSUED,
+    METRIC_BARRIERS_ELIDED,
+    METRIC_BYTES_UPLOADED,
+    // of the frame MAX_FRAME behind like gpu_frame_ms, read back from the profiler
+    METRIC_FRAGMENT_SHADER_INVOCATIONS,
+    // totals sampled at the end of the frame, not per frame sums
+    METRIC_VMA_ALLOCATIONS,
+    METRIC_VMA_ALLOCATION_BYTES,
+    METRIC_COUNT
+} MetricCounter;
+
+// frames kept in memory, older ones only survive in the exported file
+constexpr u32 METRICS_HISTORY = 256;
+
+typedef enum MetricsFormat
+{
+    METRICS_FORMAT_CSV,
+    // one JSON object per line, appendable without rewriting the file
+    METRICS_FORMAT_JSON_LINES
+} MetricsFormat;
+
+typedef struct FrameMetrics
+{
+    u64 frame;
+    f32 cpu_frame_ms;
+    // of the frame MAX_FRAME behind, timestamps are read once it retired
+    f32 gpu_frame_ms;
+    u64 counters[METRIC_COUNT];
+} FrameMetrics;
+
+// heap_index went past pressure_fraction of its budget, called from vulkan_memory_poll_budgets
+typedef void (*MemoryPressureFn)(RenderContext* context, u32 heap_index, u64 usage, u64 budget,
+                                 void* user_data);
+
+typedef struct MemoryBudget
+{
+    // sampled by vulkan_memory_poll_budgets once a frame
+    VmaBudget heaps[VK_MAX_MEMORY_HEAPS];
+    u32 heap_count;
+    // live allocations per MemoryCategory, updated from any thread
+    std::atomic<u64> category_bytes[MEMORY_CATEGORY_COUNT];
+    std::atomic<u64> category_counts[MEMORY_CATEGORY_COUNT];
+
+    f32 pressure_fraction;
+    MemoryPressureFn pressure_fn;
+    void* pressure_user_data;
+    // heaps above the threshold at the last poll, the callback fires on the way up only and a
+    // heap leaves the set once it drops a margin below the threshold
+    u32 pressure_heaps;
+} MemoryBudget;
+
+// a resource moved by the current defragmentation pass, the old handles stay alive until
+// the frame that copied out of them retired
+typedef struct DefragmentationMove
+{
+    u32 handle;
+    u8 is_texture;
+    VkBuffer old_buffer;
+    VkImage old_image;
+    VkImageView old_views[MAX_MIP_LEVELS + 1];
+    u32 old_view_count;
+} DefragmentationMove;
+
+typedef struct Defragmenter
+{
+    // NULL while no defragmentation runs
+    VmaDefragmentationContext vma_context;
+    VmaDefragmentationPassMoveInfo pass;
+    b8 pass_open;
+    // graphics timeline value of the frame the pass recorded its copies in
+    u64 pass_value;
+    std::vector<DefragmentationMove> moves;
+
+    u64 max_bytes_per_pass;
+    u32 max_allocations_per_pass;
+
+    // bumped whenever resources got new VkBuffer / VkImage handles, anything caching raw
+    // handles or writing descriptors from the views refreshes when it changes
+    u64 generation;
+    // totals of the last finished run
+    VmaDefragmentationStats stats;
+} Defragmenter;
+
+// Per frame constants : one persistently mapped buffer split into a region per frame in
+// flight, bound once as UNIFORM_BUFFER_DYNAMIC and addressed by dynamic offsets
+typedef struct UniformRing
+{
+    BufferHandle buffer;
+    u8* mapped_data;
+    // bytes per region, a multiple of alignment
+    u32 frame_size;
+    // minUniformBufferOffsetAlignment
+    u32 alignment;
+    u32 frame;
+    // bytes handed out from the region of frame
+    u32 head;
+} UniformRing;
+
+// rows of the 3x4 affine model matrix, std430 layout of the transform buffer
+typedef struct GpuTransform
+{
+    f32 rows[3][4];
+} GpuTransform;
+
+// Object transforms for the vertex shader, one persistently mapped region per frame in flight
+// bound as STORAGE_BUFFER_DYNAMIC and indexed through the instance stream
+typedef struct TransformBuffer
+{
+    BufferHandle buffer;
+    u8* mapped_data;
+    u32 capacity;
+    // bytes per region, a multiple of minStorageBufferOffsetAlignment
+    u64 frame_stride;
+
+    // CPU copy, the regions catch up with it through the dirty lists
+    std::vector<GpuTransform> transforms;
+    // bit per frame slot whose region is stale for this transform
+    std::vector<u8> dirty_frames;
+    std::vector<u32> dirty_indices[MAX_FRAME];
+    std::vector<u32> free_indices;
+} TransformBuffer;
+
+// consecutive draws sharing pipeline and geometry buffers, one indirect call. the commands
+// of the visible draws are packed at the front of the range, the count goes to the count slot
+typedef struct IndirectBatch
+{
+    Pipeline* pipeline;
+    VkBuffer vertex_buffer;
+    // positions of the same vertices, one per vertex buffer
+    VkBuffer position_buffer;
+    VkBuffer index_buffer;
+    u32 first_command;
+    // draws in the batch, the most the indirect call can read
+    u32 max_command_count;
+} IndirectBatch;
+
+// Indirect draw commands of the scene, one persistently mapped region per frame in flight.
+// a region holds capacity commands followed by one u32 draw count per batch
+typedef struct IndirectDrawBuffer
+{
+    BufferHandle buffer;
+    // resolved once for the recording threads, host visible memory is never moved
+    VkBuffer handle;
+    u8* mapped_data;
+    u32 capacity;
+    // from the start of a region
+    u64 count_offset;
+    // bytes per region, a multiple of nonCoherentAtomSize
+    u64 frame_stride;
+
+    // over the draw list, rebuilt only when it changes
+    std::vector<IndirectBatch> batches;
+    // draw counts are read from the buffer, VK_KHR_draw_indirect_count is enabled
+    b8 draw_count;
+    // drawCount above 1, without it every command is its own call
+    b8 multi_draw;
+} IndirectDrawBuffer;
+
+// min and max depth pyramid of the scene depth, see vulkan_depth_pyramid.h
+typedef struct DepthPyramid
+{
+    Pipeline pipeline;
+    VkDescriptorSetLayout set_layout;
+    // nearest and clamped, the depth is only read with texelFetch
+    VkSampler sampler;
+
+    // a set is rewritten once its frame slot retired and version moved past what it holds
+    u64 version;
+    VkDescriptorSet sets[MAX_FRAME];
+    u64 set_versions[MAX_FRAME];
+    VkImageView set_depth_views[MAX_FRAME];
+
+    // r min and g max depth per texel, mip 0 is half the depth extent rounded up
+    TextureHandle texture;
+    // groups of the dispatch that finished, the last one resets it
+    BufferHandle counter;
+    // family of the queue that last built the pyramid, the counter is refilled on a change
+    u32 counter_family_index;
+    u32 depth_width;
+    u32 depth_height;
+    u32 mips;
+    // holds the depth of a previous frame, in RESOURCE_STATE_SHADER_RESOURCE
+    b8 valid;
+    // the depth was rendered with
+    f32 view_projection[16];
+} DepthPyramid;
+
+// GPU frustum and occlusion culling of the draw list, see vulkan_gpu_culling.h
+typedef struct GpuCulling
+{
+    Pipeline cull_pipeline;
+    Pipeline compact_pipeline;
+    VkDescriptorSetLayout cull_set_layout;
+
+    // a set is rewritten once its frame slot retired and version moved past what it holds
+    u64 version;
+    // dynamic offsets of the current frame, constants in the uniform ring and transforms
+    u32 constants_offset;
+    u32 transform_offset;
+    VkDescriptorSet cull_sets[MAX_FRAME];
+    u64 cull_set_versions[MAX_FRAME];
+    u64 cull_set_pyramid_versions[MAX_FRAME];
+
+    // instances
+    u32 capacity;
+    u32 draw_count;
+    u32 instance_count;
+    // over the draw list, the commands of a batch are compacted to its front
+    std::vector<IndirectBatch> batches;
+
+    // written once per draw list, GpuCullDraw and GpuCullInstance
+    BufferHandle draws;
+    BufferHandle instances;
+    // written and read on the device only
+    BufferHandle draw_counts;       // survivors per draw
+    BufferHandle retest;            // per instance, occluded by the early pass
+    BufferHandle culled_instances;  // the instance stream the draws read
+    BufferHandle commands;          // capacity commands, then one u32 count per batch
+    u64 count_offset;
+    // first instance of every draw, increasing, tells which draw a compacted command is
+    std::vector<u32> first_instances;
+
+    // host copies of what both phases compacted, per frame slot, while checked against the CPU
+    BufferHandle readbacks[MAX_FRAME];
+    // version of the draw list a copy was made with, 0 when the slot holds none
+    u64 readback_versions[MAX_FRAME];
+
+    // built by the owner between the phases, the occlusion test reads its max
+    DepthPyramid* depth_pyramid;
+
+    b8 draw_count_supported;
+    b8 multi_draw;
+} GpuCulling;
+
+class JobSystem;
+
+// records items [first, first + count) of a draw list into a secondary command buffer
+typedef void (*RecordRangeFn)(Command* command, u32 first, u32 count, void* user_data);
+
+// Secondary command buffers recorded on the job system, one pool per slice and frame
+typedef struct ParallelRecorder
+{
+    JobSystem* jobs;
+    u32 slice_count;
+    // upper bound of the slices of one recording, 0 uses slice_count
+    u32 max_slices;
+    // [frame * slice_count + slice]
+    std::vector<Command> commands;
+    // the recorded secondaries of the current frame in draw list order
+    std::vector<VkCommandBuffer> recorded;
+    // version and slice count the secondaries of a frame slot were recorded with, the
+    // version is 0 when they were recorded for one frame only. 0 is never a valid version
+    u64 frame_versions[MAX_FRAME];
+    u32 frame_slice_counts[MAX_FRAME];
+} ParallelRecorder;
+
 class DescriptorAllocator
 {
    public:
@@ -421,6 +1068,10 @@ class DescriptorLayoutCache
     VkDevice device = VK_NULL_HANDLE;
 };
 
+typedef ResourcePool<Buffer, BufferCold> BufferPool;
+typedef ResourcePool<Texture, TextureCold> TexturePool;
+typedef ResourcePool<RenderTarget, RenderTargetCold> RenderTargetPool;
+
 typedef struct RenderContext
 {
     VmaAllocator vma_allocator;
@@ -446,6 +1097,15 @@ typedef struct RenderContext
     VulkanRenderpass main_renderpass;
 
     DescriptorAllocator* pDynamicDescriptorAllocators;
+    QueueScheduler* queue_scheduler;
+    DeletionQueue* deletion_queue;
+    // optional, passes of the render graph get a scope each when set
+    GpuProfiler* gpu_profiler;
+
+    BufferPool* buffer_pool;
+    TexturePool* texture_pool;
+    RenderTargetPool* render_target_pool;
+    MemoryBudget* memory_budget;
 } VulkanContext;
 
 #endif  // !VULKAN_TYPES_INL
\ No newline at end of file
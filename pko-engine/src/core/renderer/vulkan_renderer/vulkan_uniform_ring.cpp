@@ -0,0 +1,103 @@
+#include "vulkan_uniform_ring.h"
+
+#include "vulkan_buffer.h"
+#include "vulkan_metrics.h"
+
+static u32 align_up(u32 value, u32 alignment)
+{
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+void vulkan_uniform_ring_create(RenderContext* context, UniformRing* ring, u32 frame_size)
+{
+    assert(context);
+    assert(ring);
+
+    ring->alignment =
+        (u32)context->device_context.properties.limits.minUniformBufferOffsetAlignment;
+    if (ring->alignment == 0)
+        ring->alignment = 1;
+
+    ring->frame_size = align_up(frame_size, ring->alignment);
+    ring->frame = 0;
+    ring->head = 0;
+
+    vulkan_buffer_create(context, (u64)ring->frame_size * MAX_FRAME,
+                         VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VMA_MEMORY_USAGE_AUTO,
+                         VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT |
+                             VMA_ALLOCATION_CREATE_MAPPED_BIT,
+                         &ring->buffer, MEMORY_CATEGORY_UNIFORM);
+
+    ring->mapped_data = (u8*)vulkan_buffer_get(context, ring->buffer)->mapped_data;
+    assert(ring->mapped_data && "uniform ring needs host visible memory");
+}
+
+void vulkan_uniform_ring_destroy(RenderContext* context, UniformRing* ring)
+{
+    assert(context);
+    assert(ring);
+
+    vulkan_buffer_destroy(context, ring->buffer);
+    ring->buffer = {};
+    ring->mapped_data = NULL;
+}
+
+void vulkan_uniform_ring_begin_frame(UniformRing* ring, u32 frame)
+{
+    assert(frame < MAX_FRAME);
+
+    ring->frame = frame;
+    ring->head = 0;
+}
+
+void* vulkan_uniform_ring_allocate(UniformRing* ring, u32 size, u32* out_offset)
+{
+    assert(out_offset);
+
+    const u32 offset = ring->head;
+    const u32 end = align_up(offset + size, ring->alignment);
+    assert(end <= ring->frame_size && "uniform ring region is full, raise frame_size");
+
+    ring->head = end;
+    *out_offset = ring->frame * ring->frame_size + offset;
+
+    return ring->mapped_data + *out_offset;
+}
+
+u32 vulkan_uniform_ring_push(UniformRing* ring, const void* data, u32 size)
+{
+    u32 offset;
+    memcpy(vulkan_uniform_ring_allocate(ring, size, &offset), data, size);
+
+    vulkan_metrics_add(METRIC_BYTES_UPLOADED, size);
+    return offset;
+}
+
+void vulkan_uniform_ring_flush(RenderContext* context, UniformRing* ring)
+{
+    if (ring->head == 0)
+        return;
+
+    Buffer* buffer = vulkan_buffer_get(context, ring->buffer);
+    vmaFlushAllocation(context->vma_allocator, buffer->allocation,
+                       (VkDeviceSize)ring->frame * ring->frame_size, ring->head);
+}
+
+void vulkan_uniform_ring_write_descriptor(RenderContext* context, UniformRing* ring,
+                                          VkDescriptorSet set, u32 binding, u32 range)
+{
+    assert(range <= ring->frame_size);
+
+    VkDescriptorBufferInfo buffer_info{};
+    buffer_info.buffer = vulkan_buffer_get(context, ring->buffer)->handle;
+    buffer_info.offset = 0;
+    buffer_info.range = range;
+
+    VkWriteDescriptorSet write{VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
+    write.dstSet = set;
+    write.dstBinding = binding;
+    write.descriptorCount = 1;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    write.pBufferInfo = &buffer_info;
+    vkUpdateDescriptorSets(context->device_context.handle, 1, &write, 0, NULL);
+}
@@ -0,0 +1,32 @@
+#ifndef VULKAN_UNIFORM_RING_H
+#define VULKAN_UNIFORM_RING_H
+
+#include "vulkan_types.inl"
+
+/*
+     Uniform ring : per frame constants cost one memcpy into persistently mapped memory and
+     one dynamic offset at bind time, no map calls and no descriptor set per frame.
+     A region is reused only after its frame retired, so begin the frame after the queue
+     scheduler waited for it. Allocations are aligned to minUniformBufferOffsetAlignment.
+     Not thread safe, everything is pushed from the thread recording the frame.
+*/
+void vulkan_uniform_ring_create(RenderContext* context, UniformRing* ring, u32 frame_size);
+// the device has to be idle
+void vulkan_uniform_ring_destroy(RenderContext* context, UniformRing* ring);
+
+void vulkan_uniform_ring_begin_frame(UniformRing* ring, u32 frame);
+
+// size bytes in the current region, returns the write pointer and the dynamic offset
+void* vulkan_uniform_ring_allocate(UniformRing* ring, u32 size, u32* out_offset);
+// copies data and returns its dynamic offset
+u32 vulkan_uniform_ring_push(UniformRing* ring, const void* data, u32 size);
+
+// makes the region written this frame visible, only does work on non coherent memory
+void vulkan_uniform_ring_flush(RenderContext* context, UniformRing* ring);
+
+// points binding of set, a UNIFORM_BUFFER_DYNAMIC, at the ring. range is the size a shader
+// reads behind each dynamic offset
+void vulkan_uniform_ring_write_descriptor(RenderContext* context, UniformRing* ring,
+                                          VkDescriptorSet set, u32 binding, u32 range);
+
+#endif  // !VULKAN_UNIFORM_RING_H
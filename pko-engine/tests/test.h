@@ -0,0 +1,59 @@
+#pragma once
+
+/*
+* Minimal test registry for the pko-engine-tests project.
+* PKO_TEST(name) registers a test, PKO_BENCHMARK(name) a benchmark that only runs with --bench.
+* Checks report the failing expression and keep going, a test fails when any check failed.
+* Only CPU code is tested, nothing here creates a device. Tests that record commands point the
+* Vulkan entry points at stubs recording into memory.
+*/
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+
+#include "defines.h"
+
+typedef void (*TestFn)();
+
+struct TestCase {
+    const char* name;
+    TestFn fn;
+    b8 benchmark;
+};
+
+// registered from static initializers, run by test_main.cpp
+void test_register(const char* name, TestFn fn, b8 benchmark);
+void test_report_failure(const char* file, int line, const char* expression);
+
+struct TestRegistrar {
+    TestRegistrar(const char* name, TestFn fn, b8 benchmark) { test_register(name, fn, benchmark); }
+};
+
+#define PKO_TEST_DEFINE(name, benchmark) \
+    static void name(); \
+    static TestRegistrar name##_registrar(#name, name, benchmark); \
+    static void name()
+
+#define PKO_TEST(name) PKO_TEST_DEFINE(name, false)
+#define PKO_BENCHMARK(name) PKO_TEST_DEFINE(name, true)
+
+#define CHECK(expression) \
+    do { \
+        if (!(expression)) \
+            test_report_failure(__FILE__, __LINE__, #expression); \
+    } while (0)
+
+#define CHECK_EQ(a, b) CHECK((a) == (b))
+#define CHECK_NEAR(a, b, epsilon) CHECK(std::fabs((f64)(a) - (f64)(b)) <= (f64)(epsilon))
+
+// wall time of the enclosing scope for benchmarks
+struct BenchTimer {
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+
+    f64 elapsed_ms() const
+    {
+        return std::chrono::duration<f64, std::milli>(std::chrono::steady_clock::now() - begin)
+            .count();
+    }
+};
@@ -0,0 +1,236 @@
+#include "test.h"
+
+#include <vector>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "core/renderer/culling.h"
+
+// boxes whose farthest corner is this close to a plane may go either way, the kernels sum in
+// another order than the reference
+static const f64 PLANE_EPSILON = 1e-4;
+
+enum Reference {
+    REFERENCE_OUTSIDE,
+    REFERENCE_INSIDE,
+    REFERENCE_EITHER
+};
+
+// deterministic, every run tests the same boxes
+struct Random {
+    u32 state;
+
+    f32 next(f32 min, f32 max)
+    {
+        state = state * 1664525u + 1013904223u;
+        return min + (max - min) * (f32)(state >> 8) / (f32)(1u << 24);
+    }
+};
+
+static void random_boxes(u32 count, u32 seed, std::vector<glm::vec3>* mins,
+    std::vector<glm::vec3>* maxs)
+{
+    Random random{seed};
+    for (u32 i = 0; i < count; ++i) {
+        const glm::vec3 center(random.next(-60.0f, 60.0f), random.next(-60.0f, 60.0f),
+            random.next(-20.0f, 120.0f));
+        const glm::vec3 extent(random.next(0.05f, 4.0f), random.next(0.05f, 4.0f),
+            random.next(0.05f, 4.0f));
+        mins->push_back(center - extent);
+        maxs->push_back(center + extent);
+    }
+}
+
+static Frustum test_frustum()
+{
+    const glm::mat4 projection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 100.0f);
+    const glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, -10.0f), glm::vec3(0.0f, 0.0f, 1.0f),
+        glm::vec3(0.0f, -1.0f, 0.0f));
+    Frustum frustum;
+    frustum_from_matrix(projection * view, &frustum);
+    return frustum;
+}
+
+// every corner of the box against every plane, in double
+static Reference reference_cull(const Frustum& frustum, const glm::vec3& min, const glm::vec3& max)
+{
+    Reference result = REFERENCE_INSIDE;
+    for (u32 p = 0; p < 6; ++p) {
+        const glm::vec4& plane = frustum.planes[p];
+        f64 farthest = -1e30;
+        for (u32 corner = 0; corner < 8; ++corner) {
+            const f64 x = (corner & 1) ? max.x : min.x;
+            const f64 y = (corner & 2) ? max.y : min.y;
+            const f64 z = (corner & 4) ? max.z : min.z;
+            const f64 distance = (f64)plane.x * x + (f64)plane.y * y + (f64)plane.z * z + plane.w;
+            farthest = distance > farthest ? distance : farthest;
+        }
+
+        if (farthest < -PLANE_EPSILON)
+            return REFERENCE_OUTSIDE;
+        if (farthest < PLANE_EPSILON)
+            result = REFERENCE_EITHER;
+    }
+    return result;
+}
+
+static u32 count_mismatches(const std::vector<Reference>& expected, const u8* visible, u32 first,
+    u32 count)
+{
+    u32 mismatches = 0;
+    for (u32 i = 0; i < count; ++i) {
+        const Reference reference = expected[first + i];
+        if (reference == REFERENCE_EITHER)
+            continue;
+        mismatches += (visible[i] != 0) != (reference == REFERENCE_INSIDE) ? 1 : 0;
+    }
+    return mismatches;
+}
+
+static std::vector<CullKernel> supported_kernels()
+{
+    std::vector<CullKernel> kernels;
+    for (u32 kernel = CULL_KERNEL_SCALAR; kernel <= (u32)cull_kernel_best(); ++kernel)
+        kernels.push_back((CullKernel)kernel);
+    return kernels;
+}
+
+PKO_TEST(culling_kernels_match_brute_force)
+{
+    const u32 box_count = 10007;
+    std::vector<glm::vec3> mins, maxs;
+    random_boxes(box_count, 7, &mins, &maxs);
+
+    const Frustum frustum = test_frustum();
+    std::vector<Reference> expected(box_count);
+    u32 inside = 0;
+    for (u32 i = 0; i < box_count; ++i) {
+        expected[i] = reference_cull(frustum, mins[i], maxs[i]);
+        inside += expected[i] == REFERENCE_INSIDE ? 1 : 0;
+    }
+    // both sides have to be exercised
+    CHECK(inside > box_count / 20);
+    CHECK(inside < box_count - box_count / 20);
+
+    BoundsSoA bounds;
+    bounds_soa_build(mins.data(), maxs.data(), box_count, &bounds);
+
+    const std::vector<CullKernel> kernels = supported_kernels();
+    printf("  kernels up to %s\n", cull_kernel_name(cull_kernel_best()));
+    for (CullKernel kernel : kernels) {
+        std::vector<u8> visible(box_count);
+        frustum_cull_aabbs(frustum.planes, 6, bounds, 0, box_count, visible.data(), kernel);
+        CHECK_EQ(count_mismatches(expected, visible.data(), 0, box_count), 0u);
+
+        // ranges starting and ending off a step, the tail lanes must stay untouched
+        const u32 first = 13;
+        const u32 count = 45;
+        std::vector<u8> range(count + 1, 0xcd);
+        frustum_cull_aabbs(frustum.planes, 6, bounds, first, count, range.data(), kernel);
+        CHECK_EQ(count_mismatches(expected, range.data(), first, count), 0u);
+        CHECK_EQ(range[count], 0xcd);
+    }
+}
+
+PKO_TEST(culling_bvh_matches_brute_force)
+{
+    const u32 box_count = 5003;
+    std::vector<glm::vec3> mins, maxs;
+    random_boxes(box_count, 11, &mins, &maxs);
+
+    const Frustum frustum = test_frustum();
+    Bvh bvh;
+    bvh_build(mins.data(), maxs.data(), box_count, &bvh);
+
+    for (CullKernel kernel : supported_kernels()) {
+        std::vector<u8> visible(box_count, 0xcd);
+        const u32 visible_count = bvh_cull(bvh, frustum, visible.data(), kernel);
+
+        u32 counted = 0;
+        u32 mismatches = 0;
+        for (u32 i = 0; i < box_count; ++i) {
+            // every item written
+            CHECK(visible[i] <= 1);
+            counted += visible[i];
+
+            const Reference reference = reference_cull(frustum, mins[i], maxs[i]);
+            if (reference != REFERENCE_EITHER)
+                mismatches += (visible[i] != 0) != (reference == REFERENCE_INSIDE) ? 1 : 0;
+        }
+        CHECK_EQ(visible_count, counted);
+        CHECK_EQ(mismatches, 0u);
+    }
+}
+
+PKO_TEST(culling_spheres_match_brute_force)
+{
+    const Frustum frustum = test_frustum();
+    Random random{3};
+    const u32 sphere_count = 4096;
+    std::vector<glm::vec4> spheres(sphere_count);
+    for (glm::vec4& sphere : spheres) {
+        sphere = glm::vec4(random.next(-60.0f, 60.0f), random.next(-60.0f, 60.0f),
+            random.next(-20.0f, 120.0f), random.next(0.1f, 5.0f));
+    }
+
+    std::vector<u8> visible(sphere_count);
+    const u32 visible_count =
+        frustum_cull_spheres(frustum, spheres.data(), sphere_count, visible.data());
+
+    u32 counted = 0;
+    for (u32 i = 0; i < sphere_count; ++i) {
+        b8 outside = false;
+        b8 ambiguous = false;
+        for (u32 p = 0; p < 6; ++p) {
+            const glm::vec4& plane = frustum.planes[p];
+            const f64 distance = (f64)plane.x * spheres[i].x + (f64)plane.y * spheres[i].y +
+                (f64)plane.z * spheres[i].z + plane.w + spheres[i].w;
+            outside |= distance < -PLANE_EPSILON;
+            ambiguous |= distance >= -PLANE_EPSILON && distance < PLANE_EPSILON;
+        }
+        if (outside || !ambiguous)
+            CHECK_EQ(visible[i], outside ? 0 : 1);
+        counted += visible[i];
+    }
+    CHECK_EQ(visible_count, counted);
+
+    // the largest axis scale grows the radius, the translation moves the center
+    const glm::mat4 transform = glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(1, 2, 3)),
+        glm::vec3(2.0f, 0.5f, 3.0f));
+    const glm::vec4 moved = sphere_transform(transform, glm::vec4(1.0f, 0.0f, 0.0f, 2.0f));
+    CHECK_NEAR(moved.x, 3.0, 1e-5);
+    CHECK_NEAR(moved.y, 2.0, 1e-5);
+    CHECK_NEAR(moved.z, 3.0, 1e-5);
+    CHECK_NEAR(moved.w, 6.0, 1e-5);
+}
+
+PKO_BENCHMARK(culling_100k_boxes)
+{
+    const u32 box_count = 100000;
+    std::vector<glm::vec3> mins, maxs;
+    random_boxes(box_count, 5, &mins, &maxs);
+
+    const Frustum frustum = test_frustum();
+    BoundsSoA bounds;
+    bounds_soa_build(mins.data(), maxs.data(), box_count, &bounds);
+    Bvh bvh;
+    bvh_build(mins.data(), maxs.data(), box_count, &bvh);
+
+    const u32 iterations = 20;
+    std::vector<u8> visible(box_count);
+    for (CullKernel kernel : supported_kernels()) {
+        BenchTimer flat_timer;
+        for (u32 i = 0; i < iterations; ++i)
+            frustum_cull_aabbs(frustum.planes, 6, bounds, 0, box_count, visible.data(), kernel);
+        const f64 flat_ms = flat_timer.elapsed_ms() / iterations;
+
+        u32 visible_count = 0;
+        BenchTimer bvh_timer;
+        for (u32 i = 0; i < iterations; ++i)
+            visible_count = bvh_cull(bvh, frustum, visible.data(), kernel);
+        const f64 bvh_ms = bvh_timer.elapsed_ms() / iterations;
+
+        printf("  %-6s  flat %.3f ms  bvh %.3f ms  (%u of %u visible)\n",
+            cull_kernel_name(kernel), flat_ms, bvh_ms, visible_count, box_count);
+    }
+}
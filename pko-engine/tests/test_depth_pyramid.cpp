@@ -0,0 +1,243 @@
+#include "test.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "core/renderer/depth_pyramid.h"
+
+// mips of depth_pyramid.comp and the side of the tile a group reduces
+static const u32 SHADER_MIPS = 13;
+static const i32 TILE_SIZE = 64;
+
+static glm::vec2 combine(const glm::vec2& a, const glm::vec2& b)
+{
+    return glm::vec2(std::min(a.x, b.x), std::max(a.y, b.y));
+}
+
+// depth_pyramid.comp step by step on the CPU: groups reduce 64x64 tiles of mip 0 down to mip 6
+// without clamping inside the tile, then the last group reduces mip 6 down to mip 12
+struct ShaderPyramid {
+    const f32* depth;
+    i32 depth_width;
+    i32 depth_height;
+    u32 mip_count;
+    std::vector<DepthPyramidLevel> levels;
+
+    void size(i32 level, i32* out_width, i32* out_height) const
+    {
+        u32 width, height;
+        depth_pyramid_level_size(depth_width, depth_height, level, &width, &height);
+        *out_width = (i32)width;
+        *out_height = (i32)height;
+    }
+
+    glm::vec2 load_source(i32 x, i32 y, i32 first_level) const
+    {
+        if (first_level == 0) {
+            glm::vec2 value(1e30f, -1e30f);
+            for (i32 i = 0; i < 4; ++i) {
+                const i32 sx = std::min(x * 2 + (i & 1), depth_width - 1);
+                const i32 sy = std::min(y * 2 + (i >> 1), depth_height - 1);
+                value = combine(value, glm::vec2(depth[sy * depth_width + sx]));
+            }
+            return value;
+        }
+
+        const DepthPyramidLevel& mip6 = levels[6];
+        glm::vec2 value(1e30f, -1e30f);
+        for (i32 i = 0; i < 4; ++i) {
+            const i32 sx = std::min(x * 2 + (i & 1), (i32)mip6.width - 1);
+            const i32 sy = std::min(y * 2 + (i >> 1), (i32)mip6.height - 1);
+            value = combine(value, mip6.texels[sy * mip6.width + sx]);
+        }
+        return value;
+    }
+
+    void store(i32 level, i32 x, i32 y, const glm::vec2& value)
+    {
+        if (level >= (i32)mip_count)
+            return;
+        DepthPyramidLevel& target = levels[level];
+        if (x >= (i32)target.width || y >= (i32)target.height)
+            return;
+        target.texels[y * target.width + x] = value;
+    }
+
+    void reduce_tile(i32 origin_x, i32 origin_y, i32 first_level)
+    {
+        glm::vec2 tile[16][16];
+        for (i32 cy = 0; cy < 16; ++cy) {
+            for (i32 cx = 0; cx < 16; ++cx) {
+                glm::vec2 quads[4];
+                for (i32 q = 0; q < 4; ++q) {
+                    const i32 qx = cx * 2 + (q & 1);
+                    const i32 qy = cy * 2 + (q >> 1);
+                    glm::vec2 reduced;
+                    for (i32 i = 0; i < 4; ++i) {
+                        const i32 tx = origin_x + qx * 2 + (i & 1);
+                        const i32 ty = origin_y + qy * 2 + (i >> 1);
+                        const glm::vec2 value = load_source(tx, ty, first_level);
+                        store(first_level, tx, ty, value);
+                        reduced = i == 0 ? value : combine(reduced, value);
+                    }
+                    store(first_level + 1, (origin_x >> 1) + qx, (origin_y >> 1) + qy, reduced);
+                    quads[q] = reduced;
+                }
+
+                const glm::vec2 value =
+                    combine(combine(quads[0], quads[1]), combine(quads[2], quads[3]));
+                store(first_level + 2, (origin_x >> 2) + cx, (origin_y >> 2) + cy, value);
+                tile[cy][cx] = value;
+            }
+        }
+
+        for (i32 step = 1; step <= 4; ++step) {
+            const i32 cells = 16 >> step;
+            for (i32 cy = 0; cy < cells; ++cy) {
+                for (i32 cx = 0; cx < cells; ++cx) {
+                    const glm::vec2 value =
+                        combine(combine(tile[cy * 2][cx * 2], tile[cy * 2][cx * 2 + 1]),
+                            combine(tile[cy * 2 + 1][cx * 2], tile[cy * 2 + 1][cx * 2 + 1]));
+                    store(first_level + 2 + step, (origin_x >> (2 + step)) + cx,
+                        (origin_y >> (2 + step)) + cy, value);
+                    // the cells read this step are all read before any is written
+                    tile[cy][cx] = value;
+                }
+            }
+        }
+    }
+
+    void build()
+    {
+        levels.resize(mip_count);
+        for (u32 level = 0; level < mip_count; ++level) {
+            depth_pyramid_level_size(depth_width, depth_height, level, &levels[level].width,
+                &levels[level].height);
+            // never written texels show up as a mismatch
+            levels[level].texels.assign(levels[level].width * levels[level].height,
+                glm::vec2(-7.0f));
+        }
+
+        i32 width, height;
+        size(0, &width, &height);
+        const i32 groups_x = (width + TILE_SIZE - 1) / TILE_SIZE;
+        const i32 groups_y = (height + TILE_SIZE - 1) / TILE_SIZE;
+        for (i32 gy = 0; gy < groups_y; ++gy) {
+            for (i32 gx = 0; gx < groups_x; ++gx)
+                reduce_tile(gx * TILE_SIZE, gy * TILE_SIZE, 0);
+        }
+
+        if (mip_count > 7)
+            reduce_tile(0, 0, 7);
+    }
+};
+
+static std::vector<f32> known_depth(u32 width, u32 height)
+{
+    std::vector<f32> depth(width * height);
+    u32 state = width * 31 + height;
+    for (f32& value : depth) {
+        state = state * 1664525u + 1013904223u;
+        value = (f32)(state >> 8) / (f32)(1u << 24);
+    }
+    return depth;
+}
+
+static u32 compare_levels(const std::vector<DepthPyramidLevel>& a,
+    const std::vector<DepthPyramidLevel>& b)
+{
+    u32 mismatches = 0;
+    for (u32 level = 0; level < a.size(); ++level) {
+        CHECK_EQ(a[level].width, b[level].width);
+        CHECK_EQ(a[level].height, b[level].height);
+        u32 level_mismatches = 0;
+        for (u32 i = 0; i < a[level].texels.size() && i < b[level].texels.size(); ++i)
+            level_mismatches += a[level].texels[i] != b[level].texels[i] ? 1 : 0;
+        if (level_mismatches)
+            printf("  level %u: %u texels differ\n", level, level_mismatches);
+        mismatches += level_mismatches;
+    }
+    return mismatches;
+}
+
+PKO_TEST(depth_pyramid_reference_of_a_known_image)
+{
+    // 5x3, odd both ways
+    const f32 depth[] = {
+        0.1f, 0.9f, 0.5f, 0.4f, 0.3f,
+        0.2f, 0.8f, 0.6f, 0.7f, 0.05f,
+        0.6f, 0.0f, 1.0f, 0.2f, 0.25f,
+    };
+
+    CHECK_EQ(depth_pyramid_level_count(5, 3, SHADER_MIPS), 3u);
+    std::vector<DepthPyramidLevel> levels;
+    depth_pyramid_reduce(depth, 5, 3, 3, &levels);
+
+    // 3x2, the last column covers only column 4, the last row only row 2
+    CHECK_EQ(levels[0].width, 3u);
+    CHECK_EQ(levels[0].height, 2u);
+    const glm::vec2 level0[] = {
+        {0.1f, 0.9f}, {0.4f, 0.7f}, {0.05f, 0.3f},
+        {0.0f, 0.6f}, {0.2f, 1.0f}, {0.25f, 0.25f},
+    };
+    for (u32 i = 0; i < 6; ++i)
+        CHECK(levels[0].texels[i] == level0[i]);
+
+    // 2x1, then 1x1
+    CHECK_EQ(levels[1].width, 2u);
+    CHECK_EQ(levels[1].height, 1u);
+    CHECK(levels[1].texels[0] == glm::vec2(0.0f, 1.0f));
+    CHECK(levels[1].texels[1] == glm::vec2(0.05f, 0.3f));
+    CHECK_EQ(levels[2].width, 1u);
+    CHECK(levels[2].texels[0] == glm::vec2(0.0f, 1.0f));
+}
+
+PKO_TEST(depth_pyramid_level_counts)
+{
+    CHECK_EQ(depth_pyramid_level_count(1, 1, SHADER_MIPS), 1u);
+    CHECK_EQ(depth_pyramid_level_count(2, 2, SHADER_MIPS), 1u);
+    CHECK_EQ(depth_pyramid_level_count(3, 1, SHADER_MIPS), 2u);
+    // 960x540 down to 1x1
+    CHECK_EQ(depth_pyramid_level_count(1920, 1080, SHADER_MIPS), 11u);
+    // 8192 gets the full chain, anything larger is capped
+    CHECK_EQ(depth_pyramid_level_count(8192, 8192, SHADER_MIPS), 13u);
+    CHECK_EQ(depth_pyramid_level_count(16384, 16, SHADER_MIPS), 13u);
+
+    u32 width, height;
+    depth_pyramid_level_size(1919, 1081, 3, &width, &height);
+    CHECK_EQ(width, 120u);
+    CHECK_EQ(height, 68u);
+}
+
+PKO_TEST(depth_pyramid_shader_matches_reference_per_level)
+{
+    // one tile, partial tiles, odd extents, and past 64x64 groups the second pass up to mip 12
+    const u32 extents[][2] = {
+        {1, 1}, {2, 2}, {64, 64}, {37, 23}, {129, 2}, {300, 201}, {1920, 1080}, {8191, 17},
+    };
+
+    for (const auto& extent : extents) {
+        const u32 width = extent[0];
+        const u32 height = extent[1];
+        const std::vector<f32> depth = known_depth(width, height);
+        const u32 level_count = depth_pyramid_level_count(width, height, SHADER_MIPS);
+
+        std::vector<DepthPyramidLevel> reference;
+        depth_pyramid_reduce(depth.data(), width, height, level_count, &reference);
+
+        ShaderPyramid shader{depth.data(), (i32)width, (i32)height, level_count, {}};
+        shader.build();
+
+        const u32 mismatches = compare_levels(reference, shader.levels);
+        if (mismatches)
+            printf("  %ux%u: %u texels differ\n", width, height, mismatches);
+        CHECK_EQ(mismatches, 0u);
+
+        // the last level covers the whole image
+        const DepthPyramidLevel& last = reference.back();
+        if (last.width == 1 && last.height == 1) {
+            CHECK_EQ(last.texels[0].x, *std::min_element(depth.begin(), depth.end()));
+            CHECK_EQ(last.texels[0].y, *std::max_element(depth.begin(), depth.end()));
+        }
+    }
+}
@@ -0,0 +1,147 @@
+#include "test.h"
+
+#include <vector>
+
+#include "core/renderer/vulkan_renderer/vulkan_indirect.h"
+
+// the builders only compare the handles, any distinct values do
+static Pipeline* const PIPELINE_A = (Pipeline*)0x10;
+static Pipeline* const PIPELINE_B = (Pipeline*)0x20;
+static const VkBuffer VERTICES_A = (VkBuffer)0x100;
+static const VkBuffer VERTICES_B = (VkBuffer)0x200;
+static const VkBuffer INDICES = (VkBuffer)0x1000;
+
+static instanced_draw make_draw(Pipeline* pipeline, VkBuffer vertex_buffer, u32 index)
+{
+    instanced_draw draw{};
+    draw.pipeline = pipeline;
+    draw.vertex_buffer = vertex_buffer;
+    draw.position_buffer = vertex_buffer;
+    draw.index_buffer = INDICES;
+    draw.first_index = index * 36;
+    draw.vertex_offset = (i32)index * 24;
+    draw.index_count = 36;
+    draw.first_instance = index * 4;
+    draw.instance_count = 1 + index % 4;
+    return draw;
+}
+
+static b8 is_zero(const VkDrawIndexedIndirectCommand& command)
+{
+    return command.indexCount == 0 && command.instanceCount == 0 && command.firstIndex == 0 &&
+        command.vertexOffset == 0 && command.firstInstance == 0;
+}
+
+PKO_TEST(indirect_batches_break_on_pipeline_and_buffers)
+{
+    std::vector<instanced_draw> draws;
+    draws.push_back(make_draw(PIPELINE_A, VERTICES_A, 0));
+    draws.push_back(make_draw(PIPELINE_A, VERTICES_A, 1));
+    draws.push_back(make_draw(PIPELINE_A, VERTICES_A, 2));
+    draws.push_back(make_draw(PIPELINE_B, VERTICES_A, 3));
+    draws.push_back(make_draw(PIPELINE_B, VERTICES_B, 4));
+    draws.push_back(make_draw(PIPELINE_B, VERTICES_B, 5));
+    // not merged with the first run, only neighbours are
+    draws.push_back(make_draw(PIPELINE_A, VERTICES_A, 6));
+
+    std::vector<IndirectBatch> batches;
+    vulkan_indirect_build_batches(draws.data(), (u32)draws.size(), &batches);
+
+    CHECK_EQ(batches.size(), 4u);
+    const u32 expected_first[] = {0, 3, 4, 6};
+    const u32 expected_count[] = {3, 1, 2, 1};
+    for (u32 i = 0; i < batches.size() && i < 4; ++i) {
+        CHECK_EQ(batches[i].first_command, expected_first[i]);
+        CHECK_EQ(batches[i].max_command_count, expected_count[i]);
+        CHECK_EQ(batches[i].pipeline, draws[expected_first[i]].pipeline);
+        CHECK_EQ(batches[i].vertex_buffer, draws[expected_first[i]].vertex_buffer);
+    }
+
+    // rebuilding replaces the batches
+    vulkan_indirect_build_batches(draws.data(), 0, &batches);
+    CHECK(batches.empty());
+}
+
+PKO_TEST(indirect_commands_pack_visible_and_zero_the_tail)
+{
+    std::vector<instanced_draw> draws;
+    for (u32 i = 0; i < 5; ++i)
+        draws.push_back(make_draw(PIPELINE_A, VERTICES_A, i));
+    for (u32 i = 5; i < 8; ++i)
+        draws.push_back(make_draw(PIPELINE_B, VERTICES_A, i));
+
+    std::vector<IndirectBatch> batches;
+    vulkan_indirect_build_batches(draws.data(), (u32)draws.size(), &batches);
+    CHECK_EQ(batches.size(), 2u);
+
+    // the second batch has nothing visible
+    const u8 visible[] = {0, 1, 0, 1, 1, 0, 0, 0};
+
+    // stale contents from an earlier frame
+    std::vector<VkDrawIndexedIndirectCommand> commands(draws.size(), {7, 7, 7, 7, 7});
+    std::vector<u32> counts(batches.size(), 99);
+
+    const u32 written = vulkan_indirect_build_commands(draws.data(), visible, batches.data(),
+        (u32)batches.size(), commands.data(), counts.data());
+
+    CHECK_EQ(written, 3u);
+    CHECK_EQ(counts[0], 3u);
+    CHECK_EQ(counts[1], 0u);
+
+    // visible draws in list order at the front of their batch
+    const u32 visible_draws[] = {1, 3, 4};
+    for (u32 i = 0; i < 3; ++i) {
+        const instanced_draw& draw = draws[visible_draws[i]];
+        CHECK_EQ(commands[i].indexCount, draw.index_count);
+        CHECK_EQ(commands[i].instanceCount, draw.instance_count);
+        CHECK_EQ(commands[i].firstIndex, draw.first_index);
+        CHECK_EQ(commands[i].vertexOffset, draw.vertex_offset);
+        CHECK_EQ(commands[i].firstInstance, draw.first_instance);
+    }
+
+    // a call that ignores the count reads harmless commands past it
+    for (u32 i = 3; i < commands.size(); ++i)
+        CHECK(is_zero(commands[i]));
+
+    // without flags every draw is written
+    const u32 written_all = vulkan_indirect_build_commands(draws.data(), NULL, batches.data(),
+        (u32)batches.size(), commands.data(), counts.data());
+    CHECK_EQ(written_all, (u32)draws.size());
+    CHECK_EQ(counts[0], 5u);
+    CHECK_EQ(counts[1], 3u);
+    for (u32 i = 0; i < draws.size(); ++i)
+        CHECK_EQ(commands[i].firstInstance, draws[i].first_instance);
+}
+
+PKO_BENCHMARK(indirect_build_commands_100k)
+{
+    const u32 draw_count = 100000;
+    std::vector<instanced_draw> draws;
+    std::vector<u8> visible(draw_count);
+    for (u32 i = 0; i < draw_count; ++i) {
+        // runs of 64 draws per pipeline
+        draws.push_back(make_draw((i / 64) % 2 ? PIPELINE_B : PIPELINE_A, VERTICES_A, i));
+        visible[i] = (i * 2654435761u >> 16) % 2;
+    }
+
+    std::vector<IndirectBatch> batches;
+    BenchTimer batch_timer;
+    vulkan_indirect_build_batches(draws.data(), draw_count, &batches);
+    const f64 batch_ms = batch_timer.elapsed_ms();
+
+    std::vector<VkDrawIndexedIndirectCommand> commands(draw_count);
+    std::vector<u32> counts(batches.size());
+
+    const u32 iterations = 50;
+    u32 written = 0;
+    BenchTimer build_timer;
+    for (u32 i = 0; i < iterations; ++i) {
+        written = vulkan_indirect_build_commands(draws.data(), visible.data(), batches.data(),
+            (u32)batches.size(), commands.data(), counts.data());
+    }
+    const f64 build_ms = build_timer.elapsed_ms() / iterations;
+
+    printf("  %u draws in %u batches: batches %.3f ms, commands %.3f ms (%u visible)\n",
+        draw_count, (u32)batches.size(), batch_ms, build_ms, written);
+    CHECK_EQ(batches.size(), (size_t)((draw_count + 63) / 64));
+}
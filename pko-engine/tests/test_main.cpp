@@ -0,0 +1,57 @@
+#include "test.h"
+
+#include <cstring>
+#include <vector>
+
+static std::vector<TestCase>& test_cases()
+{
+    static std::vector<TestCase> cases;
+    return cases;
+}
+
+static u32 failure_count = 0;
+
+void test_register(const char* name, TestFn fn, b8 benchmark)
+{
+    test_cases().push_back({name, fn, benchmark});
+}
+
+void test_report_failure(const char* file, int line, const char* expression)
+{
+    printf("  %s(%d): CHECK(%s) failed\n", file, line, expression);
+    ++failure_count;
+}
+
+// pko-engine-tests [--bench] [name filter]
+int main(int argc, char** argv)
+{
+    b8 run_benchmarks = false;
+    const char* filter = NULL;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--bench") == 0)
+            run_benchmarks = true;
+        else
+            filter = argv[i];
+    }
+
+    u32 run_count = 0;
+    u32 failed_tests = 0;
+    for (const TestCase& test : test_cases()) {
+        if (test.benchmark && !run_benchmarks)
+            continue;
+        if (filter && !strstr(test.name, filter))
+            continue;
+
+        printf("[ run  ] %s\n", test.name);
+        const u32 failures_before = failure_count;
+        test.fn();
+        ++run_count;
+
+        const b8 passed = failure_count == failures_before;
+        failed_tests += passed ? 0 : 1;
+        printf("[ %s ] %s\n", passed ? " ok " : "FAIL", test.name);
+    }
+
+    printf("%u of %u passed\n", run_count - failed_tests, run_count);
+    return failed_tests == 0 ? 0 : 1;
+}
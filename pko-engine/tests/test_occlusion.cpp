@@ -0,0 +1,188 @@
+#include "test.h"
+
+#include <vector>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "core/renderer/occlusion.h"
+
+// two tiles side by side. with an identity view projection clip space is the input, pixel
+// coordinates below are turned into it so the goldens read in pixels
+static const u32 WIDTH = 16;
+static const u32 HEIGHT = 8;
+static const glm::mat4 IDENTITY = glm::mat4(1.0f);
+
+static glm::vec3 pixel_point(f32 x, f32 y, f32 depth)
+{
+    return glm::vec3(x / WIDTH * 2.0f - 1.0f, y / HEIGHT * 2.0f - 1.0f, depth);
+}
+
+// a box over the pixel rectangle at one depth
+static void pixel_box(f32 x0, f32 y0, f32 x1, f32 y1, f32 depth, glm::vec3* out_min,
+    glm::vec3* out_max)
+{
+    *out_min = pixel_point(x0, y0, depth);
+    *out_max = pixel_point(x1, y1, depth);
+}
+
+// a and b overlap at row 0 column 7, where the nearer a wins
+static const char* TWO_TRIANGLES_GOLDEN[HEIGHT] = {
+    "aaaaaaaabbbbbbbb",
+    "aaaaaaa.bbbbbbbb",
+    "aaaaaa...bbbbbbb",
+    "aaaaa.....bbbbbb",
+    "aaaa.......bbbbb",
+    "aaa.........bbbb",
+    "aa...........bbb",
+    "a.............bb",
+};
+
+PKO_TEST(occlusion_rasterizes_golden_triangles)
+{
+    OcclusionBuffer buffer;
+    occlusion_buffer_create(&buffer, WIDTH, HEIGHT);
+    CHECK_EQ(buffer.tiles_x, 2u);
+    CHECK_EQ(buffer.tiles_y, 1u);
+
+    // edges kept off the pixel centers, the golden does not depend on the fill rule
+    const glm::vec3 triangles[] = {
+        // a, flat at 0.3, covers the centers with column + row <= 7
+        pixel_point(0.0f, 0.0f, 0.3f), pixel_point(8.2f, 0.0f, 0.3f),
+        pixel_point(0.0f, 8.2f, 0.3f),
+        // b, depth 0.5 + 0.04 * (x - 6.1), covers the centers with column >= row + 7. wound
+        // the other way, both orders rasterize
+        pixel_point(6.1f, -0.1f, 0.5f), pixel_point(16.1f, 9.9f, 0.9f),
+        pixel_point(16.1f, -0.1f, 0.9f),
+    };
+    occlusion_buffer_render(&buffer, IDENTITY, triangles, 2, NULL);
+    CHECK_EQ(buffer.rasterized_triangles, 2u);
+
+    for (u32 row = 0; row < HEIGHT; ++row) {
+        for (u32 column = 0; column < WIDTH; ++column) {
+            const f32 depth = buffer.depth[row * WIDTH + column];
+            switch (TWO_TRIANGLES_GOLDEN[row][column]) {
+            case 'a':
+                CHECK_NEAR(depth, 0.3, 1e-5);
+                break;
+            case 'b':
+                CHECK_NEAR(depth, 0.5 + 0.04 * (column + 0.5 - 6.1), 1e-5);
+                break;
+            default:
+                CHECK_EQ(depth, 1.0f);
+            }
+        }
+    }
+
+    // both tiles have empty pixels
+    CHECK_EQ(buffer.tile_max[0], 1.0f);
+    CHECK_EQ(buffer.tile_max[1], 1.0f);
+
+    // a second render clears what the first left
+    occlusion_buffer_render(&buffer, IDENTITY, triangles + 3, 1, NULL);
+    CHECK_EQ(buffer.depth[0], 1.0f);
+    CHECK_NEAR(buffer.depth[15], 0.5 + 0.04 * (15.5 - 6.1), 1e-5);
+}
+
+PKO_TEST(occlusion_drops_triangles_crossing_the_near_plane)
+{
+    OcclusionBuffer buffer;
+    occlusion_buffer_create(&buffer, WIDTH, HEIGHT);
+
+    // with w 1 the near plane is z -1
+    const glm::vec3 triangles[] = {
+        pixel_point(0.0f, 0.0f, -1.5f), pixel_point(16.0f, 0.0f, 0.2f),
+        pixel_point(0.0f, 8.0f, 0.2f),
+        pixel_point(0.0f, 0.0f, 0.5f), pixel_point(0.0f, 0.0f, 0.5f),
+        pixel_point(8.0f, 8.0f, 0.5f),
+    };
+    occlusion_buffer_render(&buffer, IDENTITY, triangles, 2, NULL);
+    // one crosses the plane, the other has no area
+    CHECK_EQ(buffer.rasterized_triangles, 0u);
+    for (f32 depth : buffer.depth)
+        CHECK_EQ(depth, 1.0f);
+
+    // behind the camera of a perspective, w is negative for every vertex
+    const glm::mat4 view_projection =
+        glm::perspective(glm::radians(60.0f), 2.0f, 0.1f, 100.0f) *
+        glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    const glm::vec3 behind[] = {
+        glm::vec3(-1.0f, -1.0f, 5.0f), glm::vec3(1.0f, -1.0f, 5.0f), glm::vec3(0.0f, 1.0f, 5.0f),
+    };
+    occlusion_buffer_render(&buffer, view_projection, behind, 1, NULL);
+    CHECK_EQ(buffer.rasterized_triangles, 0u);
+
+    const glm::vec3 in_front[] = {
+        glm::vec3(-1.0f, -1.0f, -5.0f), glm::vec3(1.0f, -1.0f, -5.0f), glm::vec3(0.0f, 1.0f, -5.0f),
+    };
+    occlusion_buffer_render(&buffer, view_projection, in_front, 1, NULL);
+    CHECK_EQ(buffer.rasterized_triangles, 1u);
+}
+
+PKO_TEST(occlusion_tile_max_is_conservative)
+{
+    OcclusionBuffer buffer;
+    occlusion_buffer_create(&buffer, WIDTH, HEIGHT);
+
+    // the whole screen at depth 0.1 + 0.05 * x
+    const glm::vec3 quad[] = {
+        pixel_point(-1.0f, -1.0f, 0.05f), pixel_point(17.0f, -1.0f, 0.95f),
+        pixel_point(17.0f, 9.0f, 0.95f),
+        pixel_point(-1.0f, -1.0f, 0.05f), pixel_point(17.0f, 9.0f, 0.95f),
+        pixel_point(-1.0f, 9.0f, 0.05f),
+    };
+    occlusion_buffer_render(&buffer, IDENTITY, quad, 2, NULL);
+
+    for (u32 tile = 0; tile < 2; ++tile) {
+        f32 farthest = 0.0f;
+        for (u32 row = 0; row < HEIGHT; ++row) {
+            for (u32 column = tile * 8; column < tile * 8 + 8; ++column) {
+                const f32 depth = buffer.depth[row * WIDTH + column];
+                CHECK_NEAR(depth, 0.1 + 0.05 * (column + 0.5), 1e-5);
+                // never below a pixel of the tile
+                CHECK(buffer.tile_max[tile] >= depth);
+                farthest = depth > farthest ? depth : farthest;
+            }
+        }
+        CHECK_EQ(buffer.tile_max[tile], farthest);
+    }
+    CHECK_NEAR(buffer.tile_max[0], 0.475, 1e-5);
+    CHECK_NEAR(buffer.tile_max[1], 0.875, 1e-5);
+
+    glm::vec3 min, max;
+
+    // behind the farthest of the first tile, the tile answers alone
+    pixel_box(0.1f, 0.1f, 7.9f, 7.9f, 0.5f, &min, &max);
+    CHECK(!occlusion_test_aabb(buffer, IDENTITY, min, max));
+
+    // in front of the tile max but behind every pixel under it, the pixels decide
+    pixel_box(0.1f, 0.1f, 3.9f, 7.9f, 0.45f, &min, &max);
+    CHECK(!occlusion_test_aabb(buffer, IDENTITY, min, max));
+
+    // column 7 is at 0.475, behind the box
+    pixel_box(6.1f, 0.1f, 7.9f, 7.9f, 0.45f, &min, &max);
+    CHECK(occlusion_test_aabb(buffer, IDENTITY, min, max));
+
+    // spanning both tiles, the second is farther than the box
+    pixel_box(6.1f, 0.1f, 9.9f, 7.9f, 0.5f, &min, &max);
+    CHECK(occlusion_test_aabb(buffer, IDENTITY, min, max));
+
+    // crossing the near plane is always visible, however deep the occluders
+    min = pixel_point(2.0f, 2.0f, -2.0f);
+    max = pixel_point(4.0f, 4.0f, 0.9f);
+    CHECK(occlusion_test_aabb(buffer, IDENTITY, min, max));
+
+    // off screen is for the frustum test
+    pixel_box(20.0f, 0.1f, 24.0f, 7.9f, 0.9f, &min, &max);
+    CHECK(occlusion_test_aabb(buffer, IDENTITY, min, max));
+
+    // occlusion_cull_aabbs clears only the occluded of the visible ones
+    glm::vec3 mins[3], maxs[3];
+    pixel_box(0.1f, 0.1f, 7.9f, 7.9f, 0.5f, &mins[0], &maxs[0]);
+    pixel_box(6.1f, 0.1f, 7.9f, 7.9f, 0.45f, &mins[1], &maxs[1]);
+    pixel_box(0.1f, 0.1f, 3.9f, 7.9f, 0.45f, &mins[2], &maxs[2]);
+    u8 visible[3] = {1, 1, 0};
+    CHECK_EQ(occlusion_cull_aabbs(buffer, IDENTITY, mins, maxs, 3, visible, NULL), 1u);
+    CHECK_EQ(visible[0], 0);
+    CHECK_EQ(visible[1], 1);
+    CHECK_EQ(visible[2], 0);
+}
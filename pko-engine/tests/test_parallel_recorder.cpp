@@ -0,0 +1,352 @@
+#include "test.h"
+
+#include <vector>
+
+#include "core/job_system.h"
+#include "core/renderer/vulkan_renderer/vulkan_command_buffer.h"
+#include "core/renderer/vulkan_renderer/vulkan_mesh.h"
+#include "core/renderer/vulkan_renderer/vulkan_parallel_recorder.h"
+#include "core/renderer/vulkan_renderer/vulkan_pipeline.h"
+
+// recorded commands of a fake command buffer, an opcode followed by its arguments
+enum FakeOp : u64 {
+    FAKE_OP_BIND_PIPELINE = 1,
+    FAKE_OP_BIND_VERTEX_BUFFERS,
+    FAKE_OP_BIND_INDEX_BUFFER,
+    FAKE_OP_BIND_DESCRIPTOR_SETS,
+    FAKE_OP_SET_VIEWPORT,
+    FAKE_OP_SET_SCISSOR,
+    FAKE_OP_DRAW_INDEXED,
+    FAKE_OP_EXECUTE_COMMANDS,
+};
+
+struct FakeCommandBuffer {
+    std::vector<u64> stream;
+};
+
+// one buffer per pool, the recorder never allocates more
+struct FakeCommandPool {
+    FakeCommandBuffer buffer;
+};
+
+static FakeCommandBuffer* fake(VkCommandBuffer buffer)
+{
+    return (FakeCommandBuffer*)buffer;
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL fake_create_command_pool(VkDevice,
+    const VkCommandPoolCreateInfo*, const VkAllocationCallbacks*, VkCommandPool* out_pool)
+{
+    *out_pool = (VkCommandPool) new FakeCommandPool();
+    return VK_SUCCESS;
+}
+
+static VKAPI_ATTR void VKAPI_CALL fake_destroy_command_pool(VkDevice, VkCommandPool pool,
+    const VkAllocationCallbacks*)
+{
+    delete (FakeCommandPool*)pool;
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL fake_allocate_command_buffers(VkDevice,
+    const VkCommandBufferAllocateInfo* info, VkCommandBuffer* out_buffers)
+{
+    *out_buffers = (VkCommandBuffer) & ((FakeCommandPool*)info->commandPool)->buffer;
+    return VK_SUCCESS;
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL fake_reset_command_buffer(VkCommandBuffer buffer,
+    VkCommandBufferResetFlags)
+{
+    fake(buffer)->stream.clear();
+    return VK_SUCCESS;
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL fake_begin_command_buffer(VkCommandBuffer,
+    const VkCommandBufferBeginInfo*)
+{
+    return VK_SUCCESS;
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL fake_end_command_buffer(VkCommandBuffer)
+{
+    return VK_SUCCESS;
+}
+
+static VKAPI_ATTR void VKAPI_CALL fake_cmd_bind_pipeline(VkCommandBuffer buffer,
+    VkPipelineBindPoint, VkPipeline pipeline)
+{
+    fake(buffer)->stream.insert(fake(buffer)->stream.end(),
+        {FAKE_OP_BIND_PIPELINE, (u64)pipeline});
+}
+
+static VKAPI_ATTR void VKAPI_CALL fake_cmd_bind_vertex_buffers(VkCommandBuffer buffer,
+    u32 first_binding, u32 count, const VkBuffer* buffers, const VkDeviceSize* offsets)
+{
+    std::vector<u64>& stream = fake(buffer)->stream;
+    stream.insert(stream.end(), {FAKE_OP_BIND_VERTEX_BUFFERS, first_binding, count});
+    for (u32 i = 0; i < count; ++i)
+        stream.insert(stream.end(), {(u64)buffers[i], offsets[i]});
+}
+
+static VKAPI_ATTR void VKAPI_CALL fake_cmd_bind_index_buffer(VkCommandBuffer buffer,
+    VkBuffer index_buffer, VkDeviceSize offset, VkIndexType index_type)
+{
+    fake(buffer)->stream.insert(fake(buffer)->stream.end(),
+        {FAKE_OP_BIND_INDEX_BUFFER, (u64)index_buffer, offset, (u64)index_type});
+}
+
+static VKAPI_ATTR void VKAPI_CALL fake_cmd_bind_descriptor_sets(VkCommandBuffer buffer,
+    VkPipelineBindPoint, VkPipelineLayout layout, u32 first_set, u32 set_count,
+    const VkDescriptorSet* sets, u32 dynamic_offset_count, const u32* dynamic_offsets)
+{
+    std::vector<u64>& stream = fake(buffer)->stream;
+    stream.insert(stream.end(), {FAKE_OP_BIND_DESCRIPTOR_SETS, (u64)layout, first_set});
+    for (u32 i = 0; i < set_count; ++i)
+        stream.push_back((u64)sets[i]);
+    for (u32 i = 0; i < dynamic_offset_count; ++i)
+        stream.push_back(dynamic_offsets[i]);
+}
+
+static VKAPI_ATTR void VKAPI_CALL fake_cmd_set_viewport(VkCommandBuffer buffer, u32, u32,
+    const VkViewport*)
+{
+    fake(buffer)->stream.push_back(FAKE_OP_SET_VIEWPORT);
+}
+
+static VKAPI_ATTR void VKAPI_CALL fake_cmd_set_scissor(VkCommandBuffer buffer, u32, u32,
+    const VkRect2D*)
+{
+    fake(buffer)->stream.push_back(FAKE_OP_SET_SCISSOR);
+}
+
+static VKAPI_ATTR void VKAPI_CALL fake_cmd_draw_indexed(VkCommandBuffer buffer, u32 index_count,
+    u32 instance_count, u32 first_index, i32 vertex_offset, u32 first_instance)
+{
+    fake(buffer)->stream.insert(fake(buffer)->stream.end(),
+        {FAKE_OP_DRAW_INDEXED, index_count, instance_count, first_index, (u64)vertex_offset,
+            first_instance});
+}
+
+static VKAPI_ATTR void VKAPI_CALL fake_cmd_execute_commands(VkCommandBuffer buffer, u32 count,
+    const VkCommandBuffer* buffers)
+{
+    std::vector<u64>& stream = fake(buffer)->stream;
+    stream.insert(stream.end(), {FAKE_OP_EXECUTE_COMMANDS, count});
+    for (u32 i = 0; i < count; ++i)
+        stream.push_back((u64)buffers[i]);
+}
+
+// the entry points are loaded from the device at runtime, here they record into memory
+static void use_fake_device()
+{
+    vkCreateCommandPool = fake_create_command_pool;
+    vkDestroyCommandPool = fake_destroy_command_pool;
+    vkAllocateCommandBuffers = fake_allocate_command_buffers;
+    vkResetCommandBuffer = fake_reset_command_buffer;
+    vkBeginCommandBuffer = fake_begin_command_buffer;
+    vkEndCommandBuffer = fake_end_command_buffer;
+    vkCmdBindPipeline = fake_cmd_bind_pipeline;
+    vkCmdBindVertexBuffers = fake_cmd_bind_vertex_buffers;
+    vkCmdBindIndexBuffer = fake_cmd_bind_index_buffer;
+    vkCmdBindDescriptorSets = fake_cmd_bind_descriptor_sets;
+    vkCmdSetViewport = fake_cmd_set_viewport;
+    vkCmdSetScissor = fake_cmd_set_scissor;
+    vkCmdDrawIndexed = fake_cmd_draw_indexed;
+    vkCmdExecuteCommands = fake_cmd_execute_commands;
+}
+
+// what the scene pass of the renderer records, state is bound again in every secondary
+struct SceneRecording {
+    const RenderDesc* desc;
+    Pipeline* pipeline;
+    VkDescriptorSet set;
+    VkBuffer instance_buffer;
+    const instanced_draw* draws;
+};
+
+static void record_scene_draws(Command* command, u32 first, u32 count, void* user_data)
+{
+    const SceneRecording* scene = (const SceneRecording*)user_data;
+
+    vulkan_pipeline_bind(command, VK_PIPELINE_BIND_POINT_GRAPHICS, scene->pipeline);
+
+    const VkRect2D& area = scene->desc->render_area;
+    VkViewport viewport{0.0f, 0.0f, (f32)area.extent.width, (f32)area.extent.height, 0.0f, 1.0f};
+    vkCmdSetViewport(command->buffer, 0, 1, &viewport);
+    vkCmdSetScissor(command->buffer, 0, 1, &area);
+
+    const u32 dynamic_offsets[2] = {0, 256};
+    vkCmdBindDescriptorSets(command->buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+        scene->pipeline->layout, 0, 1, &scene->set, 2, dynamic_offsets);
+
+    vulkan_instanced_draws_record(command, scene->pipeline, scene->instance_buffer,
+        scene->draws + first, count, false);
+}
+
+// a grouped draw list, a few pipelines over many meshes in a handful of buffers
+static std::vector<instanced_draw> make_draw_list(Pipeline* pipelines, u32 pipeline_count,
+    u32 count)
+{
+    std::vector<instanced_draw> draws(count);
+    for (u32 i = 0; i < count; ++i) {
+        instanced_draw& draw = draws[i];
+        draw = {};
+        draw.pipeline = &pipelines[i * pipeline_count / count];
+        draw.vertex_buffer = (VkBuffer)(u64)(0x1000 + (i / 512));
+        draw.position_buffer = draw.vertex_buffer;
+        draw.index_buffer = (VkBuffer)(u64)(0x2000 + (i / 2048));
+        draw.first_index = (i % 512) * 36;
+        draw.vertex_offset = (i32)(i % 512) * 24;
+        draw.index_count = 36;
+        draw.first_instance = i * 2;
+        draw.instance_count = 1 + i % 3;
+    }
+    return draws;
+}
+
+// the draw calls reaching the primary, following the executed secondaries in order
+static std::vector<u64> executed_draws(const Command* primary)
+{
+    std::vector<u64> out;
+
+    const std::vector<u64>& stream = fake(primary->buffer)->stream;
+    CHECK(stream.size() >= 2 && stream[0] == FAKE_OP_EXECUTE_COMMANDS);
+    if (stream.size() < 2)
+        return out;
+
+    const u64 count = stream[1];
+    for (u64 i = 0; i < count; ++i) {
+        const std::vector<u64>& slice = fake((VkCommandBuffer)stream[2 + i])->stream;
+        for (size_t at = 0; at < slice.size(); ++at) {
+            if (slice[at] == FAKE_OP_DRAW_INDEXED) {
+                out.insert(out.end(), slice.begin() + at + 1, slice.begin() + at + 6);
+                at += 5;
+            }
+        }
+    }
+    return out;
+}
+
+struct RecorderFixture {
+    JobSystem jobs;
+    RenderContext context{};
+    Command primary{};
+    RenderTarget color{};
+    RenderTarget* color_targets[1] = {&color};
+    RenderDesc desc{};
+    Pipeline pipelines[4]{};
+
+    explicit RecorderFixture(u32 thread_count)
+    {
+        use_fake_device();
+        jobs.init(thread_count);
+
+        for (u32 i = 0; i < 4; ++i) {
+            pipelines[i].handle = (VkPipeline)(u64)(0x100 + i);
+            pipelines[i].layout = (VkPipelineLayout)(u64)0x200;
+        }
+
+        color.vulkan_format = VK_FORMAT_B8G8R8A8_UNORM;
+        color.sample_count = VK_SAMPLE_COUNT_1_BIT;
+        desc.render_targets = color_targets;
+        desc.render_target_count = 1;
+        desc.render_area = {{0, 0}, {1280, 720}};
+        desc.secondary_contents = true;
+
+        vulkan_command_pool_create(&context, &primary, QUEUE_TYPE_GRAPHICS);
+        vulkan_command_buffer_allocate(&context, &primary, true);
+        // only the secondaries go through rendering, the primary just executes them
+        primary.is_rendering = true;
+    }
+
+    ~RecorderFixture()
+    {
+        primary.is_rendering = false;
+        vulkan_command_pool_destroy(&context, &primary);
+        jobs.shutdown();
+    }
+
+    void record(ParallelRecorder* recorder, SceneRecording* scene, u32 count)
+    {
+        fake(primary.buffer)->stream.clear();
+        vulkan_parallel_recorder_record(&context, recorder, &primary, &desc, count, 1,
+            record_scene_draws, scene);
+    }
+};
+
+PKO_TEST(parallel_recorder_keeps_draw_order_for_every_slice_count)
+{
+    // more slices than cores still interleave on the workers
+    RecorderFixture fixture(4);
+    const std::vector<instanced_draw> draws = make_draw_list(fixture.pipelines, 4, 5000);
+    SceneRecording scene{&fixture.desc, &fixture.pipelines[0], (VkDescriptorSet)(u64)0x300,
+        (VkBuffer)(u64)0x400, draws.data()};
+
+    std::vector<u64> expected;
+    for (const instanced_draw& draw : draws) {
+        expected.insert(expected.end(), {draw.index_count, draw.instance_count, draw.first_index,
+            (u64)draw.vertex_offset, draw.first_instance});
+    }
+
+    ParallelRecorder recorder{};
+    vulkan_parallel_recorder_create(&fixture.context, &recorder, &fixture.jobs);
+
+    for (u32 slices = 1; slices <= recorder.slice_count; ++slices) {
+        vulkan_parallel_recorder_set_max_slices(&recorder, slices);
+        fixture.record(&recorder, &scene, (u32)draws.size());
+
+        CHECK_EQ(fake(fixture.primary.buffer)->stream[1], (u64)slices);
+        CHECK(executed_draws(&fixture.primary) == expected);
+    }
+
+    // every slice starts without state, it binds the pipeline of its first draw itself
+    vulkan_parallel_recorder_set_max_slices(&recorder, recorder.slice_count);
+    fixture.record(&recorder, &scene, (u32)draws.size());
+    const std::vector<u64>& primary_stream = fake(fixture.primary.buffer)->stream;
+    for (u64 i = 0; i < primary_stream[1]; ++i) {
+        const std::vector<u64>& slice = fake((VkCommandBuffer)primary_stream[2 + i])->stream;
+        CHECK(slice.size() >= 2 && slice[0] == FAKE_OP_BIND_PIPELINE);
+    }
+
+    // an empty list executes nothing
+    fixture.record(&recorder, &scene, 0);
+    CHECK(fake(fixture.primary.buffer)->stream.empty());
+
+    vulkan_parallel_recorder_destroy(&fixture.context, &recorder);
+}
+
+PKO_BENCHMARK(parallel_recorder_thread_scaling)
+{
+    const u32 DRAW_COUNT = 20000;
+    const u32 RUNS = 50;
+
+    // one worker per core, the calling thread included
+    RecorderFixture fixture(0);
+    const std::vector<instanced_draw> draws = make_draw_list(fixture.pipelines, 4, DRAW_COUNT);
+    SceneRecording scene{&fixture.desc, &fixture.pipelines[0], (VkDescriptorSet)(u64)0x300,
+        (VkBuffer)(u64)0x400, draws.data()};
+
+    ParallelRecorder recorder{};
+    vulkan_parallel_recorder_create(&fixture.context, &recorder, &fixture.jobs);
+
+    // the stubs stand in for the driver, what scales here is the split and the job system
+    printf("  %u draws, commands recorded into memory, %u workers\n", DRAW_COUNT,
+        recorder.slice_count);
+
+    f64 single_ms = 0.0;
+    for (u32 slices = 1; slices <= recorder.slice_count; ++slices) {
+        vulkan_parallel_recorder_set_max_slices(&recorder, slices);
+        fixture.record(&recorder, &scene, DRAW_COUNT);
+
+        BenchTimer timer;
+        for (u32 run = 0; run < RUNS; ++run)
+            fixture.record(&recorder, &scene, DRAW_COUNT);
+        const f64 ms = timer.elapsed_ms() / RUNS;
+
+        if (slices == 1)
+            single_ms = ms;
+        printf("  %2u threads  %8.3f ms  %5.2fx\n", slices, ms, single_ms / ms);
+    }
+
+    vulkan_parallel_recorder_destroy(&fixture.context, &recorder);
+}
@@ -0,0 +1,248 @@
+#include "test.h"
+
+#include "core/renderer/vulkan_renderer/vulkan_render_graph.h"
+
+static void noop_pass(RenderContext*, RenderGraph*, Command*, void*) {}
+
+static RenderGraphResource create_target(RenderGraph* graph, const char* name, u32 size)
+{
+    RenderTargetDesc desc{};
+    desc.width = size;
+    desc.height = size;
+    desc.mip_levels = 1;
+    desc.sample_count = 1;
+    desc.vulkan_format = VK_FORMAT_R8G8B8A8_UNORM;
+    return vulkan_render_graph_create_rendertarget(graph, name, &desc);
+}
+
+static RenderGraphResource import_backbuffer(RenderGraph* graph)
+{
+    return vulkan_render_graph_import_rendertarget(graph, "backbuffer", RESOURCE_STATE_UNDEFINED,
+        RESOURCE_STATE_PRESENT);
+}
+
+// barriers recorded before the step of the pass, NULL when the pass was culled
+static const RenderGraphStep* find_step(const RenderGraph& graph, u32 pass)
+{
+    for (const RenderGraphStep& step : graph.steps) {
+        if (step.pass == pass)
+            return &step;
+    }
+    return NULL;
+}
+
+static const RenderGraphBarrier* find_barrier(const RenderGraph& graph,
+    const RenderGraphStep& step, RenderGraphResource resource)
+{
+    for (u32 i = step.first_barrier; i < step.first_barrier + step.barrier_count; ++i) {
+        if (graph.barriers[i].resource == resource)
+            return &graph.barriers[i];
+    }
+    return NULL;
+}
+
+PKO_TEST(render_graph_culls_unconsumed_passes)
+{
+    RenderGraph graph{};
+    RenderGraphResource unused = create_target(&graph, "unused", 64);
+    RenderGraphResource color = create_target(&graph, "color", 64);
+    RenderGraphResource temp = create_target(&graph, "temp", 64);
+    RenderGraphResource temp_out = create_target(&graph, "temp_out", 64);
+    RenderGraphResource backbuffer = import_backbuffer(&graph);
+
+    u32 write_unused = vulkan_render_graph_add_pass(&graph, "write_unused", noop_pass, NULL);
+    vulkan_render_graph_pass_write(&graph, write_unused, unused, RESOURCE_STATE_RENDER_TARGET);
+
+    u32 write_color = vulkan_render_graph_add_pass(&graph, "write_color", noop_pass, NULL);
+    vulkan_render_graph_pass_write(&graph, write_color, color, RESOURCE_STATE_RENDER_TARGET);
+
+    // a chain nothing consumes is culled as a whole
+    u32 write_temp = vulkan_render_graph_add_pass(&graph, "write_temp", noop_pass, NULL);
+    vulkan_render_graph_pass_write(&graph, write_temp, temp, RESOURCE_STATE_RENDER_TARGET);
+    u32 read_temp = vulkan_render_graph_add_pass(&graph, "read_temp", noop_pass, NULL);
+    vulkan_render_graph_pass_read(&graph, read_temp, temp, RESOURCE_STATE_SHADER_RESOURCE);
+    vulkan_render_graph_pass_write(&graph, read_temp, temp_out, RESOURCE_STATE_RENDER_TARGET);
+
+    u32 present = vulkan_render_graph_add_pass(&graph, "present", noop_pass, NULL);
+    vulkan_render_graph_pass_read(&graph, present, color, RESOURCE_STATE_SHADER_RESOURCE);
+    vulkan_render_graph_pass_write(&graph, present, backbuffer, RESOURCE_STATE_RENDER_TARGET);
+
+    u32 side_effect = vulkan_render_graph_add_pass(&graph, "side_effect", noop_pass, NULL);
+    vulkan_render_graph_pass_side_effect(&graph, side_effect);
+
+    CHECK(vulkan_render_graph_compile(&graph));
+
+    CHECK(graph.passes[write_unused].culled);
+    CHECK(!graph.passes[write_color].culled);
+    CHECK(graph.passes[write_temp].culled);
+    CHECK(graph.passes[read_temp].culled);
+    CHECK(!graph.passes[present].culled);
+    CHECK(!graph.passes[side_effect].culled);
+
+    CHECK_EQ(graph.steps.size(), 3u);
+    CHECK(find_step(graph, write_color) && find_step(graph, present) &&
+        find_step(graph, side_effect));
+
+    // culled passes give their resources no lifetime and no memory
+    CHECK(graph.resources[unused].alias_slot == ~0u);
+    CHECK(graph.resources[temp].alias_slot == ~0u);
+    CHECK(graph.resources[color].alias_slot != ~0u);
+}
+
+PKO_TEST(render_graph_rejects_read_before_write)
+{
+    RenderGraph graph{};
+    RenderGraphResource color = create_target(&graph, "color", 64);
+    RenderGraphResource backbuffer = import_backbuffer(&graph);
+
+    u32 read_first = vulkan_render_graph_add_pass(&graph, "read_first", noop_pass, NULL);
+    vulkan_render_graph_pass_read(&graph, read_first, color, RESOURCE_STATE_SHADER_RESOURCE);
+    vulkan_render_graph_pass_write(&graph, read_first, backbuffer, RESOURCE_STATE_RENDER_TARGET);
+
+    u32 write_later = vulkan_render_graph_add_pass(&graph, "write_later", noop_pass, NULL);
+    vulkan_render_graph_pass_write(&graph, write_later, color, RESOURCE_STATE_RENDER_TARGET);
+
+    CHECK(!vulkan_render_graph_compile(&graph));
+    CHECK(!graph.compiled);
+
+    // imported resources hold contents from outside the frame and may be read first
+    RenderGraph imported_graph{};
+    RenderGraphResource history = vulkan_render_graph_import_rendertarget(&imported_graph,
+        "history", RESOURCE_STATE_SHADER_RESOURCE, RESOURCE_STATE_SHADER_RESOURCE);
+    RenderGraphResource imported_backbuffer = import_backbuffer(&imported_graph);
+
+    u32 resolve = vulkan_render_graph_add_pass(&imported_graph, "resolve", noop_pass, NULL);
+    vulkan_render_graph_pass_read(&imported_graph, resolve, history,
+        RESOURCE_STATE_SHADER_RESOURCE);
+    vulkan_render_graph_pass_write(&imported_graph, resolve, imported_backbuffer,
+        RESOURCE_STATE_RENDER_TARGET);
+
+    CHECK(vulkan_render_graph_compile(&imported_graph));
+}
+
+PKO_TEST(render_graph_aliases_disjoint_lifetimes)
+{
+    // a -> b -> c -> backbuffer, a and c never live at the same time
+    RenderGraph graph{};
+    RenderGraphResource a = create_target(&graph, "a", 256);
+    RenderGraphResource b = create_target(&graph, "b", 256);
+    RenderGraphResource c = create_target(&graph, "c", 128);
+    RenderGraphResource backbuffer = import_backbuffer(&graph);
+
+    u32 pass_a = vulkan_render_graph_add_pass(&graph, "pass_a", noop_pass, NULL);
+    vulkan_render_graph_pass_write(&graph, pass_a, a, RESOURCE_STATE_RENDER_TARGET);
+
+    u32 pass_b = vulkan_render_graph_add_pass(&graph, "pass_b", noop_pass, NULL);
+    vulkan_render_graph_pass_read(&graph, pass_b, a, RESOURCE_STATE_SHADER_RESOURCE);
+    vulkan_render_graph_pass_write(&graph, pass_b, b, RESOURCE_STATE_RENDER_TARGET);
+
+    u32 pass_c = vulkan_render_graph_add_pass(&graph, "pass_c", noop_pass, NULL);
+    vulkan_render_graph_pass_read(&graph, pass_c, b, RESOURCE_STATE_SHADER_RESOURCE);
+    vulkan_render_graph_pass_write(&graph, pass_c, c, RESOURCE_STATE_RENDER_TARGET);
+
+    u32 present = vulkan_render_graph_add_pass(&graph, "present", noop_pass, NULL);
+    vulkan_render_graph_pass_read(&graph, present, c, RESOURCE_STATE_SHADER_RESOURCE);
+    vulkan_render_graph_pass_write(&graph, present, backbuffer, RESOURCE_STATE_RENDER_TARGET);
+
+    CHECK(vulkan_render_graph_compile(&graph));
+
+    CHECK_EQ(graph.resources[a].first_step, 0u);
+    CHECK_EQ(graph.resources[a].last_step, 1u);
+    CHECK_EQ(graph.resources[c].first_step, 2u);
+    CHECK_EQ(graph.resources[c].last_step, 3u);
+
+    CHECK_EQ(graph.alias_slots.size(), 2u);
+    CHECK_EQ(graph.resources[a].alias_slot, graph.resources[c].alias_slot);
+    CHECK(graph.resources[b].alias_slot != graph.resources[a].alias_slot);
+    CHECK(graph.resources[backbuffer].alias_slot == ~0u);
+
+    // the slot is as large as its largest member, members are ordered by first use
+    const RenderGraphAliasSlot& shared = graph.alias_slots[graph.resources[a].alias_slot];
+    CHECK_EQ(shared.estimated_size, graph.resources[a].estimated_size);
+    CHECK(graph.resources[c].estimated_size < graph.resources[a].estimated_size);
+    CHECK(shared.resources.size() == 2 && shared.resources[0] == a && shared.resources[1] == c);
+
+    // the first use of each member waits on the state the other one leaves the memory in
+    const RenderGraphBarrier* first_c = find_barrier(graph, *find_step(graph, pass_c), c);
+    CHECK(first_c && first_c->current_state == RESOURCE_STATE_UNDEFINED);
+    CHECK(first_c && first_c->alias_state == RESOURCE_STATE_SHADER_RESOURCE);
+
+    const RenderGraphBarrier* first_a = find_barrier(graph, *find_step(graph, pass_a), a);
+    CHECK(first_a && first_a->alias_state == RESOURCE_STATE_SHADER_RESOURCE);
+
+    // b is alone in its slot and aliases itself across frames
+    const RenderGraphBarrier* first_b = find_barrier(graph, *find_step(graph, pass_b), b);
+    CHECK(first_b && first_b->alias_state == RESOURCE_STATE_SHADER_RESOURCE);
+}
+
+PKO_TEST(render_graph_widens_reads_sharing_a_layout)
+{
+    RenderGraph graph{};
+    RenderGraphResource color = create_target(&graph, "color", 64);
+    RenderGraphResource backbuffer = import_backbuffer(&graph);
+
+    u32 write = vulkan_render_graph_add_pass(&graph, "write", noop_pass, NULL);
+    vulkan_render_graph_pass_write(&graph, write, color, RESOURCE_STATE_RENDER_TARGET);
+
+    u32 compute_read = vulkan_render_graph_add_pass(&graph, "compute_read", noop_pass, NULL);
+    vulkan_render_graph_pass_read(&graph, compute_read, color,
+        RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+    vulkan_render_graph_pass_write(&graph, compute_read, backbuffer,
+        RESOURCE_STATE_RENDER_TARGET);
+
+    u32 pixel_read = vulkan_render_graph_add_pass(&graph, "pixel_read", noop_pass, NULL);
+    vulkan_render_graph_pass_read(&graph, pixel_read, color, RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+    vulkan_render_graph_pass_write(&graph, pixel_read, backbuffer, RESOURCE_STATE_RENDER_TARGET);
+
+    CHECK(vulkan_render_graph_compile(&graph));
+    CHECK_EQ(graph.steps.size(), 3u);
+
+    // both reads are covered by the first transition
+    const RenderGraphBarrier* widened =
+        find_barrier(graph, *find_step(graph, compute_read), color);
+    CHECK(widened && widened->current_state == RESOURCE_STATE_RENDER_TARGET);
+    CHECK(widened && widened->new_state == RESOURCE_STATE_SHADER_RESOURCE);
+    CHECK(!find_barrier(graph, *find_step(graph, pixel_read), color));
+
+    // the same write state twice still orders the writes
+    const RenderGraphBarrier* write_after_write =
+        find_barrier(graph, *find_step(graph, pixel_read), backbuffer);
+    CHECK(write_after_write &&
+        write_after_write->current_state == RESOURCE_STATE_RENDER_TARGET &&
+        write_after_write->new_state == RESOURCE_STATE_RENDER_TARGET);
+
+    // the import leaves the frame in its final state
+    CHECK_EQ(graph.final_barrier_count, 1u);
+    const RenderGraphBarrier& final_barrier = graph.barriers[graph.final_barrier_offset];
+    CHECK_EQ(final_barrier.resource, backbuffer);
+    CHECK_EQ(final_barrier.new_state, RESOURCE_STATE_PRESENT);
+
+    // a write in between ends the widening
+    RenderGraph split_graph{};
+    RenderGraphResource target = create_target(&split_graph, "target", 64);
+    RenderGraphResource split_backbuffer = import_backbuffer(&split_graph);
+
+    u32 first_write = vulkan_render_graph_add_pass(&split_graph, "first_write", noop_pass, NULL);
+    vulkan_render_graph_pass_write(&split_graph, first_write, target,
+        RESOURCE_STATE_RENDER_TARGET);
+    u32 first_read = vulkan_render_graph_add_pass(&split_graph, "first_read", noop_pass, NULL);
+    vulkan_render_graph_pass_read(&split_graph, first_read, target,
+        RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+    vulkan_render_graph_pass_write(&split_graph, first_read, split_backbuffer,
+        RESOURCE_STATE_RENDER_TARGET);
+    u32 second_write = vulkan_render_graph_add_pass(&split_graph, "second_write", noop_pass,
+        NULL);
+    vulkan_render_graph_pass_write(&split_graph, second_write, target,
+        RESOURCE_STATE_RENDER_TARGET);
+    u32 second_read = vulkan_render_graph_add_pass(&split_graph, "second_read", noop_pass, NULL);
+    vulkan_render_graph_pass_read(&split_graph, second_read, target,
+        RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+    vulkan_render_graph_pass_write(&split_graph, second_read, split_backbuffer,
+        RESOURCE_STATE_RENDER_TARGET);
+
+    CHECK(vulkan_render_graph_compile(&split_graph));
+    const RenderGraphBarrier* narrow =
+        find_barrier(split_graph, *find_step(split_graph, first_read), target);
+    CHECK(narrow && narrow->new_state == RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+    CHECK(find_barrier(split_graph, *find_step(split_graph, second_read), target));
+}
@@ -0,0 +1,550 @@
+#include "test.h"
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "core/job_system.h"
+#include "core/renderer/culling.h"
+#include "core/renderer/render_world.h"
+
+static const u32 ALL_COMPONENTS = RENDER_COMPONENT_BIT(RENDER_COMPONENT_COUNT) - 1;
+static const u32 NO_MATERIAL = ALL_COMPONENTS & ~RENDER_COMPONENT_BIT(RENDER_COMPONENT_MATERIAL);
+
+// deterministic, every run spawns and destroys the same entities
+struct Random {
+    u32 state;
+
+    u32 next()
+    {
+        state = state * 1664525u + 1013904223u;
+        return state >> 8;
+    }
+
+    f32 next(f32 min, f32 max) { return min + (max - min) * (f32)next() / (f32)(1u << 24); }
+};
+
+// everything the records and the chunks must agree on, returns how many places do not
+static u32 count_broken_invariants(RenderWorld* world)
+{
+    u32 broken = 0;
+
+    // chunks full except the last, counts add up
+    u32 archetype_total = 0;
+    for (const RenderArchetype& archetype : world->archetypes) {
+        u32 rows = 0;
+        for (u32 c = 0; c < archetype.chunks.size(); ++c) {
+            const u32 count = archetype.chunks[c].count;
+            const b8 last = c + 1 == archetype.chunks.size();
+            if (count == 0 || (!last && count != RENDER_CHUNK_CAPACITY))
+                ++broken;
+            rows += count;
+        }
+        broken += rows != archetype.entity_count ? 1 : 0;
+        archetype_total += archetype.entity_count;
+    }
+    broken += archetype_total != world->entity_count ? 1 : 0;
+
+    // every live record points at a row holding its own handle
+    u32 alive = 0;
+    for (u32 index = 0; index < world->records.size(); ++index) {
+        const RenderEntityRecord& record = world->records[index];
+        if (!record.alive)
+            continue;
+        ++alive;
+
+        const RenderArchetype& archetype = world->archetypes[record.archetype];
+        if (record.chunk >= archetype.chunks.size() ||
+            record.row >= archetype.chunks[record.chunk].count) {
+            ++broken;
+            continue;
+        }
+
+        const Entity entity{index, record.generation};
+        u32 row;
+        const RenderChunkView view = render_world_view(world, entity, &row);
+        if (view.entities[row].index != index || view.entities[row].generation != record.generation)
+            ++broken;
+    }
+    broken += alive != world->entity_count ? 1 : 0;
+
+    // dead records are free exactly once
+    u32 dead = 0;
+    std::vector<u8> freed(world->records.size(), 0);
+    for (u32 index : world->free_indices) {
+        if (world->records[index].alive || freed[index])
+            ++broken;
+        freed[index] = 1;
+    }
+    for (const RenderEntityRecord& record : world->records)
+        dead += record.alive ? 0 : 1;
+    broken += dead != world->free_indices.size() ? 1 : 0;
+
+    return broken;
+}
+
+// a mesh reference unique to the entity, follows it through every move
+static MeshRef mesh_of(Entity entity)
+{
+    return {entity.index * 7 + 1, entity.generation + 3};
+}
+
+static void set_values(RenderWorld* world, Entity entity, Random* random)
+{
+    u32 row;
+    const RenderChunkView view = render_world_view(world, entity, &row);
+    view.transforms[row] = glm::translate(glm::mat4(1.0f),
+        glm::vec3((f32)entity.index, (f32)entity.generation, 1.0f));
+    view.min_x[row] = random->next(-60.0f, 60.0f);
+    view.min_y[row] = random->next(-60.0f, 60.0f);
+    view.min_z[row] = random->next(-20.0f, 120.0f);
+    view.max_x[row] = view.min_x[row] + random->next(0.1f, 8.0f);
+    view.max_y[row] = view.min_y[row] + random->next(0.1f, 8.0f);
+    view.max_z[row] = view.min_z[row] + random->next(0.1f, 8.0f);
+    view.meshes[row] = mesh_of(entity);
+    if (view.materials)
+        view.materials[row].texture = entity.index + 11;
+}
+
+static u32 count_value_mismatches(RenderWorld* world, const std::vector<Entity>& entities)
+{
+    u32 mismatches = 0;
+    for (Entity entity : entities) {
+        u32 row;
+        const RenderChunkView view = render_world_view(world, entity, &row);
+        const MeshRef expected = mesh_of(entity);
+        if (view.meshes[row].mesh != expected.mesh ||
+            view.meshes[row].instance != expected.instance)
+            ++mismatches;
+        if (view.transforms[row][3].x != (f32)entity.index)
+            ++mismatches;
+        if (view.materials && view.materials[row].texture != entity.index + 11)
+            ++mismatches;
+    }
+    return mismatches;
+}
+
+static Frustum test_frustum()
+{
+    const glm::mat4 projection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 100.0f);
+    const glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, -10.0f), glm::vec3(0.0f, 0.0f, 1.0f),
+        glm::vec3(0.0f, -1.0f, 0.0f));
+    Frustum frustum;
+    frustum_from_matrix(projection * view, &frustum);
+    return frustum;
+}
+
+// the farthest corner along every plane, the same sums render_world_cull does
+static b8 box_visible(const Frustum& frustum, const glm::vec3& min, const glm::vec3& max)
+{
+    for (const glm::vec4& plane : frustum.planes) {
+        const f32 x = plane.x >= 0.0f ? max.x : min.x;
+        const f32 y = plane.y >= 0.0f ? max.y : min.y;
+        const f32 z = plane.z >= 0.0f ? max.z : min.z;
+        if (plane.x * x + plane.y * y + plane.z * z + plane.w < 0.0f)
+            return false;
+    }
+    return true;
+}
+
+PKO_TEST(render_world_spawn_fills_chunks_in_order)
+{
+    RenderWorld world{};
+    Random random{3};
+
+    std::vector<Entity> entities;
+    for (u32 i = 0; i < RENDER_CHUNK_CAPACITY * 2 + 44; ++i) {
+        entities.push_back(render_world_create(&world, ALL_COMPONENTS));
+        set_values(&world, entities.back(), &random);
+    }
+
+    CHECK_EQ(world.archetypes.size(), (size_t)1);
+    const RenderArchetype& archetype = world.archetypes[0];
+    CHECK_EQ(archetype.chunks.size(), (size_t)3);
+    CHECK_EQ(archetype.chunks[2].count, 44u);
+    CHECK_EQ(world.entity_count, RENDER_CHUNK_CAPACITY * 2 + 44);
+
+    // rows in creation order, entity i in chunk i / 128
+    for (u32 i = 0; i < entities.size(); ++i) {
+        CHECK_EQ(entities[i].index, i);
+        CHECK_EQ(world.records[i].chunk, i / RENDER_CHUNK_CAPACITY);
+        CHECK_EQ(world.records[i].row, i % RENDER_CHUNK_CAPACITY);
+    }
+    CHECK_EQ(count_broken_invariants(&world), 0u);
+    CHECK_EQ(count_value_mismatches(&world, entities), 0u);
+
+    // columns start on a cache line
+    for (u32 c = 0; c < RENDER_CHUNK_COLUMNS; ++c)
+        CHECK_EQ(archetype.column_offsets[c] % 64, 0u);
+
+    // a fresh row has the documented defaults
+    const Entity fresh = render_world_create(&world, ALL_COMPONENTS);
+    u32 row;
+    const RenderChunkView view = render_world_view(&world, fresh, &row);
+    CHECK(view.transforms[row] == glm::mat4(1.0f));
+    CHECK_EQ(view.min_x[row], 0.0f);
+    CHECK_EQ(view.max_z[row], 0.0f);
+    CHECK_EQ(view.meshes[row].mesh, 0u);
+    CHECK_EQ(view.materials[row].texture, 0u);
+    CHECK_EQ(view.visible[row], 1);
+
+    render_world_clear(&world);
+}
+
+PKO_TEST(render_world_destroy_swaps_back_and_remaps)
+{
+    RenderWorld world{};
+    Random random{5};
+
+    std::vector<Entity> entities;
+    for (u32 i = 0; i < RENDER_CHUNK_CAPACITY * 3; ++i) {
+        entities.push_back(render_world_create(&world, ALL_COMPONENTS));
+        set_values(&world, entities.back(), &random);
+    }
+
+    // a hole in the first chunk takes the last entity of the archetype
+    const Entity last = entities.back();
+    render_world_destroy(&world, entities[5]);
+    CHECK(!render_world_alive(&world, entities[5]));
+    CHECK_EQ(world.records[last.index].chunk, 0u);
+    CHECK_EQ(world.records[last.index].row, 5u);
+    CHECK_EQ(world.archetypes[0].chunks[2].count, RENDER_CHUNK_CAPACITY - 1);
+    entities.erase(entities.begin() + 5);
+    CHECK_EQ(count_broken_invariants(&world), 0u);
+    CHECK_EQ(count_value_mismatches(&world, entities), 0u);
+
+    // the last row itself leaves nothing to move
+    u32 row;
+    const RenderChunkView last_view = render_world_view(&world, entities[300], &row);
+    const Entity last_row = last_view.entities[last_view.count - 1];
+    const Entity before_last_row = last_view.entities[last_view.count - 2];
+    render_world_destroy(&world, last_row);
+    entities.erase(std::find_if(entities.begin(), entities.end(),
+        [&](Entity entity) { return entity.index == last_row.index; }));
+    CHECK_EQ(world.records[before_last_row.index].row, RENDER_CHUNK_CAPACITY - 3);
+    CHECK_EQ(count_broken_invariants(&world), 0u);
+
+    // random order down to a few, chunks emptied at the end are freed
+    while (entities.size() > 100) {
+        const u32 i = random.next() % (u32)entities.size();
+        render_world_destroy(&world, entities[i]);
+        entities[i] = entities.back();
+        entities.pop_back();
+        if (entities.size() % 37 == 0)
+            CHECK_EQ(count_broken_invariants(&world), 0u);
+    }
+    CHECK_EQ(world.archetypes[0].chunks.size(), (size_t)1);
+    CHECK_EQ(world.archetypes[0].chunks[0].count, 100u);
+    CHECK_EQ(count_broken_invariants(&world), 0u);
+    CHECK_EQ(count_value_mismatches(&world, entities), 0u);
+
+    for (Entity entity : entities)
+        render_world_destroy(&world, entity);
+    CHECK_EQ(world.archetypes[0].chunks.size(), (size_t)0);
+    CHECK_EQ(world.archetypes[0].entity_count, 0u);
+    CHECK_EQ(world.entity_count, 0u);
+    CHECK_EQ(count_broken_invariants(&world), 0u);
+
+    render_world_clear(&world);
+}
+
+PKO_TEST(render_world_stale_handles_stay_dead)
+{
+    RenderWorld world{};
+
+    const Entity a = render_world_create(&world, ALL_COMPONENTS);
+    const Entity b = render_world_create(&world, ALL_COMPONENTS);
+    const Entity c = render_world_create(&world, ALL_COMPONENTS);
+    render_world_destroy(&world, a);
+    render_world_destroy(&world, c);
+
+    // indices come back last freed first, with the next generation
+    const Entity reused_c = render_world_create(&world, ALL_COMPONENTS);
+    const Entity reused_a = render_world_create(&world, ALL_COMPONENTS);
+    CHECK_EQ(reused_c.index, c.index);
+    CHECK_EQ(reused_c.generation, c.generation + 1);
+    CHECK_EQ(reused_a.index, a.index);
+    CHECK_EQ(reused_a.generation, a.generation + 1);
+    CHECK_EQ(world.records.size(), (size_t)3);
+
+    CHECK(!render_world_alive(&world, a));
+    CHECK(!render_world_alive(&world, c));
+    CHECK(render_world_alive(&world, b));
+    CHECK(render_world_alive(&world, reused_a));
+    CHECK(render_world_alive(&world, reused_c));
+
+    // a handle that was never handed out
+    CHECK(!render_world_alive(&world, Entity{3, 0}));
+
+    render_world_destroy(&world, reused_a);
+    const Entity again = render_world_create(&world, ALL_COMPONENTS);
+    CHECK_EQ(again.generation, a.generation + 2);
+    CHECK(!render_world_alive(&world, reused_a));
+    CHECK_EQ(count_broken_invariants(&world), 0u);
+
+    render_world_clear(&world);
+}
+
+PKO_TEST(render_world_migration_keeps_shared_components)
+{
+    RenderWorld world{};
+    Random random{7};
+
+    std::vector<Entity> entities;
+    for (u32 i = 0; i < RENDER_CHUNK_CAPACITY + 30; ++i) {
+        entities.push_back(render_world_create(&world, ALL_COMPONENTS));
+        set_values(&world, entities.back(), &random);
+    }
+
+    // every third entity loses its material, the rest stays packed behind it
+    std::vector<Entity> moved, stayed;
+    for (u32 i = 0; i < entities.size(); ++i) {
+        if (i % 3 == 0) {
+            u32 row;
+            const RenderChunkView view = render_world_view(&world, entities[i], &row);
+            const f32 min_x = view.min_x[row];
+
+            render_world_set_components(&world, entities[i], NO_MATERIAL);
+            CHECK_EQ(render_world_components(&world, entities[i]), NO_MATERIAL);
+
+            const RenderChunkView moved_view = render_world_view(&world, entities[i], &row);
+            CHECK(moved_view.materials == NULL);
+            CHECK_EQ(moved_view.min_x[row], min_x);
+            moved.push_back(entities[i]);
+        } else {
+            stayed.push_back(entities[i]);
+        }
+    }
+
+    CHECK_EQ(world.archetypes.size(), (size_t)2);
+    CHECK_EQ(world.archetypes[0].entity_count, (u32)stayed.size());
+    CHECK_EQ(world.archetypes[1].entity_count, (u32)moved.size());
+    CHECK_EQ(world.entity_count, (u32)entities.size());
+    CHECK_EQ(count_broken_invariants(&world), 0u);
+    CHECK_EQ(count_value_mismatches(&world, stayed), 0u);
+    CHECK_EQ(count_value_mismatches(&world, moved), 0u);
+
+    // the same mask is no move at all
+    const RenderEntityRecord before = world.records[moved[0].index];
+    render_world_set_components(&world, moved[0], NO_MATERIAL);
+    CHECK_EQ(world.records[moved[0].index].chunk, before.chunk);
+    CHECK_EQ(world.records[moved[0].index].row, before.row);
+
+    // back again, the material starts over at its default
+    for (Entity entity : moved) {
+        render_world_set_components(&world, entity, ALL_COMPONENTS);
+        u32 row;
+        const RenderChunkView view = render_world_view(&world, entity, &row);
+        CHECK_EQ(view.materials[row].texture, 0u);
+        view.materials[row].texture = entity.index + 11;
+    }
+    CHECK_EQ(world.archetypes[1].chunks.size(), (size_t)0);
+    CHECK_EQ(world.archetypes[0].entity_count, (u32)entities.size());
+    CHECK_EQ(count_broken_invariants(&world), 0u);
+    CHECK_EQ(count_value_mismatches(&world, entities), 0u);
+
+    // migrated entities are destroyed like any other
+    render_world_set_components(&world, entities[1], NO_MATERIAL);
+    render_world_destroy(&world, entities[1]);
+    CHECK_EQ(world.archetypes[1].entity_count, 0u);
+    CHECK_EQ(count_broken_invariants(&world), 0u);
+
+    render_world_clear(&world);
+}
+
+PKO_TEST(render_world_cull_matches_per_box_test)
+{
+    RenderWorld world{};
+    Random random{11};
+    const Frustum frustum = test_frustum();
+
+    // two archetypes, and one without bounds the culling leaves alone
+    std::vector<Entity> entities;
+    for (u32 i = 0; i < 5000; ++i) {
+        const u32 mask = i % 4 == 0 ? NO_MATERIAL : ALL_COMPONENTS;
+        entities.push_back(render_world_create(&world, mask));
+        set_values(&world, entities.back(), &random);
+    }
+    const Entity unbounded = render_world_create(&world,
+        RENDER_COMPONENT_BIT(RENDER_COMPONENT_MESH) |
+            RENDER_COMPONENT_BIT(RENDER_COMPONENT_VISIBILITY));
+
+    u32 expected_visible = 0;
+    std::vector<u8> expected(entities.size());
+    for (u32 i = 0; i < entities.size(); ++i) {
+        u32 row;
+        const RenderChunkView view = render_world_view(&world, entities[i], &row);
+        expected[i] = box_visible(frustum, glm::vec3(view.min_x[row], view.min_y[row],
+            view.min_z[row]), glm::vec3(view.max_x[row], view.max_y[row], view.max_z[row]));
+        expected_visible += expected[i];
+    }
+    CHECK(expected_visible > 0 && expected_visible < entities.size());
+
+    JobSystem jobs;
+    jobs.init(4);
+    JobSystem* job_options[2] = {NULL, &jobs};
+    for (JobSystem* job_option : job_options) {
+        CHECK_EQ(render_world_cull(&world, frustum, job_option), expected_visible);
+
+        u32 mismatches = 0;
+        for (u32 i = 0; i < entities.size(); ++i) {
+            u32 row;
+            const RenderChunkView view = render_world_view(&world, entities[i], &row);
+            mismatches += view.visible[row] != expected[i] ? 1 : 0;
+        }
+        CHECK_EQ(mismatches, 0u);
+    }
+
+    // every row of a matching archetype reaches the systems exactly once
+    const RenderArchetype& with_material =
+        world.archetypes[world.records[entities[1].index].archetype];
+    std::atomic<u32> rows{0};
+    std::atomic<u32> chunks{0};
+    render_world_for_each_chunk(&world, RENDER_COMPONENT_BIT(RENDER_COMPONENT_MATERIAL), &jobs,
+        [&](const RenderChunkView& view, u32) {
+            rows += view.count;
+            ++chunks;
+        });
+    CHECK_EQ(rows.load(), with_material.entity_count);
+    CHECK_EQ(chunks.load(), (u32)with_material.chunks.size());
+
+    rows = 0;
+    render_world_for_each_chunk(&world, RENDER_COMPONENT_BIT(RENDER_COMPONENT_MESH), &jobs,
+        [&](const RenderChunkView& view, u32) { rows += view.count; });
+    CHECK_EQ(rows.load(), world.entity_count);
+    CHECK(render_world_alive(&world, unbounded));
+
+    jobs.shutdown();
+    render_world_clear(&world);
+}
+
+// the scene before the render world: one heap object per thing drawn, the transform as
+// position, rotation and scale, its meshes in a vector of their own
+struct SceneObject {
+    glm::vec3 position;
+    glm::vec3 rotation;
+    glm::vec3 scale;
+    std::vector<MeshRef> meshes;
+    u32 texture;
+    glm::vec3 min;
+    glm::vec3 max;
+    b8 visible;
+};
+
+PKO_BENCHMARK(render_world_vs_object_vector)
+{
+    const u32 count = 100000;
+    const u32 frames = 20;
+    const Frustum frustum = test_frustum();
+
+    std::vector<glm::vec3> mins, maxs;
+    Random random{13};
+    for (u32 i = 0; i < count; ++i) {
+        mins.push_back(glm::vec3(random.next(-60.0f, 60.0f), random.next(-60.0f, 60.0f),
+            random.next(-20.0f, 120.0f)));
+        maxs.push_back(mins.back() + glm::vec3(random.next(0.1f, 8.0f)));
+    }
+    // the same destroy order for both
+    std::vector<u32> destroy_order(count);
+    for (u32 i = 0; i < count; ++i)
+        destroy_order[i] = i;
+    for (u32 i = count - 1; i > 0; --i)
+        std::swap(destroy_order[i], destroy_order[random.next() % (i + 1)]);
+
+    // object vector
+    f64 object_create_ms, object_frame_ms, object_destroy_ms;
+    u32 object_visible = 0;
+    {
+        std::vector<SceneObject*> objects;
+        BenchTimer create_timer;
+        for (u32 i = 0; i < count; ++i) {
+            SceneObject* object = new SceneObject();
+            object->position = (mins[i] + maxs[i]) * 0.5f;
+            object->scale = glm::vec3(1.0f);
+            object->meshes.push_back({i, 0});
+            object->min = mins[i];
+            object->max = maxs[i];
+            object->visible = true;
+            objects.push_back(object);
+        }
+        object_create_ms = create_timer.elapsed_ms();
+
+        BenchTimer frame_timer;
+        for (u32 frame = 0; frame < frames; ++frame) {
+            object_visible = 0;
+            for (SceneObject* object : objects) {
+                object->visible = box_visible(frustum, object->min, object->max);
+                object_visible += object->visible;
+            }
+        }
+        object_frame_ms = frame_timer.elapsed_ms() / frames;
+
+        // a slot per object to find it again, removed by swapping with the last
+        std::vector<u32> slots(count);
+        for (u32 i = 0; i < count; ++i)
+            slots[i] = i;
+        BenchTimer destroy_timer;
+        for (u32 id : destroy_order) {
+            const u32 slot = slots[id];
+            SceneObject* last = objects.back();
+            slots[last->meshes[0].mesh] = slot;
+            delete objects[slot];
+            objects[slot] = last;
+            objects.pop_back();
+        }
+        object_destroy_ms = destroy_timer.elapsed_ms();
+    }
+
+    // render world, single threaded and over the jobs
+    JobSystem jobs;
+    jobs.init();
+    JobSystem* job_options[2] = {NULL, &jobs};
+
+    RenderWorld world{};
+    std::vector<Entity> entities(count);
+    BenchTimer create_timer;
+    for (u32 i = 0; i < count; ++i) {
+        entities[i] = render_world_create(&world, ALL_COMPONENTS);
+        u32 row;
+        const RenderChunkView view = render_world_view(&world, entities[i], &row);
+        view.transforms[row] = glm::translate(glm::mat4(1.0f), (mins[i] + maxs[i]) * 0.5f);
+        view.min_x[row] = mins[i].x;
+        view.min_y[row] = mins[i].y;
+        view.min_z[row] = mins[i].z;
+        view.max_x[row] = maxs[i].x;
+        view.max_y[row] = maxs[i].y;
+        view.max_z[row] = maxs[i].z;
+        view.meshes[row] = {i, 0};
+    }
+    const f64 world_create_ms = create_timer.elapsed_ms();
+
+    printf("  %u entities, create: objects %.3f ms  render world %.3f ms\n", count,
+        object_create_ms, world_create_ms);
+
+    for (JobSystem* job_option : job_options) {
+        u32 world_visible = 0;
+        BenchTimer frame_timer;
+        for (u32 frame = 0; frame < frames; ++frame)
+            world_visible = render_world_cull(&world, frustum, job_option);
+        const f64 world_frame_ms = frame_timer.elapsed_ms() / frames;
+        CHECK_EQ(world_visible, object_visible);
+
+        printf("  cull, %u threads: objects %.3f ms  render world %.3f ms (%u visible)\n",
+            job_option ? jobs.worker_count() : 1, object_frame_ms, world_frame_ms,
+            world_visible);
+    }
+
+    BenchTimer destroy_timer;
+    for (u32 id : destroy_order)
+        render_world_destroy(&world, entities[id]);
+    const f64 world_destroy_ms = destroy_timer.elapsed_ms();
+    CHECK_EQ(world.entity_count, 0u);
+
+    printf("  destroy: objects %.3f ms  render world %.3f ms\n", object_destroy_ms,
+        world_destroy_ms);
+
+    jobs.shutdown();
+    render_world_clear(&world);
+}
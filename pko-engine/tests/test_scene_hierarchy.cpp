@@ -0,0 +1,261 @@
+#include "test.h"
+
+#include <vector>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "core/job_system.h"
+#include "core/renderer/scene_hierarchy.h"
+
+// deterministic, every run builds the same tree
+struct Random {
+    u32 state;
+
+    u32 next()
+    {
+        state = state * 1664525u + 1013904223u;
+        return state >> 8;
+    }
+
+    f32 next(f32 min, f32 max) { return min + (max - min) * (f32)next() / (f32)(1u << 24); }
+};
+
+static glm::mat4 random_local(Random* random)
+{
+    const glm::vec3 translation(random->next(-2.0f, 2.0f), random->next(-2.0f, 2.0f),
+        random->next(-2.0f, 2.0f));
+    glm::mat4 local = glm::translate(glm::mat4(1.0f), translation);
+    local = glm::rotate(local, random->next(-0.5f, 0.5f), glm::vec3(0.0f, 1.0f, 0.0f));
+    return glm::scale(local, glm::vec3(random->next(0.9f, 1.1f)));
+}
+
+// parents before children, a few roots. nodes hang below one of the later half of the nodes
+// before them, so the tree is some twenty levels deep
+static void random_tree(u32 count, u32 seed, std::vector<u32>* parents,
+    std::vector<glm::mat4>* locals)
+{
+    Random random{seed};
+    for (u32 i = 0; i < count; ++i) {
+        u32 parent = SCENE_NODE_NONE;
+        if (i > 0 && random.next() % 50 != 0)
+            parent = i - 1 - random.next() % (i / 2 + 1);
+        parents->push_back(parent);
+        locals->push_back(random_local(&random));
+    }
+}
+
+// world of node straight from the definition, every ancestor multiplied again
+static glm::mat4 naive_world(const SceneHierarchy& hierarchy, u32 node)
+{
+    const u32 parent = hierarchy.parents[node];
+    if (parent == SCENE_NODE_NONE)
+        return hierarchy.locals[node];
+    return naive_world(hierarchy, parent) * hierarchy.locals[node];
+}
+
+static u32 count_world_mismatches(const SceneHierarchy& hierarchy)
+{
+    u32 mismatches = 0;
+    for (u32 node = 0; node < hierarchy.parents.size(); ++node) {
+        const glm::mat4 expected = naive_world(hierarchy, node);
+        for (u32 c = 0; c < 4; ++c) {
+            for (u32 r = 0; r < 4; ++r) {
+                const f32 difference = std::fabs(hierarchy.worlds[node][c][r] - expected[c][r]);
+                // long chains of float products drift, relative to the magnitude
+                if (difference > 1e-4f * (1.0f + std::fabs(expected[c][r]))) {
+                    ++mismatches;
+                    c = r = 4;
+                }
+            }
+        }
+    }
+    return mismatches;
+}
+
+// node or any of its ancestors edited
+static b8 in_edited_subtree(const SceneHierarchy& hierarchy, const std::vector<u8>& edited,
+    u32 node)
+{
+    for (; node != SCENE_NODE_NONE; node = hierarchy.parents[node]) {
+        if (edited[node])
+            return true;
+    }
+    return false;
+}
+
+static void check_random_edits(SceneHierarchy* hierarchy, JobSystem* jobs, u32 seed)
+{
+    const u32 count = (u32)hierarchy->parents.size();
+    Random random{seed};
+
+    for (u32 round = 0; round < 5; ++round) {
+        std::vector<u8> edited(count, 0);
+        for (u32 i = 0; i < 40; ++i) {
+            const u32 node = random.next() % count;
+            scene_hierarchy_set_local(hierarchy, node, random_local(&random));
+            edited[node] = 1;
+        }
+
+        u32 expected_updates = 0;
+        u32 flag_mismatches = 0;
+        std::vector<u8> expected_flags(count);
+        for (u32 node = 0; node < count; ++node) {
+            expected_flags[node] = in_edited_subtree(*hierarchy, edited, node);
+            expected_updates += expected_flags[node];
+        }
+
+        CHECK_EQ(scene_hierarchy_update(hierarchy, jobs), expected_updates);
+        CHECK_EQ(hierarchy->updated_count, expected_updates);
+        for (u32 node = 0; node < count; ++node)
+            flag_mismatches += hierarchy->updated[node] != expected_flags[node] ? 1 : 0;
+        CHECK_EQ(flag_mismatches, 0u);
+        CHECK_EQ(count_world_mismatches(*hierarchy), 0u);
+    }
+
+    // nothing changed, the flags of the last update are cleared
+    CHECK_EQ(scene_hierarchy_update(hierarchy, jobs), 0u);
+    u32 flagged = 0;
+    for (u8 flag : hierarchy->updated)
+        flagged += flag;
+    CHECK_EQ(flagged, 0u);
+}
+
+PKO_TEST(scene_hierarchy_matches_naive_evaluation)
+{
+    const u32 count = 3000;
+    std::vector<u32> parents;
+    std::vector<glm::mat4> locals;
+    random_tree(count, 17, &parents, &locals);
+
+    SceneHierarchy hierarchy;
+    std::vector<u32> nodes;
+    scene_hierarchy_build(&hierarchy, parents.data(), locals.data(), count, &nodes);
+
+    // parents before children and the given locals at the node of every input
+    u32 order_mismatches = 0;
+    for (u32 i = 0; i < count; ++i) {
+        const u32 node = nodes[i];
+        if (parents[i] != SCENE_NODE_NONE && hierarchy.parents[node] != nodes[parents[i]])
+            ++order_mismatches;
+        if (hierarchy.parents[node] != SCENE_NODE_NONE && hierarchy.parents[node] >= node)
+            ++order_mismatches;
+        if (hierarchy.locals[node] != locals[i])
+            ++order_mismatches;
+    }
+    CHECK_EQ(order_mismatches, 0u);
+    CHECK(hierarchy.level_offsets.size() > 10);
+
+    // everything starts dirty
+    CHECK_EQ(scene_hierarchy_update(&hierarchy, NULL), count);
+    CHECK_EQ(count_world_mismatches(hierarchy), 0u);
+
+    check_random_edits(&hierarchy, NULL, 23);
+}
+
+PKO_TEST(scene_hierarchy_jobs_match_single_thread)
+{
+    // levels wide enough to be split over the workers
+    const u32 count = 20000;
+    std::vector<u32> parents;
+    std::vector<glm::mat4> locals;
+    random_tree(count, 29, &parents, &locals);
+
+    JobSystem jobs;
+    jobs.init(4);
+
+    SceneHierarchy single, parallel;
+    std::vector<u32> nodes;
+    scene_hierarchy_build(&single, parents.data(), locals.data(), count, &nodes);
+    scene_hierarchy_build(&parallel, parents.data(), locals.data(), count, &nodes);
+    scene_hierarchy_update(&single, NULL);
+    scene_hierarchy_update(&parallel, &jobs);
+
+    Random random{31};
+    for (u32 i = 0; i < 500; ++i) {
+        const u32 node = random.next() % count;
+        const glm::mat4 local = random_local(&random);
+        scene_hierarchy_set_local(&single, node, local);
+        scene_hierarchy_set_local(&parallel, node, local);
+    }
+    CHECK_EQ(scene_hierarchy_update(&single, NULL), scene_hierarchy_update(&parallel, &jobs));
+
+    // the same products in the same order, bit for bit
+    u32 mismatches = 0;
+    for (u32 node = 0; node < count; ++node)
+        mismatches += single.worlds[node] != parallel.worlds[node] ? 1 : 0;
+    CHECK_EQ(mismatches, 0u);
+
+    check_random_edits(&parallel, &jobs, 37);
+    jobs.shutdown();
+}
+
+// time of an update after edits to random nodes, averaged over iterations
+static f64 time_random_edits(SceneHierarchy* hierarchy, JobSystem* jobs, u32 edits,
+    u32 iterations, u32* out_updates)
+{
+    const u32 count = (u32)hierarchy->parents.size();
+    Random random{43};
+    f64 ms = 0.0;
+    for (u32 i = 0; i < iterations; ++i) {
+        for (u32 edit = 0; edit < edits; ++edit) {
+            const u32 node = random.next() % count;
+            scene_hierarchy_set_local(hierarchy, node, hierarchy->locals[node]);
+        }
+        BenchTimer timer;
+        *out_updates = scene_hierarchy_update(hierarchy, jobs);
+        ms += timer.elapsed_ms();
+    }
+    return ms / iterations;
+}
+
+PKO_BENCHMARK(scene_hierarchy_dirty_vs_full_update)
+{
+    const u32 count = 100000;
+    std::vector<u32> parents;
+    std::vector<glm::mat4> locals;
+    random_tree(count, 41, &parents, &locals);
+
+    JobSystem jobs;
+    jobs.init();
+
+    SceneHierarchy hierarchy;
+    std::vector<u32> nodes;
+    scene_hierarchy_build(&hierarchy, parents.data(), locals.data(), count, &nodes);
+    scene_hierarchy_update(&hierarchy, NULL);
+
+    const u32 iterations = 20;
+    JobSystem* job_options[2] = {NULL, &jobs};
+    for (JobSystem* job_option : job_options) {
+        // every root set dirty recomputes the whole hierarchy
+        f64 full_ms = 0.0;
+        u32 full_updates = 0;
+        for (u32 i = 0; i < iterations; ++i) {
+            for (u32 node = 0; node < hierarchy.level_offsets[1]; ++node)
+                scene_hierarchy_set_local(&hierarchy, node, hierarchy.locals[node]);
+            BenchTimer timer;
+            full_updates = scene_hierarchy_update(&hierarchy, job_option);
+            full_ms += timer.elapsed_ms();
+        }
+
+        // a few moving objects, and 1% of the nodes moved with everything below them
+        u32 few_updates = 0;
+        u32 many_updates = 0;
+        const f64 few_ms = time_random_edits(&hierarchy, job_option, 100, iterations,
+            &few_updates);
+        const f64 many_ms = time_random_edits(&hierarchy, job_option, count / 100, iterations,
+            &many_updates);
+
+        // nothing edited
+        BenchTimer clean_timer;
+        for (u32 i = 0; i < iterations; ++i)
+            scene_hierarchy_update(&hierarchy, job_option);
+        const f64 clean_ms = clean_timer.elapsed_ms() / iterations;
+
+        printf("  %u nodes, %u threads: full %.3f ms (%u worlds)  100 edits %.3f ms (%u worlds)"
+               "  1%% edits %.3f ms (%u worlds)  clean %.4f ms\n",
+            count, job_option ? jobs.worker_count() : 1, full_ms / iterations, full_updates, few_ms,
+            few_updates, many_ms, many_updates, clean_ms);
+    }
+
+    jobs.shutdown();
+}